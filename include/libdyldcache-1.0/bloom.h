@@ -0,0 +1,68 @@
+/**
+  * libdyldcache-1.0 - bloom.h
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef DYLDBLOOM_H_
+#define DYLDBLOOM_H_
+
+#include <stdint.h>
+
+#include <libdyldcache-1.0/cache.h>
+#include <libdyldcache-1.0/pool.h>
+
+#define DYLDBLOOM_MAGIC    "DYLDBLOM"
+#define DYLDBLOOM_VERSION  2
+#define DYLDBLOOM_SUFFIX   ".bloom"
+
+// About a 1% false positive rate
+#define DYLDBLOOM_BITS     10
+#define DYLDBLOOM_HASHES   7
+
+/*
+ * One bloom filter of symbol names per image. The filter of image i is
+ *  the words[offsets[i]] up to (but not including) words[offsets[i+1]];
+ *  an image without symbols has an empty filter and never matches. The
+ *  cache's uuid, inode and mtime tie saved filters to one cache file.
+ *  Saved filters are little endian throughout.
+ */
+typedef struct dyldcache_bloom_t {
+	uint32_t count;
+	uint32_t hashes;
+	uint64_t base_address;
+	uint64_t size;
+	uint8_t uuid[16];
+	uint64_t inode;
+	uint64_t mtime;
+	uint64_t word_count;
+	uint64_t* offsets;
+	uint64_t* words;
+} dyldcache_bloom_t;
+
+/*
+ * Dyldcache Bloom Functions
+ */
+dyldcache_bloom_t* dyldcache_bloom_create();
+dyldcache_bloom_t* dyldcache_bloom_load(dyldcache_t* cache, dyldpool_t* pool);
+int dyldcache_bloom_test(dyldcache_bloom_t* bloom, uint32_t image, const char* name);
+uint32_t* dyldcache_bloom_candidates(dyldcache_bloom_t* bloom, const char* name, uint32_t* count);
+int dyldcache_bloom_save(dyldcache_bloom_t* bloom, const char* path);
+dyldcache_bloom_t* dyldcache_bloom_open(dyldcache_t* cache, const char* path);
+void dyldcache_bloom_debug(dyldcache_bloom_t* bloom);
+void dyldcache_bloom_free(dyldcache_bloom_t* bloom);
+
+#endif /* DYLDBLOOM_H_ */
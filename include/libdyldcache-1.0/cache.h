@@ -22,6 +22,8 @@
 
 #include <libdyldcache-1.0/cache.h>
 #include <libdyldcache-1.0/image.h>
+#include <libdyldcache-1.0/seekable.h>
+#include <libdyldcache-1.0/decoder.h>
 
 #include <libcrippy-1.0/file.h>
 #include <libcrippy-1.0/libcrippy.h>
@@ -35,17 +37,30 @@
 #define DYLDARCH_X86_64  "x86_64"
 #define DYLDARCH_ARMV6   "armv6"
 #define DYLDARCH_ARMV7   "armv7"
+#define DYLDARCH_ARM64   "arm64"
+
+// Recent mapping translations each thread keeps for dyldcache_read()
+#define DYLDCACHE_TLB_SIZE  4
+
+// Bytes of header every cache has, newer ones grow it up to mapping_offset
+#define DYLDCACHE_HEADER_SIZE  0x38
+
+// Mapped caches start on this boundary so their front can use huge pages
+#define DYLDCACHE_HUGE_PAGE  (2ULL * 1024 * 1024)
 
 typedef enum {
 	kArmType,
-	kIntelType
+	kIntelType,
+	kPowerPCType
 } cpu_type_t;
 
 typedef enum {
 	kArmv6,
 	kArmv7,
 	kIntelx86,
-	kIntelx86_64
+	kIntelx86_64,
+	kArm64,
+	kPowerPC
 } cpu_subtype_t;
 
 typedef struct architecture_t {
@@ -53,8 +68,41 @@ typedef struct architecture_t {
 	endian_t cpu_endian;
 	cpu_type_t cpu_type;
 	cpu_subtype_t cpu_subtype;
+	uint32_t pointer_size;
 } architecture_t;
 
+typedef enum {
+	kAdviseNormal,
+	kAdviseSequential,
+	kAdviseRandom,
+	kAdviseWillNeed,
+	kAdviseDontNeed,
+	kAdviseHugePages
+} dyldcache_advice_t;
+
+typedef struct dyldcache_range_t {
+	uint64_t offset;
+	uint64_t size;
+} dyldcache_range_t;
+
+/*
+ * Where the memory behind a cache goes. arena counts the heap structures
+ *  describing the cache, index the lookup tables over them, mapped the
+ *  bytes of cache data mapped into the process and resident how many of
+ *  those are currently backed by physical pages.
+ */
+typedef struct dyldcache_usage_t {
+	uint64_t arena;
+	uint64_t index;
+	uint64_t mapped;
+	uint64_t resident;
+} dyldcache_usage_t;
+
+/*
+ * The fields after codesign_size are only present in newer caches, and
+ *  left zero when the header ends before them. accelerate_info_* are only
+ *  meaningful in caches without a dylibs trie, later caches reuse them.
+ */
 typedef struct dyldcache_header_t {
 	char magic[16];
 	uint32_t mapping_offset;
@@ -64,18 +112,61 @@ typedef struct dyldcache_header_t {
 	uint64_t base_address;
 	uint64_t codesign_offset;
 	uint64_t codesign_size;
+	uint64_t slide_info_offset;
+	uint64_t slide_info_size;
+	uint64_t local_symbols_offset;
+	uint64_t local_symbols_size;
+	uint8_t uuid[16];
+	uint64_t cache_type;
+	uint32_t branch_pools_offset;
+	uint32_t branch_pools_count;
+	uint64_t accelerate_info_addr;
+	uint64_t accelerate_info_size;
+	uint64_t images_text_offset;
+	uint64_t images_text_count;
+	uint64_t dylibs_trie_addr;
+	uint64_t dylibs_trie_size;
 } dyldcache_header_t;
 
+typedef struct dyldcache_table_entry_t {
+	uint64_t address;
+	uint32_t index;
+} dyldcache_table_entry_t;
+
+/*
+ * Lookup tables dyld builds into the cache, used in place. trie maps
+ *  install paths to image indices; ranges (accelerator info) or text
+ *  (image text info) map addresses to images. by_address is only built
+ *  when the cache has neither address table.
+ */
+typedef struct dyldcache_tables_t {
+	const unsigned char* trie;
+	uint64_t trie_size;
+	const unsigned char* ranges;
+	uint32_t range_count;
+	const unsigned char* text;
+	uint32_t text_count;
+	dyldcache_table_entry_t* by_address;
+} dyldcache_tables_t;
+
 typedef struct dyldcache_t {
 	dyldcache_header_t* header;
 	architecture_t* arch;
+	const dyldcache_decoder_t* decoder;
 	dyldimage_t** images;
 	dyldmap_t** maps;
+	dyldcache_tables_t* tables;
 	file_t* file;
-	uint32_t offset;
+	dyldseekable_t* seekable;
+	uint64_t offset;
 	uint32_t count;
-	unsigned int size;
+	uint64_t size;
 	unsigned char* data;
+	int mapped;
+	uint64_t anonymous;
+	uint32_t serial;
+	uint64_t inode;
+	uint64_t mtime;
 } dyldcache_t;
 
 /*
@@ -83,11 +174,25 @@ typedef struct dyldcache_t {
  */
 dyldcache_t* dyldcache_create();
 dyldcache_t* dyldcache_open(const char* path);
+int dyldcache_fetch(dyldcache_t* cache, uint64_t offset, uint64_t size);
+void dyldcache_hold(dyldcache_t* cache);
+void dyldcache_release(dyldcache_t* cache);
 dyldmap_t* dyldcache_map_image(dyldcache_t* cache, dyldimage_t* image);
+unsigned char* dyldcache_image_data(dyldcache_t* cache, dyldimage_t* image, uint64_t* size);
+unsigned char* dyldcache_image_extent(dyldcache_t* cache, dyldimage_t* image, uint64_t* size);
 dyldmap_t* dyldcache_map_address(dyldcache_t* cache, uint64_t address);
+const unsigned char* dyldcache_read(dyldcache_t* cache, uint64_t address, uint64_t length);
+int dyldcache_read_u32(dyldcache_t* cache, uint64_t address, uint32_t* value);
+int dyldcache_read_u64(dyldcache_t* cache, uint64_t address, uint64_t* value);
+const char* dyldcache_read_cstring(dyldcache_t* cache, uint64_t address);
 dyldimage_t* dyldcache_get_image(dyldcache_t* cache, const char* dylib);
+int dyldcache_image_index(dyldcache_t* cache, const char* path);
+dyldimage_t* dyldcache_image_containing(dyldcache_t* cache, uint64_t address);
 dyldimage_t* dyldcache_first_image(dyldcache_t* cache);
 dyldimage_t* dyldcache_next_image(dyldcache_t* cache, dyldimage_t* image);
+int dyldcache_memory_usage(dyldcache_t* cache, dyldcache_usage_t* usage);
+dyldcache_range_t dyldcache_metadata_range(dyldcache_t* cache);
+int dyldcache_advise(dyldcache_t* cache, dyldcache_range_t range, dyldcache_advice_t advice);
 void dyldcache_debug(dyldcache_t* cache);
 void dyldcache_free(dyldcache_t* cache);
 
@@ -123,4 +228,12 @@ dyldmap_t** dyldcache_maps_load(dyldcache_t* cache);
 void dyldcache_maps_debug(dyldcache_t* cache);
 void dyldcache_maps_free(dyldmap_t** maps);
 
+/*
+ * Dyldcache Tables Functions
+ */
+dyldcache_tables_t* dyldcache_tables_create();
+dyldcache_tables_t* dyldcache_tables_load(dyldcache_t* cache);
+void dyldcache_tables_debug(dyldcache_tables_t* tables);
+void dyldcache_tables_free(dyldcache_tables_t* tables);
+
 #endif /* DYLDCACHE_H_ */
@@ -0,0 +1,66 @@
+/**
+  * libdyldcache-1.0 - catalog.h
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef DYLDCATALOG_H_
+#define DYLDCATALOG_H_
+
+#include <stdint.h>
+
+#include <libdyldcache-1.0/cache.h>
+#include <libdyldcache-1.0/pool.h>
+
+typedef struct dyldcache_catalog_ref_t {
+	uint32_t cache;
+	uint32_t image;
+} dyldcache_catalog_ref_t;
+
+/*
+ * Many caches opened side by side. Install paths are interned once
+ *  across all of them: path i is strings + names[i], and the images
+ *  carrying it are refs[first[i]] up to (but not including)
+ *  refs[first[i+1]], in cache order. caches[i] is NULL for files that
+ *  could not be opened.
+ */
+typedef struct dyldcache_catalog_t {
+	uint32_t count;
+	char** files;
+	dyldcache_t** caches;
+	uint32_t path_count;
+	uint64_t strings_size;
+	char* strings;
+	uint64_t* names;
+	uint32_t ref_count;
+	uint32_t* first;
+	dyldcache_catalog_ref_t* refs;
+	uint32_t mask;
+	uint32_t* table;
+} dyldcache_catalog_t;
+
+/*
+ * Dyldcache Catalog Functions
+ */
+dyldcache_catalog_t* dyldcache_catalog_create();
+dyldcache_catalog_t* dyldcache_catalog_open(const char** files, uint32_t count, dyldpool_t* pool);
+int dyldcache_catalog_path(dyldcache_catalog_t* catalog, const char* path);
+dyldcache_catalog_ref_t* dyldcache_catalog_lookup(dyldcache_catalog_t* catalog, const char* path, uint32_t* count);
+uint64_t* dyldcache_catalog_symbol(dyldcache_catalog_t* catalog, const char* path, const char* symbol, dyldpool_t* pool, uint32_t* count);
+void dyldcache_catalog_debug(dyldcache_catalog_t* catalog);
+void dyldcache_catalog_free(dyldcache_catalog_t* catalog);
+
+#endif /* DYLDCATALOG_H_ */
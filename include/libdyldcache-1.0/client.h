@@ -0,0 +1,93 @@
+/**
+  * libdyldcache-1.0 - client.h
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef DYLDCLIENT_H_
+#define DYLDCLIENT_H_
+
+#include <stdint.h>
+
+#define DYLDCACHED_SOCKET      "/tmp/dyldcached.sock"
+#define DYLDCACHED_SOCKET_ENV  "DYLDCACHED_SOCKET"
+#define DYLDCACHED_MAGIC       0x44594C44
+
+/*
+ * Wire protocol spoken with dyldcached over a Unix domain socket. Every
+ *  request is a dyldcached_request_t followed by length payload bytes,
+ *  every response a dyldcached_response_t followed by length bytes. For
+ *  record responses the payload holds count dyldcached_record_t, each
+ *  followed by its image name and symbol name (not NUL terminated).
+ *  All fields are in host byte order.
+ */
+enum {
+	DYLDCACHED_OP_OPEN = 1,
+	DYLDCACHED_OP_SYMBOL,
+	DYLDCACHED_OP_IMAGE_SYMBOL,
+	DYLDCACHED_OP_ADDRESS,
+	DYLDCACHED_OP_EXTRACT,
+	DYLDCACHED_OP_IMAGES
+};
+
+typedef struct dyldcached_request_t {
+	uint32_t magic;
+	uint8_t op;
+	uint8_t cache;
+	uint16_t reserved;
+	uint32_t length;
+} dyldcached_request_t;
+
+typedef struct dyldcached_response_t {
+	uint32_t magic;
+	int32_t status;
+	uint32_t count;
+	uint32_t length;
+} dyldcached_response_t;
+
+typedef struct dyldcached_record_t {
+	uint64_t address;
+	uint32_t image;
+	uint16_t image_length;
+	uint16_t symbol_length;
+} dyldcached_record_t;
+
+typedef struct dyldclient_record_t {
+	uint64_t address;
+	uint32_t image;
+	char* image_name;
+	char* symbol;
+} dyldclient_record_t;
+
+typedef struct dyldclient_t {
+	int fd;
+	int cache;
+} dyldclient_t;
+
+/*
+ * Dyld Client Functions
+ */
+dyldclient_t* dyldclient_connect(const char* path);
+int dyldclient_open(dyldclient_t* client, const char* cache);
+int dyldclient_symbol(dyldclient_t* client, const char* symbol, dyldclient_record_t** records, uint32_t* count);
+int dyldclient_image_symbol(dyldclient_t* client, const char* dylib, const char* symbol, dyldclient_record_t** records, uint32_t* count);
+int dyldclient_address(dyldclient_t* client, uint64_t address, dyldclient_record_t** records, uint32_t* count);
+int dyldclient_images(dyldclient_t* client, dyldclient_record_t** records, uint32_t* count);
+int dyldclient_extract(dyldclient_t* client, const char* dylib, unsigned char** data, uint64_t* size);
+void dyldclient_records_free(dyldclient_record_t* records, uint32_t count);
+void dyldclient_free(dyldclient_t* client);
+
+#endif /* DYLDCLIENT_H_ */
@@ -0,0 +1,69 @@
+/**
+  * libdyldcache-1.0 - codesign.h
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef DYLDCODESIGN_H_
+#define DYLDCODESIGN_H_
+
+#include <stdint.h>
+
+#include <libdyldcache-1.0/cache.h>
+#include <libdyldcache-1.0/pool.h>
+
+#define CSMAGIC_EMBEDDED_SIGNATURE  0xFADE0CC0
+#define CSMAGIC_CODEDIRECTORY       0xFADE0C02
+
+#define CSSLOT_CODEDIRECTORY        0
+#define CSSLOT_ALTERNATE            0x1000
+
+#define CS_HASHTYPE_SHA1            1
+#define CS_HASHTYPE_SHA256          2
+#define CS_HASHTYPE_SHA256_TRUNC    3
+
+/*
+ * The code directory covering the cache, picked out of the signature
+ *  superblob at codesign_offset. Page i is the page_size bytes at
+ *  i * page_size (the last one stops at limit) and its expected hash is
+ *  the hash_size bytes at hashes + i * hash_size. The strongest digest
+ *  we can compute is preferred when alternates are present.
+ */
+typedef struct dyldcodesign_t {
+	uint32_t version;
+	uint32_t flags;
+	uint8_t hash_type;
+	uint8_t hash_size;
+	uint32_t page_size;
+	uint32_t count;
+	uint64_t limit;
+	char* identifier;
+	unsigned char* hashes;
+	uint32_t mismatch_count;
+	uint32_t* mismatches;
+} dyldcodesign_t;
+
+/*
+ * Dyld Codesign Functions
+ */
+dyldcodesign_t* dyldcodesign_create();
+dyldcodesign_t* dyldcodesign_load(dyldcache_t* cache);
+int dyldcodesign_verify(dyldcodesign_t* codesign, dyldcache_t* cache, dyldpool_t* pool);
+const char* dyldcodesign_hash_name(uint8_t type);
+void dyldcodesign_debug(dyldcodesign_t* codesign);
+void dyldcodesign_free(dyldcodesign_t* codesign);
+
+#endif /* DYLDCODESIGN_H_ */
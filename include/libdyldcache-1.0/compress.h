@@ -0,0 +1,60 @@
+/**
+  * libdyldcache-1.0 - compress.h
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef DYLDCOMPRESS_H_
+#define DYLDCOMPRESS_H_
+
+#include <stdint.h>
+
+#include <libdyldcache-1.0/image.h>
+#include <libdyldcache-1.0/cache.h>
+#include <libdyldcache-1.0/pool.h>
+
+#define DYLDCOMPRESS_LEVEL 3
+
+typedef struct dyldcompress_slot_t {
+	unsigned char* data;
+	uint64_t size;
+	uint64_t capacity;
+	int err;
+} dyldcompress_slot_t;
+
+/*
+ * Compresses images straight out of the mapped cache, one image per
+ *  worker at a time. Every worker keeps its own compression context and
+ *  output buffer for the lifetime of the compressor.
+ */
+typedef struct dyldcompress_t {
+	int level;
+	dyldpool_t* pool;
+	void** contexts;
+	unsigned char** buffers;
+	dyldcompress_slot_t* slots;
+	uint32_t window;
+} dyldcompress_t;
+
+/*
+ * Dyld Compress Functions
+ */
+dyldcompress_t* dyldcompress_create(int level, uint32_t threads);
+int dyldcompress_save(dyldcompress_t* compress, dyldcache_t* cache, dyldimage_t** images, uint32_t count, const char* directory);
+int dyldcompress_archive(dyldcompress_t* compress, dyldcache_t* cache, dyldimage_t** images, uint32_t count, const char* path);
+void dyldcompress_free(dyldcompress_t* compress);
+
+#endif /* DYLDCOMPRESS_H_ */
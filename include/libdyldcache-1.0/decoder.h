@@ -0,0 +1,55 @@
+/**
+  * libdyldcache-1.0 - decoder.h
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef DYLDDECODER_H_
+#define DYLDDECODER_H_
+
+#include <stdint.h>
+
+#include <libcrippy-1.0/endianness.h>
+
+struct dyldcache_header_t;
+struct dyldmap_info_t;
+struct dyldimage_info_t;
+
+/*
+ * Readers for cache structures and in-image data, one instance per byte
+ *  order and pointer width. Each instance is compiled with its byte order
+ *  fixed, so picking one when the cache is opened is the only byte order
+ *  decision made.
+ */
+typedef struct dyldcache_decoder_t {
+	const char* name;
+	endian_t endian;
+	uint32_t pointer_size;
+	uint16_t (*read16)(const unsigned char* data);
+	uint32_t (*read32)(const unsigned char* data);
+	uint64_t (*read64)(const unsigned char* data);
+	uint64_t (*pointer)(const unsigned char* data);
+	void (*header)(const unsigned char* data, uint32_t length, struct dyldcache_header_t* header);
+	void (*map_info)(const unsigned char* data, struct dyldmap_info_t* info);
+	void (*image_info)(const unsigned char* data, struct dyldimage_info_t* info);
+} dyldcache_decoder_t;
+
+/*
+ * Dyld Decoder Functions
+ */
+const dyldcache_decoder_t* dyldcache_decoder_get(endian_t endian, uint32_t pointer_size);
+
+#endif /* DYLDDECODER_H_ */
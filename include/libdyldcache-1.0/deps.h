@@ -0,0 +1,61 @@
+/**
+  * libdyldcache-1.0 - deps.h
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef DYLDDEPS_H_
+#define DYLDDEPS_H_
+
+#include <stdint.h>
+
+#include <libdyldcache-1.0/cache.h>
+#include <libdyldcache-1.0/pool.h>
+
+#define DYLDDEP_LOAD      1
+#define DYLDDEP_WEAK      2
+#define DYLDDEP_REEXPORT  4
+#define DYLDDEP_UPWARD    8
+#define DYLDDEP_LAZY      16
+#define DYLDDEP_ALL       0x1F
+
+/*
+ * Dependency graph over image indices in compressed sparse row form.
+ *  The dependencies of image i are edges[offsets[i]] up to (but not
+ *  including) edges[offsets[i+1]], with the matching load command kind
+ *  in kinds[].
+ */
+typedef struct dyldcache_deps_t {
+	uint32_t count;
+	uint32_t edge_count;
+	uint32_t missing;
+	uint32_t* offsets;
+	uint32_t* edges;
+	uint8_t* kinds;
+} dyldcache_deps_t;
+
+/*
+ * Dyldcache Dependency Functions
+ */
+dyldcache_deps_t* dyldcache_deps_create();
+dyldcache_deps_t* dyldcache_deps_load(dyldcache_t* cache, dyldpool_t* pool);
+uint32_t* dyldcache_deps_get(dyldcache_deps_t* deps, uint32_t index, uint32_t* count);
+uint32_t* dyldcache_deps_closure(dyldcache_deps_t* deps, uint32_t index, uint32_t kinds, uint32_t* count);
+uint32_t* dyldcache_deps_order(dyldcache_deps_t* deps, uint32_t kinds, uint32_t* count);
+void dyldcache_deps_debug(dyldcache_deps_t* deps);
+void dyldcache_deps_free(dyldcache_deps_t* deps);
+
+#endif /* DYLDDEPS_H_ */
@@ -0,0 +1,94 @@
+/**
+  * libdyldcache-1.0 - dump.h
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef DYLDDUMP_H_
+#define DYLDDUMP_H_
+
+#include <stdint.h>
+
+#include <libdyldcache-1.0/cache.h>
+
+#define DYLDDUMP_MAGIC    "DYLDDUMP"
+#define DYLDDUMP_VERSION  1
+#define DYLDDUMP_BUFFER   (256 * 1024)
+
+#define DYLDDUMP_HEADER   1
+#define DYLDDUMP_MAPPINGS 2
+#define DYLDDUMP_IMAGES   4
+#define DYLDDUMP_SYMBOLS  8
+#define DYLDDUMP_TABLES   (DYLDDUMP_HEADER | DYLDDUMP_MAPPINGS | DYLDDUMP_IMAGES)
+
+enum {
+	DYLDDUMP_RECORD_HEADER = 1,
+	DYLDDUMP_RECORD_MAPPING,
+	DYLDDUMP_RECORD_IMAGE,
+	DYLDDUMP_RECORD_SYMBOL
+};
+
+typedef enum {
+	kDumpJson,
+	kDumpBinary
+} dylddump_format_t;
+
+/*
+ * The binary format starts with the 8 byte magic and a uint32_t version
+ *  and reserved word, followed by records of a dylddump_record_t and
+ *  length payload bytes. Payloads are the fixed fields listed below in
+ *  order, then any name they count the length of (not NUL terminated).
+ *  All fields are in host byte order.
+ *
+ *  header:  char magic[16], u64 base, u32 mappings, u32 images,
+ *           u64 codesign_offset, u64 codesign_size
+ *  mapping: u64 address, u64 size, u64 offset, u32 maxprot, u32 initprot
+ *  image:   u64 address, u64 modtime, u64 inode, u32 index, u32 path_length
+ *  symbol:  u64 address, u32 image, u32 name_length
+ *
+ * JSON Lines output has one object per record with the same fields and
+ *  a "type" key.
+ */
+typedef struct dylddump_record_t {
+	uint16_t type;
+	uint16_t reserved;
+	uint32_t length;
+} dylddump_record_t;
+
+typedef struct dylddump_t {
+	int fd;
+	int err;
+	dylddump_format_t format;
+	uint32_t used;
+	uint32_t capacity;
+	unsigned char* buffer;
+	uint64_t written;
+} dylddump_t;
+
+/*
+ * Dyld Dump Functions
+ */
+dylddump_t* dylddump_create(int fd, dylddump_format_t format);
+dylddump_format_t dylddump_format_parse(const char* name);
+int dylddump_cache(dylddump_t* dump, dyldcache_t* cache, uint32_t sections);
+int dylddump_header(dylddump_t* dump, dyldcache_t* cache);
+int dylddump_mappings(dylddump_t* dump, dyldcache_t* cache);
+int dylddump_images(dylddump_t* dump, dyldcache_t* cache);
+int dylddump_symbols(dylddump_t* dump, dyldcache_t* cache);
+int dylddump_flush(dylddump_t* dump);
+void dylddump_free(dylddump_t* dump);
+
+#endif /* DYLDDUMP_H_ */
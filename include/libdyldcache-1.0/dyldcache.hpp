@@ -0,0 +1,408 @@
+/**
+  * libdyldcache-1.0 - dyldcache.hpp
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef DYLDCACHE_HPP_
+#define DYLDCACHE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#if __cplusplus >= 202002L && defined(__has_include)
+#if __has_include(<span>)
+#include <span>
+#define DYLDCACHE_HAVE_SPAN
+#endif
+#endif
+
+extern "C" {
+#include <libdyldcache-1.0/map.h>
+#include <libdyldcache-1.0/image.h>
+#include <libdyldcache-1.0/cache.h>
+#include <libdyldcache-1.0/segment.h>
+}
+
+/*
+ * Header only C++17 layer over cache.h, image.h, map.h and segment.h.
+ *  Cache owns a dyldcache_t; ImageRef and Mapping are two pointer views
+ *  and Segment a copy of a dyldcache_segment_t, all only valid while the
+ *  Cache they came from is alive. Nothing here allocates beyond what the
+ *  C calls do.
+ */
+namespace dyld {
+
+#ifdef DYLDCACHE_HAVE_SPAN
+using Bytes = std::span<const std::byte>;
+#else
+// The subset of std::span<const std::byte> we need before C++20
+class Bytes {
+public:
+	using element_type = const std::byte;
+	using value_type = std::byte;
+	using size_type = std::size_t;
+	using pointer = const std::byte*;
+	using reference = const std::byte&;
+	using iterator = const std::byte*;
+
+	constexpr Bytes() noexcept : data_(nullptr), size_(0) {}
+	constexpr Bytes(const std::byte* data, std::size_t size) noexcept : data_(data), size_(size) {}
+
+	constexpr const std::byte* data() const noexcept { return data_; }
+	constexpr std::size_t size() const noexcept { return size_; }
+	constexpr std::size_t size_bytes() const noexcept { return size_; }
+	constexpr bool empty() const noexcept { return size_ == 0; }
+	constexpr iterator begin() const noexcept { return data_; }
+	constexpr iterator end() const noexcept { return data_ + size_; }
+	constexpr reference operator[](std::size_t index) const { return data_[index]; }
+
+	constexpr Bytes first(std::size_t count) const { return Bytes(data_, count); }
+	constexpr Bytes last(std::size_t count) const { return Bytes(data_ + size_ - count, count); }
+	constexpr Bytes subspan(std::size_t offset, std::size_t count = static_cast<std::size_t>(-1)) const {
+		return Bytes(data_ + offset, count == static_cast<std::size_t>(-1) ? size_ - offset : count);
+	}
+
+private:
+	const std::byte* data_;
+	std::size_t size_;
+};
+#endif
+
+namespace detail {
+
+inline Bytes bytes(dyldcache_t* cache, std::uint64_t offset, std::uint64_t size) {
+	// Compressed caches only have the ranges we fetch
+	if (cache == nullptr || dyldcache_fetch(cache, offset, size) < 0) {
+		return Bytes();
+	}
+	return Bytes(reinterpret_cast<const std::byte*>(cache->data + offset), static_cast<std::size_t>(size));
+}
+
+// Random access over one of the cache's tables, yielding views
+template <typename View, typename Element>
+class TableIterator {
+public:
+	using iterator_category = std::random_access_iterator_tag;
+	using value_type = View;
+	using difference_type = std::ptrdiff_t;
+	using pointer = void;
+	using reference = View;
+
+	TableIterator() noexcept : cache_(nullptr), cursor_(nullptr) {}
+	TableIterator(dyldcache_t* cache, Element* cursor) noexcept : cache_(cache), cursor_(cursor) {}
+
+	View operator*() const noexcept { return View(cache_, *cursor_); }
+	View operator[](difference_type n) const noexcept { return View(cache_, cursor_[n]); }
+
+	TableIterator& operator++() noexcept { ++cursor_; return *this; }
+	TableIterator operator++(int) noexcept { TableIterator old = *this; ++cursor_; return old; }
+	TableIterator& operator--() noexcept { --cursor_; return *this; }
+	TableIterator operator--(int) noexcept { TableIterator old = *this; --cursor_; return old; }
+	TableIterator& operator+=(difference_type n) noexcept { cursor_ += n; return *this; }
+	TableIterator& operator-=(difference_type n) noexcept { cursor_ -= n; return *this; }
+
+	friend TableIterator operator+(TableIterator it, difference_type n) noexcept { return it += n; }
+	friend TableIterator operator+(difference_type n, TableIterator it) noexcept { return it += n; }
+	friend TableIterator operator-(TableIterator it, difference_type n) noexcept { return it -= n; }
+	friend difference_type operator-(const TableIterator& a, const TableIterator& b) noexcept { return a.cursor_ - b.cursor_; }
+
+	friend bool operator==(const TableIterator& a, const TableIterator& b) noexcept { return a.cursor_ == b.cursor_; }
+	friend bool operator!=(const TableIterator& a, const TableIterator& b) noexcept { return a.cursor_ != b.cursor_; }
+	friend bool operator<(const TableIterator& a, const TableIterator& b) noexcept { return a.cursor_ < b.cursor_; }
+	friend bool operator>(const TableIterator& a, const TableIterator& b) noexcept { return a.cursor_ > b.cursor_; }
+	friend bool operator<=(const TableIterator& a, const TableIterator& b) noexcept { return a.cursor_ <= b.cursor_; }
+	friend bool operator>=(const TableIterator& a, const TableIterator& b) noexcept { return a.cursor_ >= b.cursor_; }
+
+private:
+	dyldcache_t* cache_;
+	Element* cursor_;
+};
+
+template <typename Iterator>
+class Range {
+public:
+	Range(Iterator first, Iterator last) noexcept : first_(first), last_(last) {}
+	Iterator begin() const noexcept { return first_; }
+	Iterator end() const noexcept { return last_; }
+	std::size_t size() const noexcept { return static_cast<std::size_t>(last_ - first_); }
+	bool empty() const noexcept { return first_ == last_; }
+	typename Iterator::value_type operator[](std::size_t index) const noexcept { return first_[index]; }
+
+private:
+	Iterator first_;
+	Iterator last_;
+};
+
+} // namespace detail
+
+class Mapping {
+public:
+	Mapping(dyldcache_t* cache, dyldmap_t* map) noexcept : cache_(cache), map_(map) {}
+
+	std::uint64_t address() const noexcept { return map_->address; }
+	std::uint64_t size() const noexcept { return map_->size; }
+	std::uint64_t file_offset() const noexcept { return map_->offset; }
+	std::uint32_t max_prot() const noexcept { return map_->info ? map_->info->maxProt : 0; }
+	std::uint32_t init_prot() const noexcept { return map_->info ? map_->info->initProt : 0; }
+	bool executable() const noexcept { return (init_prot() & DYLDMAP_EXEC) != 0; }
+	bool writable() const noexcept { return (init_prot() & DYLDMAP_WRITE) != 0; }
+	bool contains(std::uint64_t address) const noexcept {
+		return address >= map_->address && address - map_->address < map_->size;
+	}
+
+	Bytes bytes() const { return detail::bytes(cache_, map_->offset, map_->size); }
+	dyldmap_t* get() const noexcept { return map_; }
+
+	friend bool operator==(const Mapping& a, const Mapping& b) noexcept { return a.map_ == b.map_; }
+	friend bool operator!=(const Mapping& a, const Mapping& b) noexcept { return a.map_ != b.map_; }
+
+private:
+	dyldcache_t* cache_;
+	dyldmap_t* map_;
+};
+
+/*
+ * One LC_SEGMENT or LC_SEGMENT_64 of an image as dyldcache_segments_load()
+ *  resolved it. bytes() is empty for a segment no mapping covers, and
+ *  file_size() is already clipped to the mapping.
+ */
+class Segment {
+public:
+	Segment(dyldcache_t* cache, const dyldcache_segment_t& segment) noexcept : cache_(cache), segment_(segment) {}
+
+	std::string_view name() const noexcept { return std::string_view(segment_.name, strnlen(segment_.name, 16)); }
+	std::uint64_t address() const noexcept { return segment_.address; }
+	std::uint64_t size() const noexcept { return segment_.vmsize; }
+	std::uint64_t file_size() const noexcept { return segment_.size; }
+	std::uint64_t file_offset() const noexcept { return segment_.offset; }
+	std::uint32_t max_prot() const noexcept { return segment_.maxprot; }
+	std::uint32_t init_prot() const noexcept { return segment_.initprot; }
+	bool contains(std::uint64_t address) const noexcept {
+		return address >= segment_.address && address - segment_.address < segment_.vmsize;
+	}
+
+	Bytes bytes() const {
+		if (segment_.map == nullptr) {
+			return Bytes();
+		}
+		return detail::bytes(cache_, segment_.offset, segment_.size);
+	}
+	const dyldcache_segment_t& get() const noexcept { return segment_; }
+
+private:
+	dyldcache_t* cache_;
+	dyldcache_segment_t segment_;
+};
+
+using SegmentIterator = detail::TableIterator<Segment, const dyldcache_segment_t>;
+
+// Owns the dyldcache_segments_t of one image
+class Segments {
+public:
+	Segments() noexcept : cache_(nullptr), segments_(nullptr) {}
+	Segments(dyldcache_t* cache, dyldcache_segments_t* segments) noexcept : cache_(cache), segments_(segments) {}
+	~Segments() { dyldcache_segments_free(segments_); }
+
+	Segments(const Segments&) = delete;
+	Segments& operator=(const Segments&) = delete;
+	Segments(Segments&& other) noexcept : cache_(other.cache_), segments_(std::exchange(other.segments_, nullptr)) {}
+	Segments& operator=(Segments&& other) noexcept {
+		if (this != &other) {
+			dyldcache_segments_free(segments_);
+			cache_ = other.cache_;
+			segments_ = std::exchange(other.segments_, nullptr);
+		}
+		return *this;
+	}
+
+	SegmentIterator begin() const noexcept { return SegmentIterator(cache_, segments_ ? segments_->segments : nullptr); }
+	SegmentIterator end() const noexcept { return begin() + static_cast<std::ptrdiff_t>(size()); }
+	std::size_t size() const noexcept { return segments_ ? segments_->count : 0; }
+	bool empty() const noexcept { return size() == 0; }
+	Segment operator[](std::size_t index) const noexcept { return begin()[static_cast<std::ptrdiff_t>(index)]; }
+
+	std::optional<Segment> find(std::string_view name) const noexcept {
+		for (Segment segment : *this) {
+			if (segment.name() == name) {
+				return segment;
+			}
+		}
+		return std::nullopt;
+	}
+	std::optional<Segment> lookup(std::uint64_t address) const noexcept {
+		dyldcache_segment_t* segment = dyldcache_segments_lookup(segments_, address);
+		if (segment == nullptr) {
+			return std::nullopt;
+		}
+		return Segment(cache_, *segment);
+	}
+
+	dyldcache_segments_t* get() const noexcept { return segments_; }
+
+private:
+	dyldcache_t* cache_;
+	dyldcache_segments_t* segments_;
+};
+
+class ImageRef {
+public:
+	ImageRef(dyldcache_t* cache, dyldimage_t* image) noexcept : cache_(cache), image_(image) {}
+
+	std::string_view path() const noexcept { return image_->path ? std::string_view(image_->path) : std::string_view(); }
+	std::string_view name() const noexcept { return image_->name ? std::string_view(image_->name) : std::string_view(); }
+	std::uint32_t index() const noexcept { return image_->index; }
+	std::uint64_t address() const noexcept { return image_->address; }
+
+	std::optional<Mapping> mapping() const noexcept {
+		if (image_->map == nullptr) {
+			return std::nullopt;
+		}
+		return Mapping(cache_, image_->map);
+	}
+	// Offset of the Mach-O header in the cache file
+	std::uint64_t file_offset() const noexcept {
+		return image_->map ? image_->map->offset + (image_->address - image_->map->address) : 0;
+	}
+
+	// Loads the load commands once; keep the result around for repeated lookups
+	Segments segments() const { return Segments(cache_, dyldcache_segments_load(cache_, image_)); }
+
+	std::optional<Segment> segment(std::string_view name) const { return segments().find(name); }
+
+	dyldimage_t* get() const noexcept { return image_; }
+
+	friend bool operator==(const ImageRef& a, const ImageRef& b) noexcept { return a.image_ == b.image_; }
+	friend bool operator!=(const ImageRef& a, const ImageRef& b) noexcept { return a.image_ != b.image_; }
+
+private:
+	dyldcache_t* cache_;
+	dyldimage_t* image_;
+};
+
+using ImageIterator = detail::TableIterator<ImageRef, dyldimage_t*>;
+using MappingIterator = detail::TableIterator<Mapping, dyldmap_t*>;
+using Images = detail::Range<ImageIterator>;
+using Mappings = detail::Range<MappingIterator>;
+
+class Cache {
+public:
+	explicit Cache(const std::string& path) : cache_(dyldcache_open(path.c_str())) {
+		if (cache_ == nullptr) {
+			throw std::runtime_error("unable to open dyld cache " + path);
+		}
+	}
+	// Takes ownership of an already opened cache
+	explicit Cache(dyldcache_t* cache) noexcept : cache_(cache) {}
+	~Cache() { reset(); }
+
+	Cache(const Cache&) = delete;
+	Cache& operator=(const Cache&) = delete;
+	Cache(Cache&& other) noexcept : cache_(std::exchange(other.cache_, nullptr)) {}
+	Cache& operator=(Cache&& other) noexcept {
+		if (this != &other) {
+			reset();
+			cache_ = std::exchange(other.cache_, nullptr);
+		}
+		return *this;
+	}
+
+	explicit operator bool() const noexcept { return cache_ != nullptr; }
+	dyldcache_t* get() const noexcept { return cache_; }
+	dyldcache_t* release() noexcept { return std::exchange(cache_, nullptr); }
+	void reset() noexcept {
+		if (cache_) {
+			dyldcache_free(cache_);
+			cache_ = nullptr;
+		}
+	}
+
+	std::string_view magic() const noexcept { return std::string_view(cache_->header->magic, strnlen(cache_->header->magic, 16)); }
+	std::string_view architecture() const noexcept { return cache_->arch && cache_->arch->name ? cache_->arch->name : std::string_view(); }
+	std::uint64_t base_address() const noexcept { return cache_->header->base_address; }
+	std::uint64_t size() const noexcept { return cache_->size; }
+
+	Images images() const noexcept {
+		return Images(ImageIterator(cache_, cache_->images), ImageIterator(cache_, cache_->images + cache_->count));
+	}
+	Mappings mappings() const noexcept {
+		return Mappings(MappingIterator(cache_, cache_->maps), MappingIterator(cache_, cache_->maps + cache_->header->mapping_count));
+	}
+
+	// Matches the install path, or the file name when given no slash
+	std::optional<ImageRef> image(std::string_view name) const {
+		char path[1024];
+		bool full = name.find('/') != std::string_view::npos;
+		// Install paths fit MAXPATHLEN, so the trie lookup never needs the heap
+		if (full && name.size() < sizeof(path)) {
+			std::memcpy(path, name.data(), name.size());
+			path[name.size()] = '\0';
+			int index = dyldcache_image_index(cache_, path);
+			if (index < 0) {
+				return std::nullopt;
+			}
+			return ImageRef(cache_, cache_->images[index]);
+		}
+		for (ImageRef image : images()) {
+			if ((full ? image.path() : image.name()) == name) {
+				return image;
+			}
+		}
+		return std::nullopt;
+	}
+
+	std::optional<ImageRef> image_at(std::uint64_t address) const noexcept {
+		dyldimage_t* image = dyldcache_image_containing(cache_, address);
+		if (image == nullptr) {
+			return std::nullopt;
+		}
+		return ImageRef(cache_, image);
+	}
+
+	std::optional<Mapping> mapping(std::uint64_t address) const noexcept {
+		dyldmap_t* map = dyldcache_map_address(cache_, address);
+		if (map == nullptr) {
+			return std::nullopt;
+		}
+		return Mapping(cache_, map);
+	}
+
+	// Cache bytes at a virtual address, clipped to the mapping holding it
+	Bytes bytes(std::uint64_t address, std::uint64_t size) const {
+		dyldmap_t* map = dyldcache_map_address(cache_, address);
+		if (map == nullptr) {
+			return Bytes();
+		}
+		if (size > map->size - (address - map->address)) {
+			size = map->size - (address - map->address);
+		}
+		return detail::bytes(cache_, map->offset + (address - map->address), size);
+	}
+
+private:
+	dyldcache_t* cache_;
+};
+
+} // namespace dyld
+
+#endif /* DYLDCACHE_HPP_ */
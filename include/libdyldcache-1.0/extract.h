@@ -0,0 +1,56 @@
+/**
+  * libdyldcache-1.0 - extract.h
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef DYLDEXTRACT_H_
+#define DYLDEXTRACT_H_
+
+#include <stdint.h>
+
+#include <libdyldcache-1.0/image.h>
+#include <libdyldcache-1.0/cache.h>
+#include <libdyldcache-1.0/pool.h>
+
+typedef struct dyldextract_buffer_t {
+	unsigned char* data;
+	uint64_t size;
+	uint64_t capacity;
+} dyldextract_buffer_t;
+
+/*
+ * Rebuilds cache images as standalone dylibs. Segments are laid out back
+ *  to back and the shared LINKEDIT is replaced by one holding only the
+ *  image's own symbols, strings, exports and fixups. Every worker keeps
+ *  an output and a string table buffer that are reused image to image.
+ */
+typedef struct dyldextract_t {
+	dyldcache_t* cache;
+	dyldpool_t* pool;
+	dyldextract_buffer_t* outputs;
+	dyldextract_buffer_t* strings;
+} dyldextract_t;
+
+/*
+ * Dyld Extract Functions
+ */
+dyldextract_t* dyldextract_create(dyldcache_t* cache, uint32_t threads);
+int dyldextract_image(dyldextract_t* extract, dyldimage_t* image, uint32_t worker, dyldimage_t* output);
+int dyldextract_save(dyldextract_t* extract, dyldimage_t** images, uint32_t count, const char* directory);
+void dyldextract_free(dyldextract_t* extract);
+
+#endif /* DYLDEXTRACT_H_ */
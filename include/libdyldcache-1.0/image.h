@@ -23,6 +23,7 @@
 #include <stdint.h>
 
 #include <libdyldcache-1.0/map.h>
+#include <libdyldcache-1.0/decoder.h>
 
 typedef struct dyldimage_info_t {
 	uint64_t address;
@@ -32,13 +33,20 @@ typedef struct dyldimage_info_t {
 	uint32_t pad;
 } dyldimage_info_t;
 
+/*
+ * data and size only describe images built outside a cache, such as the
+ *  dylibs dyldextract rebuilds. They are left empty for cache images:
+ *  dyldcache_image_extent() returns the bytes of one in place, and
+ *  dyldcache_image_data() a window running to the end of its mapping for
+ *  parsing.
+ */
 typedef struct dyldimage_t {
 	char* name;
 	char* path;
 	uint8_t* data;
-	uint32_t size;
+	uint64_t size;
 	uint32_t index;
-	uint32_t offset;
+	uint64_t offset;
 	uint64_t address;
 	dyldmap_t* map;
 	dyldimage_info_t* info;
@@ -48,9 +56,10 @@ typedef struct dyldimage_t {
  * Dyld Image Functions
  */
 dyldimage_t* dyldimage_create();
-dyldimage_t* dyldimage_parse(unsigned char* data, uint32_t offset);
+dyldimage_t* dyldimage_parse(unsigned char* data, uint64_t offset);
+dyldimage_t* dyldimage_decode(const dyldcache_decoder_t* decoder, unsigned char* data, uint64_t offset);
 char* dyldimage_get_name(dyldimage_t* image);
-void dyldimage_save(dyldimage_t* image, const char* path);
+int dyldimage_save(dyldimage_t* image, const char* path);
 void dyldimage_free(dyldimage_t* image);
 void dyldimage_debug(dyldimage_t* image);
 
@@ -58,7 +67,8 @@ void dyldimage_debug(dyldimage_t* image);
  * Dyld Image Info Functions
  */
 dyldimage_info_t* dyldimage_info_create();
-dyldimage_info_t* dyldimage_info_parse(unsigned char* data, uint32_t offset);
+dyldimage_info_t* dyldimage_info_parse(unsigned char* data, uint64_t offset);
+dyldimage_info_t* dyldimage_info_decode(const dyldcache_decoder_t* decoder, unsigned char* data, uint64_t offset);
 void dyldimage_info_free(dyldimage_info_t* info);
 void dyldimage_info_debug(dyldimage_info_t* info);
 
@@ -23,5 +23,22 @@
 #include <libdyldcache-1.0/map.h>
 #include <libdyldcache-1.0/image.h>
 #include <libdyldcache-1.0/cache.h>
+#include <libdyldcache-1.0/pool.h>
+#include <libdyldcache-1.0/deps.h>
+#include <libdyldcache-1.0/writer.h>
+#include <libdyldcache-1.0/compress.h>
+#include <libdyldcache-1.0/seekable.h>
+#include <libdyldcache-1.0/client.h>
+#include <libdyldcache-1.0/codesign.h>
+#include <libdyldcache-1.0/decoder.h>
+#include <libdyldcache-1.0/stubs.h>
+#include <libdyldcache-1.0/xrefs.h>
+#include <libdyldcache-1.0/scan.h>
+#include <libdyldcache-1.0/dump.h>
+#include <libdyldcache-1.0/segment.h>
+#include <libdyldcache-1.0/catalog.h>
+#include <libdyldcache-1.0/bloom.h>
+#include <libdyldcache-1.0/objc.h>
+#include <libdyldcache-1.0/extract.h>
 
 #endif /* LIBDYLDCACHE_H_ */
@@ -23,6 +23,8 @@
 #include <libcrippy-1.0/libcrippy.h>
 #include <libcrippy-1.0/boolean.h>
 
+#include <libdyldcache-1.0/decoder.h>
+
 #define DYLDMAP_EXEC   1
 #define DYLDMAP_WRITE  2
 #define DYLDMAP_READ   4
@@ -46,7 +48,8 @@ typedef struct dyldmap_t {
  * Dyldcache Map Functions
  */
 dyldmap_t* dyldmap_create();
-dyldmap_t* dyldmap_parse(unsigned char* data, uint32_t offset);
+dyldmap_t* dyldmap_parse(unsigned char* data, uint64_t offset);
+dyldmap_t* dyldmap_decode(const dyldcache_decoder_t* decoder, unsigned char* data, uint64_t offset);
 boolean_t dyldmap_contains(dyldmap_t* map, uint64_t address);
 void dyldmap_debug(dyldmap_t* image);
 void dyldmap_free(dyldmap_t* map);
@@ -55,7 +58,8 @@ void dyldmap_free(dyldmap_t* map);
  * Dyldcache Map Info Functions
  */
 dyldmap_info_t* dyldmap_info_create();
-dyldmap_info_t* dyldmap_info_parse(unsigned char* data, uint32_t offset);
+dyldmap_info_t* dyldmap_info_parse(unsigned char* data, uint64_t offset);
+dyldmap_info_t* dyldmap_info_decode(const dyldcache_decoder_t* decoder, unsigned char* data, uint64_t offset);
 void dyldmap_info_debug(dyldmap_info_t* map);
 void dyldmap_info_free(dyldmap_info_t* map);
 
@@ -0,0 +1,104 @@
+/**
+  * libdyldcache-1.0 - objc.h
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef DYLDOBJC_H_
+#define DYLDOBJC_H_
+
+#include <stdint.h>
+
+#include <libdyldcache-1.0/cache.h>
+#include <libdyldcache-1.0/pool.h>
+
+#define DYLDOBJC_IMAGE    "/usr/lib/libobjc.A.dylib"
+
+// objc_opt_t versions whose tables we know how to read
+#define DYLDOBJC_VERSION_MIN  12
+#define DYLDOBJC_VERSION_MAX  16
+
+typedef struct dyldcache_objc_method_t {
+	uint64_t name;
+	uint64_t imp;
+} dyldcache_objc_method_t;
+
+/*
+ * A class and its methods, methods[method_count] instance methods followed
+ *  by class_method_count class methods in dyldcache_objc_t.methods.
+ */
+typedef struct dyldcache_objc_class_t {
+	uint64_t address;
+	uint64_t name;
+	uint32_t image;
+	uint32_t methods;
+	uint32_t method_count;
+	uint32_t class_method_count;
+} dyldcache_objc_class_t;
+
+typedef struct dyldcache_objc_protocol_t {
+	uint64_t address;
+	uint64_t name;
+	uint32_t image;
+} dyldcache_objc_protocol_t;
+
+/*
+ * Objective-C metadata of a cache. selopt, clsopt and protocolopt are
+ *  the addresses of libobjc's optimized hash tables in __objc_opt_ro, or
+ *  0 when the cache has none we can read; they are used in place. The
+ *  class, method and protocol arrays are only filled in by
+ *  dyldcache_objc_index(), from every image's own metadata, and serve
+ *  lookups the tables can't. Names are addresses of strings in the cache.
+ */
+typedef struct dyldcache_objc_t {
+	dyldcache_t* cache;
+	uint32_t version;
+	uint64_t opt;
+	uint64_t selopt;
+	uint64_t clsopt;
+	uint64_t protocolopt;
+	int protocol_classes;
+	uint64_t selector_base;
+	uint32_t class_count;
+	dyldcache_objc_class_t* classes;
+	uint32_t method_count;
+	dyldcache_objc_method_t* methods;
+	uint32_t protocol_count;
+	dyldcache_objc_protocol_t* protocols;
+	uint32_t class_mask;
+	uint32_t* class_table;
+	uint32_t selector_mask;
+	uint32_t* selector_table;
+	uint32_t protocol_mask;
+	uint32_t* protocol_table;
+} dyldcache_objc_t;
+
+/*
+ * Dyldcache Objc Functions
+ */
+dyldcache_objc_t* dyldcache_objc_create();
+dyldcache_objc_t* dyldcache_objc_load(dyldcache_t* cache);
+int dyldcache_objc_index(dyldcache_objc_t* objc, dyldpool_t* pool);
+uint64_t dyldcache_objc_selector(dyldcache_objc_t* objc, const char* name);
+uint64_t dyldcache_objc_class(dyldcache_objc_t* objc, const char* name);
+uint64_t dyldcache_objc_protocol(dyldcache_objc_t* objc, const char* name);
+dyldcache_objc_class_t* dyldcache_objc_find_class(dyldcache_objc_t* objc, const char* name);
+dyldcache_objc_method_t* dyldcache_objc_methods(dyldcache_objc_t* objc, dyldcache_objc_class_t* cls, uint32_t* count);
+uint64_t dyldcache_objc_imp(dyldcache_objc_t* objc, const char* cls, const char* selector, int meta);
+void dyldcache_objc_debug(dyldcache_objc_t* objc);
+void dyldcache_objc_free(dyldcache_objc_t* objc);
+
+#endif /* DYLDOBJC_H_ */
@@ -0,0 +1,56 @@
+/**
+  * libdyldcache-1.0 - pool.h
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef DYLDPOOL_H_
+#define DYLDPOOL_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+/*
+ * Called once for every index in [0, count). worker is the id of the
+ *  thread running the call, in [0, pool->count), and can be used to
+ *  pick per-thread scratch buffers.
+ */
+typedef void (*dyldpool_func_t)(uint32_t index, uint32_t worker, void* userdata);
+
+typedef struct dyldpool_t {
+	pthread_t* threads;
+	pthread_mutex_t lock;
+	pthread_cond_t start;
+	pthread_cond_t done;
+	uint32_t count;
+	uint32_t running;
+	uint32_t generation;
+	int shutdown;
+	dyldpool_func_t func;
+	void* userdata;
+	uint32_t total;
+	volatile uint32_t next;
+} dyldpool_t;
+
+/*
+ * Dyld Pool Functions
+ */
+uint32_t dyldpool_cpu_count();
+dyldpool_t* dyldpool_create(uint32_t count);
+void dyldpool_run(dyldpool_t* pool, uint32_t count, dyldpool_func_t func, void* userdata);
+void dyldpool_free(dyldpool_t* pool);
+
+#endif /* DYLDPOOL_H_ */
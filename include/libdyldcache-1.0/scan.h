@@ -0,0 +1,78 @@
+/**
+  * libdyldcache-1.0 - scan.h
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef DYLDSCAN_H_
+#define DYLDSCAN_H_
+
+#include <stdint.h>
+
+#include <libdyldcache-1.0/cache.h>
+#include <libdyldcache-1.0/image.h>
+#include <libdyldcache-1.0/pool.h>
+
+// Bytes of a region scanned per pool task
+#define DYLDSCAN_CHUNK  (256 * 1024)
+
+/*
+ * A byte signature such as "E0 03 ?? AA". Each byte matches where
+ *  (data & mask) == bytes, so "??" has a zero mask and "A?" matches any
+ *  byte with an A high nibble. anchor is the offset of the fixed byte
+ *  (or pair of fixed bytes, when wide) candidates are searched for.
+ */
+typedef struct dyldcache_pattern_t {
+	char* name;
+	uint32_t length;
+	uint32_t anchor;
+	int wide;
+	uint8_t* bytes;
+	uint8_t* mask;
+} dyldcache_pattern_t;
+
+typedef struct dyldcache_hit_t {
+	uint64_t address;
+	uint32_t pattern;
+	int32_t image;
+} dyldcache_hit_t;
+
+typedef struct dyldcache_scan_t {
+	uint32_t count;
+	uint32_t longest;
+	dyldcache_pattern_t** patterns;
+	uint64_t hit_count;
+	dyldcache_hit_t* hits;
+} dyldcache_scan_t;
+
+/*
+ * Dyldcache Pattern Functions
+ */
+dyldcache_pattern_t* dyldcache_pattern_create();
+dyldcache_pattern_t* dyldcache_pattern_parse(const char* name, const char* text);
+void dyldcache_pattern_free(dyldcache_pattern_t* pattern);
+
+/*
+ * Dyldcache Scan Functions
+ */
+dyldcache_scan_t* dyldcache_scan_create();
+int dyldcache_scan_add(dyldcache_scan_t* scan, const char* name, const char* text);
+int dyldcache_scan_mappings(dyldcache_scan_t* scan, dyldcache_t* cache, dyldpool_t* pool, uint32_t prot);
+int dyldcache_scan_images(dyldcache_scan_t* scan, dyldcache_t* cache, dyldpool_t* pool, dyldimage_t** images, uint32_t count);
+void dyldcache_scan_debug(dyldcache_scan_t* scan);
+void dyldcache_scan_free(dyldcache_scan_t* scan);
+
+#endif /* DYLDSCAN_H_ */
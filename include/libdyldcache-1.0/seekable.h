@@ -0,0 +1,100 @@
+/**
+  * libdyldcache-1.0 - seekable.h
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef DYLDSEEKABLE_H_
+#define DYLDSEEKABLE_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define DYLDSEEKABLE_BUDGET (512ULL * 1024 * 1024)
+
+#define DYLDSEEKABLE_RESIDENT  1
+#define DYLDSEEKABLE_PINNED    2
+#define DYLDSEEKABLE_LOADING   4
+
+#define DYLDSEEKABLE_NONE      0xFFFFFFFF
+
+/*
+ * Resident, unpinned frames are kept on a list from most (newer) to least
+ *  (older) recently used, linked by frame index. loads counts the
+ *  dyldseekable_load() calls whose range covers the frame and which
+ *  haven't returned yet; such frames are never evicted.
+ */
+typedef struct dyldseekable_frame_t {
+	uint64_t offset;
+	uint64_t compressed;
+	uint64_t address;
+	uint32_t size;
+	uint32_t flags;
+	uint32_t loads;
+	uint32_t newer;
+	uint32_t older;
+} dyldseekable_frame_t;
+
+/*
+ * A decompression context with its scratch buffer. Idle ones are kept on
+ *  a free list, so concurrent loads each get their own.
+ */
+typedef struct dyldseekable_context_t {
+	void* dctx;
+	unsigned char* scratch;
+	uint64_t scratch_size;
+	struct dyldseekable_context_t* next;
+} dyldseekable_context_t;
+
+/*
+ * A seekable zstd file decompressed lazily into an anonymous mapping of
+ *  its full uncompressed size. Frames are only decompressed once a range
+ *  covering them is loaded, and different frames decompress in parallel.
+ *  Pinned frames stay resident, the others are dropped least recently
+ *  used first once more than budget bytes are resident, so pointers into
+ *  unpinned ranges are only good until that many more bytes have been
+ *  loaded. While any hold is taken nothing is dropped, which is what
+ *  keeps pointers valid for threads reading in parallel.
+ */
+typedef struct dyldseekable_t {
+	int fd;
+	uint64_t size;
+	uint64_t resident;
+	uint64_t budget;
+	uint32_t count;
+	uint32_t holds;
+	uint32_t newest;
+	uint32_t oldest;
+	dyldseekable_frame_t* frames;
+	unsigned char* data;
+	dyldseekable_context_t* idle;
+	uint64_t scratch_size;
+	pthread_mutex_t lock;
+	pthread_cond_t loaded;
+} dyldseekable_t;
+
+/*
+ * Dyld Seekable Functions
+ */
+int dyldseekable_probe(const char* path);
+dyldseekable_t* dyldseekable_open(const char* path);
+int dyldseekable_load(dyldseekable_t* seekable, uint64_t offset, uint64_t size, int pin);
+void dyldseekable_hold(dyldseekable_t* seekable);
+void dyldseekable_release(dyldseekable_t* seekable);
+void dyldseekable_debug(dyldseekable_t* seekable);
+void dyldseekable_free(dyldseekable_t* seekable);
+
+#endif /* DYLDSEEKABLE_H_ */
@@ -0,0 +1,68 @@
+/**
+  * libdyldcache-1.0 - segment.h
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef DYLDSEGMENT_H_
+#define DYLDSEGMENT_H_
+
+#include <stdint.h>
+
+#include <libdyldcache-1.0/map.h>
+#include <libdyldcache-1.0/image.h>
+#include <libdyldcache-1.0/cache.h>
+
+/*
+ * One segment of an image, resolved through the mapping it lives in.
+ *  data points size bytes into the cache data at file offset offset; it
+ *  is NULL for segments outside every mapping such as __PAGEZERO. size
+ *  is the segment's file size clipped to its mapping. Seekable caches
+ *  only have the load commands fetched, call dyldcache_fetch() for the
+ *  range before touching data. sections points at the first of nsects
+ *  section headers inside the load command.
+ */
+typedef struct dyldcache_segment_t {
+	char name[17];
+	uint64_t address;
+	uint64_t vmsize;
+	uint64_t offset;
+	uint64_t size;
+	unsigned char* data;
+	uint32_t maxprot;
+	uint32_t initprot;
+	uint32_t nsects;
+	unsigned char* sections;
+	dyldmap_t* map;
+} dyldcache_segment_t;
+
+typedef struct dyldcache_segments_t {
+	int wide;
+	uint32_t count;
+	dyldcache_segment_t* segments;
+} dyldcache_segments_t;
+
+/*
+ * Dyldcache Segments Functions
+ */
+dyldcache_segments_t* dyldcache_segments_create();
+dyldcache_segments_t* dyldcache_segments_load(dyldcache_t* cache, dyldimage_t* image);
+dyldcache_segment_t* dyldcache_segments_find(dyldcache_segments_t* segments, const char* name);
+dyldcache_segment_t* dyldcache_segments_lookup(dyldcache_segments_t* segments, uint64_t address);
+void dyldcache_segments_debug(dyldcache_segments_t* segments);
+void dyldcache_segments_free(dyldcache_segments_t* segments);
+
+#endif /* DYLDSEGMENT_H_ */
@@ -0,0 +1,64 @@
+/**
+  * libdyldcache-1.0 - stubs.h
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef DYLDSTUBS_H_
+#define DYLDSTUBS_H_
+
+#include <stdint.h>
+
+#include <libdyldcache-1.0/cache.h>
+#include <libdyldcache-1.0/pool.h>
+
+#define DYLDSTUB_STUB    1
+#define DYLDSTUB_AUTH    2
+#define DYLDSTUB_ISLAND  3
+
+// Image of islands found in branch pools, which aren't cache images
+#define DYLDSTUB_NO_IMAGE  0xFFFFFFFF
+
+// Trampolines followed by dyldcache_stubs_resolve before giving up
+#define DYLDSTUB_HOPS    8
+
+typedef struct dyldcache_stub_t {
+	uint64_t address;
+	uint64_t target;
+	uint32_t image;
+	uint32_t kind;
+} dyldcache_stub_t;
+
+/*
+ * Every decoded stub and branch island in the cache, sorted by address.
+ *  A target may itself be a stub or island, see dyldcache_stubs_resolve.
+ */
+typedef struct dyldcache_stubs_t {
+	uint32_t count;
+	dyldcache_stub_t* stubs;
+} dyldcache_stubs_t;
+
+/*
+ * Dyldcache Stubs Functions
+ */
+dyldcache_stubs_t* dyldcache_stubs_create();
+dyldcache_stubs_t* dyldcache_stubs_load(dyldcache_t* cache, dyldpool_t* pool);
+dyldcache_stub_t* dyldcache_stubs_lookup(dyldcache_stubs_t* stubs, uint64_t address);
+uint64_t dyldcache_stubs_resolve(dyldcache_stubs_t* stubs, uint64_t address);
+void dyldcache_stubs_debug(dyldcache_stubs_t* stubs);
+void dyldcache_stubs_free(dyldcache_stubs_t* stubs);
+
+#endif /* DYLDSTUBS_H_ */
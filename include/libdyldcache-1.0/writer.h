@@ -0,0 +1,73 @@
+/**
+  * libdyldcache-1.0 - writer.h
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef DYLDWRITER_H_
+#define DYLDWRITER_H_
+
+#include <stdint.h>
+
+#include <libdyldcache-1.0/image.h>
+#include <libdyldcache-1.0/cache.h>
+#include <libdyldcache-1.0/pool.h>
+
+#define DYLDWRITER_DEPTH 256
+
+typedef enum {
+	kWriterAuto,
+	kWriterSync,
+	kWriterThreads,
+	kWriterUring,
+	kWriterInvalid
+} dyldwriter_backend_t;
+
+typedef struct dyldwriter_job_t {
+	char* path;
+	const unsigned char* data;
+	uint64_t size;
+	int fd;
+	int err;
+} dyldwriter_job_t;
+
+/*
+ * Queued writes only reference their data, which has to stay valid
+ *  until dyldwriter_flush() returns. Jobs are flushed in batches of
+ *  depth files.
+ */
+typedef struct dyldwriter_t {
+	dyldwriter_backend_t backend;
+	dyldwriter_job_t* jobs;
+	uint32_t depth;
+	uint32_t count;
+	uint32_t failed;
+	dyldpool_t* pool;
+	void* ring;
+} dyldwriter_t;
+
+/*
+ * Dyld Writer Functions
+ */
+dyldwriter_t* dyldwriter_create(dyldwriter_backend_t backend, uint32_t depth);
+dyldwriter_backend_t dyldwriter_backend_parse(const char* name);
+const char* dyldwriter_backend_name(dyldwriter_backend_t backend);
+int dyldwriter_write(dyldwriter_t* writer, const char* path, const unsigned char* data, uint64_t size);
+int dyldwriter_save(dyldwriter_t* writer, dyldcache_t* cache, dyldimage_t* image, const char* path);
+int dyldwriter_flush(dyldwriter_t* writer);
+void dyldwriter_free(dyldwriter_t* writer);
+
+#endif /* DYLDWRITER_H_ */
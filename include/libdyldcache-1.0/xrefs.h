@@ -0,0 +1,75 @@
+/**
+  * libdyldcache-1.0 - xrefs.h
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef DYLDXREFS_H_
+#define DYLDXREFS_H_
+
+#include <stdint.h>
+
+#include <libdyldcache-1.0/cache.h>
+#include <libdyldcache-1.0/pool.h>
+
+#define DYLDXREF_CALL   1
+#define DYLDXREF_JUMP   2
+#define DYLDXREF_ADDR   4
+#define DYLDXREF_LOAD   8
+#define DYLDXREF_ALL    0xF
+
+#define DYLDXREFS_MAGIC    "DYLDXREF"
+#define DYLDXREFS_VERSION  3
+
+// Bytes of executable mapping scanned per pool task
+#define DYLDXREFS_CHUNK    (1024 * 1024)
+
+// Instructions referencing a target are kept as 32-bit counts of
+//  instructions from the base address, which reach this far
+#define DYLDXREFS_REACH    (4ULL << 32)
+
+/*
+ * Inverted index from target address to the instructions referencing it.
+ *  targets is sorted; the references to targets[i] are refs[offsets[i]]
+ *  up to (but not including) refs[offsets[i+1]], in address order, with
+ *  the kind of each in kinds[]. Use dyldcache_xrefs_address() to turn a
+ *  ref back into an address. uuid is the cache's, used to reject saved
+ *  indexes of other caches.
+ */
+typedef struct dyldcache_xrefs_t {
+	uint64_t count;
+	uint64_t ref_count;
+	uint64_t base_address;
+	uint8_t uuid[16];
+	uint64_t* targets;
+	uint32_t* offsets;
+	uint32_t* refs;
+	uint8_t* kinds;
+} dyldcache_xrefs_t;
+
+/*
+ * Dyldcache Xrefs Functions
+ */
+dyldcache_xrefs_t* dyldcache_xrefs_create();
+dyldcache_xrefs_t* dyldcache_xrefs_load(dyldcache_t* cache, dyldpool_t* pool, uint32_t kinds);
+uint32_t* dyldcache_xrefs_get(dyldcache_xrefs_t* xrefs, uint64_t target, uint8_t** kinds, uint64_t* count);
+uint64_t dyldcache_xrefs_address(dyldcache_xrefs_t* xrefs, uint32_t ref);
+int dyldcache_xrefs_save(dyldcache_xrefs_t* xrefs, const char* path);
+dyldcache_xrefs_t* dyldcache_xrefs_open(dyldcache_t* cache, const char* path);
+void dyldcache_xrefs_debug(dyldcache_xrefs_t* xrefs);
+void dyldcache_xrefs_free(dyldcache_xrefs_t* xrefs);
+
+#endif /* DYLDXREFS_H_ */
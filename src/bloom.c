@@ -0,0 +1,449 @@
+/**
+  * libdyldcache-1.0 - bloom.c
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <libmacho-1.0/macho.h>
+
+#define _DEBUG
+#include <libcrippy-1.0/debug.h>
+#include <libcrippy-1.0/libcrippy.h>
+
+#include <libdyldcache-1.0/map.h>
+#include <libdyldcache-1.0/image.h>
+#include <libdyldcache-1.0/cache.h>
+#include <libdyldcache-1.0/pool.h>
+#include <libdyldcache-1.0/decoder.h>
+#include <libdyldcache-1.0/bloom.h>
+
+typedef struct dyldcache_bloom_list_t {
+	uint64_t count;
+	uint64_t capacity;
+	uint64_t* hashes;
+	int failed;
+} dyldcache_bloom_list_t;
+
+typedef struct dyldcache_bloom_ctx_t {
+	dyldcache_t* cache;
+	dyldcache_bloom_t* bloom;
+	dyldcache_bloom_list_t* lists;
+} dyldcache_bloom_ctx_t;
+
+/*
+ * Saved filters start with magic, version, count, hashes, a reserved
+ *  word, base_address, size, word_count, uuid, inode and mtime, all
+ *  little endian, followed by offsets[] and words[].
+ */
+#define DYLDBLOOM_HEADER_SIZE  80
+
+static uint64_t dyldcache_bloom_hash(const char* name) {
+	uint64_t hash = 14695981039346656037ULL;
+	while (*name) {
+		hash ^= (uint8_t) *name++;
+		hash *= 1099511628211ULL;
+	}
+	// FNV alone leaves the high bits weak for short names
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCDULL;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+static void dyldcache_bloom_set(uint64_t* words, uint64_t bits, uint32_t hashes, uint64_t hash) {
+	uint32_t i = 0;
+	uint64_t bit = 0;
+	uint64_t step = (hash >> 32) | 1;
+	for (i = 0; i < hashes; i++) {
+		bit = (hash + i * step) % bits;
+		words[bit / 64] |= 1ULL << (bit % 64);
+	}
+}
+
+static int dyldcache_bloom_get(const uint64_t* words, uint64_t bits, uint32_t hashes, uint64_t hash) {
+	uint32_t i = 0;
+	uint64_t bit = 0;
+	uint64_t step = (hash >> 32) | 1;
+	for (i = 0; i < hashes; i++) {
+		bit = (hash + i * step) % bits;
+		if ((words[bit / 64] & (1ULL << (bit % 64))) == 0) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static void dyldcache_bloom_collect(const char* name, uint32_t address, void* userdata) {
+	dyldcache_bloom_list_t* list = (dyldcache_bloom_list_t*) userdata;
+	uint64_t capacity = 0;
+	uint64_t* hashes = NULL;
+	if (list->failed) {
+		return;
+	}
+	if (list->count == list->capacity) {
+		capacity = list->capacity ? list->capacity * 2 : 256;
+		hashes = (uint64_t*) realloc(list->hashes, capacity * sizeof(uint64_t));
+		if (hashes == NULL) {
+			list->failed = 1;
+			return;
+		}
+		list->hashes = hashes;
+		list->capacity = capacity;
+	}
+	list->hashes[list->count++] = dyldcache_bloom_hash(name);
+}
+
+static void dyldcache_bloom_collect_func(uint32_t index, uint32_t worker, void* userdata) {
+	dyldcache_bloom_ctx_t* ctx = (dyldcache_bloom_ctx_t*) userdata;
+	dyldcache_t* cache = ctx->cache;
+	dyldimage_t* image = cache->images[index];
+	uint64_t size = 0;
+	unsigned char* data = NULL;
+	macho_t* macho = NULL;
+
+	data = dyldcache_image_data(cache, image, &size);
+	if (data == NULL) {
+		return;
+	}
+	macho = macho_load(data, size > 0xFFFFFFFFULL ? 0xFFFFFFFFU : (uint32_t) size);
+	if (macho) {
+		macho_list_symbols(macho, dyldcache_bloom_collect, &ctx->lists[index]);
+		macho_free(macho);
+	}
+}
+
+static void dyldcache_bloom_fill_func(uint32_t index, uint32_t worker, void* userdata) {
+	dyldcache_bloom_ctx_t* ctx = (dyldcache_bloom_ctx_t*) userdata;
+	dyldcache_bloom_t* bloom = ctx->bloom;
+	dyldcache_bloom_list_t* list = &ctx->lists[index];
+	uint64_t i = 0;
+	uint64_t* words = &bloom->words[bloom->offsets[index]];
+	uint64_t bits = (bloom->offsets[index + 1] - bloom->offsets[index]) * 64;
+
+	for (i = 0; i < list->count; i++) {
+		dyldcache_bloom_set(words, bits, bloom->hashes, list->hashes[i]);
+	}
+	free(list->hashes);
+	list->hashes = NULL;
+}
+
+/*
+ * Dyldcache Bloom Functions
+ */
+dyldcache_bloom_t* dyldcache_bloom_create() {
+	debug("Creating dyld cache bloom filters\n");
+	dyldcache_bloom_t* bloom = (dyldcache_bloom_t*) malloc(sizeof(dyldcache_bloom_t));
+	if (bloom) {
+		memset(bloom, '\0', sizeof(dyldcache_bloom_t));
+	}
+	return bloom;
+}
+
+dyldcache_bloom_t* dyldcache_bloom_load(dyldcache_t* cache, dyldpool_t* pool) {
+	debug("Building dyld cache bloom filters\n");
+	uint32_t i = 0;
+	int failed = 0;
+	dyldpool_t* owned = NULL;
+	dyldcache_bloom_t* bloom = NULL;
+	dyldcache_bloom_ctx_t ctx;
+
+	if (cache == NULL || cache->images == NULL) {
+		return NULL;
+	}
+	bloom = dyldcache_bloom_create();
+	if (bloom == NULL) {
+		error("Unable to allocate memory for dyld cache bloom filters\n");
+		return NULL;
+	}
+	bloom->count = cache->count;
+	bloom->hashes = DYLDBLOOM_HASHES;
+	bloom->base_address = cache->header->base_address;
+	bloom->size = cache->size;
+	memcpy(bloom->uuid, cache->header->uuid, sizeof(bloom->uuid));
+	bloom->inode = cache->inode;
+	bloom->mtime = cache->mtime;
+
+	memset(&ctx, '\0', sizeof(ctx));
+	ctx.cache = cache;
+	ctx.bloom = bloom;
+	ctx.lists = (dyldcache_bloom_list_t*) calloc(cache->count + 1, sizeof(dyldcache_bloom_list_t));
+	bloom->offsets = (uint64_t*) calloc(cache->count + 1, sizeof(uint64_t));
+	if (ctx.lists == NULL || bloom->offsets == NULL) {
+		error("Unable to allocate memory for dyld cache bloom filters\n");
+		free(ctx.lists);
+		dyldcache_bloom_free(bloom);
+		return NULL;
+	}
+
+	if (pool == NULL) {
+		pool = owned = dyldpool_create(0);
+	}
+
+	// First pass hashes each image's names, which sizes its filter
+	dyldcache_hold(cache);
+	dyldpool_run(pool, cache->count, dyldcache_bloom_collect_func, &ctx);
+	dyldcache_release(cache);
+	for (i = 0; i < cache->count; i++) {
+		// A filter missing names would rule its image out for them
+		if (ctx.lists[i].failed) {
+			error("Unable to allocate memory for %s symbol hashes\n", cache->images[i]->path);
+			failed = 1;
+		}
+		bloom->offsets[i + 1] = bloom->offsets[i] + (ctx.lists[i].count * DYLDBLOOM_BITS + 63) / 64;
+	}
+	bloom->word_count = bloom->offsets[cache->count];
+	if (failed == 0) {
+		bloom->words = (uint64_t*) calloc(bloom->word_count + 1, sizeof(uint64_t));
+		if (bloom->words == NULL) {
+			error("Unable to allocate memory for dyld cache bloom filters\n");
+		}
+	}
+	if (bloom->words != NULL) {
+		dyldpool_run(pool, cache->count, dyldcache_bloom_fill_func, &ctx);
+	}
+	if (owned) {
+		dyldpool_free(owned);
+	}
+
+	for (i = 0; i < cache->count; i++) {
+		free(ctx.lists[i].hashes);
+	}
+	free(ctx.lists);
+	if (bloom->words == NULL) {
+		dyldcache_bloom_free(bloom);
+		return NULL;
+	}
+	return bloom;
+}
+
+/*
+ * Returns 0 if image certainly doesn't have a symbol called name and 1
+ *  if it might.
+ */
+int dyldcache_bloom_test(dyldcache_bloom_t* bloom, uint32_t image, const char* name) {
+	uint64_t bits = 0;
+	if (bloom == NULL || image >= bloom->count) {
+		return 1;
+	}
+	bits = (bloom->offsets[image + 1] - bloom->offsets[image]) * 64;
+	if (bits == 0) {
+		return 0;
+	}
+	return dyldcache_bloom_get(&bloom->words[bloom->offsets[image]], bits, bloom->hashes, dyldcache_bloom_hash(name));
+}
+
+uint32_t* dyldcache_bloom_candidates(dyldcache_bloom_t* bloom, const char* name, uint32_t* count) {
+	uint32_t i = 0;
+	uint64_t bits = 0;
+	uint64_t hash = 0;
+	uint32_t* images = NULL;
+
+	*count = 0;
+	if (bloom == NULL || name == NULL) {
+		return NULL;
+	}
+	images = (uint32_t*) malloc((bloom->count + 1) * sizeof(uint32_t));
+	if (images == NULL) {
+		return NULL;
+	}
+	hash = dyldcache_bloom_hash(name);
+	for (i = 0; i < bloom->count; i++) {
+		bits = (bloom->offsets[i + 1] - bloom->offsets[i]) * 64;
+		if (bits > 0 && dyldcache_bloom_get(&bloom->words[bloom->offsets[i]], bits, bloom->hashes, hash)) {
+			images[(*count)++] = i;
+		}
+	}
+	return images;
+}
+
+static void dyldcache_bloom_put32(unsigned char* data, uint32_t value) {
+	data[0] = value;
+	data[1] = value >> 8;
+	data[2] = value >> 16;
+	data[3] = value >> 24;
+}
+
+static void dyldcache_bloom_put64(unsigned char* data, uint64_t value) {
+	dyldcache_bloom_put32(data, (uint32_t) value);
+	dyldcache_bloom_put32(data + 4, (uint32_t) (value >> 32));
+}
+
+static int dyldcache_bloom_write(FILE* file, const uint64_t* values, uint64_t count) {
+	uint64_t i = 0;
+	uint64_t used = 0;
+	unsigned char buffer[4096];
+	for (i = 0; i < count; i++) {
+		dyldcache_bloom_put64(&buffer[used], values[i]);
+		used += 8;
+		if (used == sizeof(buffer) || i + 1 == count) {
+			if (fwrite(buffer, 1, used, file) != used) {
+				return -1;
+			}
+			used = 0;
+		}
+	}
+	return 0;
+}
+
+static int dyldcache_bloom_read(FILE* file, uint64_t* values, uint64_t count) {
+	uint64_t i = 0;
+	const dyldcache_decoder_t* decoder = dyldcache_decoder_get(kLittleEndian, 8);
+	if (fread(values, sizeof(uint64_t), count, file) != count) {
+		return -1;
+	}
+	for (i = 0; i < count; i++) {
+		values[i] = decoder->read64((const unsigned char*) &values[i]);
+	}
+	return 0;
+}
+
+int dyldcache_bloom_save(dyldcache_bloom_t* bloom, const char* path) {
+	debug("Saving dyld cache bloom filters\n");
+	int err = 0;
+	FILE* file = NULL;
+	unsigned char header[DYLDBLOOM_HEADER_SIZE];
+
+	if (bloom == NULL || path == NULL) {
+		return -1;
+	}
+	file = fopen(path, "wb");
+	if (file == NULL) {
+		error("Unable to open %s for writing\n", path);
+		return -1;
+	}
+	memset(header, '\0', sizeof(header));
+	memcpy(header, DYLDBLOOM_MAGIC, 8);
+	dyldcache_bloom_put32(&header[8], DYLDBLOOM_VERSION);
+	dyldcache_bloom_put32(&header[12], bloom->count);
+	dyldcache_bloom_put32(&header[16], bloom->hashes);
+	dyldcache_bloom_put64(&header[24], bloom->base_address);
+	dyldcache_bloom_put64(&header[32], bloom->size);
+	dyldcache_bloom_put64(&header[40], bloom->word_count);
+	memcpy(&header[48], bloom->uuid, sizeof(bloom->uuid));
+	dyldcache_bloom_put64(&header[64], bloom->inode);
+	dyldcache_bloom_put64(&header[72], bloom->mtime);
+	if (fwrite(header, sizeof(header), 1, file) != 1 ||
+			dyldcache_bloom_write(file, bloom->offsets, bloom->count + 1) < 0 ||
+			dyldcache_bloom_write(file, bloom->words, bloom->word_count) < 0) {
+		error("Unable to write bloom filters to %s\n", path);
+		err = -1;
+	}
+	if (fclose(file) != 0) {
+		err = -1;
+	}
+	return err;
+}
+
+dyldcache_bloom_t* dyldcache_bloom_open(dyldcache_t* cache, const char* path) {
+	debug("Opening dyld cache bloom filters\n");
+	uint32_t i = 0;
+	uint64_t size = 0;
+	FILE* file = NULL;
+	dyldcache_bloom_t* bloom = NULL;
+	unsigned char header[DYLDBLOOM_HEADER_SIZE];
+	const dyldcache_decoder_t* decoder = dyldcache_decoder_get(kLittleEndian, 8);
+	struct stat status;
+
+	file = fopen(path, "rb");
+	if (file == NULL) {
+		return NULL;
+	}
+	if (fstat(fileno(file), &status) != 0 || fread(header, sizeof(header), 1, file) != 1 ||
+			memcmp(header, DYLDBLOOM_MAGIC, 8) != 0 || decoder->read32(&header[8]) != DYLDBLOOM_VERSION ||
+			decoder->read32(&header[16]) == 0) {
+		error("%s is not a dyld cache bloom filter file\n", path);
+		fclose(file);
+		return NULL;
+	}
+
+	bloom = dyldcache_bloom_create();
+	if (bloom == NULL) {
+		fclose(file);
+		return NULL;
+	}
+	bloom->count = decoder->read32(&header[12]);
+	bloom->hashes = decoder->read32(&header[16]);
+	bloom->base_address = decoder->read64(&header[24]);
+	bloom->size = decoder->read64(&header[32]);
+	bloom->word_count = decoder->read64(&header[40]);
+	memcpy(bloom->uuid, &header[48], sizeof(bloom->uuid));
+	bloom->inode = decoder->read64(&header[64]);
+	bloom->mtime = decoder->read64(&header[72]);
+
+	// Filters from another cache would wrongly rule images out
+	if (cache && (bloom->base_address != cache->header->base_address || bloom->size != cache->size ||
+			bloom->count != cache->count || memcmp(bloom->uuid, cache->header->uuid, sizeof(bloom->uuid)) != 0 ||
+			bloom->inode != cache->inode || bloom->mtime != cache->mtime)) {
+		error("Bloom filters %s were built for a different cache\n", path);
+		dyldcache_bloom_free(bloom);
+		fclose(file);
+		return NULL;
+	}
+	size = (uint64_t) status.st_size - sizeof(header);
+	if (bloom->word_count > size / 8 || (uint64_t) bloom->count + 1 + bloom->word_count != size / 8 || size % 8 != 0) {
+		error("Bloom filters %s are truncated or corrupt\n", path);
+		dyldcache_bloom_free(bloom);
+		fclose(file);
+		return NULL;
+	}
+
+	bloom->offsets = (uint64_t*) malloc((bloom->count + 1) * sizeof(uint64_t));
+	bloom->words = (uint64_t*) malloc((bloom->word_count + 1) * sizeof(uint64_t));
+	if (bloom->offsets == NULL || bloom->words == NULL ||
+			dyldcache_bloom_read(file, bloom->offsets, bloom->count + 1) < 0 ||
+			dyldcache_bloom_read(file, bloom->words, bloom->word_count) < 0) {
+		error("Unable to read bloom filters from %s\n", path);
+		dyldcache_bloom_free(bloom);
+		fclose(file);
+		return NULL;
+	}
+	fclose(file);
+
+	for (i = 0; i < bloom->count; i++) {
+		if (bloom->offsets[i] > bloom->offsets[i + 1]) {
+			break;
+		}
+	}
+	if (i < bloom->count || bloom->offsets[0] != 0 || bloom->offsets[bloom->count] != bloom->word_count) {
+		error("Bloom filters %s are truncated or corrupt\n", path);
+		dyldcache_bloom_free(bloom);
+		return NULL;
+	}
+	return bloom;
+}
+
+void dyldcache_bloom_debug(dyldcache_bloom_t* bloom) {
+	if (bloom) {
+		debug("\tBloom:\n");
+		debug("\t\timages = %u\n", bloom->count);
+		debug("\t\tbytes = %llu\n", (unsigned long long) bloom->word_count * 8);
+		debug("\n");
+	}
+}
+
+void dyldcache_bloom_free(dyldcache_bloom_t* bloom) {
+	debug("Freeing dyld cache bloom filters\n");
+	if (bloom) {
+		free(bloom->offsets);
+		free(bloom->words);
+		free(bloom);
+	}
+}
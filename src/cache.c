@@ -17,9 +17,20 @@
   * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  **/
 
+// For mremap()
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define _DEBUG
 #include <libcrippy-1.0/file.h>
@@ -30,6 +41,282 @@
 #include <libdyldcache-1.0/map.h>
 #include <libdyldcache-1.0/image.h>
 #include <libdyldcache-1.0/cache.h>
+#include <libdyldcache-1.0/seekable.h>
+#include <libdyldcache-1.0/segment.h>
+
+/*
+ * One translation remembered by dyldcache_read(). Entries name their
+ *  cache by serial, which is never reused, so a freed cache can't be
+ *  matched by a new one allocated at the same address.
+ */
+typedef struct dyldcache_tlb_t {
+	uint32_t serial;
+	uint64_t address;
+	uint64_t size;
+	uint64_t offset;
+} dyldcache_tlb_t;
+
+static uint32_t dyldcache_serial = 0;
+static __thread uint32_t dyldcache_tlb_next = 0;
+static __thread dyldcache_tlb_t dyldcache_tlb[DYLDCACHE_TLB_SIZE];
+
+static int dyldcache_fetch_pinned(dyldcache_t* cache, uint64_t offset, uint64_t size) {
+	if (offset + size > cache->size) {
+		return -1;
+	}
+	if (cache->seekable) {
+		return dyldseekable_load(cache->seekable, offset, size, 1);
+	}
+	return 0;
+}
+
+static int dyldcache_fetch_string(dyldcache_t* cache, uint64_t offset) {
+	// Install paths are short but may straddle a frame boundary
+	uint64_t length = 256;
+	while (offset < cache->size) {
+		if (length > cache->size - offset) {
+			length = cache->size - offset;
+		}
+		if (dyldcache_fetch_pinned(cache, offset, length) < 0) {
+			return -1;
+		}
+		if (memchr(&cache->data[offset], '\0', length) != NULL) {
+			return 0;
+		}
+		if (offset + length == cache->size) {
+			break;
+		}
+		length *= 2;
+	}
+	return -1;
+}
+
+static int dyldcache_uleb(const unsigned char** data, const unsigned char* end, uint64_t* value) {
+	uint32_t shift = 0;
+	const unsigned char* cursor = *data;
+	*value = 0;
+	do {
+		if (cursor >= end || shift > 63) {
+			return -1;
+		}
+		*value |= (uint64_t) (*cursor & 0x7F) << shift;
+		shift += 7;
+	} while (*cursor++ & 0x80);
+	*data = cursor;
+	return 0;
+}
+
+/*
+ * Follows path through a Mach-O style trie and returns its terminal
+ *  payload, or NULL if the trie doesn't hold path.
+ */
+static const unsigned char* dyldcache_trie_walk(const unsigned char* start, const unsigned char* end, const char* path) {
+	int matched = 0;
+	uint32_t i = 0;
+	uint32_t count = 0;
+	uint64_t child = 0;
+	uint64_t terminal = 0;
+	const char* cursor = NULL;
+	const unsigned char* node = start;
+
+	while (1) {
+		if (dyldcache_uleb(&node, end, &terminal) < 0) {
+			return NULL;
+		}
+		if (*path == '\0') {
+			return terminal ? node : NULL;
+		}
+		if (terminal >= (uint64_t) (end - node)) {
+			return NULL;
+		}
+		node += terminal;
+		count = *node++;
+		for (i = 0; i < count; i++) {
+			matched = 1;
+			cursor = path;
+			while (node < end && *node != '\0') {
+				if (matched && *cursor == (char) *node) {
+					cursor++;
+				} else {
+					matched = 0;
+				}
+				node++;
+			}
+			if (node >= end) {
+				return NULL;
+			}
+			node++;
+			if (dyldcache_uleb(&node, end, &child) < 0) {
+				return NULL;
+			}
+			// Every edge consumes part of path, so a bad trie can't loop
+			if (matched && cursor != path) {
+				break;
+			}
+		}
+		if (i == count || child >= (uint64_t) (end - start)) {
+			return NULL;
+		}
+		path = cursor;
+		node = start + child;
+	}
+}
+
+/*
+ * Returns the last of count entries stride bytes apart whose address,
+ *  at field within each entry, is at or below address.
+ */
+static int64_t dyldcache_table_search(dyldcache_t* cache, const unsigned char* table, uint32_t count,
+		uint32_t stride, uint32_t field, uint64_t address) {
+	uint32_t low = 0;
+	uint32_t high = count;
+	uint32_t middle = 0;
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		if (cache->decoder->read64(&table[(uint64_t) middle * stride + field]) <= address) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	return (int64_t) low - 1;
+}
+
+static int dyldcache_table_compare(const void* a, const void* b) {
+	const dyldcache_table_entry_t* left = (const dyldcache_table_entry_t*) a;
+	const dyldcache_table_entry_t* right = (const dyldcache_table_entry_t*) b;
+	if (left->address != right->address) {
+		return left->address < right->address ? -1 : 1;
+	}
+	return left->index < right->index ? -1 : (left->index > right->index);
+}
+
+static int dyldcache_map_file(dyldcache_t* cache, const char* path) {
+	int fd = 0;
+	void* data = NULL;
+	unsigned char* reserved = NULL;
+	unsigned char* aligned = NULL;
+	uint64_t slack = 0;
+	uint64_t page = (uint64_t) sysconf(_SC_PAGESIZE);
+	struct stat status;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+	if (fstat(fd, &status) < 0 || !S_ISREG(status.st_mode) || status.st_size <= 0 ||
+			(uint64_t) status.st_size > (uint64_t) SIZE_MAX - DYLDCACHE_HUGE_PAGE) {
+		close(fd);
+		return -1;
+	}
+	// Start big caches on a huge page boundary, so the metadata at their
+	//  front can later be moved onto a huge page of its own
+	if ((uint64_t) status.st_size >= DYLDCACHE_HUGE_PAGE) {
+		reserved = (unsigned char*) mmap(NULL, status.st_size + DYLDCACHE_HUGE_PAGE, PROT_NONE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (reserved != MAP_FAILED) {
+			aligned = (unsigned char*) (((uintptr_t) reserved + DYLDCACHE_HUGE_PAGE - 1) & ~(uintptr_t) (DYLDCACHE_HUGE_PAGE - 1));
+			slack = aligned - reserved;
+			if (slack > 0) {
+				munmap(reserved, slack);
+			}
+			// munmap() wants a page aligned start, the file's last page
+			//  is still part of its mapping
+			munmap(aligned + ((status.st_size + page - 1) & ~(page - 1)), DYLDCACHE_HUGE_PAGE - slack);
+		} else {
+			aligned = NULL;
+		}
+	}
+	// Private and writable so callers patching cache data stay local.
+	//  kAdviseDontNeed throws such patches away again, see dyldcache_advise()
+	data = mmap(aligned, status.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | (aligned ? MAP_FIXED : 0), fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		if (aligned) {
+			munmap(aligned, status.st_size);
+		}
+		return -1;
+	}
+	cache->data = (unsigned char*) data;
+	cache->size = status.st_size;
+	cache->mapped = 1;
+	return 0;
+}
+
+/*
+ * Madvising a private file mapping for huge pages does nothing, only
+ *  anonymous memory gets them. The huge pages around range are copied
+ *  into an anonymous region marked for huge pages, which then replaces
+ *  them in one mremap() so readers never see the range unmapped. The
+ *  copy stays for the life of the cache and is no longer file backed.
+ */
+static int dyldcache_advise_huge(dyldcache_t* cache, dyldcache_range_t range) {
+#if defined(MADV_HUGEPAGE) && defined(MREMAP_FIXED)
+	uint64_t start = 0;
+	uint64_t end = 0;
+	unsigned char* copy = NULL;
+	unsigned char* reserved = NULL;
+
+	start = range.offset & ~(DYLDCACHE_HUGE_PAGE - 1);
+	end = (range.offset + range.size + DYLDCACHE_HUGE_PAGE - 1) & ~(DYLDCACHE_HUGE_PAGE - 1);
+	if (end > (cache->size & ~(DYLDCACHE_HUGE_PAGE - 1))) {
+		end = cache->size & ~(DYLDCACHE_HUGE_PAGE - 1);
+	}
+	if (((uintptr_t) cache->data & (DYLDCACHE_HUGE_PAGE - 1)) != 0 || end <= start) {
+		debug("Dyld cache range is too small or unaligned for huge pages\n");
+		return -1;
+	}
+	if (start < cache->anonymous) {
+		start = cache->anonymous;
+	}
+	if (end <= start) {
+		return 0;
+	}
+
+	reserved = (unsigned char*) mmap(NULL, end - start + DYLDCACHE_HUGE_PAGE, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (reserved == MAP_FAILED) {
+		return -1;
+	}
+	copy = (unsigned char*) (((uintptr_t) reserved + DYLDCACHE_HUGE_PAGE - 1) & ~(uintptr_t) (DYLDCACHE_HUGE_PAGE - 1));
+	if (copy > reserved) {
+		munmap(reserved, copy - reserved);
+	}
+	munmap(copy + (end - start), DYLDCACHE_HUGE_PAGE - (copy - reserved));
+
+	madvise(copy, end - start, MADV_HUGEPAGE);
+	memcpy(copy, &cache->data[start], end - start);
+	if (mremap(copy, end - start, end - start, MREMAP_MAYMOVE | MREMAP_FIXED, &cache->data[start]) == MAP_FAILED) {
+		munmap(copy, end - start);
+		return -1;
+	}
+	if (start == cache->anonymous) {
+		cache->anonymous = end;
+	}
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+static uint64_t dyldcache_page_size() {
+	static uint64_t page = 0;
+	if (page == 0) {
+		page = (uint64_t) sysconf(_SC_PAGESIZE);
+	}
+	return page;
+}
+
+// Longer names first where one contains another
+static const architecture_t dyldcache_architectures[] = {
+	{ DYLDARCH_ARM64, kLittleEndian, kArmType, kArm64, 8 },
+	{ DYLDARCH_ARMV6, kLittleEndian, kArmType, kArmv6, 4 },
+	{ DYLDARCH_ARMV7, kLittleEndian, kArmType, kArmv7, 4 },
+	{ DYLDARCH_X86_64, kLittleEndian, kIntelType, kIntelx86_64, 8 },
+	{ DYLDARCH_I386, kLittleEndian, kIntelType, kIntelx86, 4 },
+	{ DYLDARCH_PPC, kBigEndian, kPowerPCType, kPowerPC, 4 },
+	{ NULL, kLittleEndian, kArmType, kArmv7, 0 }
+};
 
 /*
  * Dyldcache Functions
@@ -39,6 +326,7 @@ dyldcache_t* dyldcache_create() {
 	dyldcache_t* cache = (dyldcache_t*) malloc(sizeof(dyldcache_t));
 	if (cache) {
 		memset(cache, '\0', sizeof(dyldcache_t));
+		cache->serial = __sync_add_and_fetch(&dyldcache_serial, 1);
 	}
 	return cache;
 }
@@ -47,40 +335,73 @@ dyldcache_t* dyldcache_open(const char* path) {
 	int i = 0;
 	int err = 0;
 	uint32_t count = 0;
-	uint32_t offset = 0;
-	uint32_t length = 0;
+	uint64_t offset = 0;
+	unsigned int length = 0;
 	file_t* file = NULL;
 	dyldcache_t* cache = NULL;
 	dyldimage_t* image = NULL;
 	unsigned char* data = NULL;
 	unsigned char* buffer = NULL;
+	struct stat status;
 	debug("Opening dyld shared cache\n");
 	cache = dyldcache_create();
 	if (cache) {
-		err = file_read(path, &buffer, &length);
-		if (err < 0) {
-			error("Unable to open file at path %s\n", path);
-			dyldcache_free(cache);
-			return NULL;
+		// Lets indexes saved beside the cache notice it being replaced
+		if (stat(path, &status) == 0) {
+			cache->inode = status.st_ino;
+			cache->mtime = status.st_mtime;
 		}
-		cache->data = buffer;
-		cache->size = length;
+		if (dyldseekable_probe(path)) {
+			// Compressed caches are only decompressed where we look
+			cache->seekable = dyldseekable_open(path);
+			if (cache->seekable == NULL) {
+				error("Unable to open compressed cache at path %s\n", path);
+				dyldcache_free(cache);
+				return NULL;
+			}
+			cache->data = cache->seekable->data;
+			cache->size = cache->seekable->size;
+			if (dyldcache_fetch_pinned(cache, 0, DYLDCACHE_HEADER_SIZE) < 0) {
+				error("Unable to read dyldcache header\n");
+				dyldcache_free(cache);
+				return NULL;
+			}
 
-		cache->header = dyldcache_header_load(cache);
-		if (cache->header == NULL) {
-			error("Unable to parse dyldcache header\n");
+		} else if (dyldcache_map_file(cache, path) < 0) {
+			// Fall back to reading anything we can't map
+			err = file_read(path, &buffer, &length);
+			if (err < 0) {
+				error("Unable to open file at path %s\n", path);
+				dyldcache_free(cache);
+				return NULL;
+			}
+			cache->data = buffer;
+			cache->size = length;
+		}
+
+		if (cache->size < DYLDCACHE_HEADER_SIZE) {
+			error("File at path %s is too small to be a dyldcache\n", path);
 			dyldcache_free(cache);
 			return NULL;
 		}
-		cache->count = cache->header->images_count;
-		cache->offset = cache->header->images_offset;
 
+		// The magic names the architecture, which decides how to read the rest
 		cache->arch = dyldcache_architecture_load(cache);
 		if (cache->arch == NULL) {
 			error("Unable to parse architecture from dyldcache header\n");
 			dyldcache_free(cache);
 			return NULL;
 		}
+		cache->decoder = dyldcache_decoder_get(cache->arch->cpu_endian, cache->arch->pointer_size);
+
+		cache->header = dyldcache_header_load(cache);
+		if (cache->header == NULL) {
+			error("Unable to parse dyldcache header\n");
+			dyldcache_free(cache);
+			return NULL;
+		}
+		cache->count = cache->header->images_count;
+		cache->offset = cache->header->images_offset;
 
 		cache->maps = dyldcache_maps_load(cache);
 		if (cache->maps == NULL) {
@@ -96,6 +417,13 @@ dyldcache_t* dyldcache_open(const char* path) {
 			return NULL;
 		}
 
+		cache->tables = dyldcache_tables_load(cache);
+		if (cache->tables == NULL) {
+			error("Unable to load lookup tables from dyldcache\n");
+			dyldcache_free(cache);
+			return NULL;
+		}
+
 		//dyldcache_debug(cache);
 	}
 	return cache;
@@ -116,10 +444,24 @@ void dyldcache_free(dyldcache_t* cache) {
 			dyldcache_images_free(cache->images);
 			cache->images = NULL;
 		}
+		if (cache->tables) {
+			dyldcache_tables_free(cache->tables);
+			cache->tables = NULL;
+		}
 		if (cache->arch) {
 			dyldcache_architecture_free(cache->arch);
 			cache->arch = NULL;
 		}
+		if (cache->seekable) {
+			// The decompressed data belongs to the seekable file
+			dyldseekable_free(cache->seekable);
+			cache->seekable = NULL;
+			cache->data = NULL;
+		}
+		if (cache->mapped && cache->data) {
+			munmap(cache->data, cache->size);
+			cache->data = NULL;
+		}
 		if (cache->data) {
 			free(cache->data);
 			cache->data = NULL;
@@ -138,6 +480,7 @@ void dyldcache_debug(dyldcache_t* cache) {
 		if (cache->header) dyldcache_header_debug(cache->header);
 		if (cache->images) dyldcache_images_debug(cache);
 		if (cache->maps) dyldcache_maps_debug(cache);
+		if (cache->tables) dyldcache_tables_debug(cache->tables);
 	}
 }
 
@@ -148,41 +491,37 @@ architecture_t* dyldcache_architecture_create() {
 	debug("Creating dyld cache architecture structure\n");
 	architecture_t* arch = (architecture_t*) malloc(sizeof(architecture_t));
 	if (arch) {
-		memset(arch, '\0', sizeof(architecture_t*));
+		memset(arch, '\0', sizeof(architecture_t));
 	}
 	return arch;
 }
 
 architecture_t* dyldcache_architecture_load(dyldcache_t* cache) {
 	debug("Loading dyld cache architecture\n");
-	unsigned char* found = NULL;
-	architecture_t* arch = dyldcache_architecture_create();
-	if (arch) {
-		found = strstr(cache->data, DYLDARCH_ARMV6);
-		if (found) {
-			arch->name = DYLDARCH_ARMV6;
-			arch->cpu_type = kArmType;
-			arch->cpu_subtype = kArmv6;
-			arch->cpu_endian = kLittleEndian;
-		}
+	int i = 0;
+	char magic[17];
+	char* found = NULL;
+	architecture_t* arch = NULL;
 
-		found = strstr(cache->data, DYLDARCH_ARMV7);
+	// Only look inside the magic, the header isn't NUL terminated
+	memset(magic, '\0', sizeof(magic));
+	memcpy(magic, cache->data, 16);
+	for (i = 0; dyldcache_architectures[i].name != NULL; i++) {
+		found = strstr(magic, dyldcache_architectures[i].name);
 		if (found) {
-			arch->name = DYLDARCH_ARMV7;
-			arch->cpu_type = kArmType;
-			arch->cpu_subtype = kArmv7;
-			arch->cpu_endian = kLittleEndian;
+			break;
 		}
-
-		// TODO: Add other architectures in here. We only need iPhone for now.
-		dyldcache_architecture_debug(arch);
 	}
-
 	if (found == NULL) {
-		error("Unknown architechure encountered! %s\n", cache->data);
+		error("Unknown architechure encountered! %s\n", magic);
 		return NULL;
 	}
 
+	arch = dyldcache_architecture_create();
+	if (arch) {
+		memcpy(arch, &dyldcache_architectures[i], sizeof(architecture_t));
+		dyldcache_architecture_debug(arch);
+	}
 	return arch;
 }
 
@@ -192,6 +531,7 @@ void dyldcache_architecture_debug(architecture_t* arch) {
 	debug("\t\tcpu_id = %d\n", arch->cpu_type);
 	debug("\t\tcpu_sub_id = %d\n", arch->cpu_subtype);
 	debug("\t\tcpu_endian = %s\n", arch->cpu_endian == kLittleEndian ? "little endian" : "big endian");
+	debug("\t\tpointer_size = %u\n", arch->pointer_size);
 	debug("\n");
 }
 
@@ -223,9 +563,16 @@ void dyldcache_header_free(dyldcache_header_t* header) {
 
 dyldcache_header_t* dyldcache_header_load(dyldcache_t* cache) {
 	debug("Loading dyld cache header\n");
+	uint32_t length = 0;
 	dyldcache_header_t* header = dyldcache_header_create();
 	if (header) {
-		memcpy(header, cache->data, sizeof(dyldcache_header_t));
+		// Newer caches grow the header, which ends where the mappings start
+		length = cache->decoder->read32(&cache->data[16]);
+		if (length < DYLDCACHE_HEADER_SIZE || length > cache->size ||
+				dyldcache_fetch_pinned(cache, 0, length) < 0) {
+			length = DYLDCACHE_HEADER_SIZE;
+		}
+		cache->decoder->header(cache->data, length, header);
 	}
 
 	dyldcache_header_debug(header);
@@ -242,6 +589,15 @@ void dyldcache_header_debug(dyldcache_header_t* header) {
 	debug("\t\tbase_address = 0x%qX\n", header->base_address);
 	debug("\t\tcodesign_offset = 0x%qX\n", header->codesign_offset);
 	debug("\t\tcodesign_size = %llu\n", header->codesign_size);
+	debug("\t\tlocal_symbols_offset = 0x%qX\n", header->local_symbols_offset);
+	debug("\t\tlocal_symbols_size = %llu\n", header->local_symbols_size);
+	debug("\t\tcache_type = %llu\n", header->cache_type);
+	debug("\t\taccelerate_info_addr = 0x%qX\n", header->accelerate_info_addr);
+	debug("\t\taccelerate_info_size = %llu\n", header->accelerate_info_size);
+	debug("\t\timages_text_offset = 0x%qX\n", header->images_text_offset);
+	debug("\t\timages_text_count = %llu\n", header->images_text_count);
+	debug("\t\tdylibs_trie_addr = 0x%qX\n", header->dylibs_trie_addr);
+	debug("\t\tdylibs_trie_size = %llu\n", header->dylibs_trie_size);
 	debug("\n");
 }
 
@@ -262,7 +618,7 @@ dyldimage_t** dyldcache_images_load(dyldcache_t* cache) {
 	debug("Loading dyld cache images\n");
 	uint32_t i = 0;
 	uint32_t count = 0;
-	uint32_t offset = 0;
+	uint64_t offset = 0;
 	uint8_t* buffer = NULL;
 	dyldimage_t* image = NULL;
 	dyldimage_t** images = NULL;
@@ -276,21 +632,26 @@ dyldimage_t** dyldcache_images_load(dyldcache_t* cache) {
 		}
 
 		offset = cache->header->images_offset;
+		if (dyldcache_fetch_pinned(cache, offset, (uint64_t) count * sizeof(dyldimage_info_t)) < 0) {
+			error("Unable to read dyld image table\n");
+			dyldcache_images_free(images);
+			return NULL;
+		}
 		for (i = 0; i < count; i++) {
 			debug("Loading image %d\n", i);
-			image = dyldimage_parse(cache->data, offset);
+			if (dyldcache_fetch_string(cache, cache->decoder->read32(&cache->data[offset + offsetof(dyldimage_info_t, offset)])) < 0) {
+				error("Unable to read dyld image path\n");
+				dyldcache_images_free(images);
+				return NULL;
+			}
+			image = dyldimage_decode(cache->decoder, cache->data, offset);
 			if (image == NULL) {
 				error("Unable to parse dyld image from cache\n");
 				return NULL;
 			}
+			image->index = i;
 			image->map = dyldcache_map_address(cache, image->address);
-			image->offset = image->address - image->map->address;
-			image->data = &cache->data[offset];
-			if(image->data) {
-				image->size = *(uint32_t*)(image->data + 0x38);
-			} else {
-				image->size = 0;
-			}
+			image->offset = image->map ? image->address - image->map->address : 0;
 			images[i] = image;
 			offset += sizeof(dyldimage_info_t);
 		}
@@ -349,7 +710,7 @@ dyldmap_t** dyldcache_maps_load(dyldcache_t* cache) {
 	debug("Loading dyld cache maps\n");
 	int i = 0;
 	uint32_t count = 0;
-	uint32_t offset = 0;
+	uint64_t offset = 0;
 	dyldmap_t** maps = NULL;
 	if (cache) {
 		count = cache->header->mapping_count;
@@ -360,9 +721,14 @@ dyldmap_t** dyldcache_maps_load(dyldcache_t* cache) {
 		}
 
 		offset = cache->header->mapping_offset;
+		if (dyldcache_fetch_pinned(cache, offset, (uint64_t) count * sizeof(dyldmap_info_t)) < 0) {
+			error("Unable to read dyld map table\n");
+			dyldcache_maps_free(maps);
+			return NULL;
+		}
 		for (i = 0; i < count; i++) {
 			debug("Parsing mapping %d\n", i);
-			maps[i] = dyldmap_parse(cache->data, offset);
+			maps[i] = dyldmap_decode(cache->decoder, cache->data, offset);
 			if (maps[i] == NULL) {
 				error("Unable to parse dyld map from cache\n");
 				return NULL;
@@ -406,11 +772,233 @@ void dyldcache_maps_free(dyldmap_t** maps) {
 	}
 }
 
+/*
+ * Dyldcache Tables Functions
+ */
+dyldcache_tables_t* dyldcache_tables_create() {
+	debug("Creating dyld cache lookup tables\n");
+	dyldcache_tables_t* tables = (dyldcache_tables_t*) malloc(sizeof(dyldcache_tables_t));
+	if (tables) {
+		memset(tables, '\0', sizeof(dyldcache_tables_t));
+	}
+	return tables;
+}
+
+static const unsigned char* dyldcache_tables_data(dyldcache_t* cache, uint64_t address, uint64_t size) {
+	uint64_t offset = 0;
+	dyldmap_t* map = dyldcache_map_address(cache, address);
+	if (map == NULL || size > map->size - (address - map->address)) {
+		return NULL;
+	}
+	offset = map->offset + (address - map->address);
+	if (offset > cache->size || size > cache->size - offset ||
+			dyldcache_fetch_pinned(cache, offset, size) < 0) {
+		return NULL;
+	}
+	return &cache->data[offset];
+}
+
+static void dyldcache_tables_accelerator(dyldcache_t* cache, dyldcache_tables_t* tables) {
+	uint64_t size = cache->header->accelerate_info_size;
+	uint32_t offset = 0;
+	uint32_t length = 0;
+	const unsigned char* info = NULL;
+
+	// struct dyld_cache_accelerator_info, version 1 is 72 bytes
+	info = dyldcache_tables_data(cache, cache->header->accelerate_info_addr, size);
+	if (info == NULL || size < 72 || cache->decoder->read32(info) != 1) {
+		debug("Ignoring unreadable accelerator info\n");
+		return;
+	}
+	offset = cache->decoder->read32(info + 16);
+	length = cache->decoder->read32(info + 20);
+	if (offset <= size && length <= size - offset) {
+		tables->trie = info + offset;
+		tables->trie_size = length;
+	}
+	offset = cache->decoder->read32(info + 56);
+	length = cache->decoder->read32(info + 60);
+	if (offset <= size && length <= (size - offset) / 16) {
+		tables->ranges = info + offset;
+		tables->range_count = length;
+	}
+}
+
+static void dyldcache_tables_text(dyldcache_t* cache, dyldcache_tables_t* tables) {
+	uint32_t i = 0;
+	uint64_t offset = cache->header->images_text_offset;
+	uint64_t count = cache->header->images_text_count;
+	const unsigned char* text = NULL;
+
+	// struct dyld_cache_image_text_info is 32 bytes, in image order
+	if (count != cache->count || offset > cache->size || count > (cache->size - offset) / 32 ||
+			dyldcache_fetch_pinned(cache, offset, count * 32) < 0) {
+		debug("Ignoring unreadable image text info\n");
+		return;
+	}
+	text = &cache->data[offset];
+	// Only usable for address lookups when sorted, as dyld lays it out
+	for (i = 1; i < count; i++) {
+		if (cache->decoder->read64(&text[i * 32 + 16]) < cache->decoder->read64(&text[(i - 1) * 32 + 16])) {
+			debug("Ignoring unsorted image text info\n");
+			return;
+		}
+	}
+	tables->text = text;
+	tables->text_count = count;
+}
+
+dyldcache_tables_t* dyldcache_tables_load(dyldcache_t* cache) {
+	debug("Loading dyld cache lookup tables\n");
+	uint32_t i = 0;
+	dyldcache_header_t* header = cache->header;
+	dyldcache_tables_t* tables = dyldcache_tables_create();
+	if (tables == NULL) {
+		error("Unable to allocate memory for dyld cache lookup tables\n");
+		return NULL;
+	}
+
+	if (header->dylibs_trie_addr != 0 && header->dylibs_trie_size != 0) {
+		tables->trie = dyldcache_tables_data(cache, header->dylibs_trie_addr, header->dylibs_trie_size);
+		tables->trie_size = tables->trie ? header->dylibs_trie_size : 0;
+	} else if (header->accelerate_info_addr != 0 && header->accelerate_info_size != 0) {
+		dyldcache_tables_accelerator(cache, tables);
+	}
+	if (tables->ranges == NULL && header->images_text_offset != 0) {
+		dyldcache_tables_text(cache, tables);
+	}
+
+	if (tables->ranges == NULL && tables->text == NULL && cache->count > 0) {
+		tables->by_address = (dyldcache_table_entry_t*) malloc(cache->count * sizeof(dyldcache_table_entry_t));
+		if (tables->by_address == NULL) {
+			error("Unable to allocate memory for dyld cache address table\n");
+			dyldcache_tables_free(tables);
+			return NULL;
+		}
+		for (i = 0; i < cache->count; i++) {
+			tables->by_address[i].address = cache->images[i]->address;
+			tables->by_address[i].index = i;
+		}
+		qsort(tables->by_address, cache->count, sizeof(dyldcache_table_entry_t), dyldcache_table_compare);
+	}
+
+	dyldcache_tables_debug(tables);
+	return tables;
+}
+
+void dyldcache_tables_debug(dyldcache_tables_t* tables) {
+	debug("\tTables:\n");
+	debug("\t\ttrie_size = %llu\n", tables->trie_size);
+	debug("\t\trange_count = %u\n", tables->range_count);
+	debug("\t\ttext_count = %u\n", tables->text_count);
+	debug("\t\tby_address = %s\n", tables->by_address ? "built" : "none");
+	debug("\n");
+}
+
+void dyldcache_tables_free(dyldcache_tables_t* tables) {
+	debug("Freeing dyld cache lookup tables\n");
+	if (tables) {
+		if (tables->by_address) {
+			free(tables->by_address);
+			tables->by_address = NULL;
+		}
+		free(tables);
+	}
+}
+
+int dyldcache_fetch(dyldcache_t* cache, uint64_t offset, uint64_t size) {
+	if (cache == NULL || offset > cache->size || size > cache->size - offset) {
+		return -1;
+	}
+	if (cache->seekable) {
+		return dyldseekable_load(cache->seekable, offset, size, 0);
+	}
+	return 0;
+}
+
+/*
+ * Fetched data of seekable caches stays valid between a hold and its
+ *  release, whatever else is fetched meanwhile. Parallel passes take one
+ *  around their pool run so no worker's fetch evicts another's data.
+ */
+void dyldcache_hold(dyldcache_t* cache) {
+	if (cache && cache->seekable) {
+		dyldseekable_hold(cache->seekable);
+	}
+}
+
+void dyldcache_release(dyldcache_t* cache) {
+	if (cache && cache->seekable) {
+		dyldseekable_release(cache->seekable);
+	}
+}
+
 dyldmap_t* dyldcache_map_image(dyldcache_t* cache, dyldimage_t* image) {
 	debug("Mapping dyld cache image\n");
+	if (image->map) {
+		return image->map;
+	}
 	return dyldcache_map_address(cache, image->address);
 }
 
+/*
+ * Returns a parse window on the image: its Mach-O header in place, with
+ *  every byte from there to the end of its mapping in size, fetching them
+ *  first for seekable caches. That is more than the image itself, use
+ *  dyldcache_image_extent() for the bytes to copy out.
+ */
+unsigned char* dyldcache_image_data(dyldcache_t* cache, dyldimage_t* image, uint64_t* size) {
+	uint64_t offset = 0;
+	*size = 0;
+	if (cache == NULL || image == NULL || image->map == NULL) {
+		return NULL;
+	}
+	offset = image->map->offset + image->offset;
+	if (offset >= cache->size) {
+		return NULL;
+	}
+	*size = image->map->size - image->offset;
+	if (*size > cache->size - offset) {
+		*size = cache->size - offset;
+	}
+	if (dyldcache_fetch(cache, offset, *size) < 0) {
+		*size = 0;
+		return NULL;
+	}
+	return &cache->data[offset];
+}
+
+/*
+ * Returns the image's Mach-O header in place, with the file size of the
+ *  segment holding it in size. Images whose other segments live in other
+ *  mappings need dyldcache_segments_load() to be copied whole.
+ */
+unsigned char* dyldcache_image_extent(dyldcache_t* cache, dyldimage_t* image, uint64_t* size) {
+	uint64_t offset = 0;
+	dyldcache_segment_t* segment = NULL;
+	dyldcache_segments_t* segments = NULL;
+	*size = 0;
+	if (cache == NULL || image == NULL || image->map == NULL) {
+		return NULL;
+	}
+	offset = image->map->offset + image->offset;
+	segments = dyldcache_segments_load(cache, image);
+	segment = dyldcache_segments_lookup(segments, image->address);
+	if (segment == NULL || segment->data == NULL || offset < segment->offset
+			|| offset - segment->offset >= segment->size) {
+		error("Unable to find the header segment of %s\n", image->path);
+		dyldcache_segments_free(segments);
+		return NULL;
+	}
+	*size = segment->size - (offset - segment->offset);
+	dyldcache_segments_free(segments);
+	if (dyldcache_fetch(cache, offset, *size) < 0) {
+		*size = 0;
+		return NULL;
+	}
+	return &cache->data[offset];
+}
+
 dyldmap_t* dyldcache_map_address(dyldcache_t* cache, uint64_t address) {
 	debug("Mapping dyld cache address\n");
 	int i = 0;
@@ -424,15 +1012,132 @@ dyldmap_t* dyldcache_map_address(dyldcache_t* cache, uint64_t address) {
 	return NULL;
 }
 
+static dyldcache_tlb_t* dyldcache_translate(dyldcache_t* cache, uint64_t address) {
+	uint32_t i = 0;
+	dyldmap_t* map = NULL;
+	dyldcache_tlb_t* entry = NULL;
+
+	for (i = 0; i < DYLDCACHE_TLB_SIZE; i++) {
+		entry = &dyldcache_tlb[i];
+		if (entry->serial == cache->serial && address - entry->address < entry->size) {
+			return entry;
+		}
+	}
+
+	for (i = 0; i < cache->header->mapping_count; i++) {
+		map = cache->maps[i];
+		if (address >= map->address && address - map->address < map->size && map->offset < cache->size) {
+			entry = &dyldcache_tlb[dyldcache_tlb_next++ % DYLDCACHE_TLB_SIZE];
+			entry->serial = cache->serial;
+			entry->address = map->address;
+			entry->offset = map->offset;
+			// Truncated caches must not hand out bytes past their end
+			entry->size = map->size;
+			if (entry->size > cache->size - map->offset) {
+				entry->size = cache->size - map->offset;
+			}
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Returns length bytes at address in place, or NULL if they are not
+ *  all inside a single mapping.
+ */
+const unsigned char* dyldcache_read(dyldcache_t* cache, uint64_t address, uint64_t length) {
+	uint64_t delta = 0;
+	dyldcache_tlb_t* entry = NULL;
+
+	if (cache == NULL || cache->maps == NULL) {
+		return NULL;
+	}
+	entry = dyldcache_translate(cache, address);
+	if (entry == NULL) {
+		return NULL;
+	}
+	delta = address - entry->address;
+	if (length > entry->size - delta) {
+		return NULL;
+	}
+	if (cache->seekable && dyldcache_fetch(cache, entry->offset + delta, length) < 0) {
+		return NULL;
+	}
+	return &cache->data[entry->offset + delta];
+}
+
+int dyldcache_read_u32(dyldcache_t* cache, uint64_t address, uint32_t* value) {
+	const unsigned char* data = dyldcache_read(cache, address, sizeof(uint32_t));
+	if (data == NULL) {
+		return -1;
+	}
+	*value = cache->decoder->read32(data);
+	return 0;
+}
+
+int dyldcache_read_u64(dyldcache_t* cache, uint64_t address, uint64_t* value) {
+	const unsigned char* data = dyldcache_read(cache, address, sizeof(uint64_t));
+	if (data == NULL) {
+		return -1;
+	}
+	*value = cache->decoder->read64(data);
+	return 0;
+}
+
+/*
+ * Returns the NUL terminated string at address, or NULL if it runs off
+ *  the end of its mapping.
+ */
+const char* dyldcache_read_cstring(dyldcache_t* cache, uint64_t address) {
+	uint64_t delta = 0;
+	uint64_t length = 64;
+	uint64_t avail = 0;
+	const unsigned char* data = NULL;
+	dyldcache_tlb_t* entry = NULL;
+
+	if (cache == NULL || cache->maps == NULL) {
+		return NULL;
+	}
+	entry = dyldcache_translate(cache, address);
+	if (entry == NULL) {
+		return NULL;
+	}
+	delta = address - entry->address;
+	avail = entry->size - delta;
+	data = &cache->data[entry->offset + delta];
+	if (cache->seekable == NULL) {
+		return memchr(data, '\0', avail) ? (const char*) data : NULL;
+	}
+	// Compressed caches are only fetched as far as the string goes
+	while (1) {
+		if (length > avail) {
+			length = avail;
+		}
+		if (dyldcache_fetch(cache, entry->offset + delta, length) < 0) {
+			return NULL;
+		}
+		if (memchr(data, '\0', length)) {
+			return (const char*) data;
+		}
+		if (length == avail) {
+			return NULL;
+		}
+		length *= 4;
+	}
+}
 
 dyldimage_t* dyldcache_get_image(dyldcache_t* cache, const char* dylib) {
 	debug("Getting dyld cache image\n");
 	int i = 0;
 	dyldimage_t* image = NULL;
+	if (strchr(dylib, '/') != NULL) {
+		i = dyldcache_image_index(cache, dylib);
+		return i < 0 ? NULL : cache->images[i];
+	}
 	for(i = 0; i < cache->count; i++) {
 		image = cache->images[i];
 		if(image != NULL) {
-			printf("Found %s\n", image->name);
 			if(!strcmp(image->name, dylib)) {
 				return image;
 			}
@@ -441,6 +1146,99 @@ dyldimage_t* dyldcache_get_image(dyldcache_t* cache, const char* dylib) {
 	return NULL;
 }
 
+/*
+ * Returns the index of the image installed at path, or -1. Aliases are
+ *  found too when the cache has a dylibs trie.
+ */
+int dyldcache_image_index(dyldcache_t* cache, const char* path) {
+	uint32_t i = 0;
+	uint64_t index = 0;
+	const unsigned char* end = NULL;
+	const unsigned char* node = NULL;
+
+	if (cache == NULL || path == NULL) {
+		return -1;
+	}
+	if (cache->tables && cache->tables->trie) {
+		end = cache->tables->trie + cache->tables->trie_size;
+		node = dyldcache_trie_walk(cache->tables->trie, end, path);
+		if (node == NULL || dyldcache_uleb(&node, end, &index) < 0 || index >= cache->count) {
+			return -1;
+		}
+		return (int) index;
+	}
+	for (i = 0; i < cache->count; i++) {
+		if (cache->images[i] && cache->images[i]->path && !strcmp(cache->images[i]->path, path)) {
+			return (int) i;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Returns the image whose segments hold address. With only image text
+ *  info in the cache that is limited to __TEXT; without either table the
+ *  nearest image below address in the same mapping is assumed.
+ */
+dyldimage_t* dyldcache_image_containing(dyldcache_t* cache, uint64_t address) {
+	int64_t found = 0;
+	uint32_t low = 0;
+	uint32_t high = 0;
+	uint32_t middle = 0;
+	uint32_t index = 0;
+	const unsigned char* entry = NULL;
+	dyldcache_tables_t* tables = NULL;
+
+	if (cache == NULL || cache->tables == NULL) {
+		return NULL;
+	}
+	tables = cache->tables;
+	if (tables->ranges) {
+		// struct dyld_cache_range_entry { uint64 start; uint32 size; uint32 image; }
+		found = dyldcache_table_search(cache, tables->ranges, tables->range_count, 16, 0, address);
+		if (found < 0) {
+			return NULL;
+		}
+		entry = &tables->ranges[found * 16];
+		index = cache->decoder->read32(entry + 12);
+		if (address - cache->decoder->read64(entry) >= cache->decoder->read32(entry + 8) || index >= cache->count) {
+			return NULL;
+		}
+		return cache->images[index];
+	}
+	if (tables->text) {
+		found = dyldcache_table_search(cache, tables->text, tables->text_count, 32, 16, address);
+		if (found < 0) {
+			return NULL;
+		}
+		entry = &tables->text[found * 32];
+		if (address - cache->decoder->read64(entry + 16) >= cache->decoder->read32(entry + 24)) {
+			return NULL;
+		}
+		return cache->images[found];
+	}
+	if (tables->by_address) {
+		high = cache->count;
+		while (low < high) {
+			middle = low + (high - low) / 2;
+			if (tables->by_address[middle].address <= address) {
+				low = middle + 1;
+			} else {
+				high = middle;
+			}
+		}
+		if (low == 0) {
+			return NULL;
+		}
+		index = tables->by_address[low - 1].index;
+		if (cache->images[index]->map == NULL || dyldmap_contains(cache->images[index]->map, address) != kTrue) {
+			return NULL;
+		}
+		return cache->images[index];
+	}
+	return NULL;
+}
+
 dyldimage_t* dyldcache_first_image(dyldcache_t* cache) {
 	debug("Returning first image in dyld cache\n");
 	return cache->images[0];
@@ -458,3 +1256,185 @@ dyldimage_t* dyldcache_next_image(dyldcache_t* cache, dyldimage_t* image) {
 	}
 	return next;
 }
+
+int dyldcache_memory_usage(dyldcache_t* cache, dyldcache_usage_t* usage) {
+	debug("Measuring dyld cache memory usage\n");
+	uint64_t i = 0;
+	uint64_t page = dyldcache_page_size();
+	uint64_t pages = 0;
+	uint64_t length = 0;
+	unsigned char* vector = NULL;
+	dyldseekable_t* seekable = NULL;
+
+	if (cache == NULL || usage == NULL) {
+		return -1;
+	}
+	memset(usage, '\0', sizeof(dyldcache_usage_t));
+
+	usage->arena = sizeof(dyldcache_t);
+	if (cache->header) usage->arena += sizeof(dyldcache_header_t);
+	if (cache->arch) usage->arena += sizeof(architecture_t);
+	if (cache->maps) {
+		usage->arena += cache->header->mapping_count * (sizeof(dyldmap_t) + sizeof(dyldmap_info_t));
+		usage->index += (cache->header->mapping_count + 1) * sizeof(dyldmap_t*);
+	}
+	if (cache->images) {
+		usage->arena += cache->count * (sizeof(dyldimage_t) + sizeof(dyldimage_info_t));
+		usage->index += (cache->count + 1) * sizeof(dyldimage_t*);
+	}
+	if (cache->tables) {
+		usage->arena += sizeof(dyldcache_tables_t);
+		if (cache->tables->by_address) {
+			usage->index += cache->count * sizeof(dyldcache_table_entry_t);
+		}
+	}
+
+	seekable = cache->seekable;
+	if (seekable) {
+		usage->arena += sizeof(dyldseekable_t) + seekable->scratch_size;
+		usage->index += seekable->count * sizeof(dyldseekable_frame_t);
+	}
+
+	if (cache->data == NULL || cache->size == 0) {
+		return 0;
+	}
+	length = (cache->size + page - 1) & ~(page - 1);
+	usage->mapped = length;
+
+	// Heap buffers may not start on a page boundary
+	if (((uintptr_t) cache->data & (page - 1)) != 0) {
+		usage->resident = cache->size;
+		return 0;
+	}
+	pages = length / page;
+	vector = (unsigned char*) malloc(pages);
+	if (vector == NULL) {
+		error("Unable to allocate memory for residency vector\n");
+		return -1;
+	}
+	if (mincore(cache->data, length, vector) < 0) {
+		error("Unable to query residency of dyld cache\n");
+		free(vector);
+		return -1;
+	}
+	for (i = 0; i < pages; i++) {
+		if (vector[i] & 1) {
+			usage->resident += page;
+		}
+	}
+	free(vector);
+	return 0;
+}
+
+dyldcache_range_t dyldcache_metadata_range(dyldcache_t* cache) {
+	uint32_t i = 0;
+	uint64_t end = DYLDCACHE_HEADER_SIZE;
+	uint64_t offset = 0;
+	dyldcache_range_t range;
+
+	// Header, mapping and image tables, and the install paths after them
+	if (cache->header) {
+		offset = cache->header->mapping_offset + (uint64_t) cache->header->mapping_count * sizeof(dyldmap_info_t);
+		if (offset > end) end = offset;
+		offset = cache->header->images_offset + (uint64_t) cache->header->images_count * sizeof(dyldimage_info_t);
+		if (offset > end) end = offset;
+	}
+	if (cache->images) {
+		for (i = 0; i < cache->count; i++) {
+			offset = (cache->images[i]->path - (char*) cache->data) + strlen(cache->images[i]->path) + 1;
+			if (offset > end) end = offset;
+		}
+	}
+	if (end > cache->size) {
+		end = cache->size;
+	}
+	range.offset = 0;
+	range.size = end;
+	return range;
+}
+
+/*
+ * kAdviseDontNeed drops the range's pages, which read back from the file
+ *  afterwards. On a mapped cache that also drops anything written to
+ *  them, so don't advise it on ranges that have been patched.
+ */
+int dyldcache_advise(dyldcache_t* cache, dyldcache_range_t range, dyldcache_advice_t advice) {
+	debug("Advising kernel of dyld cache access pattern\n");
+	int flag = 0;
+	uint64_t page = dyldcache_page_size();
+	uint64_t start = 0;
+	uint64_t end = 0;
+
+	if (cache == NULL || cache->data == NULL || range.offset >= cache->size) {
+		return -1;
+	}
+	if (range.size > cache->size - range.offset) {
+		range.size = cache->size - range.offset;
+	}
+
+	if (cache->seekable) {
+		// Residency of compressed caches is managed by the seekable budget
+		if (advice == kAdviseWillNeed) {
+			return dyldseekable_load(cache->seekable, range.offset, range.size, 0);
+		}
+		if (advice == kAdviseDontNeed) {
+			return 0;
+		}
+	} else if (!cache->mapped && advice == kAdviseDontNeed) {
+		// Dropping pages of a heap copy would zero them
+		return 0;
+	} else if (advice == kAdviseDontNeed && range.offset < cache->anonymous) {
+		// And so would dropping the huge page copy of the metadata
+		if (range.offset + range.size <= cache->anonymous) {
+			return 0;
+		}
+		range.size -= cache->anonymous - range.offset;
+		range.offset = cache->anonymous;
+	}
+
+	switch (advice) {
+	case kAdviseNormal:
+		flag = MADV_NORMAL;
+		break;
+	case kAdviseSequential:
+		flag = MADV_SEQUENTIAL;
+		break;
+	case kAdviseRandom:
+		flag = MADV_RANDOM;
+		break;
+	case kAdviseWillNeed:
+		flag = MADV_WILLNEED;
+		break;
+	case kAdviseDontNeed:
+		flag = MADV_DONTNEED;
+		break;
+	case kAdviseHugePages:
+		if (cache->mapped) {
+			return dyldcache_advise_huge(cache, range);
+		}
+#ifdef MADV_HUGEPAGE
+		flag = MADV_HUGEPAGE;
+		break;
+#else
+		return -1;
+#endif
+	default:
+		return -1;
+	}
+
+	start = ((uintptr_t) cache->data + range.offset) & ~(page - 1);
+	end = ((uintptr_t) cache->data + range.offset + range.size + page - 1) & ~(page - 1);
+	if (!cache->mapped && !cache->seekable) {
+		// Stay inside the heap buffer
+		start = ((uintptr_t) cache->data + range.offset + page - 1) & ~(page - 1);
+		end = ((uintptr_t) cache->data + range.offset + range.size) & ~(page - 1);
+		if (end <= start) {
+			return 0;
+		}
+	}
+	if (madvise((void*) (uintptr_t) start, end - start, flag) < 0) {
+		debug("Kernel refused advice %d for dyld cache range\n", advice);
+		return -1;
+	}
+	return 0;
+}
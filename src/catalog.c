@@ -0,0 +1,360 @@
+/**
+  * libdyldcache-1.0 - catalog.c
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libmacho-1.0/macho.h>
+
+#define _DEBUG
+#include <libcrippy-1.0/debug.h>
+#include <libcrippy-1.0/libcrippy.h>
+
+#include <libdyldcache-1.0/map.h>
+#include <libdyldcache-1.0/image.h>
+#include <libdyldcache-1.0/cache.h>
+#include <libdyldcache-1.0/pool.h>
+#include <libdyldcache-1.0/catalog.h>
+
+typedef struct dyldcache_catalog_query_t {
+	dyldcache_catalog_t* catalog;
+	dyldcache_catalog_ref_t* refs;
+	const char* symbol;
+	uint64_t* addresses;
+} dyldcache_catalog_query_t;
+
+static uint32_t dyldcache_catalog_hash(const char* path) {
+	uint32_t hash = 2166136261u;
+	while (*path) {
+		hash ^= (uint8_t) *path++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static void dyldcache_catalog_open_func(uint32_t index, uint32_t worker, void* userdata) {
+	dyldcache_catalog_t* catalog = (dyldcache_catalog_t*) userdata;
+	catalog->caches[index] = dyldcache_open(catalog->files[index]);
+	if (catalog->caches[index] == NULL) {
+		error("Unable to open dyld cache %s\n", catalog->files[index]);
+	}
+}
+
+static int dyldcache_catalog_grow(dyldcache_catalog_t* catalog) {
+	uint32_t i = 0;
+	uint32_t slot = 0;
+	uint32_t size = (catalog->mask + 1) * 2;
+	uint32_t* table = (uint32_t*) calloc(size, sizeof(uint32_t));
+	if (table == NULL) {
+		return -1;
+	}
+	for (i = 0; i < catalog->path_count; i++) {
+		slot = dyldcache_catalog_hash(catalog->strings + catalog->names[i]) & (size - 1);
+		while (table[slot] != 0) {
+			slot = (slot + 1) & (size - 1);
+		}
+		table[slot] = i + 1;
+	}
+	free(catalog->table);
+	catalog->table = table;
+	catalog->mask = size - 1;
+	return 0;
+}
+
+/*
+ * Returns the id of path in the string pool, adding it if it is new
+ */
+static int dyldcache_catalog_intern(dyldcache_catalog_t* catalog, const char* path, uint64_t* capacity) {
+	uint32_t slot = dyldcache_catalog_hash(path) & catalog->mask;
+	uint32_t entry = 0;
+	uint64_t length = strlen(path) + 1;
+	uint64_t* names = NULL;
+	char* strings = NULL;
+
+	while ((entry = catalog->table[slot]) != 0) {
+		if (!strcmp(catalog->strings + catalog->names[entry - 1], path)) {
+			return entry - 1;
+		}
+		slot = (slot + 1) & catalog->mask;
+	}
+
+	if (catalog->strings_size + length > capacity[0]) {
+		capacity[0] = (capacity[0] + length) * 2;
+		strings = (char*) realloc(catalog->strings, capacity[0]);
+		if (strings == NULL) {
+			return -1;
+		}
+		catalog->strings = strings;
+	}
+	if (catalog->path_count == capacity[1]) {
+		capacity[1] = capacity[1] ? capacity[1] * 2 : 1024;
+		names = (uint64_t*) realloc(catalog->names, capacity[1] * sizeof(uint64_t));
+		if (names == NULL) {
+			return -1;
+		}
+		catalog->names = names;
+	}
+	memcpy(catalog->strings + catalog->strings_size, path, length);
+	catalog->names[catalog->path_count] = catalog->strings_size;
+	catalog->strings_size += length;
+	catalog->table[slot] = ++catalog->path_count;
+
+	// Keep the table at most half full
+	if (catalog->path_count * 2 > catalog->mask && dyldcache_catalog_grow(catalog) < 0) {
+		return -1;
+	}
+	return catalog->path_count - 1;
+}
+
+static int dyldcache_catalog_index(dyldcache_catalog_t* catalog) {
+	int id = 0;
+	uint32_t i = 0;
+	uint32_t j = 0;
+	uint32_t total = 0;
+	uint32_t* ids = NULL;
+	uint32_t* fill = NULL;
+	uint64_t capacity[2] = { 0, 0 };
+	dyldcache_t* cache = NULL;
+
+	for (i = 0; i < catalog->count; i++) {
+		if (catalog->caches[i]) {
+			total += catalog->caches[i]->count;
+		}
+	}
+	catalog->mask = 1023;
+	catalog->table = (uint32_t*) calloc(catalog->mask + 1, sizeof(uint32_t));
+	ids = (uint32_t*) malloc((total + 1) * sizeof(uint32_t));
+	if (catalog->table == NULL || ids == NULL) {
+		free(ids);
+		return -1;
+	}
+
+	// Intern every install path, in cache then image order
+	total = 0;
+	for (i = 0; i < catalog->count; i++) {
+		cache = catalog->caches[i];
+		for (j = 0; cache && j < cache->count; j++) {
+			id = dyldcache_catalog_intern(catalog, cache->images[j]->path, capacity);
+			if (id < 0) {
+				free(ids);
+				return -1;
+			}
+			ids[total++] = id;
+		}
+	}
+
+	catalog->ref_count = total;
+	catalog->first = (uint32_t*) calloc(catalog->path_count + 2, sizeof(uint32_t));
+	catalog->refs = (dyldcache_catalog_ref_t*) malloc((total + 1) * sizeof(dyldcache_catalog_ref_t));
+	fill = (uint32_t*) malloc((catalog->path_count + 1) * sizeof(uint32_t));
+	if (catalog->first == NULL || catalog->refs == NULL || fill == NULL) {
+		free(fill);
+		free(ids);
+		return -1;
+	}
+	for (i = 0; i < total; i++) {
+		catalog->first[ids[i] + 1]++;
+	}
+	for (i = 0; i < catalog->path_count; i++) {
+		catalog->first[i + 1] += catalog->first[i];
+	}
+	memcpy(fill, catalog->first, catalog->path_count * sizeof(uint32_t));
+
+	total = 0;
+	for (i = 0; i < catalog->count; i++) {
+		cache = catalog->caches[i];
+		for (j = 0; cache && j < cache->count; j++) {
+			id = ids[total++];
+			catalog->refs[fill[id]].cache = i;
+			catalog->refs[fill[id]].image = j;
+			fill[id]++;
+		}
+	}
+	free(fill);
+	free(ids);
+	return 0;
+}
+
+static void dyldcache_catalog_symbol_func(uint32_t index, uint32_t worker, void* userdata) {
+	dyldcache_catalog_query_t* query = (dyldcache_catalog_query_t*) userdata;
+	dyldcache_t* cache = query->catalog->caches[query->refs[index].cache];
+	dyldimage_t* image = cache->images[query->refs[index].image];
+	uint64_t size = 0;
+	unsigned char* data = NULL;
+	macho_t* macho = NULL;
+
+	query->addresses[index] = 0;
+	data = dyldcache_image_data(cache, image, &size);
+	if (data == NULL) {
+		return;
+	}
+	macho = macho_load(data, size > 0xFFFFFFFFULL ? 0xFFFFFFFFU : (uint32_t) size);
+	if (macho) {
+		query->addresses[index] = macho_lookup(macho, query->symbol);
+		macho_free(macho);
+	}
+}
+
+/*
+ * Dyldcache Catalog Functions
+ */
+dyldcache_catalog_t* dyldcache_catalog_create() {
+	debug("Creating dyld cache catalog\n");
+	dyldcache_catalog_t* catalog = (dyldcache_catalog_t*) malloc(sizeof(dyldcache_catalog_t));
+	if (catalog) {
+		memset(catalog, '\0', sizeof(dyldcache_catalog_t));
+	}
+	return catalog;
+}
+
+dyldcache_catalog_t* dyldcache_catalog_open(const char** files, uint32_t count, dyldpool_t* pool) {
+	debug("Opening dyld cache catalog\n");
+	uint32_t i = 0;
+	dyldpool_t* owned = NULL;
+	dyldcache_catalog_t* catalog = NULL;
+
+	if (files == NULL) {
+		return NULL;
+	}
+	catalog = dyldcache_catalog_create();
+	if (catalog == NULL) {
+		error("Unable to allocate memory for dyld cache catalog\n");
+		return NULL;
+	}
+	catalog->count = count;
+	catalog->files = (char**) calloc(count + 1, sizeof(char*));
+	catalog->caches = (dyldcache_t**) calloc(count + 1, sizeof(dyldcache_t*));
+	if (catalog->files == NULL || catalog->caches == NULL) {
+		error("Unable to allocate memory for dyld cache catalog\n");
+		dyldcache_catalog_free(catalog);
+		return NULL;
+	}
+	for (i = 0; i < count; i++) {
+		catalog->files[i] = strdup(files[i]);
+	}
+
+	// Opening is mostly page faults and header parsing, one cache per task
+	if (pool == NULL) {
+		pool = owned = dyldpool_create(0);
+	}
+	dyldpool_run(pool, count, dyldcache_catalog_open_func, catalog);
+	if (owned) {
+		dyldpool_free(owned);
+	}
+
+	if (dyldcache_catalog_index(catalog) < 0) {
+		error("Unable to allocate memory for dyld cache catalog index\n");
+		dyldcache_catalog_free(catalog);
+		return NULL;
+	}
+	debug("Cataloged %u install paths across %u caches\n", catalog->path_count, count);
+	return catalog;
+}
+
+int dyldcache_catalog_path(dyldcache_catalog_t* catalog, const char* path) {
+	uint32_t slot = 0;
+	uint32_t entry = 0;
+	if (catalog == NULL || catalog->table == NULL || path == NULL) {
+		return -1;
+	}
+	slot = dyldcache_catalog_hash(path) & catalog->mask;
+	while ((entry = catalog->table[slot]) != 0) {
+		if (!strcmp(catalog->strings + catalog->names[entry - 1], path)) {
+			return entry - 1;
+		}
+		slot = (slot + 1) & catalog->mask;
+	}
+	return -1;
+}
+
+dyldcache_catalog_ref_t* dyldcache_catalog_lookup(dyldcache_catalog_t* catalog, const char* path, uint32_t* count) {
+	int id = dyldcache_catalog_path(catalog, path);
+	*count = 0;
+	if (id < 0) {
+		return NULL;
+	}
+	*count = catalog->first[id + 1] - catalog->first[id];
+	return &catalog->refs[catalog->first[id]];
+}
+
+/*
+ * Looks symbol up in every cache's copy of the image at path. Returns
+ *  its address in each of the count refs dyldcache_catalog_lookup()
+ *  gives for path, 0 where the image doesn't define it.
+ */
+uint64_t* dyldcache_catalog_symbol(dyldcache_catalog_t* catalog, const char* path, const char* symbol, dyldpool_t* pool, uint32_t* count) {
+	debug("Looking up symbol across dyld cache catalog\n");
+	dyldpool_t* owned = NULL;
+	dyldcache_catalog_query_t query;
+
+	memset(&query, '\0', sizeof(query));
+	query.refs = dyldcache_catalog_lookup(catalog, path, count);
+	if (query.refs == NULL || symbol == NULL) {
+		return NULL;
+	}
+	query.catalog = catalog;
+	query.symbol = symbol;
+	query.addresses = (uint64_t*) calloc(*count + 1, sizeof(uint64_t));
+	if (query.addresses == NULL) {
+		error("Unable to allocate memory for catalog symbol lookup\n");
+		return NULL;
+	}
+	if (pool == NULL) {
+		pool = owned = dyldpool_create(0);
+	}
+	dyldpool_run(pool, *count, dyldcache_catalog_symbol_func, &query);
+	if (owned) {
+		dyldpool_free(owned);
+	}
+	return query.addresses;
+}
+
+void dyldcache_catalog_debug(dyldcache_catalog_t* catalog) {
+	uint32_t i = 0;
+	if (catalog) {
+		debug("\tCatalog:\n");
+		for (i = 0; i < catalog->count; i++) {
+			debug("\t\t%u: %s (%u images)\n", i, catalog->files[i], catalog->caches[i] ? catalog->caches[i]->count : 0);
+		}
+		debug("\t\tpaths = %u\n", catalog->path_count);
+		debug("\t\trefs = %u\n", catalog->ref_count);
+		debug("\t\tstrings = %llu bytes\n", (unsigned long long) catalog->strings_size);
+		debug("\n");
+	}
+}
+
+void dyldcache_catalog_free(dyldcache_catalog_t* catalog) {
+	debug("Freeing dyld cache catalog\n");
+	uint32_t i = 0;
+	if (catalog) {
+		for (i = 0; i < catalog->count; i++) {
+			if (catalog->caches) dyldcache_free(catalog->caches[i]);
+			if (catalog->files) free(catalog->files[i]);
+		}
+		free(catalog->caches);
+		free(catalog->files);
+		free(catalog->strings);
+		free(catalog->names);
+		free(catalog->first);
+		free(catalog->refs);
+		free(catalog->table);
+		free(catalog);
+	}
+}
@@ -0,0 +1,274 @@
+/**
+  * libdyldcache-1.0 - client.c
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define _DEBUG
+#include <libcrippy-1.0/debug.h>
+#include <libcrippy-1.0/libcrippy.h>
+
+#include <libdyldcache-1.0/client.h>
+
+static int dyldclient_send(int fd, const void* data, size_t size) {
+	ssize_t done = 0;
+	const unsigned char* cursor = (const unsigned char*) data;
+	while (size > 0) {
+		done = send(fd, cursor, size, MSG_NOSIGNAL);
+		if (done < 0 && errno == EINTR) {
+			continue;
+		}
+		if (done <= 0) {
+			return -1;
+		}
+		cursor += done;
+		size -= done;
+	}
+	return 0;
+}
+
+static int dyldclient_recv(int fd, void* data, size_t size) {
+	ssize_t done = 0;
+	unsigned char* cursor = (unsigned char*) data;
+	while (size > 0) {
+		done = recv(fd, cursor, size, 0);
+		if (done < 0 && errno == EINTR) {
+			continue;
+		}
+		if (done <= 0) {
+			return -1;
+		}
+		cursor += done;
+		size -= done;
+	}
+	return 0;
+}
+
+/*
+ * Sends one request and reads the whole response. The payload is
+ *  returned in a malloc'd buffer the caller owns.
+ */
+static int dyldclient_query(dyldclient_t* client, uint8_t op, const void* payload, uint32_t length,
+		dyldcached_response_t* response, unsigned char** data) {
+	dyldcached_request_t request;
+
+	*data = NULL;
+	memset(&request, '\0', sizeof(request));
+	request.magic = DYLDCACHED_MAGIC;
+	request.op = op;
+	request.cache = (uint8_t) client->cache;
+	request.length = length;
+	if (dyldclient_send(client->fd, &request, sizeof(request)) < 0 ||
+			(length > 0 && dyldclient_send(client->fd, payload, length) < 0)) {
+		error("Unable to send request to dyldcached\n");
+		return -1;
+	}
+
+	if (dyldclient_recv(client->fd, response, sizeof(*response)) < 0 ||
+			response->magic != DYLDCACHED_MAGIC) {
+		error("Unable to read response from dyldcached\n");
+		return -1;
+	}
+	if (response->length > 0) {
+		*data = (unsigned char*) malloc(response->length);
+		if (*data == NULL || dyldclient_recv(client->fd, *data, response->length) < 0) {
+			error("Unable to read response payload from dyldcached\n");
+			free(*data);
+			*data = NULL;
+			return -1;
+		}
+	}
+	return response->status;
+}
+
+static int dyldclient_records(dyldclient_t* client, uint8_t op, const void* payload, uint32_t length,
+		dyldclient_record_t** records, uint32_t* count) {
+	int err = 0;
+	uint32_t i = 0;
+	unsigned char* data = NULL;
+	unsigned char* cursor = NULL;
+	unsigned char* end = NULL;
+	dyldcached_record_t record;
+	dyldcached_response_t response;
+	dyldclient_record_t* result = NULL;
+
+	*records = NULL;
+	*count = 0;
+	err = dyldclient_query(client, op, payload, length, &response, &data);
+	if (err < 0) {
+		free(data);
+		return err;
+	}
+
+	result = (dyldclient_record_t*) calloc(response.count + 1, sizeof(dyldclient_record_t));
+	if (result == NULL) {
+		free(data);
+		return -1;
+	}
+	cursor = data;
+	end = data + response.length;
+	for (i = 0; i < response.count; i++) {
+		if (cursor + sizeof(record) > end) {
+			break;
+		}
+		memcpy(&record, cursor, sizeof(record));
+		cursor += sizeof(record);
+		if (cursor + record.image_length + record.symbol_length > end) {
+			break;
+		}
+		result[i].address = record.address;
+		result[i].image = record.image;
+		result[i].image_name = strndup((const char*) cursor, record.image_length);
+		cursor += record.image_length;
+		result[i].symbol = strndup((const char*) cursor, record.symbol_length);
+		cursor += record.symbol_length;
+	}
+	free(data);
+
+	*records = result;
+	*count = i;
+	return 0;
+}
+
+/*
+ * Dyld Client Functions
+ */
+dyldclient_t* dyldclient_connect(const char* path) {
+	debug("Connecting to dyldcached\n");
+	struct sockaddr_un address;
+	dyldclient_t* client = NULL;
+
+	if (path == NULL) {
+		path = getenv(DYLDCACHED_SOCKET_ENV);
+	}
+	if (path == NULL) {
+		path = DYLDCACHED_SOCKET;
+	}
+	if (strlen(path) >= sizeof(address.sun_path)) {
+		error("dyldcached socket path is too long\n");
+		return NULL;
+	}
+
+	client = (dyldclient_t*) malloc(sizeof(dyldclient_t));
+	if (client == NULL) {
+		error("Unable to allocate memory for dyld client\n");
+		return NULL;
+	}
+	memset(client, '\0', sizeof(dyldclient_t));
+	client->cache = -1;
+
+	memset(&address, '\0', sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+	client->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (client->fd < 0 || connect(client->fd, (struct sockaddr*) &address, sizeof(address)) < 0) {
+		debug("Unable to connect to dyldcached at %s\n", path);
+		dyldclient_free(client);
+		return NULL;
+	}
+	return client;
+}
+
+int dyldclient_open(dyldclient_t* client, const char* cache) {
+	debug("Selecting cache on dyldcached\n");
+	int err = 0;
+	uint32_t index = 0;
+	char resolved[PATH_MAX];
+	unsigned char* data = NULL;
+	dyldcached_response_t response;
+
+	if (client == NULL || cache == NULL) {
+		return -1;
+	}
+	// The daemon knows its caches by their real path
+	if (realpath(cache, resolved) == NULL) {
+		return -1;
+	}
+	err = dyldclient_query(client, DYLDCACHED_OP_OPEN, resolved, strlen(resolved), &response, &data);
+	if (err == 0 && data != NULL && response.length >= sizeof(uint32_t)) {
+		memcpy(&index, data, sizeof(uint32_t));
+		client->cache = (int) index;
+	} else {
+		err = -1;
+	}
+	free(data);
+	return err;
+}
+
+int dyldclient_symbol(dyldclient_t* client, const char* symbol, dyldclient_record_t** records, uint32_t* count) {
+	return dyldclient_records(client, DYLDCACHED_OP_SYMBOL, symbol, strlen(symbol), records, count);
+}
+
+int dyldclient_image_symbol(dyldclient_t* client, const char* dylib, const char* symbol, dyldclient_record_t** records, uint32_t* count) {
+	int err = 0;
+	size_t length = strlen(dylib) + 1 + strlen(symbol);
+	char* payload = (char*) malloc(length + 1);
+	if (payload == NULL) {
+		return -1;
+	}
+	// "<dylib>\0<symbol>"
+	strcpy(payload, dylib);
+	strcpy(payload + strlen(dylib) + 1, symbol);
+	err = dyldclient_records(client, DYLDCACHED_OP_IMAGE_SYMBOL, payload, length, records, count);
+	free(payload);
+	return err;
+}
+
+int dyldclient_address(dyldclient_t* client, uint64_t address, dyldclient_record_t** records, uint32_t* count) {
+	return dyldclient_records(client, DYLDCACHED_OP_ADDRESS, &address, sizeof(address), records, count);
+}
+
+int dyldclient_images(dyldclient_t* client, dyldclient_record_t** records, uint32_t* count) {
+	return dyldclient_records(client, DYLDCACHED_OP_IMAGES, NULL, 0, records, count);
+}
+
+int dyldclient_extract(dyldclient_t* client, const char* dylib, unsigned char** data, uint64_t* size) {
+	int err = 0;
+	dyldcached_response_t response;
+	err = dyldclient_query(client, DYLDCACHED_OP_EXTRACT, dylib, strlen(dylib), &response, data);
+	*size = (err == 0) ? response.length : 0;
+	return err;
+}
+
+void dyldclient_records_free(dyldclient_record_t* records, uint32_t count) {
+	uint32_t i = 0;
+	if (records) {
+		for (i = 0; i < count; i++) {
+			free(records[i].image_name);
+			free(records[i].symbol);
+		}
+		free(records);
+	}
+}
+
+void dyldclient_free(dyldclient_t* client) {
+	debug("Freeing dyld client\n");
+	if (client) {
+		if (client->fd >= 0) {
+			close(client->fd);
+		}
+		free(client);
+	}
+}
@@ -0,0 +1,440 @@
+/**
+  * libdyldcache-1.0 - codesign.c
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(HAVE_OPENSSL_EVP_H) && defined(HAVE_LIBCRYPTO)
+#include <openssl/evp.h>
+#define DYLDCODESIGN_OPENSSL
+#endif
+
+#define _DEBUG
+#include <libcrippy-1.0/debug.h>
+#include <libcrippy-1.0/libcrippy.h>
+
+#include <libdyldcache-1.0/cache.h>
+#include <libdyldcache-1.0/pool.h>
+#include <libdyldcache-1.0/codesign.h>
+
+// Pages hashed by a worker per dispatch
+#define DYLDCODESIGN_BATCH  64
+
+typedef struct dyldcodesign_ctx_t {
+	dyldcache_t* cache;
+	dyldcodesign_t* codesign;
+	uint8_t* failed;
+} dyldcodesign_ctx_t;
+
+static uint32_t dyldcodesign_be32(const unsigned char* data) {
+	return ((uint32_t) data[0] << 24) | ((uint32_t) data[1] << 16) |
+			((uint32_t) data[2] << 8) | (uint32_t) data[3];
+}
+
+static uint64_t dyldcodesign_be64(const unsigned char* data) {
+	return ((uint64_t) dyldcodesign_be32(data) << 32) | dyldcodesign_be32(data + 4);
+}
+
+#ifndef DYLDCODESIGN_OPENSSL
+/*
+ * Portable digests, only used when libcrypto (and with it the SHA-NI and
+ *  AVX2 code paths) isn't available.
+ */
+#define ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define ROL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static const uint32_t dyldcodesign_sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static void dyldcodesign_sha256_block(uint32_t* state, const unsigned char* block) {
+	int i = 0;
+	uint32_t w[64];
+	uint32_t a, b, c, d, e, f, g, h, t1, t2;
+
+	for (i = 0; i < 16; i++) {
+		w[i] = dyldcodesign_be32(block + i * 4);
+	}
+	for (i = 16; i < 64; i++) {
+		w[i] = w[i - 16] + (ROR32(w[i - 15], 7) ^ ROR32(w[i - 15], 18) ^ (w[i - 15] >> 3)) +
+				w[i - 7] + (ROR32(w[i - 2], 17) ^ ROR32(w[i - 2], 19) ^ (w[i - 2] >> 10));
+	}
+	a = state[0]; b = state[1]; c = state[2]; d = state[3];
+	e = state[4]; f = state[5]; g = state[6]; h = state[7];
+	for (i = 0; i < 64; i++) {
+		t1 = h + (ROR32(e, 6) ^ ROR32(e, 11) ^ ROR32(e, 25)) + ((e & f) ^ (~e & g)) +
+				dyldcodesign_sha256_k[i] + w[i];
+		t2 = (ROR32(a, 2) ^ ROR32(a, 13) ^ ROR32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+	state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+	state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+static void dyldcodesign_sha1_block(uint32_t* state, const unsigned char* block) {
+	int i = 0;
+	uint32_t w[80];
+	uint32_t a, b, c, d, e, f, k, t;
+
+	for (i = 0; i < 16; i++) {
+		w[i] = dyldcodesign_be32(block + i * 4);
+	}
+	for (i = 16; i < 80; i++) {
+		w[i] = ROL32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+	}
+	a = state[0]; b = state[1]; c = state[2]; d = state[3]; e = state[4];
+	for (i = 0; i < 80; i++) {
+		if (i < 20) {
+			f = (b & c) | (~b & d);
+			k = 0x5A827999;
+		} else if (i < 40) {
+			f = b ^ c ^ d;
+			k = 0x6ED9EBA1;
+		} else if (i < 60) {
+			f = (b & c) | (b & d) | (c & d);
+			k = 0x8F1BBCDC;
+		} else {
+			f = b ^ c ^ d;
+			k = 0xCA62C1D6;
+		}
+		t = ROL32(a, 5) + f + e + k + w[i];
+		e = d; d = c; c = ROL32(b, 30); b = a; a = t;
+	}
+	state[0] += a; state[1] += b; state[2] += c; state[3] += d; state[4] += e;
+}
+
+// Merkle-Damgard padding shared by both digests
+static void dyldcodesign_digest(uint32_t* state, uint32_t words, void (*block)(uint32_t*, const unsigned char*),
+		const unsigned char* data, uint64_t size, unsigned char* out) {
+	uint32_t i = 0;
+	uint64_t done = 0;
+	uint64_t rest = 0;
+	unsigned char tail[128];
+
+	for (done = 0; size - done >= 64; done += 64) {
+		block(state, data + done);
+	}
+	rest = size - done;
+	memset(tail, '\0', sizeof(tail));
+	memcpy(tail, data + done, rest);
+	tail[rest] = 0x80;
+	rest = (rest < 56) ? 64 : 128;
+	for (i = 0; i < 8; i++) {
+		tail[rest - 1 - i] = (unsigned char) ((size * 8) >> (i * 8));
+	}
+	block(state, tail);
+	if (rest == 128) {
+		block(state, tail + 64);
+	}
+	for (i = 0; i < words; i++) {
+		out[i * 4] = state[i] >> 24;
+		out[i * 4 + 1] = state[i] >> 16;
+		out[i * 4 + 2] = state[i] >> 8;
+		out[i * 4 + 3] = state[i];
+	}
+}
+#endif
+
+static int dyldcodesign_hash(uint8_t type, const unsigned char* data, uint64_t size, unsigned char* out) {
+#ifdef DYLDCODESIGN_OPENSSL
+	const EVP_MD* md = (type == CS_HASHTYPE_SHA1) ? EVP_sha1() : EVP_sha256();
+	return EVP_Digest(data, size, out, NULL, md, NULL) == 1 ? 0 : -1;
+#else
+	uint32_t state[8];
+	if (type == CS_HASHTYPE_SHA1) {
+		state[0] = 0x67452301; state[1] = 0xEFCDAB89; state[2] = 0x98BADCFE;
+		state[3] = 0x10325476; state[4] = 0xC3D2E1F0;
+		dyldcodesign_digest(state, 5, dyldcodesign_sha1_block, data, size, out);
+	} else {
+		state[0] = 0x6a09e667; state[1] = 0xbb67ae85; state[2] = 0x3c6ef372; state[3] = 0xa54ff53a;
+		state[4] = 0x510e527f; state[5] = 0x9b05688c; state[6] = 0x1f83d9ab; state[7] = 0x5be0cd19;
+		dyldcodesign_digest(state, 8, dyldcodesign_sha256_block, data, size, out);
+	}
+	return 0;
+#endif
+}
+
+static int dyldcodesign_rank(uint8_t type) {
+	switch (type) {
+	case CS_HASHTYPE_SHA256:
+		return 3;
+	case CS_HASHTYPE_SHA256_TRUNC:
+		return 2;
+	case CS_HASHTYPE_SHA1:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static void dyldcodesign_verify_func(uint32_t index, uint32_t worker, void* userdata) {
+	dyldcodesign_ctx_t* ctx = (dyldcodesign_ctx_t*) userdata;
+	dyldcodesign_t* codesign = ctx->codesign;
+	uint32_t page = 0;
+	uint32_t last = 0;
+	uint64_t offset = 0;
+	uint64_t length = 0;
+	unsigned char digest[32];
+
+	page = index * DYLDCODESIGN_BATCH;
+	last = page + DYLDCODESIGN_BATCH;
+	if (last > codesign->count) {
+		last = codesign->count;
+	}
+	for (; page < last; page++) {
+		offset = (uint64_t) page * codesign->page_size;
+		length = codesign->limit - offset;
+		if (length > codesign->page_size) {
+			length = codesign->page_size;
+		}
+		if (dyldcache_fetch(ctx->cache, offset, length) < 0 ||
+				dyldcodesign_hash(codesign->hash_type, &ctx->cache->data[offset], length, digest) < 0 ||
+				memcmp(digest, &codesign->hashes[(uint64_t) page * codesign->hash_size], codesign->hash_size) != 0) {
+			ctx->failed[page] = 1;
+		}
+	}
+}
+
+/*
+ * Dyld Codesign Functions
+ */
+dyldcodesign_t* dyldcodesign_create() {
+	debug("Creating dyld codesign structure\n");
+	dyldcodesign_t* codesign = (dyldcodesign_t*) malloc(sizeof(dyldcodesign_t));
+	if (codesign) {
+		memset(codesign, '\0', sizeof(dyldcodesign_t));
+	}
+	return codesign;
+}
+
+dyldcodesign_t* dyldcodesign_load(dyldcache_t* cache) {
+	debug("Loading dyld cache code directory\n");
+	uint32_t i = 0;
+	uint32_t type = 0;
+	uint32_t count = 0;
+	uint32_t offset = 0;
+	uint32_t length = 0;
+	uint32_t version = 0;
+	uint32_t hashes = 0;
+	uint32_t ident = 0;
+	uint64_t size = 0;
+	uint64_t limit = 0;
+	unsigned char* blob = NULL;
+	unsigned char* best = NULL;
+	unsigned char* directory = NULL;
+	dyldcodesign_t* codesign = NULL;
+
+	if (cache == NULL || cache->header == NULL) {
+		return NULL;
+	}
+	size = cache->header->codesign_size;
+	if (cache->header->codesign_offset == 0 || size < 12 ||
+			dyldcache_fetch(cache, cache->header->codesign_offset, size) < 0) {
+		error("Dyld cache carries no code signature\n");
+		return NULL;
+	}
+	blob = &cache->data[cache->header->codesign_offset];
+	if (dyldcodesign_be32(blob) != CSMAGIC_EMBEDDED_SIGNATURE) {
+		error("Unknown code signature magic 0x%08x\n", dyldcodesign_be32(blob));
+		return NULL;
+	}
+	length = dyldcodesign_be32(blob + 4);
+	if (length < size) {
+		size = length;
+	}
+	count = dyldcodesign_be32(blob + 8);
+	if (count > (size - 12) / 8) {
+		error("Code signature index is truncated\n");
+		return NULL;
+	}
+
+	for (i = 0; i < count; i++) {
+		type = dyldcodesign_be32(blob + 12 + i * 8);
+		offset = dyldcodesign_be32(blob + 16 + i * 8);
+		if (type != CSSLOT_CODEDIRECTORY && (type < CSSLOT_ALTERNATE || type >= CSSLOT_ALTERNATE + 5)) {
+			continue;
+		}
+		if (offset > size || size - offset < 44) {
+			continue;
+		}
+		directory = blob + offset;
+		if (dyldcodesign_be32(directory) != CSMAGIC_CODEDIRECTORY ||
+				dyldcodesign_be32(directory + 4) > size - offset) {
+			continue;
+		}
+		if (best == NULL || dyldcodesign_rank(directory[37]) > dyldcodesign_rank(best[37])) {
+			best = directory;
+		}
+	}
+	if (best == NULL || dyldcodesign_rank(best[37]) == 0) {
+		error("Unable to find a supported code directory\n");
+		return NULL;
+	}
+
+	codesign = dyldcodesign_create();
+	if (codesign == NULL) {
+		error("Unable to allocate memory for dyld codesign\n");
+		return NULL;
+	}
+	length = dyldcodesign_be32(best + 4);
+	version = dyldcodesign_be32(best + 8);
+	hashes = dyldcodesign_be32(best + 16);
+	ident = dyldcodesign_be32(best + 20);
+	codesign->version = version;
+	codesign->flags = dyldcodesign_be32(best + 12);
+	codesign->count = dyldcodesign_be32(best + 28);
+	codesign->hash_size = best[36];
+	codesign->hash_type = best[37];
+	limit = dyldcodesign_be32(best + 32);
+	if (version >= 0x20300 && length >= 64 && dyldcodesign_be64(best + 56) != 0) {
+		limit = dyldcodesign_be64(best + 56);
+	}
+	codesign->limit = limit;
+	// A page size of zero means the whole range is one page
+	codesign->page_size = best[39] ? (1U << best[39]) : (uint32_t) limit;
+
+	if (codesign->hash_size == 0 || codesign->hash_size > 32 || codesign->page_size == 0 ||
+			limit > cache->size || hashes > length ||
+			(uint64_t) codesign->count * codesign->hash_size > length - hashes ||
+			(uint64_t) codesign->count * codesign->page_size < limit ||
+			(codesign->count > 0 && (uint64_t) (codesign->count - 1) * codesign->page_size >= limit)) {
+		error("Malformed code directory\n");
+		dyldcodesign_free(codesign);
+		return NULL;
+	}
+
+	// Copied out so compressed caches are free to evict the signature
+	codesign->hashes = (unsigned char*) malloc((uint64_t) codesign->count * codesign->hash_size + 1);
+	if (codesign->hashes == NULL) {
+		error("Unable to allocate memory for code directory hashes\n");
+		dyldcodesign_free(codesign);
+		return NULL;
+	}
+	memcpy(codesign->hashes, best + hashes, (uint64_t) codesign->count * codesign->hash_size);
+	if (ident > 0 && ident < length) {
+		codesign->identifier = strndup((const char*) best + ident, length - ident);
+	}
+
+	dyldcodesign_debug(codesign);
+	return codesign;
+}
+
+int dyldcodesign_verify(dyldcodesign_t* codesign, dyldcache_t* cache, dyldpool_t* pool) {
+	debug("Verifying dyld cache page hashes\n");
+	uint32_t i = 0;
+	uint32_t found = 0;
+	uint32_t tasks = 0;
+	dyldpool_t* owned = NULL;
+	dyldcodesign_ctx_t ctx;
+
+	if (codesign == NULL || cache == NULL) {
+		return -1;
+	}
+	free(codesign->mismatches);
+	codesign->mismatches = NULL;
+	codesign->mismatch_count = 0;
+
+	memset(&ctx, '\0', sizeof(ctx));
+	ctx.cache = cache;
+	ctx.codesign = codesign;
+	ctx.failed = (uint8_t*) calloc(codesign->count + 1, sizeof(uint8_t));
+	if (ctx.failed == NULL) {
+		error("Unable to allocate memory for page verification\n");
+		return -1;
+	}
+
+	if (pool == NULL) {
+		pool = owned = dyldpool_create(0);
+	}
+	tasks = (codesign->count + DYLDCODESIGN_BATCH - 1) / DYLDCODESIGN_BATCH;
+	dyldcache_hold(cache);
+	dyldpool_run(pool, tasks, dyldcodesign_verify_func, &ctx);
+	dyldcache_release(cache);
+	if (owned) {
+		dyldpool_free(owned);
+	}
+
+	for (i = 0; i < codesign->count; i++) {
+		found += ctx.failed[i];
+	}
+	if (found > 0) {
+		codesign->mismatches = (uint32_t*) malloc(found * sizeof(uint32_t));
+		if (codesign->mismatches == NULL) {
+			error("Unable to allocate memory for mismatching pages\n");
+			free(ctx.failed);
+			return -1;
+		}
+		for (i = 0; i < codesign->count; i++) {
+			if (ctx.failed[i]) {
+				codesign->mismatches[codesign->mismatch_count++] = i;
+			}
+		}
+	}
+	free(ctx.failed);
+	return codesign->mismatch_count;
+}
+
+const char* dyldcodesign_hash_name(uint8_t type) {
+	switch (type) {
+	case CS_HASHTYPE_SHA1:
+		return "sha1";
+	case CS_HASHTYPE_SHA256:
+		return "sha256";
+	case CS_HASHTYPE_SHA256_TRUNC:
+		return "sha256-truncated";
+	default:
+		return "unknown";
+	}
+}
+
+void dyldcodesign_debug(dyldcodesign_t* codesign) {
+	if (codesign) {
+		debug("\tCode Directory:\n");
+		debug("\t\tidentifier = %s\n", codesign->identifier ? codesign->identifier : "");
+		debug("\t\tversion = 0x%x\n", codesign->version);
+		debug("\t\thash = %s\n", dyldcodesign_hash_name(codesign->hash_type));
+		debug("\t\tpage_size = %u\n", codesign->page_size);
+		debug("\t\tpages = %u\n", codesign->count);
+		debug("\t\tlimit = 0x%llx\n", (unsigned long long) codesign->limit);
+		debug("\n");
+	}
+}
+
+void dyldcodesign_free(dyldcodesign_t* codesign) {
+	debug("Freeing dyld codesign structure\n");
+	if (codesign) {
+		free(codesign->identifier);
+		free(codesign->hashes);
+		free(codesign->mismatches);
+		free(codesign);
+	}
+}
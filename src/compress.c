@@ -0,0 +1,481 @@
+/**
+  * libdyldcache-1.0 - compress.c
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+#define _DEBUG
+#include <libcrippy-1.0/debug.h>
+#include <libcrippy-1.0/libcrippy.h>
+
+#include <libdyldcache-1.0/image.h>
+#include <libdyldcache-1.0/cache.h>
+#include <libdyldcache-1.0/pool.h>
+#include <libdyldcache-1.0/compress.h>
+
+#define TAR_BLOCK 512
+#define DYLDCOMPRESS_PATH_MAX 1024
+#define DYLDCOMPRESS_HEADER_MAX (TAR_BLOCK * 2 + DYLDCOMPRESS_PATH_MAX + TAR_BLOCK)
+#define DYLDCOMPRESS_SLOT_MAX (4 * 1024 * 1024)
+
+#ifdef HAVE_LIBZSTD
+typedef struct dyldcompress_ctx_t {
+	dyldcompress_t* compress;
+	dyldcache_t* cache;
+	dyldimage_t** images;
+	const char* directory;
+	uint32_t base;
+	volatile uint32_t failed;
+} dyldcompress_ctx_t;
+
+static int dyldcompress_write_all(int fd, const unsigned char* data, uint64_t size) {
+	ssize_t done = 0;
+	while (size > 0) {
+		done = write(fd, data, size);
+		if (done < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		data += done;
+		size -= done;
+	}
+	return 0;
+}
+
+static void dyldcompress_tar_block(unsigned char* block, const char* name, uint64_t size, char type) {
+	uint32_t i = 0;
+	uint32_t sum = 0;
+	size_t length = strlen(name);
+
+	memset(block, '\0', TAR_BLOCK);
+	memcpy(block, name, length > 100 ? 100 : length);
+	snprintf((char*) block + 100, 8, "%07o", 0644);
+	snprintf((char*) block + 108, 8, "%07o", 0);
+	snprintf((char*) block + 116, 8, "%07o", 0);
+	snprintf((char*) block + 124, 12, "%011llo", (unsigned long long) size);
+	snprintf((char*) block + 136, 12, "%011o", 0);
+	block[156] = type;
+	memcpy(block + 257, "ustar", 6);
+	memcpy(block + 263, "00", 2);
+
+	memset(block + 148, ' ', 8);
+	for (i = 0; i < TAR_BLOCK; i++) {
+		sum += block[i];
+	}
+	snprintf((char*) block + 148, 8, "%06o", sum);
+	block[155] = ' ';
+}
+
+/*
+ * Builds the tar header for an install path. Paths longer than the
+ *  ustar name field get a pax extended header in front. Returns the
+ *  number of header bytes, always a multiple of the block size.
+ */
+static int dyldcompress_tar_header(unsigned char* header, const char* path, uint64_t size) {
+	int digits = 0;
+	int length = 0;
+	int record = 0;
+	int padded = 0;
+
+	while (*path == '/') {
+		path++;
+	}
+	length = strlen(path);
+	if (length <= 100) {
+		dyldcompress_tar_block(header, path, size, '0');
+		return TAR_BLOCK;
+	}
+	if (length > DYLDCOMPRESS_PATH_MAX) {
+		return -1;
+	}
+
+	// "<len> path=<path>\n" where <len> counts its own digits too
+	record = length + 7;
+	digits = snprintf(NULL, 0, "%d", record);
+	if (snprintf(NULL, 0, "%d", record + digits) > digits) {
+		digits++;
+	}
+	record += digits;
+	padded = (record + TAR_BLOCK - 1) & ~(TAR_BLOCK - 1);
+
+	dyldcompress_tar_block(header, "././@PaxHeader", record, 'x');
+	memset(header + TAR_BLOCK, '\0', padded);
+	snprintf((char*) header + TAR_BLOCK, record + 1, "%d path=%s\n", record, path);
+	dyldcompress_tar_block(header + TAR_BLOCK + padded, path + length - 100, size, '0');
+	return TAR_BLOCK + padded + TAR_BLOCK;
+}
+
+static void dyldcompress_save_func(uint32_t index, uint32_t worker, void* userdata) {
+	int fd = -1;
+	int err = 0;
+	size_t left = 0;
+	uint64_t size = 0;
+	char* path = NULL;
+	unsigned char* data = NULL;
+	dyldcompress_ctx_t* ctx = (dyldcompress_ctx_t*) userdata;
+	dyldcompress_t* compress = ctx->compress;
+	dyldimage_t* image = ctx->images[index];
+	ZSTD_CCtx* cctx = (ZSTD_CCtx*) compress->contexts[worker];
+	ZSTD_inBuffer input;
+	ZSTD_outBuffer output;
+
+	data = dyldcache_image_extent(ctx->cache, image, &size);
+	if (data == NULL) {
+		__sync_fetch_and_add(&ctx->failed, 1);
+		return;
+	}
+
+	path = (char*) malloc(strlen(ctx->directory) + strlen(image->name) + 6);
+	if (path == NULL) {
+		__sync_fetch_and_add(&ctx->failed, 1);
+		return;
+	}
+	sprintf(path, "%s/%s.zst", ctx->directory, image->name);
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		error("Unable to open %s: %s\n", path, strerror(errno));
+		__sync_fetch_and_add(&ctx->failed, 1);
+		free(path);
+		return;
+	}
+
+	// Feed the image straight from the cache mapping, only the
+	//  compressed output passes through the worker's buffer
+	ZSTD_CCtx_reset(cctx, ZSTD_reset_session_only);
+	ZSTD_CCtx_setPledgedSrcSize(cctx, size);
+	input.src = data;
+	input.size = size;
+	input.pos = 0;
+	do {
+		output.dst = compress->buffers[worker];
+		output.size = ZSTD_CStreamOutSize();
+		output.pos = 0;
+		left = ZSTD_compressStream2(cctx, &output, &input, ZSTD_e_end);
+		if (ZSTD_isError(left)) {
+			error("Unable to compress %s: %s\n", image->name, ZSTD_getErrorName(left));
+			err = -1;
+			break;
+		}
+		if (dyldcompress_write_all(fd, output.dst, output.pos) < 0) {
+			error("Unable to write %s: %s\n", path, strerror(errno));
+			err = -1;
+			break;
+		}
+	} while (left != 0);
+
+	if (close(fd) < 0) {
+		err = -1;
+	}
+	if (err < 0) {
+		__sync_fetch_and_add(&ctx->failed, 1);
+	}
+	free(path);
+}
+
+/*
+ * Appends to the slot, growing it whenever zstd fills it up. Slots start
+ *  out capped at DYLDCOMPRESS_SLOT_MAX, so only members that really
+ *  compress to more than that cost more memory.
+ */
+static int dyldcompress_stream(ZSTD_CCtx* cctx, dyldcompress_slot_t* slot, const void* data, size_t size, ZSTD_EndDirective mode) {
+	size_t left = 0;
+	unsigned char* buffer = NULL;
+	ZSTD_inBuffer input;
+	ZSTD_outBuffer output;
+
+	input.src = data;
+	input.size = size;
+	input.pos = 0;
+	do {
+		if (slot->size == slot->capacity) {
+			buffer = (unsigned char*) realloc(slot->data, slot->capacity * 2);
+			if (buffer == NULL) {
+				error("Unable to allocate memory for archive member\n");
+				return -1;
+			}
+			slot->data = buffer;
+			slot->capacity *= 2;
+		}
+		output.dst = slot->data;
+		output.size = slot->capacity;
+		output.pos = slot->size;
+		left = ZSTD_compressStream2(cctx, &output, &input, mode);
+		if (ZSTD_isError(left)) {
+			error("Unable to compress archive member: %s\n", ZSTD_getErrorName(left));
+			return -1;
+		}
+		slot->size = output.pos;
+	} while ((mode == ZSTD_e_end && left != 0) || input.pos < input.size);
+	return 0;
+}
+
+/*
+ * Every archive member becomes its own zstd frame. Concatenated frames
+ *  decode as a single stream, so members compress independently and the
+ *  archive is still readable by a plain `zstd -d | tar x`.
+ */
+static void dyldcompress_archive_func(uint32_t index, uint32_t worker, void* userdata) {
+	int length = 0;
+	uint64_t size = 0;
+	uint64_t bound = 0;
+	uint64_t padding = 0;
+	unsigned char* data = NULL;
+	unsigned char* source = NULL;
+	unsigned char header[DYLDCOMPRESS_HEADER_MAX];
+	static const unsigned char zeros[TAR_BLOCK] = { 0 };
+	dyldcompress_ctx_t* ctx = (dyldcompress_ctx_t*) userdata;
+	dyldcompress_t* compress = ctx->compress;
+	dyldcompress_slot_t* slot = &compress->slots[index];
+	dyldimage_t* image = ctx->images[ctx->base + index];
+	ZSTD_CCtx* cctx = (ZSTD_CCtx*) compress->contexts[worker];
+
+	slot->size = 0;
+	slot->err = 0;
+	source = dyldcache_image_extent(ctx->cache, image, &size);
+	if (source == NULL) {
+		slot->err = -1;
+		return;
+	}
+	length = dyldcompress_tar_header(header, image->path, size);
+	if (length < 0) {
+		error("Install path too long for archive: %s\n", image->path);
+		slot->err = -1;
+		return;
+	}
+
+	padding = (TAR_BLOCK - (size % TAR_BLOCK)) % TAR_BLOCK;
+	bound = ZSTD_compressBound(length + size + padding);
+	if (bound > DYLDCOMPRESS_SLOT_MAX) {
+		bound = DYLDCOMPRESS_SLOT_MAX;
+	}
+	if (bound > slot->capacity) {
+		data = (unsigned char*) realloc(slot->data, bound);
+		if (data == NULL) {
+			error("Unable to allocate memory for archive member\n");
+			slot->err = -1;
+			return;
+		}
+		slot->data = data;
+		slot->capacity = bound;
+	}
+
+	ZSTD_CCtx_reset(cctx, ZSTD_reset_session_only);
+	ZSTD_CCtx_setPledgedSrcSize(cctx, length + size + padding);
+	if (dyldcompress_stream(cctx, slot, header, length, ZSTD_e_continue) < 0 ||
+			dyldcompress_stream(cctx, slot, source, size, ZSTD_e_continue) < 0 ||
+			dyldcompress_stream(cctx, slot, zeros, padding, ZSTD_e_end) < 0) {
+		slot->err = -1;
+	}
+}
+#endif
+
+/*
+ * Dyld Compress Functions
+ */
+dyldcompress_t* dyldcompress_create(int level, uint32_t threads) {
+	debug("Creating dyld compressor\n");
+#ifdef HAVE_LIBZSTD
+	uint32_t i = 0;
+	dyldcompress_t* compress = (dyldcompress_t*) malloc(sizeof(dyldcompress_t));
+	if (compress == NULL) {
+		error("Unable to allocate memory for dyld compressor\n");
+		return NULL;
+	}
+	memset(compress, '\0', sizeof(dyldcompress_t));
+	compress->level = level ? level : DYLDCOMPRESS_LEVEL;
+
+	compress->pool = dyldpool_create(threads);
+	if (compress->pool == NULL) {
+		dyldcompress_free(compress);
+		return NULL;
+	}
+
+	// A few images per worker keeps everyone busy while the finished
+	//  ones are written out in order
+	compress->window = compress->pool->count * 4;
+	compress->contexts = (void**) calloc(compress->pool->count, sizeof(void*));
+	compress->buffers = (unsigned char**) calloc(compress->pool->count, sizeof(unsigned char*));
+	compress->slots = (dyldcompress_slot_t*) calloc(compress->window, sizeof(dyldcompress_slot_t));
+	if (compress->contexts == NULL || compress->buffers == NULL || compress->slots == NULL) {
+		error("Unable to allocate memory for dyld compressor workers\n");
+		dyldcompress_free(compress);
+		return NULL;
+	}
+	for (i = 0; i < compress->pool->count; i++) {
+		compress->contexts[i] = ZSTD_createCCtx();
+		compress->buffers[i] = (unsigned char*) malloc(ZSTD_CStreamOutSize());
+		if (compress->contexts[i] == NULL || compress->buffers[i] == NULL) {
+			error("Unable to allocate memory for dyld compressor worker\n");
+			dyldcompress_free(compress);
+			return NULL;
+		}
+		ZSTD_CCtx_setParameter((ZSTD_CCtx*) compress->contexts[i], ZSTD_c_compressionLevel, compress->level);
+	}
+	return compress;
+#else
+	error("libdyldcache was built without zstd support\n");
+	return NULL;
+#endif
+}
+
+int dyldcompress_save(dyldcompress_t* compress, dyldcache_t* cache, dyldimage_t** images, uint32_t count, const char* directory) {
+	debug("Saving compressed dyld images\n");
+#ifdef HAVE_LIBZSTD
+	dyldcompress_ctx_t ctx;
+	if (compress == NULL || cache == NULL || images == NULL) {
+		return -1;
+	}
+	memset(&ctx, '\0', sizeof(ctx));
+	ctx.compress = compress;
+	ctx.cache = cache;
+	ctx.images = images;
+	ctx.directory = directory ? directory : ".";
+	dyldcache_hold(cache);
+	dyldpool_run(compress->pool, count, dyldcompress_save_func, &ctx);
+	dyldcache_release(cache);
+	return ctx.failed == 0 ? 0 : -1;
+#else
+	return -1;
+#endif
+}
+
+int dyldcompress_archive(dyldcompress_t* compress, dyldcache_t* cache, dyldimage_t** images, uint32_t count, const char* path) {
+	debug("Archiving compressed dyld images\n");
+#ifdef HAVE_LIBZSTD
+	int fd = -1;
+	int err = 0;
+	uint32_t i = 0;
+	uint32_t batch = 0;
+	uint32_t failed = 0;
+	dyldcompress_ctx_t ctx;
+	dyldcompress_slot_t* slot = NULL;
+	unsigned char trailer[TAR_BLOCK * 2];
+
+	if (compress == NULL || cache == NULL || images == NULL || path == NULL) {
+		return -1;
+	}
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		error("Unable to open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	memset(&ctx, '\0', sizeof(ctx));
+	ctx.compress = compress;
+	ctx.cache = cache;
+	ctx.images = images;
+	for (ctx.base = 0; ctx.base < count && err == 0; ctx.base += batch) {
+		batch = count - ctx.base;
+		if (batch > compress->window) {
+			batch = compress->window;
+		}
+		dyldcache_hold(cache);
+		dyldpool_run(compress->pool, batch, dyldcompress_archive_func, &ctx);
+		dyldcache_release(cache);
+		for (i = 0; i < batch; i++) {
+			slot = &compress->slots[i];
+			if (slot->err < 0) {
+				// Leave the member out but keep the archive usable
+				failed++;
+				continue;
+			}
+			if (dyldcompress_write_all(fd, slot->data, slot->size) < 0) {
+				error("Unable to write %s: %s\n", path, strerror(errno));
+				err = -1;
+				break;
+			}
+			// Don't let one huge member pin its buffer for the rest of the run
+			if (slot->capacity > DYLDCOMPRESS_SLOT_MAX) {
+				free(slot->data);
+				slot->data = NULL;
+				slot->capacity = 0;
+			}
+		}
+	}
+
+	// End of archive marker, as its own frame
+	if (err == 0) {
+		slot = &compress->slots[0];
+		slot->size = 0;
+		if (slot->capacity < ZSTD_compressBound(sizeof(trailer))) {
+			slot->data = (unsigned char*) realloc(slot->data, ZSTD_compressBound(sizeof(trailer)));
+			slot->capacity = slot->data ? ZSTD_compressBound(sizeof(trailer)) : 0;
+		}
+		memset(trailer, '\0', sizeof(trailer));
+		ZSTD_CCtx_reset((ZSTD_CCtx*) compress->contexts[0], ZSTD_reset_session_only);
+		if (slot->data == NULL ||
+				dyldcompress_stream((ZSTD_CCtx*) compress->contexts[0], slot, trailer, sizeof(trailer), ZSTD_e_end) < 0 ||
+				dyldcompress_write_all(fd, slot->data, slot->size) < 0) {
+			err = -1;
+		}
+	}
+
+	if (close(fd) < 0) {
+		err = -1;
+	}
+	return (err == 0 && failed == 0) ? 0 : -1;
+#else
+	return -1;
+#endif
+}
+
+void dyldcompress_free(dyldcompress_t* compress) {
+	debug("Freeing dyld compressor\n");
+#ifdef HAVE_LIBZSTD
+	uint32_t i = 0;
+	if (compress) {
+		if (compress->pool) {
+			for (i = 0; i < compress->pool->count; i++) {
+				if (compress->contexts && compress->contexts[i]) {
+					ZSTD_freeCCtx((ZSTD_CCtx*) compress->contexts[i]);
+				}
+				if (compress->buffers && compress->buffers[i]) {
+					free(compress->buffers[i]);
+				}
+			}
+			dyldpool_free(compress->pool);
+			compress->pool = NULL;
+		}
+		if (compress->slots) {
+			for (i = 0; i < compress->window; i++) {
+				free(compress->slots[i].data);
+			}
+			free(compress->slots);
+			compress->slots = NULL;
+		}
+		free(compress->contexts);
+		free(compress->buffers);
+		free(compress);
+	}
+#endif
+}
@@ -0,0 +1,149 @@
+/**
+  * libdyldcache-1.0 - decoder.c
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libcrippy-1.0/endianness.h>
+
+#include <libdyldcache-1.0/map.h>
+#include <libdyldcache-1.0/image.h>
+#include <libdyldcache-1.0/cache.h>
+#include <libdyldcache-1.0/decoder.h>
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define DYLD_LE16(x) __builtin_bswap16(x)
+#define DYLD_LE32(x) __builtin_bswap32(x)
+#define DYLD_LE64(x) __builtin_bswap64(x)
+#define DYLD_BE16(x) (x)
+#define DYLD_BE32(x) (x)
+#define DYLD_BE64(x) (x)
+#else
+#define DYLD_LE16(x) (x)
+#define DYLD_LE32(x) (x)
+#define DYLD_LE64(x) (x)
+#define DYLD_BE16(x) __builtin_bswap16(x)
+#define DYLD_BE32(x) __builtin_bswap32(x)
+#define DYLD_BE64(x) __builtin_bswap64(x)
+#endif
+
+/*
+ * Instantiates the readers for one byte order. The structures decoded
+ *  here have the same layout whatever the pointer width.
+ */
+#define DYLD_DECODER_ENDIAN(ORDER, SWAP16, SWAP32, SWAP64) \
+static uint16_t dyld_read16_##ORDER(const unsigned char* data) { \
+	uint16_t value; \
+	memcpy(&value, data, sizeof(value)); \
+	return SWAP16(value); \
+} \
+static uint32_t dyld_read32_##ORDER(const unsigned char* data) { \
+	uint32_t value; \
+	memcpy(&value, data, sizeof(value)); \
+	return SWAP32(value); \
+} \
+static uint64_t dyld_read64_##ORDER(const unsigned char* data) { \
+	uint64_t value; \
+	memcpy(&value, data, sizeof(value)); \
+	return SWAP64(value); \
+} \
+static void dyld_header_##ORDER(const unsigned char* data, uint32_t length, dyldcache_header_t* header) { \
+	memcpy(header->magic, data, sizeof(header->magic)); \
+	header->mapping_offset = dyld_read32_##ORDER(data + 16); \
+	header->mapping_count = dyld_read32_##ORDER(data + 20); \
+	header->images_offset = dyld_read32_##ORDER(data + 24); \
+	header->images_count = dyld_read32_##ORDER(data + 28); \
+	header->base_address = dyld_read64_##ORDER(data + 32); \
+	header->codesign_offset = dyld_read64_##ORDER(data + 40); \
+	header->codesign_size = dyld_read64_##ORDER(data + 48); \
+	if (length >= 0x48) { \
+		header->slide_info_offset = dyld_read64_##ORDER(data + 0x38); \
+		header->slide_info_size = dyld_read64_##ORDER(data + 0x40); \
+	} \
+	if (length >= 0x58) { \
+		header->local_symbols_offset = dyld_read64_##ORDER(data + 0x48); \
+		header->local_symbols_size = dyld_read64_##ORDER(data + 0x50); \
+	} \
+	if (length >= 0x68) { \
+		memcpy(header->uuid, data + 0x58, sizeof(header->uuid)); \
+	} \
+	if (length >= 0x70) { \
+		header->cache_type = dyld_read64_##ORDER(data + 0x68); \
+	} \
+	if (length >= 0x78) { \
+		header->branch_pools_offset = dyld_read32_##ORDER(data + 0x70); \
+		header->branch_pools_count = dyld_read32_##ORDER(data + 0x74); \
+	} \
+	if (length >= 0x88) { \
+		header->accelerate_info_addr = dyld_read64_##ORDER(data + 0x78); \
+		header->accelerate_info_size = dyld_read64_##ORDER(data + 0x80); \
+	} \
+	if (length >= 0x98) { \
+		header->images_text_offset = dyld_read64_##ORDER(data + 0x88); \
+		header->images_text_count = dyld_read64_##ORDER(data + 0x90); \
+	} \
+	if (length >= 0x118) { \
+		header->dylibs_trie_addr = dyld_read64_##ORDER(data + 0x108); \
+		header->dylibs_trie_size = dyld_read64_##ORDER(data + 0x110); \
+	} \
+} \
+static void dyld_map_info_##ORDER(const unsigned char* data, dyldmap_info_t* info) { \
+	info->address = dyld_read64_##ORDER(data); \
+	info->size = dyld_read64_##ORDER(data + 8); \
+	info->offset = dyld_read64_##ORDER(data + 16); \
+	info->maxProt = dyld_read32_##ORDER(data + 24); \
+	info->initProt = dyld_read32_##ORDER(data + 28); \
+} \
+static void dyld_image_info_##ORDER(const unsigned char* data, dyldimage_info_t* info) { \
+	info->address = dyld_read64_##ORDER(data); \
+	info->modtime = dyld_read64_##ORDER(data + 8); \
+	info->inode = dyld_read64_##ORDER(data + 16); \
+	info->offset = dyld_read32_##ORDER(data + 24); \
+	info->pad = dyld_read32_##ORDER(data + 28); \
+} \
+static uint64_t dyld_pointer32_##ORDER(const unsigned char* data) { \
+	return dyld_read32_##ORDER(data); \
+} \
+static uint64_t dyld_pointer64_##ORDER(const unsigned char* data) { \
+	return dyld_read64_##ORDER(data); \
+}
+
+DYLD_DECODER_ENDIAN(le, DYLD_LE16, DYLD_LE32, DYLD_LE64)
+DYLD_DECODER_ENDIAN(be, DYLD_BE16, DYLD_BE32, DYLD_BE64)
+
+#define DYLD_DECODER(ORDER, ENDIAN, BITS) { \
+	#ORDER #BITS, ENDIAN, BITS / 8, \
+	dyld_read16_##ORDER, dyld_read32_##ORDER, dyld_read64_##ORDER, dyld_pointer##BITS##_##ORDER, \
+	dyld_header_##ORDER, dyld_map_info_##ORDER, dyld_image_info_##ORDER \
+}
+
+static const dyldcache_decoder_t dyldcache_decoders[] = {
+	DYLD_DECODER(le, kLittleEndian, 32),
+	DYLD_DECODER(le, kLittleEndian, 64),
+	DYLD_DECODER(be, kBigEndian, 32),
+	DYLD_DECODER(be, kBigEndian, 64)
+};
+
+/*
+ * Dyld Decoder Functions
+ */
+const dyldcache_decoder_t* dyldcache_decoder_get(endian_t endian, uint32_t pointer_size) {
+	return &dyldcache_decoders[(endian == kBigEndian ? 2 : 0) + (pointer_size == 8 ? 1 : 0)];
+}
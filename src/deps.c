@@ -0,0 +1,472 @@
+/**
+  * libdyldcache-1.0 - deps.c
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define _DEBUG
+#include <libcrippy-1.0/debug.h>
+#include <libcrippy-1.0/libcrippy.h>
+
+#include <libdyldcache-1.0/map.h>
+#include <libdyldcache-1.0/image.h>
+#include <libdyldcache-1.0/cache.h>
+#include <libdyldcache-1.0/pool.h>
+#include <libdyldcache-1.0/deps.h>
+
+#ifndef MH_MAGIC
+#define MH_MAGIC              0xFEEDFACE
+#endif
+#ifndef MH_MAGIC_64
+#define MH_MAGIC_64           0xFEEDFACF
+#endif
+#ifndef LC_LOAD_DYLIB
+#define LC_LOAD_DYLIB         0x0C
+#endif
+#ifndef LC_LOAD_WEAK_DYLIB
+#define LC_LOAD_WEAK_DYLIB    0x80000018
+#endif
+#ifndef LC_REEXPORT_DYLIB
+#define LC_REEXPORT_DYLIB     0x8000001F
+#endif
+#ifndef LC_LAZY_LOAD_DYLIB
+#define LC_LAZY_LOAD_DYLIB    0x20
+#endif
+#ifndef LC_LOAD_UPWARD_DYLIB
+#define LC_LOAD_UPWARD_DYLIB  0x80000023
+#endif
+
+typedef struct dyldcache_deps_ctx_t {
+	dyldcache_t* cache;
+	dyldcache_deps_t* deps;
+	uint32_t* table;
+	uint32_t mask;
+	volatile uint32_t missing;
+} dyldcache_deps_ctx_t;
+
+static uint32_t dyldcache_deps_hash(const char* path) {
+	uint32_t hash = 2166136261u;
+	while (*path) {
+		hash ^= (uint8_t) *path++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static int dyldcache_deps_lookup(dyldcache_deps_ctx_t* ctx, const char* path) {
+	uint32_t slot = 0;
+	uint32_t entry = 0;
+	if (ctx->table == NULL) {
+		return dyldcache_image_index(ctx->cache, path);
+	}
+	slot = dyldcache_deps_hash(path) & ctx->mask;
+	while ((entry = ctx->table[slot]) != 0) {
+		if (!strcmp(ctx->cache->images[entry - 1]->path, path)) {
+			return entry - 1;
+		}
+		slot = (slot + 1) & ctx->mask;
+	}
+	return -1;
+}
+
+static uint8_t dyldcache_deps_kind(uint32_t cmd) {
+	switch (cmd) {
+	case LC_LOAD_DYLIB:
+		return DYLDDEP_LOAD;
+	case LC_LOAD_WEAK_DYLIB:
+		return DYLDDEP_WEAK;
+	case LC_REEXPORT_DYLIB:
+		return DYLDDEP_REEXPORT;
+	case LC_LOAD_UPWARD_DYLIB:
+		return DYLDDEP_UPWARD;
+	case LC_LAZY_LOAD_DYLIB:
+		return DYLDDEP_LAZY;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Walks the load commands of a single image. When edges is NULL this only
+ *  counts the dependencies which resolve to other images in the cache,
+ *  otherwise it also stores them.
+ */
+static uint32_t dyldcache_deps_parse(dyldcache_deps_ctx_t* ctx, uint32_t index, uint32_t* edges, uint8_t* kinds) {
+	int target = 0;
+	uint8_t kind = 0;
+	uint32_t i = 0;
+	uint32_t cmd = 0;
+	uint32_t size = 0;
+	uint32_t found = 0;
+	uint32_t ncmds = 0;
+	uint32_t sizeofcmds = 0;
+	uint32_t header = 0;
+	uint32_t name = 0;
+	uint64_t offset = 0;
+	uint64_t avail = 0;
+	unsigned char* macho = NULL;
+	unsigned char* command = NULL;
+	unsigned char* end = NULL;
+	dyldcache_t* cache = ctx->cache;
+	dyldimage_t* image = cache->images[index];
+	const dyldcache_decoder_t* decoder = cache->decoder;
+
+	if (image == NULL || image->map == NULL) {
+		return 0;
+	}
+
+	offset = image->map->offset + (image->address - image->map->address);
+	if (dyldcache_fetch(cache, offset, 28) < 0) {
+		return 0;
+	}
+	macho = &cache->data[offset];
+	avail = cache->size - offset;
+
+	switch (decoder->read32(macho)) {
+	case MH_MAGIC:
+		header = 28;
+		break;
+	case MH_MAGIC_64:
+		header = 32;
+		break;
+	default:
+		return 0;
+	}
+	ncmds = decoder->read32(macho + 16);
+	sizeofcmds = decoder->read32(macho + 20);
+	if ((uint64_t) header + sizeofcmds > avail ||
+			dyldcache_fetch(cache, offset, header + sizeofcmds) < 0) {
+		return 0;
+	}
+
+	command = macho + header;
+	end = command + sizeofcmds;
+	for (i = 0; i < ncmds; i++) {
+		if (command + 8 > end) {
+			break;
+		}
+		cmd = decoder->read32(command);
+		size = decoder->read32(command + 4);
+		if (size < 8 || command + size > end) {
+			break;
+		}
+
+		kind = dyldcache_deps_kind(cmd);
+		if (kind != 0 && size > 12) {
+			name = decoder->read32(command + 8);
+			if (name < size && memchr(command + name, '\0', size - name) != NULL) {
+				target = dyldcache_deps_lookup(ctx, (const char*) (command + name));
+				if (target >= 0 && (uint32_t) target != index) {
+					if (edges) {
+						edges[found] = (uint32_t) target;
+						kinds[found] = kind;
+					}
+					found++;
+				} else if (target < 0 && edges == NULL) {
+					__sync_fetch_and_add(&ctx->missing, 1);
+				}
+			}
+		}
+		command += size;
+	}
+	return found;
+}
+
+static void dyldcache_deps_count_func(uint32_t index, uint32_t worker, void* userdata) {
+	dyldcache_deps_ctx_t* ctx = (dyldcache_deps_ctx_t*) userdata;
+	ctx->deps->offsets[index + 1] = dyldcache_deps_parse(ctx, index, NULL, NULL);
+}
+
+static void dyldcache_deps_fill_func(uint32_t index, uint32_t worker, void* userdata) {
+	dyldcache_deps_ctx_t* ctx = (dyldcache_deps_ctx_t*) userdata;
+	dyldcache_deps_t* deps = ctx->deps;
+	uint32_t start = deps->offsets[index];
+	dyldcache_deps_parse(ctx, index, &deps->edges[start], &deps->kinds[start]);
+}
+
+/*
+ * Dyldcache Dependency Functions
+ */
+dyldcache_deps_t* dyldcache_deps_create() {
+	debug("Creating dyld cache dependency graph\n");
+	dyldcache_deps_t* deps = (dyldcache_deps_t*) malloc(sizeof(dyldcache_deps_t));
+	if (deps) {
+		memset(deps, '\0', sizeof(dyldcache_deps_t));
+	}
+	return deps;
+}
+
+dyldcache_deps_t* dyldcache_deps_load(dyldcache_t* cache, dyldpool_t* pool) {
+	debug("Loading dyld cache dependency graph\n");
+	uint32_t i = 0;
+	uint32_t slot = 0;
+	uint32_t size = 0;
+	uint32_t count = 0;
+	dyldpool_t* owned = NULL;
+	dyldcache_deps_t* deps = NULL;
+	dyldcache_deps_ctx_t ctx;
+
+	if (cache == NULL || cache->images == NULL) {
+		return NULL;
+	}
+
+	deps = dyldcache_deps_create();
+	if (deps == NULL) {
+		error("Unable to allocate memory for dyld cache dependency graph\n");
+		return NULL;
+	}
+	count = cache->count;
+	deps->count = count;
+	deps->offsets = (uint32_t*) calloc(count + 1, sizeof(uint32_t));
+	if (deps->offsets == NULL) {
+		error("Unable to allocate memory for dyld cache dependency offsets\n");
+		dyldcache_deps_free(deps);
+		return NULL;
+	}
+
+	memset(&ctx, '\0', sizeof(ctx));
+	ctx.cache = cache;
+	ctx.deps = deps;
+
+	// Install paths are resolved to image indices through the cache's
+	//  own trie, or an open addressing table built up front so the
+	//  workers only read it
+	size = 16;
+	while (size < count * 2) {
+		size <<= 1;
+	}
+	ctx.mask = size - 1;
+	if (cache->tables == NULL || cache->tables->trie == NULL) {
+		ctx.table = (uint32_t*) calloc(size, sizeof(uint32_t));
+		if (ctx.table == NULL) {
+			error("Unable to allocate memory for dyld cache path table\n");
+			dyldcache_deps_free(deps);
+			return NULL;
+		}
+	}
+	for (i = 0; ctx.table != NULL && i < count; i++) {
+		if (cache->images[i] == NULL || cache->images[i]->path == NULL) {
+			continue;
+		}
+		slot = dyldcache_deps_hash(cache->images[i]->path) & ctx.mask;
+		while (ctx.table[slot] != 0) {
+			slot = (slot + 1) & ctx.mask;
+		}
+		ctx.table[slot] = i + 1;
+	}
+
+	if (pool == NULL) {
+		pool = owned = dyldpool_create(0);
+	}
+
+	// First pass sizes each row, second pass fills it in place
+	dyldcache_hold(cache);
+	dyldpool_run(pool, count, dyldcache_deps_count_func, &ctx);
+	dyldcache_release(cache);
+	for (i = 0; i < count; i++) {
+		deps->offsets[i + 1] += deps->offsets[i];
+	}
+	deps->edge_count = deps->offsets[count];
+	deps->missing = ctx.missing;
+
+	deps->edges = (uint32_t*) malloc((deps->edge_count + 1) * sizeof(uint32_t));
+	deps->kinds = (uint8_t*) malloc(deps->edge_count + 1);
+	if (deps->edges == NULL || deps->kinds == NULL) {
+		error("Unable to allocate memory for dyld cache dependency edges\n");
+		dyldcache_deps_free(deps);
+		deps = NULL;
+	} else {
+		dyldcache_hold(cache);
+		dyldpool_run(pool, count, dyldcache_deps_fill_func, &ctx);
+		dyldcache_release(cache);
+	}
+
+	if (owned) {
+		dyldpool_free(owned);
+	}
+	free(ctx.table);
+	return deps;
+}
+
+uint32_t* dyldcache_deps_get(dyldcache_deps_t* deps, uint32_t index, uint32_t* count) {
+	if (deps == NULL || index >= deps->count) {
+		if (count) *count = 0;
+		return NULL;
+	}
+	if (count) *count = deps->offsets[index + 1] - deps->offsets[index];
+	return &deps->edges[deps->offsets[index]];
+}
+
+uint32_t* dyldcache_deps_closure(dyldcache_deps_t* deps, uint32_t index, uint32_t kinds, uint32_t* count) {
+	debug("Walking dyld cache dependency closure\n");
+	uint32_t e = 0;
+	uint32_t head = 0;
+	uint32_t tail = 0;
+	uint32_t node = 0;
+	uint32_t target = 0;
+	uint8_t* seen = NULL;
+	uint32_t* queue = NULL;
+
+	*count = 0;
+	if (deps == NULL || index >= deps->count) {
+		return NULL;
+	}
+	seen = (uint8_t*) calloc(deps->count, 1);
+	queue = (uint32_t*) malloc(deps->count * sizeof(uint32_t));
+	if (seen == NULL || queue == NULL) {
+		error("Unable to allocate memory for dyld cache dependency closure\n");
+		free(seen);
+		free(queue);
+		return NULL;
+	}
+
+	// Breadth first, so nearer dependencies come first in the result
+	seen[index] = 1;
+	queue[tail++] = index;
+	while (head < tail) {
+		node = queue[head++];
+		for (e = deps->offsets[node]; e < deps->offsets[node + 1]; e++) {
+			target = deps->edges[e];
+			if ((deps->kinds[e] & kinds) && !seen[target]) {
+				seen[target] = 1;
+				queue[tail++] = target;
+			}
+		}
+	}
+	free(seen);
+
+	// Drop the starting image itself
+	memmove(queue, &queue[1], (tail - 1) * sizeof(uint32_t));
+	*count = tail - 1;
+	return queue;
+}
+
+uint32_t* dyldcache_deps_order(dyldcache_deps_t* deps, uint32_t kinds, uint32_t* count) {
+	debug("Sorting dyld cache dependency graph\n");
+	uint32_t i = 0;
+	uint32_t e = 0;
+	uint32_t head = 0;
+	uint32_t tail = 0;
+	uint32_t node = 0;
+	uint32_t target = 0;
+	uint32_t* order = NULL;
+	uint32_t* pending = NULL;
+	uint32_t* roffsets = NULL;
+	uint32_t* redges = NULL;
+
+	*count = 0;
+	if (deps == NULL) {
+		return NULL;
+	}
+	order = (uint32_t*) malloc((deps->count + 1) * sizeof(uint32_t));
+	pending = (uint32_t*) calloc(deps->count + 1, sizeof(uint32_t));
+	roffsets = (uint32_t*) calloc(deps->count + 2, sizeof(uint32_t));
+	redges = (uint32_t*) malloc((deps->edge_count + 1) * sizeof(uint32_t));
+	if (order == NULL || pending == NULL || roffsets == NULL || redges == NULL) {
+		error("Unable to allocate memory for dyld cache dependency order\n");
+		free(order);
+		free(pending);
+		free(roffsets);
+		free(redges);
+		return NULL;
+	}
+
+	// Build the reverse graph (dependency -> dependents) for the selected
+	//  edge kinds, counting outstanding dependencies for every image
+	for (i = 0; i < deps->count; i++) {
+		for (e = deps->offsets[i]; e < deps->offsets[i + 1]; e++) {
+			if (deps->kinds[e] & kinds) {
+				pending[i]++;
+				roffsets[deps->edges[e] + 2]++;
+			}
+		}
+	}
+	for (i = 0; i < deps->count; i++) {
+		roffsets[i + 2] += roffsets[i + 1];
+	}
+	for (i = 0; i < deps->count; i++) {
+		for (e = deps->offsets[i]; e < deps->offsets[i + 1]; e++) {
+			if (deps->kinds[e] & kinds) {
+				redges[roffsets[deps->edges[e] + 1]++] = i;
+			}
+		}
+	}
+
+	// Kahn's algorithm, emitting dependencies before their dependents
+	for (i = 0; i < deps->count; i++) {
+		if (pending[i] == 0) {
+			order[tail++] = i;
+		}
+	}
+	while (head < tail) {
+		node = order[head++];
+		for (e = roffsets[node]; e < roffsets[node + 1]; e++) {
+			target = redges[e];
+			if (--pending[target] == 0) {
+				order[tail++] = target;
+			}
+		}
+	}
+
+	// Whatever is left sits on a cycle; append it in image order
+	if (tail < deps->count) {
+		debug("Found %u images on dependency cycles\n", deps->count - tail);
+		for (i = 0; i < deps->count; i++) {
+			if (pending[i] != 0) {
+				order[tail++] = i;
+			}
+		}
+	}
+
+	free(pending);
+	free(roffsets);
+	free(redges);
+	*count = tail;
+	return order;
+}
+
+void dyldcache_deps_debug(dyldcache_deps_t* deps) {
+	if (deps) {
+		debug("\tDependencies:\n");
+		debug("\t\timages = %u\n", deps->count);
+		debug("\t\tedges = %u\n", deps->edge_count);
+		debug("\t\tmissing = %u\n", deps->missing);
+		debug("\n");
+	}
+}
+
+void dyldcache_deps_free(dyldcache_deps_t* deps) {
+	debug("Freeing dyld cache dependency graph\n");
+	if (deps) {
+		if (deps->offsets) {
+			free(deps->offsets);
+			deps->offsets = NULL;
+		}
+		if (deps->edges) {
+			free(deps->edges);
+			deps->edges = NULL;
+		}
+		if (deps->kinds) {
+			free(deps->kinds);
+			deps->kinds = NULL;
+		}
+		free(deps);
+	}
+}
@@ -0,0 +1,379 @@
+/**
+  * libdyldcache-1.0 - dump.c
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <libmacho-1.0/macho.h>
+
+#define _DEBUG
+#include <libcrippy-1.0/debug.h>
+#include <libcrippy-1.0/libcrippy.h>
+
+#include <libdyldcache-1.0/map.h>
+#include <libdyldcache-1.0/image.h>
+#include <libdyldcache-1.0/cache.h>
+#include <libdyldcache-1.0/dump.h>
+
+typedef struct dylddump_symbols_t {
+	dylddump_t* dump;
+	uint32_t image;
+} dylddump_symbols_t;
+
+static const char dylddump_hex[] = "0123456789abcdef";
+
+static int dylddump_write(dylddump_t* dump, const unsigned char* data, uint64_t size) {
+	ssize_t done = 0;
+	while (size > 0 && dump->err == 0) {
+		done = write(dump->fd, data, size);
+		if (done < 0 && errno == EINTR) {
+			continue;
+		}
+		if (done <= 0) {
+			error("Unable to write dump: %s\n", strerror(errno));
+			dump->err = -1;
+			break;
+		}
+		dump->written += done;
+		data += done;
+		size -= done;
+	}
+	return dump->err;
+}
+
+static int dylddump_drain(dylddump_t* dump) {
+	dylddump_write(dump, dump->buffer, dump->used);
+	dump->used = 0;
+	return dump->err;
+}
+
+static unsigned char* dylddump_reserve(dylddump_t* dump, uint32_t size) {
+	if (dump->used + size > dump->capacity) {
+		dylddump_drain(dump);
+	}
+	if (dump->err < 0) {
+		return NULL;
+	}
+	return dump->buffer + dump->used;
+}
+
+/*
+ * Anything larger than the whole buffer is written straight through
+ *  once what is queued ahead of it has been drained.
+ */
+static void dylddump_bytes(dylddump_t* dump, const void* data, uint32_t size) {
+	unsigned char* cursor = NULL;
+	if (size > dump->capacity) {
+		dylddump_drain(dump);
+		dylddump_write(dump, (const unsigned char*) data, size);
+		return;
+	}
+	cursor = dylddump_reserve(dump, size);
+	if (cursor) {
+		memcpy(cursor, data, size);
+		dump->used += size;
+	}
+}
+
+/*
+ * JSON Writers
+ */
+static void dylddump_text(dylddump_t* dump, const char* text) {
+	dylddump_bytes(dump, text, strlen(text));
+}
+
+static void dylddump_number(dylddump_t* dump, uint64_t value) {
+	char digits[20];
+	uint32_t count = 0;
+	uint32_t i = 0;
+	unsigned char* cursor = dylddump_reserve(dump, sizeof(digits));
+	if (cursor == NULL) {
+		return;
+	}
+	do {
+		digits[count++] = '0' + (value % 10);
+		value /= 10;
+	} while (value);
+	for (i = 0; i < count; i++) {
+		cursor[i] = digits[count - i - 1];
+	}
+	dump->used += count;
+}
+
+static void dylddump_string(dylddump_t* dump, const char* text, uint32_t length) {
+	uint32_t i = 0;
+	unsigned char c = 0;
+	unsigned char* cursor = NULL;
+
+	cursor = dylddump_reserve(dump, 1);
+	if (cursor == NULL) {
+		return;
+	}
+	*cursor = '"';
+	dump->used++;
+	// Reserve for the longest escape, \u00XX
+	for (i = 0; i < length; i++) {
+		cursor = dylddump_reserve(dump, 6);
+		if (cursor == NULL) {
+			return;
+		}
+		c = (unsigned char) text[i];
+		if (c == '"' || c == '\\') {
+			cursor[0] = '\\';
+			cursor[1] = c;
+			dump->used += 2;
+		} else if (c < 0x20) {
+			memcpy(cursor, "\\u00", 4);
+			cursor[4] = dylddump_hex[c >> 4];
+			cursor[5] = dylddump_hex[c & 0xF];
+			dump->used += 6;
+		} else {
+			cursor[0] = c;
+			dump->used++;
+		}
+	}
+	cursor = dylddump_reserve(dump, 1);
+	if (cursor) {
+		*cursor = '"';
+		dump->used++;
+	}
+}
+
+static void dylddump_field(dylddump_t* dump, const char* key, uint64_t value) {
+	dylddump_text(dump, key);
+	dylddump_number(dump, value);
+}
+
+/*
+ * Binary Writers
+ */
+static void dylddump_record(dylddump_t* dump, uint16_t type, const void* fields, uint32_t size, const char* name, uint32_t length) {
+	dylddump_record_t record;
+	record.type = type;
+	record.reserved = 0;
+	record.length = size + length;
+	dylddump_bytes(dump, &record, sizeof(record));
+	dylddump_bytes(dump, fields, size);
+	if (length > 0) {
+		dylddump_bytes(dump, name, length);
+	}
+}
+
+static void dylddump_symbol(const char* name, uint32_t address, void* userdata) {
+	dylddump_symbols_t* symbols = (dylddump_symbols_t*) userdata;
+	dylddump_t* dump = symbols->dump;
+	uint32_t length = strlen(name);
+	unsigned char fields[16];
+	uint64_t value = address;
+
+	if (dump->format == kDumpBinary) {
+		memcpy(&fields[0], &value, 8);
+		memcpy(&fields[8], &symbols->image, 4);
+		memcpy(&fields[12], &length, 4);
+		dylddump_record(dump, DYLDDUMP_RECORD_SYMBOL, fields, sizeof(fields), name, length);
+	} else {
+		dylddump_field(dump, "{\"type\":\"symbol\",\"address\":", address);
+		dylddump_field(dump, ",\"image\":", symbols->image);
+		dylddump_text(dump, ",\"name\":");
+		dylddump_string(dump, name, length);
+		dylddump_text(dump, "}\n");
+	}
+}
+
+/*
+ * Dyld Dump Functions
+ */
+dylddump_t* dylddump_create(int fd, dylddump_format_t format) {
+	debug("Creating dyld dump\n");
+	uint32_t version = DYLDDUMP_VERSION;
+	uint32_t reserved = 0;
+	dylddump_t* dump = (dylddump_t*) malloc(sizeof(dylddump_t));
+	if (dump == NULL) {
+		error("Unable to allocate memory for dyld dump\n");
+		return NULL;
+	}
+	memset(dump, '\0', sizeof(dylddump_t));
+	dump->fd = fd;
+	dump->format = format;
+	dump->capacity = DYLDDUMP_BUFFER;
+	dump->buffer = (unsigned char*) malloc(dump->capacity);
+	if (dump->buffer == NULL) {
+		error("Unable to allocate memory for dyld dump buffer\n");
+		dylddump_free(dump);
+		return NULL;
+	}
+	if (format == kDumpBinary) {
+		dylddump_bytes(dump, DYLDDUMP_MAGIC, 8);
+		dylddump_bytes(dump, &version, 4);
+		dylddump_bytes(dump, &reserved, 4);
+	}
+	return dump;
+}
+
+dylddump_format_t dylddump_format_parse(const char* name) {
+	if (name && !strcmp(name, "binary")) {
+		return kDumpBinary;
+	}
+	return kDumpJson;
+}
+
+int dylddump_cache(dylddump_t* dump, dyldcache_t* cache, uint32_t sections) {
+	debug("Dumping dyld cache\n");
+	if (dump == NULL || cache == NULL) {
+		return -1;
+	}
+	if (sections & DYLDDUMP_HEADER) dylddump_header(dump, cache);
+	if (sections & DYLDDUMP_MAPPINGS) dylddump_mappings(dump, cache);
+	if (sections & DYLDDUMP_IMAGES) dylddump_images(dump, cache);
+	if (sections & DYLDDUMP_SYMBOLS) dylddump_symbols(dump, cache);
+	return dylddump_flush(dump);
+}
+
+int dylddump_header(dylddump_t* dump, dyldcache_t* cache) {
+	dyldcache_header_t* header = cache->header;
+	unsigned char fields[48];
+	uint32_t length = strnlen(header->magic, sizeof(header->magic));
+
+	if (dump->format == kDumpBinary) {
+		memcpy(&fields[0], header->magic, 16);
+		memcpy(&fields[16], &header->base_address, 8);
+		memcpy(&fields[24], &header->mapping_count, 4);
+		memcpy(&fields[28], &header->images_count, 4);
+		memcpy(&fields[32], &header->codesign_offset, 8);
+		memcpy(&fields[40], &header->codesign_size, 8);
+		dylddump_record(dump, DYLDDUMP_RECORD_HEADER, fields, sizeof(fields), NULL, 0);
+	} else {
+		dylddump_text(dump, "{\"type\":\"header\",\"magic\":");
+		dylddump_string(dump, header->magic, length);
+		dylddump_field(dump, ",\"base_address\":", header->base_address);
+		dylddump_field(dump, ",\"mappings\":", header->mapping_count);
+		dylddump_field(dump, ",\"images\":", header->images_count);
+		dylddump_field(dump, ",\"codesign_offset\":", header->codesign_offset);
+		dylddump_field(dump, ",\"codesign_size\":", header->codesign_size);
+		dylddump_text(dump, "}\n");
+	}
+	return dump->err;
+}
+
+int dylddump_mappings(dylddump_t* dump, dyldcache_t* cache) {
+	uint32_t i = 0;
+	uint32_t maxprot = 0;
+	uint32_t initprot = 0;
+	dyldmap_t* map = NULL;
+	unsigned char fields[32];
+
+	for (i = 0; cache->maps && i < cache->header->mapping_count; i++) {
+		map = cache->maps[i];
+		maxprot = map->info ? map->info->maxProt : 0;
+		initprot = map->info ? map->info->initProt : 0;
+		if (dump->format == kDumpBinary) {
+			memcpy(&fields[0], &map->address, 8);
+			memcpy(&fields[8], &map->size, 8);
+			memcpy(&fields[16], &map->offset, 8);
+			memcpy(&fields[24], &maxprot, 4);
+			memcpy(&fields[28], &initprot, 4);
+			dylddump_record(dump, DYLDDUMP_RECORD_MAPPING, fields, sizeof(fields), NULL, 0);
+		} else {
+			dylddump_field(dump, "{\"type\":\"mapping\",\"index\":", i);
+			dylddump_field(dump, ",\"address\":", map->address);
+			dylddump_field(dump, ",\"size\":", map->size);
+			dylddump_field(dump, ",\"offset\":", map->offset);
+			dylddump_field(dump, ",\"maxprot\":", maxprot);
+			dylddump_field(dump, ",\"initprot\":", initprot);
+			dylddump_text(dump, "}\n");
+		}
+	}
+	return dump->err;
+}
+
+int dylddump_images(dylddump_t* dump, dyldcache_t* cache) {
+	uint32_t i = 0;
+	uint32_t length = 0;
+	dyldimage_t* image = NULL;
+	unsigned char fields[32];
+
+	for (i = 0; cache->images && i < cache->count; i++) {
+		image = cache->images[i];
+		length = strlen(image->path);
+		if (dump->format == kDumpBinary) {
+			memcpy(&fields[0], &image->address, 8);
+			memcpy(&fields[8], &image->info->modtime, 8);
+			memcpy(&fields[16], &image->info->inode, 8);
+			memcpy(&fields[24], &image->index, 4);
+			memcpy(&fields[28], &length, 4);
+			dylddump_record(dump, DYLDDUMP_RECORD_IMAGE, fields, sizeof(fields), image->path, length);
+		} else {
+			dylddump_field(dump, "{\"type\":\"image\",\"index\":", image->index);
+			dylddump_field(dump, ",\"address\":", image->address);
+			dylddump_field(dump, ",\"modtime\":", image->info->modtime);
+			dylddump_field(dump, ",\"inode\":", image->info->inode);
+			dylddump_text(dump, ",\"path\":");
+			dylddump_string(dump, image->path, length);
+			dylddump_text(dump, "}\n");
+		}
+	}
+	return dump->err;
+}
+
+int dylddump_symbols(dylddump_t* dump, dyldcache_t* cache) {
+	uint32_t i = 0;
+	uint64_t size = 0;
+	unsigned char* data = NULL;
+	macho_t* macho = NULL;
+	dyldimage_t* image = NULL;
+	dylddump_symbols_t symbols;
+
+	symbols.dump = dump;
+	for (i = 0; cache->images && i < cache->count && dump->err == 0; i++) {
+		image = cache->images[i];
+		data = dyldcache_image_data(cache, image, &size);
+		if (data == NULL) {
+			continue;
+		}
+		macho = macho_load(data, size > 0xFFFFFFFFULL ? 0xFFFFFFFFU : (uint32_t) size);
+		if (macho == NULL) {
+			continue;
+		}
+		symbols.image = image->index;
+		macho_list_symbols(macho, dylddump_symbol, &symbols);
+		macho_free(macho);
+	}
+	return dump->err;
+}
+
+int dylddump_flush(dylddump_t* dump) {
+	if (dump == NULL) {
+		return -1;
+	}
+	return dylddump_drain(dump);
+}
+
+void dylddump_free(dylddump_t* dump) {
+	debug("Freeing dyld dump\n");
+	if (dump) {
+		if (dump->buffer) {
+			dylddump_drain(dump);
+			free(dump->buffer);
+		}
+		free(dump);
+	}
+}
@@ -0,0 +1,603 @@
+/**
+  * libdyldcache-1.0 - extract.c
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define _DEBUG
+#include <libcrippy-1.0/debug.h>
+#include <libcrippy-1.0/libcrippy.h>
+
+#include <libdyldcache-1.0/map.h>
+#include <libdyldcache-1.0/image.h>
+#include <libdyldcache-1.0/cache.h>
+#include <libdyldcache-1.0/pool.h>
+#include <libdyldcache-1.0/segment.h>
+#include <libdyldcache-1.0/extract.h>
+
+#ifndef LC_SEGMENT
+#define LC_SEGMENT                   0x1
+#endif
+#ifndef LC_SYMTAB
+#define LC_SYMTAB                    0x2
+#endif
+#ifndef LC_DYSYMTAB
+#define LC_DYSYMTAB                  0xB
+#endif
+#ifndef LC_SEGMENT_64
+#define LC_SEGMENT_64                0x19
+#endif
+#ifndef LC_CODE_SIGNATURE
+#define LC_CODE_SIGNATURE            0x1D
+#endif
+#ifndef LC_SEGMENT_SPLIT_INFO
+#define LC_SEGMENT_SPLIT_INFO        0x1E
+#endif
+#ifndef LC_DYLD_INFO
+#define LC_DYLD_INFO                 0x22
+#endif
+#ifndef LC_DYLD_INFO_ONLY
+#define LC_DYLD_INFO_ONLY            0x80000022
+#endif
+#ifndef LC_FUNCTION_STARTS
+#define LC_FUNCTION_STARTS           0x26
+#endif
+#ifndef LC_DATA_IN_CODE
+#define LC_DATA_IN_CODE              0x29
+#endif
+#ifndef LC_DYLIB_CODE_SIGN_DRS
+#define LC_DYLIB_CODE_SIGN_DRS       0x2B
+#endif
+#ifndef LC_LINKER_OPTIMIZATION_HINT
+#define LC_LINKER_OPTIMIZATION_HINT  0x2E
+#endif
+#ifndef LC_DYLD_EXPORTS_TRIE
+#define LC_DYLD_EXPORTS_TRIE         0x80000033
+#endif
+#ifndef LC_DYLD_CHAINED_FIXUPS
+#define LC_DYLD_CHAINED_FIXUPS       0x80000034
+#endif
+
+#define DYLDEXTRACT_PAGE        0x1000
+#define DYLDEXTRACT_PAGE_ARM64  0x4000
+
+typedef struct dyldextract_ctx_t {
+	dyldcache_t* cache;
+	const dyldcache_decoder_t* decoder;
+	dyldextract_buffer_t* output;
+	dyldextract_buffer_t* strings;
+	dyldcache_segment_t* linkedit;
+	int wide;
+	int err;
+} dyldextract_ctx_t;
+
+typedef struct dyldextract_save_t {
+	dyldextract_t* extract;
+	dyldimage_t** images;
+	const char* directory;
+	volatile uint32_t failed;
+} dyldextract_save_t;
+
+static int dyldextract_reserve(dyldextract_buffer_t* buffer, uint64_t size) {
+	uint64_t capacity = buffer->capacity ? buffer->capacity : 0x10000;
+	unsigned char* data = NULL;
+	if (buffer->size + size <= buffer->capacity) {
+		return 0;
+	}
+	while (capacity < buffer->size + size) {
+		capacity *= 2;
+	}
+	data = (unsigned char*) realloc(buffer->data, capacity);
+	if (data == NULL) {
+		return -1;
+	}
+	buffer->data = data;
+	buffer->capacity = capacity;
+	return 0;
+}
+
+// Appends size bytes of data, or of zeros when data is NULL
+static int dyldextract_append(dyldextract_buffer_t* buffer, const void* data, uint64_t size) {
+	if (size == 0) {
+		return 0;
+	}
+	if (dyldextract_reserve(buffer, size) < 0) {
+		return -1;
+	}
+	if (data) {
+		memcpy(&buffer->data[buffer->size], data, size);
+	} else {
+		memset(&buffer->data[buffer->size], '\0', size);
+	}
+	buffer->size += size;
+	return 0;
+}
+
+static int dyldextract_align(dyldextract_buffer_t* buffer, uint64_t align) {
+	return dyldextract_append(buffer, NULL, (align - (buffer->size % align)) % align);
+}
+
+static void dyldextract_write32(dyldextract_ctx_t* ctx, unsigned char* data, uint32_t value) {
+	if (ctx->decoder->endian == kBigEndian) {
+		data[0] = value >> 24;
+		data[1] = value >> 16;
+		data[2] = value >> 8;
+		data[3] = value;
+	} else {
+		data[0] = value;
+		data[1] = value >> 8;
+		data[2] = value >> 16;
+		data[3] = value >> 24;
+	}
+}
+
+static void dyldextract_write64(dyldextract_ctx_t* ctx, unsigned char* data, uint64_t value) {
+	if (ctx->decoder->endian == kBigEndian) {
+		dyldextract_write32(ctx, data, value >> 32);
+		dyldextract_write32(ctx, data + 4, value);
+	} else {
+		dyldextract_write32(ctx, data, value);
+		dyldextract_write32(ctx, data + 4, value >> 32);
+	}
+}
+
+/*
+ * LINKEDIT offsets in cache images are offsets into the cache file, all of
+ *  them inside the one shared LINKEDIT mapping.
+ */
+static const unsigned char* dyldextract_linkedit(dyldextract_ctx_t* ctx, uint64_t offset, uint64_t size) {
+	dyldcache_segment_t* linkedit = ctx->linkedit;
+	if (offset < linkedit->offset || size > linkedit->size || offset - linkedit->offset > linkedit->size - size) {
+		return NULL;
+	}
+	return dyldcache_read(ctx->cache, linkedit->address + (offset - linkedit->offset), size);
+}
+
+/*
+ * Copies the size bytes at offset into the new LINKEDIT, pointer aligned,
+ *  and points the 32 bit offset field at field to the copy.
+ */
+static void dyldextract_copy(dyldextract_ctx_t* ctx, uint64_t command, uint32_t field, uint64_t size) {
+	uint32_t offset = ctx->decoder->read32(&ctx->output->data[command + field]);
+	const unsigned char* data = NULL;
+
+	if (size == 0 || offset == 0) {
+		dyldextract_write32(ctx, &ctx->output->data[command + field], 0);
+		return;
+	}
+	data = dyldextract_linkedit(ctx, offset, size);
+	if (data == NULL || dyldextract_align(ctx->output, ctx->decoder->pointer_size) < 0) {
+		ctx->err = -1;
+		return;
+	}
+	offset = ctx->output->size;
+	if (dyldextract_append(ctx->output, data, size) < 0) {
+		ctx->err = -1;
+		return;
+	}
+	dyldextract_write32(ctx, &ctx->output->data[command + field], offset);
+}
+
+static void dyldextract_copy_field(dyldextract_ctx_t* ctx, uint64_t command, uint32_t field, uint32_t count, uint32_t entsize) {
+	uint32_t size = ctx->decoder->read32(&ctx->output->data[command + count]);
+	dyldextract_copy(ctx, command, field, (uint64_t) size * entsize);
+	if (ctx->decoder->read32(&ctx->output->data[command + field]) == 0) {
+		dyldextract_write32(ctx, &ctx->output->data[command + count], 0);
+	}
+}
+
+/*
+ * Copies the image's slice of the shared symbol table and gives it a
+ *  string table of its own, holding only the names it references.
+ */
+static void dyldextract_symtab(dyldextract_ctx_t* ctx, uint64_t command) {
+	uint32_t i = 0;
+	uint32_t strx = 0;
+	uint32_t symoff = 0;
+	uint32_t nsyms = 0;
+	uint32_t stroff = 0;
+	uint32_t strsize = 0;
+	uint32_t entsize = ctx->wide ? 16 : 12;
+	uint64_t strings = 0;
+	unsigned char* entry = NULL;
+	const char* name = NULL;
+	dyldextract_buffer_t* output = ctx->output;
+	const dyldcache_decoder_t* decoder = ctx->decoder;
+
+	nsyms = decoder->read32(&output->data[command + 12]);
+	stroff = decoder->read32(&output->data[command + 16]);
+	strsize = decoder->read32(&output->data[command + 20]);
+	dyldextract_copy(ctx, command, 8, (uint64_t) nsyms * entsize);
+	if (ctx->err < 0 || dyldextract_linkedit(ctx, stroff, strsize) == NULL) {
+		ctx->err = -1;
+		return;
+	}
+	symoff = decoder->read32(&output->data[command + 8]);
+	strings = ctx->linkedit->address + (stroff - ctx->linkedit->offset);
+
+	// Index 0 stays the empty name, as the linker lays it out
+	ctx->strings->size = 0;
+	dyldextract_append(ctx->strings, " ", 2);
+	for (i = 0; i < nsyms; i++) {
+		entry = &output->data[symoff + (uint64_t) i * entsize];
+		strx = decoder->read32(entry);
+		name = (strx > 0 && strx < strsize) ? dyldcache_read_cstring(ctx->cache, strings + strx) : NULL;
+		if (name == NULL) {
+			dyldextract_write32(ctx, entry, 0);
+			continue;
+		}
+		dyldextract_write32(ctx, entry, (uint32_t) ctx->strings->size);
+		if (dyldextract_append(ctx->strings, name, strlen(name) + 1) < 0) {
+			ctx->err = -1;
+			return;
+		}
+	}
+	if (dyldextract_align(ctx->strings, decoder->pointer_size) < 0) {
+		ctx->err = -1;
+		return;
+	}
+	// The string table goes last, after the indirect symbols
+	dyldextract_write32(ctx, &output->data[command + 20], (uint32_t) ctx->strings->size);
+}
+
+static void dyldextract_segment(dyldextract_ctx_t* ctx, uint64_t command, uint64_t address, uint64_t offset, uint64_t size) {
+	uint32_t i = 0;
+	uint32_t nsects = 0;
+	uint32_t sectoff = 0;
+	uint64_t sectaddr = 0;
+	unsigned char* data = &ctx->output->data[command];
+	unsigned char* section = NULL;
+	const dyldcache_decoder_t* decoder = ctx->decoder;
+
+	if (ctx->wide) {
+		dyldextract_write64(ctx, data + 40, offset);
+		dyldextract_write64(ctx, data + 48, size);
+		nsects = decoder->read32(data + 64);
+		section = data + 72;
+	} else {
+		dyldextract_write32(ctx, data + 32, offset);
+		dyldextract_write32(ctx, data + 36, size);
+		nsects = decoder->read32(data + 48);
+		section = data + 56;
+	}
+	for (i = 0; i < nsects; i++, section += ctx->wide ? 80 : 68) {
+		sectaddr = ctx->wide ? decoder->read64(section + 32) : decoder->read32(section + 32);
+		sectoff = ctx->wide ? 48 : 40;
+		// Zero fill sections have no file offset to move
+		if (decoder->read32(section + sectoff) != 0) {
+			dyldextract_write32(ctx, section + sectoff, offset + (sectaddr - address));
+		}
+		// reloff and nreloc, the cache builder has applied them
+		dyldextract_write32(ctx, section + sectoff + 8, 0);
+		dyldextract_write32(ctx, section + sectoff + 12, 0);
+	}
+}
+
+static void dyldextract_save_func(uint32_t index, uint32_t worker, void* userdata) {
+	char* path = NULL;
+	dyldimage_t output;
+	dyldextract_save_t* ctx = (dyldextract_save_t*) userdata;
+	dyldimage_t* image = ctx->images[index];
+
+	if (image == NULL) {
+		return;
+	}
+	if (dyldextract_image(ctx->extract, image, worker, &output) < 0) {
+		__sync_fetch_and_add(&ctx->failed, 1);
+		return;
+	}
+	path = (char*) malloc(strlen(ctx->directory) + strlen(image->name) + 2);
+	if (path == NULL) {
+		__sync_fetch_and_add(&ctx->failed, 1);
+		return;
+	}
+	sprintf(path, "%s/%s", ctx->directory, image->name);
+	if (dyldimage_save(&output, path) < 0) {
+		__sync_fetch_and_add(&ctx->failed, 1);
+	}
+	free(path);
+}
+
+/*
+ * Dyld Extract Functions
+ */
+dyldextract_t* dyldextract_create(dyldcache_t* cache, uint32_t threads) {
+	debug("Creating dyld extractor\n");
+	dyldextract_t* extract = NULL;
+	if (cache == NULL) {
+		return NULL;
+	}
+	extract = (dyldextract_t*) malloc(sizeof(dyldextract_t));
+	if (extract == NULL) {
+		error("Unable to allocate memory for dyld extractor\n");
+		return NULL;
+	}
+	memset(extract, '\0', sizeof(dyldextract_t));
+	extract->cache = cache;
+
+	extract->pool = dyldpool_create(threads);
+	if (extract->pool == NULL) {
+		dyldextract_free(extract);
+		return NULL;
+	}
+	extract->outputs = (dyldextract_buffer_t*) calloc(extract->pool->count, sizeof(dyldextract_buffer_t));
+	extract->strings = (dyldextract_buffer_t*) calloc(extract->pool->count, sizeof(dyldextract_buffer_t));
+	if (extract->outputs == NULL || extract->strings == NULL) {
+		error("Unable to allocate memory for dyld extractor workers\n");
+		dyldextract_free(extract);
+		return NULL;
+	}
+	return extract;
+}
+
+/*
+ * Builds the standalone form of image in worker's buffers and describes it
+ *  in output, whose data stays valid until worker extracts another image.
+ */
+int dyldextract_image(dyldextract_t* extract, dyldimage_t* image, uint32_t worker, dyldimage_t* output) {
+	debug("Extracting dyldimage\n");
+	uint32_t i = 0;
+	uint32_t cmd = 0;
+	uint32_t size = 0;
+	uint32_t ncmds = 0;
+	uint32_t header = 0;
+	uint32_t sizeofcmds = 0;
+	uint32_t page = DYLDEXTRACT_PAGE;
+	uint64_t start = 0;
+	uint64_t command = 0;
+	uint64_t symtab = 0;
+	uint64_t dysymtab = 0;
+	uint64_t signature = 0;
+	uint64_t* offsets = NULL;
+	const unsigned char* data = NULL;
+	dyldcache_segment_t* segment = NULL;
+	dyldcache_segments_t* segments = NULL;
+	dyldextract_ctx_t ctx;
+
+	if (extract == NULL || image == NULL || output == NULL || worker >= extract->pool->count) {
+		return -1;
+	}
+	memset(&ctx, '\0', sizeof(ctx));
+	ctx.cache = extract->cache;
+	ctx.decoder = extract->cache->decoder;
+	ctx.output = &extract->outputs[worker];
+	ctx.strings = &extract->strings[worker];
+	ctx.output->size = 0;
+	if (ctx.cache->arch && ctx.cache->arch->cpu_subtype == kArm64) {
+		page = DYLDEXTRACT_PAGE_ARM64;
+	}
+
+	segments = dyldcache_segments_load(ctx.cache, image);
+	if (segments == NULL) {
+		return -1;
+	}
+	ctx.wide = segments->wide;
+	header = ctx.wide ? 32 : 28;
+	ctx.linkedit = dyldcache_segments_find(segments, "__LINKEDIT");
+	offsets = (uint64_t*) calloc(segments->count + 1, sizeof(uint64_t));
+	if (ctx.linkedit == NULL || ctx.linkedit->map == NULL || offsets == NULL) {
+		error("Unable to find LINKEDIT of %s\n", image->path);
+		dyldcache_segments_free(segments);
+		free(offsets);
+		return -1;
+	}
+
+	// Everything but LINKEDIT back to back, the first segment holding
+	//  the Mach-O header at offset 0
+	for (i = 0; i < segments->count && ctx.err == 0; i++) {
+		segment = &segments->segments[i];
+		if (segment == ctx.linkedit || segment->map == NULL || segment->size == 0) {
+			continue;
+		}
+		if (ctx.output->size == 0 && segment->address != image->address) {
+			error("Image %s doesn't start with its header segment\n", image->path);
+			ctx.err = -1;
+			break;
+		}
+		data = dyldcache_read(ctx.cache, segment->address, segment->size);
+		if (data == NULL || dyldextract_align(ctx.output, page) < 0) {
+			ctx.err = -1;
+			break;
+		}
+		offsets[i] = ctx.output->size;
+		if (dyldextract_append(ctx.output, data, segment->size) < 0) {
+			ctx.err = -1;
+		}
+	}
+	if (ctx.err == 0 && (ctx.output->size < header || dyldextract_align(ctx.output, page) < 0)) {
+		ctx.err = -1;
+	}
+	if (ctx.err < 0) {
+		error("Unable to copy segments of %s\n", image->path);
+		dyldcache_segments_free(segments);
+		free(offsets);
+		return -1;
+	}
+	start = ctx.output->size;
+	ncmds = ctx.decoder->read32(&ctx.output->data[16]);
+	sizeofcmds = ctx.decoder->read32(&ctx.output->data[20]);
+	if (header + (uint64_t) sizeofcmds > start) {
+		dyldcache_segments_free(segments);
+		free(offsets);
+		return -1;
+	}
+
+	// Rebuild LINKEDIT in the linker's order, fixups and exports first,
+	//  then symbols, indirect symbols and strings
+	command = header;
+	for (i = 0, segment = segments->segments; i < ncmds && ctx.err == 0; i++, command += size) {
+		if (command + 8 > header + (uint64_t) sizeofcmds) {
+			break;
+		}
+		cmd = ctx.decoder->read32(&ctx.output->data[command]);
+		size = ctx.decoder->read32(&ctx.output->data[command + 4]);
+		if (size < 8 || command + size > header + (uint64_t) sizeofcmds) {
+			break;
+		}
+		switch (cmd) {
+		case LC_SEGMENT:
+		case LC_SEGMENT_64:
+			// Segment commands came out of dyldcache_segments_load in this order
+			if ((cmd == LC_SEGMENT_64) != ctx.wide || size < (ctx.wide ? 72 : 56) ||
+					segment == &segments->segments[segments->count]) {
+				break;
+			}
+			if (segment != ctx.linkedit && segment->map && segment->size) {
+				dyldextract_segment(&ctx, command, segment->address, offsets[segment - segments->segments], segment->size);
+			} else if (segment != ctx.linkedit) {
+				dyldextract_segment(&ctx, command, segment->address, 0, 0);
+			}
+			if (segment == ctx.linkedit) {
+				offsets[segments->count] = command;
+			}
+			segment++;
+			break;
+		case LC_SYMTAB:
+			symtab = command;
+			break;
+		case LC_DYSYMTAB:
+			dysymtab = command;
+			break;
+		case LC_DYLD_INFO:
+		case LC_DYLD_INFO_ONLY:
+			dyldextract_copy_field(&ctx, command, 8, 12, 1);
+			dyldextract_copy_field(&ctx, command, 16, 20, 1);
+			dyldextract_copy_field(&ctx, command, 24, 28, 1);
+			dyldextract_copy_field(&ctx, command, 32, 36, 1);
+			dyldextract_copy_field(&ctx, command, 40, 44, 1);
+			break;
+		case LC_CODE_SIGNATURE:
+			// The cache's signature doesn't cover the rebuilt file
+			signature = command;
+			break;
+		case LC_SEGMENT_SPLIT_INFO:
+		case LC_FUNCTION_STARTS:
+		case LC_DATA_IN_CODE:
+		case LC_DYLIB_CODE_SIGN_DRS:
+		case LC_LINKER_OPTIMIZATION_HINT:
+		case LC_DYLD_EXPORTS_TRIE:
+		case LC_DYLD_CHAINED_FIXUPS:
+			dyldextract_copy_field(&ctx, command, 8, 12, 1);
+			break;
+		default:
+			break;
+		}
+	}
+	if (ctx.err == 0 && dysymtab) {
+		// No table of contents, module table or external references
+		//  outside of the old object file formats
+		for (i = 32; i < 56; i += 4) {
+			dyldextract_write32(&ctx, &ctx.output->data[dysymtab + i], 0);
+		}
+		dyldextract_copy_field(&ctx, dysymtab, 72, 76, 8);
+	}
+	if (ctx.err == 0 && symtab) {
+		dyldextract_symtab(&ctx, symtab);
+	}
+	if (ctx.err == 0 && dysymtab) {
+		dyldextract_copy_field(&ctx, dysymtab, 64, 68, 8);
+		dyldextract_copy_field(&ctx, dysymtab, 56, 60, 4);
+	}
+	if (ctx.err == 0 && symtab) {
+		if (dyldextract_align(ctx.output, ctx.decoder->pointer_size) < 0) {
+			ctx.err = -1;
+		} else {
+			dyldextract_write32(&ctx, &ctx.output->data[symtab + 16], (uint32_t) ctx.output->size);
+			if (dyldextract_append(ctx.output, ctx.strings->data, ctx.strings->size) < 0) {
+				ctx.err = -1;
+			}
+		}
+	}
+	if (ctx.err == 0 && (offsets[segments->count] == 0 || ctx.output->size > 0xFFFFFFFF)) {
+		ctx.err = -1;
+	}
+	if (ctx.err < 0) {
+		error("Unable to rebuild LINKEDIT of %s\n", image->path);
+		dyldcache_segments_free(segments);
+		free(offsets);
+		return -1;
+	}
+
+	command = offsets[segments->count];
+	dyldextract_segment(&ctx, command, ctx.linkedit->address, start, ctx.output->size - start);
+	if (ctx.wide) {
+		dyldextract_write64(&ctx, &ctx.output->data[command + 32], (ctx.output->size - start + page - 1) & ~((uint64_t) page - 1));
+	} else {
+		dyldextract_write32(&ctx, &ctx.output->data[command + 28], (ctx.output->size - start + page - 1) & ~((uint64_t) page - 1));
+	}
+	if (signature) {
+		size = ctx.decoder->read32(&ctx.output->data[signature + 4]);
+		memmove(&ctx.output->data[signature], &ctx.output->data[signature + size], header + sizeofcmds - signature - size);
+		memset(&ctx.output->data[header + sizeofcmds - size], '\0', size);
+		dyldextract_write32(&ctx, &ctx.output->data[16], ncmds - 1);
+		dyldextract_write32(&ctx, &ctx.output->data[20], sizeofcmds - size);
+	}
+	dyldcache_segments_free(segments);
+	free(offsets);
+
+	memcpy(output, image, sizeof(dyldimage_t));
+	output->data = ctx.output->data;
+	output->size = ctx.output->size;
+	output->offset = 0;
+	output->map = NULL;
+	return 0;
+}
+
+/*
+ * Extracts images into directory across the extractor's workers, each
+ *  one writing out of its own buffer before it takes the next image.
+ */
+int dyldextract_save(dyldextract_t* extract, dyldimage_t** images, uint32_t count, const char* directory) {
+	debug("Saving extracted dyld images\n");
+	dyldextract_save_t ctx;
+	if (extract == NULL || images == NULL) {
+		return -1;
+	}
+	memset(&ctx, '\0', sizeof(ctx));
+	ctx.extract = extract;
+	ctx.images = images;
+	ctx.directory = directory ? directory : ".";
+	dyldcache_hold(extract->cache);
+	dyldpool_run(extract->pool, count, dyldextract_save_func, &ctx);
+	dyldcache_release(extract->cache);
+	return ctx.failed == 0 ? 0 : -1;
+}
+
+void dyldextract_free(dyldextract_t* extract) {
+	debug("Freeing dyld extractor\n");
+	uint32_t i = 0;
+	if (extract) {
+		if (extract->pool) {
+			for (i = 0; i < extract->pool->count; i++) {
+				if (extract->outputs) {
+					free(extract->outputs[i].data);
+				}
+				if (extract->strings) {
+					free(extract->strings[i].data);
+				}
+			}
+			dyldpool_free(extract->pool);
+			extract->pool = NULL;
+		}
+		free(extract->outputs);
+		free(extract->strings);
+		free(extract);
+	}
+}
@@ -26,6 +26,7 @@
 #include <libcrippy-1.0/libcrippy.h>
 #include <libdyldcache-1.0/map.h>
 #include <libdyldcache-1.0/image.h>
+#include <libdyldcache-1.0/decoder.h>
 
 /*
  * Dyld Image Functions
@@ -40,11 +41,15 @@ dyldimage_t* dyldimage_create() {
 	return image;
 }
 
-dyldimage_t* dyldimage_parse(unsigned char* data, uint32_t offset) {
+dyldimage_t* dyldimage_parse(unsigned char* data, uint64_t offset) {
+	return dyldimage_decode(NULL, data, offset);
+}
+
+dyldimage_t* dyldimage_decode(const dyldcache_decoder_t* decoder, unsigned char* data, uint64_t offset) {
 	debug("Parsing dyldimage\n");
 	dyldimage_t* image = dyldimage_create();
 	if (image) {
-		image->info = dyldimage_info_parse(data, offset);
+		image->info = dyldimage_info_decode(decoder, data, offset);
 		if(image->info == NULL) {
 			error("Unable to allocate data for dyld image info\n");
 			return NULL;
@@ -95,11 +100,19 @@ dyldimage_info_t* dyldimage_info_create() {
 	return info;
 }
 
-dyldimage_info_t* dyldimage_info_parse(unsigned char* data, uint32_t offset) {
+dyldimage_info_t* dyldimage_info_parse(unsigned char* data, uint64_t offset) {
+	return dyldimage_info_decode(NULL, data, offset);
+}
+
+dyldimage_info_t* dyldimage_info_decode(const dyldcache_decoder_t* decoder, unsigned char* data, uint64_t offset) {
 	debug("Parsing dyldimage info\n");
 	dyldimage_info_t* info = dyldimage_info_create();
 	if(info) {
-		memcpy(info, &data[offset], sizeof(dyldimage_info_t));
+		// Without a decoder the cache is taken to be little endian
+		if(decoder == NULL) {
+			decoder = dyldcache_decoder_get(kLittleEndian, 4);
+		}
+		decoder->image_info(&data[offset], info);
 	}
 	return info;
 }
@@ -120,12 +133,13 @@ void dyldimage_info_debug(dyldimage_info_t* info) {
 	}
 }
 
-void dyldimage_save(dyldimage_t* image, const char* path) {
+int dyldimage_save(dyldimage_t* image, const char* path) {
 	debug("Saving dyldimage\n");
 	if(image != NULL && image->data != NULL && image->size > 0) {
 		printf("Writing dylib to %s\n", path);
-		file_write(path, image->data, image->size);
+		return file_write(path, image->data, image->size);
 	}
+	return 0;
 }
 
 char* dyldimage_get_name(dyldimage_t* image) {
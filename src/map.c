@@ -26,6 +26,7 @@
 #include <libcrippy-1.0/libcrippy.h>
 #include <libcrippy-1.0/boolean.h>
 #include <libdyldcache-1.0/map.h>
+#include <libdyldcache-1.0/decoder.h>
 
 dyldmap_t* dyldmap_create() {
 	debug("Creating dyldmap\n");
@@ -36,11 +37,15 @@ dyldmap_t* dyldmap_create() {
 	return map;
 }
 
-dyldmap_t* dyldmap_parse(unsigned char* data, uint32_t offset) {
+dyldmap_t* dyldmap_parse(unsigned char* data, uint64_t offset) {
+	return dyldmap_decode(NULL, data, offset);
+}
+
+dyldmap_t* dyldmap_decode(const dyldcache_decoder_t* decoder, unsigned char* data, uint64_t offset) {
 	debug("Parsing dyldmap\n");
 	dyldmap_t* map = dyldmap_create();
 	if (map) {
-		map->info = dyldmap_info_parse(data, offset);
+		map->info = dyldmap_info_decode(decoder, data, offset);
 		if(map->info == NULL) {
 			error("Unable to allocate data for dyld map info\n");
 			return NULL;
@@ -95,11 +100,19 @@ dyldmap_info_t* dyldmap_info_create() {
 	return info;
 }
 
-dyldmap_info_t* dyldmap_info_parse(unsigned char* data, uint32_t offset) {
+dyldmap_info_t* dyldmap_info_parse(unsigned char* data, uint64_t offset) {
+	return dyldmap_info_decode(NULL, data, offset);
+}
+
+dyldmap_info_t* dyldmap_info_decode(const dyldcache_decoder_t* decoder, unsigned char* data, uint64_t offset) {
 	debug("Parsing dyldmap info\n");
 	dyldmap_info_t* info = dyldmap_info_create();
 	if(info) {
-		memcpy(info, &data[offset], sizeof(dyldmap_info_t));
+		// Without a decoder the cache is taken to be little endian
+		if(decoder == NULL) {
+			decoder = dyldcache_decoder_get(kLittleEndian, 4);
+		}
+		decoder->map_info(&data[offset], info);
 	}
 	return info;
 }
@@ -107,9 +120,9 @@ dyldmap_info_t* dyldmap_info_parse(unsigned char* data, uint32_t offset) {
 void dyldmap_info_debug(dyldmap_info_t* info) {
 	if(info) {
 		debug("\t\tInfo {\n");
-		debug("\t\t\t address = 0x%08x\n", (uint32_t)info->address);
-		debug("\t\t\t    size = 0x%08x\n", (uint32_t)info->size);
-		debug("\t\t\t  offset = 0x%08x\n", (uint32_t)info->offset);
+		debug("\t\t\t address = 0x%08llx\n", (unsigned long long)info->address);
+		debug("\t\t\t    size = 0x%08llx\n", (unsigned long long)info->size);
+		debug("\t\t\t  offset = 0x%08llx\n", (unsigned long long)info->offset);
 		debug("\t\t\t maxProt = %s\n", prot2str(info->maxProt));
 		debug("\t\t\tinitProt = %s\n", prot2str(info->initProt));
 		debug("\t\t}\n");
@@ -0,0 +1,843 @@
+/**
+  * libdyldcache-1.0 - objc.c
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define _DEBUG
+#include <libcrippy-1.0/debug.h>
+#include <libcrippy-1.0/libcrippy.h>
+
+#include <libdyldcache-1.0/map.h>
+#include <libdyldcache-1.0/image.h>
+#include <libdyldcache-1.0/cache.h>
+#include <libdyldcache-1.0/pool.h>
+#include <libdyldcache-1.0/segment.h>
+#include <libdyldcache-1.0/objc.h>
+
+// objc_stringhash_t: capacity, occupied, shift, mask, zero, unused, salt,
+//  scramble[256], then tab[mask + 1], checkbytes[capacity], offsets[capacity]
+#define DYLDOBJC_HASH_SALT      24
+#define DYLDOBJC_HASH_SCRAMBLE  32
+#define DYLDOBJC_HASH_TAB       1056
+
+// method_list_t flags in entsizeAndFlags
+#define DYLDOBJC_METHODS_SMALL   0x80000000
+#define DYLDOBJC_METHODS_DIRECT  0x40000000
+
+// Lists longer than this are taken to be garbage
+#define DYLDOBJC_LIST_MAX        (1 << 20)
+
+// Shared cache addresses on arm64 fit in 36 bits, the rest is tagging
+#define DYLDOBJC_ADDRESS_MASK    0xFFFFFFFFFULL
+
+typedef struct dyldcache_objc_list_t {
+	uint32_t class_count;
+	uint32_t class_capacity;
+	dyldcache_objc_class_t* classes;
+	uint32_t method_count;
+	uint32_t method_capacity;
+	dyldcache_objc_method_t* methods;
+	uint32_t protocol_count;
+	uint32_t protocol_capacity;
+	dyldcache_objc_protocol_t* protocols;
+} dyldcache_objc_list_t;
+
+typedef struct dyldcache_objc_ctx_t {
+	dyldcache_objc_t* objc;
+	dyldcache_objc_list_t* lists;
+	int arm64;
+} dyldcache_objc_ctx_t;
+
+/*
+ * Bob Jenkins' lookup8, which libobjc hashes its selector, class and
+ *  protocol tables with.
+ */
+#define DYLDOBJC_MIX(a, b, c) { \
+	a -= b; a -= c; a ^= (c >> 43); \
+	b -= c; b -= a; b ^= (a << 9); \
+	c -= a; c -= b; c ^= (b >> 8); \
+	a -= b; a -= c; a ^= (c >> 38); \
+	b -= c; b -= a; b ^= (a << 23); \
+	c -= a; c -= b; c ^= (b >> 5); \
+	a -= b; a -= c; a ^= (c >> 35); \
+	b -= c; b -= a; b ^= (a << 49); \
+	c -= a; c -= b; c ^= (b >> 11); \
+	a -= b; a -= c; a ^= (c >> 12); \
+	b -= c; b -= a; b ^= (a << 18); \
+	c -= a; c -= b; c ^= (b >> 22); \
+}
+
+static uint64_t dyldcache_objc_word(const unsigned char* key, uint32_t length) {
+	uint32_t i = 0;
+	uint64_t value = 0;
+	for (i = 0; i < length; i++) {
+		value |= (uint64_t) key[i] << (i * 8);
+	}
+	return value;
+}
+
+static uint64_t dyldcache_objc_lookup8(const unsigned char* key, uint64_t length, uint64_t level) {
+	uint64_t a = level;
+	uint64_t b = level;
+	uint64_t c = 0x9E3779B97F4A7C13ULL;
+	uint64_t left = length;
+
+	while (left >= 24) {
+		a += dyldcache_objc_word(key, 8);
+		b += dyldcache_objc_word(key + 8, 8);
+		c += dyldcache_objc_word(key + 16, 8);
+		DYLDOBJC_MIX(a, b, c);
+		key += 24;
+		left -= 24;
+	}
+	// The low byte of c is taken by the length
+	c += length;
+	if (left > 16) {
+		c += dyldcache_objc_word(key + 16, left - 16) << 8;
+	}
+	if (left > 8) {
+		b += dyldcache_objc_word(key + 8, left > 16 ? 8 : left - 8);
+	}
+	a += dyldcache_objc_word(key, left > 8 ? 8 : left);
+	DYLDOBJC_MIX(a, b, c);
+	return c;
+}
+
+static uint32_t dyldcache_objc_fnv(const char* name) {
+	uint32_t hash = 2166136261u;
+	while (*name) {
+		hash ^= (uint8_t) *name++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static uint64_t dyldcache_objc_pointer(dyldcache_objc_ctx_t* ctx, uint64_t address) {
+	uint64_t value = 0;
+	dyldcache_t* cache = ctx->objc->cache;
+	if (dyldcache_read(cache, address, cache->decoder->pointer_size) == NULL) {
+		return 0;
+	}
+	value = cache->decoder->pointer(dyldcache_read(cache, address, cache->decoder->pointer_size));
+	if (ctx->arm64) {
+		// Authenticated arm64e pointers hold an offset from the cache base
+		if (value >> 63) {
+			return cache->header->base_address + (value & 0xFFFFFFFFULL);
+		}
+		return value & DYLDOBJC_ADDRESS_MASK;
+	}
+	return value;
+}
+
+static int32_t dyldcache_objc_read_s32(dyldcache_t* cache, uint64_t address, int* ok) {
+	uint32_t value = 0;
+	if (dyldcache_read_u32(cache, address, &value) < 0) {
+		*ok = 0;
+	}
+	return (int32_t) value;
+}
+
+/*
+ * Returns the slot of key in an objc_stringhash_t at table, or -1. The
+ *  tables are perfect hashes, so this is one probe and one strcmp.
+ */
+static int64_t dyldcache_objc_hash_index(dyldcache_objc_t* objc, uint64_t table, const char* key, uint32_t* capacity) {
+	int ok = 1;
+	int32_t offset = 0;
+	uint32_t shift = 0;
+	uint32_t mask = 0;
+	uint32_t index = 0;
+	uint64_t hash = 0;
+	uint64_t length = strlen(key);
+	const char* string = NULL;
+	const unsigned char* header = NULL;
+	const unsigned char* byte = NULL;
+	dyldcache_t* cache = objc->cache;
+
+	header = dyldcache_read(cache, table, DYLDOBJC_HASH_TAB);
+	if (header == NULL || length == 0) {
+		return -1;
+	}
+	*capacity = cache->decoder->read32(header);
+	shift = cache->decoder->read32(header + 8);
+	mask = cache->decoder->read32(header + 12);
+	hash = dyldcache_objc_lookup8((const unsigned char*) key, length, cache->decoder->read64(header + DYLDOBJC_HASH_SALT));
+
+	byte = dyldcache_read(cache, table + DYLDOBJC_HASH_TAB + (hash & mask), 1);
+	if (byte == NULL || shift > 63) {
+		return -1;
+	}
+	header = dyldcache_read(cache, table, DYLDOBJC_HASH_TAB);
+	index = (uint32_t) (hash >> shift) ^ cache->decoder->read32(header + DYLDOBJC_HASH_SCRAMBLE + *byte * 4);
+	if (index >= *capacity) {
+		return -1;
+	}
+
+	// Check byte first, most misses end there without touching the string
+	byte = dyldcache_read(cache, table + DYLDOBJC_HASH_TAB + (uint64_t) mask + 1 + index, 1);
+	if (byte == NULL || *byte != (uint8_t) (((key[0] & 0x7) << 5) | (length & 0x1F))) {
+		return -1;
+	}
+	offset = dyldcache_objc_read_s32(cache, table + DYLDOBJC_HASH_TAB + (uint64_t) mask + 1 + *capacity + index * 4ULL, &ok);
+	string = ok ? dyldcache_read_cstring(cache, table + offset) : NULL;
+	if (string == NULL || strcmp(string, key)) {
+		return -1;
+	}
+	return index;
+}
+
+/*
+ * objc_clsopt_t and objc_protocolopt2_t follow the string offsets with a
+ *  (object, header) offset pair per slot; a tagged object offset instead
+ *  indexes a run of duplicates after the pairs, of which the first wins.
+ */
+static uint64_t dyldcache_objc_hash_object(dyldcache_objc_t* objc, uint64_t table, const char* key) {
+	int ok = 1;
+	int32_t object = 0;
+	uint32_t mask = 0;
+	uint32_t capacity = 0;
+	uint64_t pairs = 0;
+	int64_t index = dyldcache_objc_hash_index(objc, table, key, &capacity);
+	dyldcache_t* cache = objc->cache;
+
+	if (index < 0 || dyldcache_read_u32(cache, table + 12, &mask) < 0) {
+		return 0;
+	}
+	pairs = table + DYLDOBJC_HASH_TAB + (uint64_t) mask + 1 + capacity * 5ULL;
+	object = dyldcache_objc_read_s32(cache, pairs + index * 8, &ok);
+	if (ok && (object & 1)) {
+		// uint32_t duplicate count, then the duplicate pairs
+		object = dyldcache_objc_read_s32(cache, pairs + capacity * 8ULL + 4 + (uint64_t) (object >> 1) * 8, &ok);
+	}
+	return ok ? table + object : 0;
+}
+
+static dyldcache_segment_t* dyldcache_objc_section(dyldcache_objc_t* objc, dyldcache_segments_t* segments,
+		const char* name, uint64_t* address, uint64_t* size) {
+	uint32_t i = 0;
+	uint32_t j = 0;
+	uint32_t sectsize = segments->wide ? 80 : 68;
+	unsigned char* section = NULL;
+	const dyldcache_decoder_t* decoder = objc->cache->decoder;
+
+	for (i = 0; i < segments->count; i++) {
+		section = segments->segments[i].sections;
+		for (j = 0; j < segments->segments[i].nsects; j++, section += sectsize) {
+			if (!strncmp((const char*) section, name, 16)) {
+				*address = segments->wide ? decoder->read64(section + 32) : decoder->read32(section + 32);
+				*size = segments->wide ? decoder->read64(section + 40) : decoder->read32(section + 36);
+				return &segments->segments[i];
+			}
+		}
+	}
+	return NULL;
+}
+
+static void dyldcache_objc_opt(dyldcache_objc_t* objc) {
+	int ok = 1;
+	int32_t selopt = 0;
+	int32_t clsopt = 0;
+	int32_t protocolopt = 0;
+	int32_t protocolopt2 = 0;
+	int64_t base = 0;
+	int index = 0;
+	uint64_t size = 0;
+	uint64_t opt = 0;
+	dyldcache_t* cache = objc->cache;
+	dyldcache_segments_t* segments = NULL;
+
+	index = dyldcache_image_index(cache, DYLDOBJC_IMAGE);
+	if (index < 0) {
+		debug("No %s in dyld cache\n", DYLDOBJC_IMAGE);
+		return;
+	}
+	segments = dyldcache_segments_load(cache, cache->images[index]);
+	if (segments == NULL) {
+		return;
+	}
+	if (dyldcache_objc_section(objc, segments, "__objc_opt_ro", &opt, &size) == NULL ||
+			size < 16 || dyldcache_read_u32(cache, opt, &objc->version) < 0) {
+		debug("No objc optimization tables in dyld cache\n");
+		dyldcache_segments_free(segments);
+		return;
+	}
+	dyldcache_segments_free(segments);
+	objc->opt = opt;
+
+	if (objc->version < DYLDOBJC_VERSION_MIN || objc->version > DYLDOBJC_VERSION_MAX) {
+		debug("Unsupported objc optimization version %u\n", objc->version);
+		return;
+	}
+	if (objc->version < 15) {
+		// version, selopt, headeropt, clsopt[, protocolopt]
+		selopt = dyldcache_objc_read_s32(cache, opt + 4, &ok);
+		clsopt = dyldcache_objc_read_s32(cache, opt + 12, &ok);
+		if (objc->version >= 13 && size >= 20) {
+			protocolopt = dyldcache_objc_read_s32(cache, opt + 16, &ok);
+		}
+	} else {
+		// version, flags, selopt, headeropt_ro, clsopt, protocolopt,
+		//  headeropt_rw, protocolopt2[, class and protocol offsets,
+		//  relative method selector base]
+		if (size < 32) {
+			return;
+		}
+		selopt = dyldcache_objc_read_s32(cache, opt + 8, &ok);
+		clsopt = dyldcache_objc_read_s32(cache, opt + 16, &ok);
+		protocolopt = dyldcache_objc_read_s32(cache, opt + 20, &ok);
+		protocolopt2 = dyldcache_objc_read_s32(cache, opt + 28, &ok);
+		if (objc->version >= 16 && size >= 48 && dyldcache_read_u64(cache, opt + 40, (uint64_t*) &base) == 0 && base != 0) {
+			objc->selector_base = opt + base;
+		}
+	}
+	if (!ok) {
+		return;
+	}
+	objc->selopt = selopt ? opt + selopt : 0;
+	objc->clsopt = clsopt ? opt + clsopt : 0;
+	if (protocolopt2) {
+		objc->protocolopt = opt + protocolopt2;
+		objc->protocol_classes = 1;
+	} else if (protocolopt) {
+		objc->protocolopt = opt + protocolopt;
+	}
+}
+
+/*
+ * Per image metadata walk
+ */
+static void* dyldcache_objc_grow(void* array, uint32_t* capacity, uint32_t count, size_t size) {
+	void* grown = NULL;
+	if (count < *capacity) {
+		return array;
+	}
+	grown = realloc(array, (*capacity ? *capacity * 2 : 64) * size);
+	if (grown) {
+		*capacity = *capacity ? *capacity * 2 : 64;
+	}
+	return grown;
+}
+
+static uint32_t dyldcache_objc_method_list(dyldcache_objc_ctx_t* ctx, dyldcache_objc_list_t* list, uint64_t address) {
+	int ok = 1;
+	uint32_t i = 0;
+	uint32_t flags = 0;
+	uint32_t count = 0;
+	uint32_t entsize = 0;
+	uint32_t added = 0;
+	uint64_t entry = 0;
+	uint64_t name = 0;
+	uint64_t imp = 0;
+	dyldcache_objc_method_t* methods = NULL;
+	dyldcache_t* cache = ctx->objc->cache;
+	uint32_t pointer = cache->decoder->pointer_size;
+
+	if (address == 0 || dyldcache_read_u32(cache, address, &flags) < 0 ||
+			dyldcache_read_u32(cache, address + 4, &count) < 0 || count > DYLDOBJC_LIST_MAX) {
+		return 0;
+	}
+	entsize = flags & 0xFFFC;
+	if (entsize < ((flags & DYLDOBJC_METHODS_SMALL) ? 12 : pointer * 3)) {
+		return 0;
+	}
+	for (i = 0; i < count; i++) {
+		entry = address + 8 + (uint64_t) i * entsize;
+		if (flags & DYLDOBJC_METHODS_SMALL) {
+			// Relative: name, types and imp offsets, each from its own field
+			name = entry + dyldcache_objc_read_s32(cache, entry, &ok);
+			if (flags & DYLDOBJC_METHODS_DIRECT) {
+				name = ctx->objc->selector_base ? ctx->objc->selector_base + (name - entry) : 0;
+			} else {
+				name = dyldcache_objc_pointer(ctx, name);
+			}
+			imp = entry + 8 + dyldcache_objc_read_s32(cache, entry + 8, &ok);
+		} else {
+			name = dyldcache_objc_pointer(ctx, entry);
+			imp = dyldcache_objc_pointer(ctx, entry + pointer * 2);
+		}
+		if (!ok || name == 0) {
+			ok = 1;
+			continue;
+		}
+		methods = (dyldcache_objc_method_t*) dyldcache_objc_grow(list->methods, &list->method_capacity,
+				list->method_count, sizeof(dyldcache_objc_method_t));
+		if (methods == NULL) {
+			break;
+		}
+		list->methods = methods;
+		list->methods[list->method_count].name = name;
+		list->methods[list->method_count].imp = imp;
+		list->method_count++;
+		added++;
+	}
+	return added;
+}
+
+// class_t { isa, superclass, cache, vtable, data }, data -> class_ro_t
+static uint64_t dyldcache_objc_class_ro(dyldcache_objc_ctx_t* ctx, uint64_t cls) {
+	uint32_t pointer = ctx->objc->cache->decoder->pointer_size;
+	uint64_t data = dyldcache_objc_pointer(ctx, cls + pointer * 4);
+	return data & ~((uint64_t) pointer - 1);
+}
+
+static void dyldcache_objc_class_walk(dyldcache_objc_ctx_t* ctx, dyldcache_objc_list_t* list, uint32_t image, uint64_t cls) {
+	uint64_t ro = 0;
+	uint64_t meta = 0;
+	dyldcache_objc_class_t* classes = NULL;
+	dyldcache_objc_class_t* entry = NULL;
+	uint32_t pointer = ctx->objc->cache->decoder->pointer_size;
+	// class_ro_t { flags, instanceStart, instanceSize[, reserved], ivarLayout, name, baseMethods }
+	uint32_t name_offset = pointer == 8 ? 24 : 16;
+
+	ro = dyldcache_objc_class_ro(ctx, cls);
+	if (ro == 0) {
+		return;
+	}
+	classes = (dyldcache_objc_class_t*) dyldcache_objc_grow(list->classes, &list->class_capacity,
+			list->class_count, sizeof(dyldcache_objc_class_t));
+	if (classes == NULL) {
+		return;
+	}
+	list->classes = classes;
+	entry = &list->classes[list->class_count++];
+	memset(entry, '\0', sizeof(dyldcache_objc_class_t));
+	entry->address = cls;
+	entry->image = image;
+	entry->name = dyldcache_objc_pointer(ctx, ro + name_offset);
+	entry->methods = list->method_count;
+	entry->method_count = dyldcache_objc_method_list(ctx, list, dyldcache_objc_pointer(ctx, ro + name_offset + pointer));
+
+	meta = dyldcache_objc_pointer(ctx, cls);
+	ro = meta ? dyldcache_objc_class_ro(ctx, meta) : 0;
+	if (ro) {
+		entry->class_method_count = dyldcache_objc_method_list(ctx, list, dyldcache_objc_pointer(ctx, ro + name_offset + pointer));
+	}
+}
+
+// protocol_t { isa, mangledName, ... }
+static void dyldcache_objc_protocol_walk(dyldcache_objc_ctx_t* ctx, dyldcache_objc_list_t* list, uint32_t image, uint64_t protocol) {
+	dyldcache_objc_protocol_t* protocols = NULL;
+	uint64_t name = dyldcache_objc_pointer(ctx, protocol + ctx->objc->cache->decoder->pointer_size);
+	if (name == 0) {
+		return;
+	}
+	protocols = (dyldcache_objc_protocol_t*) dyldcache_objc_grow(list->protocols, &list->protocol_capacity,
+			list->protocol_count, sizeof(dyldcache_objc_protocol_t));
+	if (protocols == NULL) {
+		return;
+	}
+	list->protocols = protocols;
+	list->protocols[list->protocol_count].address = protocol;
+	list->protocols[list->protocol_count].name = name;
+	list->protocols[list->protocol_count].image = image;
+	list->protocol_count++;
+}
+
+static void dyldcache_objc_func(uint32_t index, uint32_t worker, void* userdata) {
+	uint64_t i = 0;
+	uint64_t size = 0;
+	uint64_t address = 0;
+	uint64_t object = 0;
+	dyldcache_objc_ctx_t* ctx = (dyldcache_objc_ctx_t*) userdata;
+	dyldcache_objc_list_t* list = &ctx->lists[index];
+	dyldcache_t* cache = ctx->objc->cache;
+	uint32_t pointer = cache->decoder->pointer_size;
+	dyldcache_segments_t* segments = NULL;
+
+	segments = dyldcache_segments_load(cache, cache->images[index]);
+	if (segments == NULL) {
+		return;
+	}
+	if (dyldcache_objc_section(ctx->objc, segments, "__objc_classlist", &address, &size)) {
+		for (i = 0; i + pointer <= size && i / pointer < DYLDOBJC_LIST_MAX; i += pointer) {
+			object = dyldcache_objc_pointer(ctx, address + i);
+			if (object) {
+				dyldcache_objc_class_walk(ctx, list, index, object);
+			}
+		}
+	}
+	if (dyldcache_objc_section(ctx->objc, segments, "__objc_protolist", &address, &size)) {
+		for (i = 0; i + pointer <= size && i / pointer < DYLDOBJC_LIST_MAX; i += pointer) {
+			object = dyldcache_objc_pointer(ctx, address + i);
+			if (object) {
+				dyldcache_objc_protocol_walk(ctx, list, index, object);
+			}
+		}
+	}
+	dyldcache_segments_free(segments);
+}
+
+/*
+ * Open addressing tables over name strings. Entries are inserted in image
+ *  order, so a lookup meets the first image's definition first.
+ */
+static uint32_t* dyldcache_objc_table(dyldcache_objc_t* objc, const unsigned char* entries, size_t stride,
+		uint32_t count, int unique, uint32_t* mask) {
+	uint32_t i = 0;
+	uint32_t slot = 0;
+	uint32_t size = 16;
+	uint32_t* table = NULL;
+	uint64_t name = 0;
+	const char* string = NULL;
+
+	while (size < count * 2) {
+		size <<= 1;
+	}
+	table = (uint32_t*) calloc(size, sizeof(uint32_t));
+	if (table == NULL) {
+		return NULL;
+	}
+	*mask = size - 1;
+	for (i = 0; i < count; i++) {
+		memcpy(&name, entries + i * stride, sizeof(uint64_t));
+		string = dyldcache_read_cstring(objc->cache, name);
+		if (string == NULL) {
+			continue;
+		}
+		slot = dyldcache_objc_fnv(string) & *mask;
+		while (table[slot] != 0) {
+			memcpy(&name, entries + (table[slot] - 1) * stride, sizeof(uint64_t));
+			// Uniqued selectors share one string, one entry does
+			if (unique && !memcmp(&name, entries + i * stride, sizeof(uint64_t))) {
+				break;
+			}
+			slot = (slot + 1) & *mask;
+		}
+		if (table[slot] == 0) {
+			table[slot] = i + 1;
+		}
+	}
+	return table;
+}
+
+static int64_t dyldcache_objc_table_find(dyldcache_objc_t* objc, const uint32_t* table, uint32_t mask,
+		const unsigned char* entries, size_t stride, const char* key) {
+	uint32_t slot = 0;
+	uint64_t name = 0;
+	const char* string = NULL;
+	if (table == NULL) {
+		return -1;
+	}
+	slot = dyldcache_objc_fnv(key) & mask;
+	while (table[slot] != 0) {
+		memcpy(&name, entries + (table[slot] - 1) * stride, sizeof(uint64_t));
+		string = dyldcache_read_cstring(objc->cache, name);
+		if (string && !strcmp(string, key)) {
+			return table[slot] - 1;
+		}
+		slot = (slot + 1) & mask;
+	}
+	return -1;
+}
+
+/*
+ * Dyldcache Objc Functions
+ */
+dyldcache_objc_t* dyldcache_objc_create() {
+	debug("Creating dyld cache objc metadata\n");
+	dyldcache_objc_t* objc = (dyldcache_objc_t*) malloc(sizeof(dyldcache_objc_t));
+	if (objc) {
+		memset(objc, '\0', sizeof(dyldcache_objc_t));
+	}
+	return objc;
+}
+
+dyldcache_objc_t* dyldcache_objc_load(dyldcache_t* cache) {
+	debug("Loading dyld cache objc metadata\n");
+	dyldcache_objc_t* objc = NULL;
+
+	if (cache == NULL || cache->images == NULL || cache->arch == NULL) {
+		return NULL;
+	}
+	objc = dyldcache_objc_create();
+	if (objc == NULL) {
+		error("Unable to allocate memory for dyld cache objc metadata\n");
+		return NULL;
+	}
+	objc->cache = cache;
+	dyldcache_objc_opt(objc);
+	dyldcache_objc_debug(objc);
+	return objc;
+}
+
+/*
+ * Walks every image's class and protocol lists across pool and builds
+ *  the class -> methods -> IMP index. Needed for methods, and for class,
+ *  selector and protocol lookups in caches without optimized tables.
+ */
+int dyldcache_objc_index(dyldcache_objc_t* objc, dyldpool_t* pool) {
+	debug("Indexing dyld cache objc metadata\n");
+	uint32_t i = 0;
+	uint32_t j = 0;
+	uint64_t classes = 0;
+	uint64_t methods = 0;
+	uint64_t protocols = 0;
+	dyldpool_t* owned = NULL;
+	dyldcache_objc_list_t* list = NULL;
+	dyldcache_objc_ctx_t ctx;
+	dyldcache_t* cache = NULL;
+
+	if (objc == NULL) {
+		return -1;
+	}
+	if (objc->classes) {
+		return 0;
+	}
+	cache = objc->cache;
+	memset(&ctx, '\0', sizeof(ctx));
+	ctx.objc = objc;
+	ctx.arm64 = cache->arch->cpu_subtype == kArm64;
+	ctx.lists = (dyldcache_objc_list_t*) calloc(cache->count + 1, sizeof(dyldcache_objc_list_t));
+	if (ctx.lists == NULL) {
+		error("Unable to allocate memory for dyld cache objc lists\n");
+		return -1;
+	}
+
+	if (pool == NULL) {
+		pool = owned = dyldpool_create(0);
+	}
+	// One list per image, so merging them in order is deterministic
+	dyldcache_hold(cache);
+	dyldpool_run(pool, cache->count, dyldcache_objc_func, &ctx);
+	dyldcache_release(cache);
+	if (owned) {
+		dyldpool_free(owned);
+	}
+
+	for (i = 0; i < cache->count; i++) {
+		classes += ctx.lists[i].class_count;
+		methods += ctx.lists[i].method_count;
+		protocols += ctx.lists[i].protocol_count;
+	}
+	if (classes < 0x7FFFFFFF && methods < 0x7FFFFFFF && protocols < 0x7FFFFFFF) {
+		objc->classes = (dyldcache_objc_class_t*) malloc((classes + 1) * sizeof(dyldcache_objc_class_t));
+		objc->methods = (dyldcache_objc_method_t*) malloc((methods + 1) * sizeof(dyldcache_objc_method_t));
+		objc->protocols = (dyldcache_objc_protocol_t*) malloc((protocols + 1) * sizeof(dyldcache_objc_protocol_t));
+	}
+	if (objc->classes && objc->methods && objc->protocols) {
+		for (i = 0; i < cache->count; i++) {
+			list = &ctx.lists[i];
+			for (j = 0; j < list->class_count; j++) {
+				list->classes[j].methods += objc->method_count;
+			}
+			if (list->class_count) {
+				memcpy(&objc->classes[objc->class_count], list->classes, list->class_count * sizeof(dyldcache_objc_class_t));
+			}
+			if (list->method_count) {
+				memcpy(&objc->methods[objc->method_count], list->methods, list->method_count * sizeof(dyldcache_objc_method_t));
+			}
+			if (list->protocol_count) {
+				memcpy(&objc->protocols[objc->protocol_count], list->protocols, list->protocol_count * sizeof(dyldcache_objc_protocol_t));
+			}
+			objc->class_count += list->class_count;
+			objc->method_count += list->method_count;
+			objc->protocol_count += list->protocol_count;
+		}
+	}
+	for (i = 0; i < cache->count; i++) {
+		free(ctx.lists[i].classes);
+		free(ctx.lists[i].methods);
+		free(ctx.lists[i].protocols);
+	}
+	free(ctx.lists);
+	if (objc->classes == NULL || objc->methods == NULL || objc->protocols == NULL) {
+		error("Unable to allocate memory for dyld cache objc index\n");
+		free(objc->classes);
+		free(objc->methods);
+		free(objc->protocols);
+		objc->classes = NULL;
+		objc->methods = NULL;
+		objc->protocols = NULL;
+		return -1;
+	}
+
+	objc->class_table = dyldcache_objc_table(objc, (const unsigned char*) &objc->classes[0].name,
+			sizeof(dyldcache_objc_class_t), objc->class_count, 0, &objc->class_mask);
+	objc->selector_table = dyldcache_objc_table(objc, (const unsigned char*) &objc->methods[0].name,
+			sizeof(dyldcache_objc_method_t), objc->method_count, 1, &objc->selector_mask);
+	objc->protocol_table = dyldcache_objc_table(objc, (const unsigned char*) &objc->protocols[0].name,
+			sizeof(dyldcache_objc_protocol_t), objc->protocol_count, 0, &objc->protocol_mask);
+	if (objc->class_table == NULL || objc->selector_table == NULL || objc->protocol_table == NULL) {
+		error("Unable to allocate memory for dyld cache objc tables\n");
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Returns the address of the uniqued selector string for name, or 0.
+ */
+uint64_t dyldcache_objc_selector(dyldcache_objc_t* objc, const char* name) {
+	int ok = 1;
+	int64_t index = 0;
+	int32_t offset = 0;
+	uint32_t mask = 0;
+	uint32_t capacity = 0;
+
+	if (objc == NULL || name == NULL) {
+		return 0;
+	}
+	if (objc->selopt) {
+		index = dyldcache_objc_hash_index(objc, objc->selopt, name, &capacity);
+		if (index < 0 || dyldcache_read_u32(objc->cache, objc->selopt + 12, &mask) < 0) {
+			return 0;
+		}
+		offset = dyldcache_objc_read_s32(objc->cache, objc->selopt + DYLDOBJC_HASH_TAB + (uint64_t) mask + 1 + capacity + index * 4, &ok);
+		return ok ? objc->selopt + offset : 0;
+	}
+	if (objc->methods == NULL) {
+		return 0;
+	}
+	index = dyldcache_objc_table_find(objc, objc->selector_table, objc->selector_mask,
+			(const unsigned char*) &objc->methods[0].name, sizeof(dyldcache_objc_method_t), name);
+	return index < 0 ? 0 : objc->methods[index].name;
+}
+
+uint64_t dyldcache_objc_class(dyldcache_objc_t* objc, const char* name) {
+	dyldcache_objc_class_t* cls = NULL;
+	if (objc == NULL || name == NULL) {
+		return 0;
+	}
+	if (objc->clsopt) {
+		return dyldcache_objc_hash_object(objc, objc->clsopt, name);
+	}
+	cls = dyldcache_objc_find_class(objc, name);
+	return cls ? cls->address : 0;
+}
+
+uint64_t dyldcache_objc_protocol(dyldcache_objc_t* objc, const char* name) {
+	int ok = 1;
+	int64_t index = 0;
+	int32_t offset = 0;
+	uint32_t mask = 0;
+	uint32_t capacity = 0;
+
+	if (objc == NULL || name == NULL) {
+		return 0;
+	}
+	if (objc->protocolopt && objc->protocol_classes) {
+		return dyldcache_objc_hash_object(objc, objc->protocolopt, name);
+	}
+	if (objc->protocolopt) {
+		// objc_protocolopt_t has one protocol offset per slot
+		index = dyldcache_objc_hash_index(objc, objc->protocolopt, name, &capacity);
+		if (index < 0 || dyldcache_read_u32(objc->cache, objc->protocolopt + 12, &mask) < 0) {
+			return 0;
+		}
+		offset = dyldcache_objc_read_s32(objc->cache,
+				objc->protocolopt + DYLDOBJC_HASH_TAB + (uint64_t) mask + 1 + capacity * 5ULL + index * 4, &ok);
+		return ok ? objc->protocolopt + offset : 0;
+	}
+	if (objc->protocols == NULL) {
+		return 0;
+	}
+	index = dyldcache_objc_table_find(objc, objc->protocol_table, objc->protocol_mask,
+			(const unsigned char*) &objc->protocols[0].name, sizeof(dyldcache_objc_protocol_t), name);
+	return index < 0 ? 0 : objc->protocols[index].address;
+}
+
+dyldcache_objc_class_t* dyldcache_objc_find_class(dyldcache_objc_t* objc, const char* name) {
+	int64_t index = 0;
+	if (objc == NULL || name == NULL || objc->classes == NULL) {
+		return NULL;
+	}
+	index = dyldcache_objc_table_find(objc, objc->class_table, objc->class_mask,
+			(const unsigned char*) &objc->classes[0].name, sizeof(dyldcache_objc_class_t), name);
+	return index < 0 ? NULL : &objc->classes[index];
+}
+
+dyldcache_objc_method_t* dyldcache_objc_methods(dyldcache_objc_t* objc, dyldcache_objc_class_t* cls, uint32_t* count) {
+	if (objc == NULL || cls == NULL) {
+		if (count) *count = 0;
+		return NULL;
+	}
+	if (count) *count = cls->method_count + cls->class_method_count;
+	return &objc->methods[cls->methods];
+}
+
+/*
+ * Returns the IMP of selector on the class named cls, its class method
+ *  when meta is set, or 0. Only the class itself is searched, not its
+ *  superclasses or categories.
+ */
+uint64_t dyldcache_objc_imp(dyldcache_objc_t* objc, const char* cls, const char* selector, int meta) {
+	uint32_t i = 0;
+	uint32_t count = 0;
+	const char* name = NULL;
+	dyldcache_objc_method_t* methods = NULL;
+	dyldcache_objc_class_t* found = dyldcache_objc_find_class(objc, cls);
+
+	if (found == NULL || selector == NULL) {
+		return 0;
+	}
+	methods = &objc->methods[found->methods + (meta ? found->method_count : 0)];
+	count = meta ? found->class_method_count : found->method_count;
+	for (i = 0; i < count; i++) {
+		name = dyldcache_read_cstring(objc->cache, methods[i].name);
+		if (name && !strcmp(name, selector)) {
+			return methods[i].imp;
+		}
+	}
+	return 0;
+}
+
+void dyldcache_objc_debug(dyldcache_objc_t* objc) {
+	debug("\tObjc:\n");
+	debug("\t\tversion = %u\n", objc->version);
+	debug("\t\tselopt = 0x%qX\n", objc->selopt);
+	debug("\t\tclsopt = 0x%qX\n", objc->clsopt);
+	debug("\t\tprotocolopt = 0x%qX\n", objc->protocolopt);
+	debug("\t\tclass_count = %u\n", objc->class_count);
+	debug("\t\tmethod_count = %u\n", objc->method_count);
+	debug("\t\tprotocol_count = %u\n", objc->protocol_count);
+	debug("\n");
+}
+
+void dyldcache_objc_free(dyldcache_objc_t* objc) {
+	debug("Freeing dyld cache objc metadata\n");
+	if (objc) {
+		if (objc->classes) {
+			free(objc->classes);
+			objc->classes = NULL;
+		}
+		if (objc->methods) {
+			free(objc->methods);
+			objc->methods = NULL;
+		}
+		if (objc->protocols) {
+			free(objc->protocols);
+			objc->protocols = NULL;
+		}
+		if (objc->class_table) {
+			free(objc->class_table);
+			objc->class_table = NULL;
+		}
+		if (objc->selector_table) {
+			free(objc->selector_table);
+			objc->selector_table = NULL;
+		}
+		if (objc->protocol_table) {
+			free(objc->protocol_table);
+			objc->protocol_table = NULL;
+		}
+		free(objc);
+	}
+}
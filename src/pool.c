@@ -0,0 +1,181 @@
+/**
+  * libdyldcache-1.0 - pool.c
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define _DEBUG
+#include <libcrippy-1.0/debug.h>
+#include <libcrippy-1.0/libcrippy.h>
+#include <libdyldcache-1.0/pool.h>
+
+typedef struct dyldpool_worker_t {
+	dyldpool_t* pool;
+	uint32_t id;
+} dyldpool_worker_t;
+
+static void dyldpool_drain(dyldpool_t* pool, uint32_t id) {
+	uint32_t i = 0;
+	// Images vary wildly in size, so hand out one index at a time
+	//  rather than splitting the range up front
+	while ((i = __sync_fetch_and_add(&pool->next, 1)) < pool->total) {
+		pool->func(i, id, pool->userdata);
+	}
+}
+
+static void* dyldpool_main(void* arg) {
+	dyldpool_worker_t* worker = (dyldpool_worker_t*) arg;
+	dyldpool_t* pool = worker->pool;
+	uint32_t id = worker->id;
+	uint32_t seen = 0;
+	free(worker);
+
+	// Threads may start after the first run was already posted, so count
+	//  from the initial generation rather than the current one
+	pthread_mutex_lock(&pool->lock);
+	while (1) {
+		while (!pool->shutdown && pool->generation == seen) {
+			pthread_cond_wait(&pool->start, &pool->lock);
+		}
+		if (pool->shutdown) {
+			break;
+		}
+		seen = pool->generation;
+		pthread_mutex_unlock(&pool->lock);
+
+		dyldpool_drain(pool, id);
+
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->running == 0) {
+			pthread_cond_signal(&pool->done);
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+/*
+ * Dyld Pool Functions
+ */
+uint32_t dyldpool_cpu_count() {
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	if (count < 1) {
+		count = 1;
+	}
+	return (uint32_t) count;
+}
+
+dyldpool_t* dyldpool_create(uint32_t count) {
+	debug("Creating dyld pool\n");
+	uint32_t i = 0;
+	dyldpool_worker_t* worker = NULL;
+	dyldpool_t* pool = (dyldpool_t*) malloc(sizeof(dyldpool_t));
+	if (pool) {
+		memset(pool, '\0', sizeof(dyldpool_t));
+		if (count == 0) {
+			count = dyldpool_cpu_count();
+		}
+		pthread_mutex_init(&pool->lock, NULL);
+		pthread_cond_init(&pool->start, NULL);
+		pthread_cond_init(&pool->done, NULL);
+
+		// The calling thread always works as worker 0
+		pool->count = 1;
+		pool->threads = (pthread_t*) malloc(count * sizeof(pthread_t));
+		if (pool->threads == NULL) {
+			error("Unable to allocate memory for dyld pool threads\n");
+			dyldpool_free(pool);
+			return NULL;
+		}
+		for (i = 1; i < count; i++) {
+			worker = (dyldpool_worker_t*) malloc(sizeof(dyldpool_worker_t));
+			if (worker == NULL) {
+				break;
+			}
+			worker->pool = pool;
+			worker->id = i;
+			if (pthread_create(&pool->threads[i], NULL, dyldpool_main, worker) != 0) {
+				error("Unable to start dyld pool thread %u\n", i);
+				free(worker);
+				break;
+			}
+			pool->count++;
+		}
+	}
+	return pool;
+}
+
+void dyldpool_run(dyldpool_t* pool, uint32_t count, dyldpool_func_t func, void* userdata) {
+	uint32_t i = 0;
+	if (count == 0 || func == NULL) {
+		return;
+	}
+
+	if (pool == NULL || pool->count <= 1 || count == 1) {
+		for (i = 0; i < count; i++) {
+			func(i, 0, userdata);
+		}
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->func = func;
+	pool->userdata = userdata;
+	pool->total = count;
+	pool->next = 0;
+	pool->running = pool->count - 1;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+
+	dyldpool_drain(pool, 0);
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->running > 0) {
+		pthread_cond_wait(&pool->done, &pool->lock);
+	}
+	pool->func = NULL;
+	pool->userdata = NULL;
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void dyldpool_free(dyldpool_t* pool) {
+	debug("Freeing dyld pool\n");
+	uint32_t i = 0;
+	if (pool) {
+		pthread_mutex_lock(&pool->lock);
+		pool->shutdown = 1;
+		pthread_cond_broadcast(&pool->start);
+		pthread_mutex_unlock(&pool->lock);
+		if (pool->threads) {
+			for (i = 1; i < pool->count; i++) {
+				pthread_join(pool->threads[i], NULL);
+			}
+			free(pool->threads);
+			pool->threads = NULL;
+		}
+		pthread_cond_destroy(&pool->done);
+		pthread_cond_destroy(&pool->start);
+		pthread_mutex_destroy(&pool->lock);
+		free(pool);
+	}
+}
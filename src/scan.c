@@ -0,0 +1,623 @@
+/**
+  * libdyldcache-1.0 - scan.c
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define _DEBUG
+#include <libcrippy-1.0/debug.h>
+#include <libcrippy-1.0/libcrippy.h>
+
+#include <libdyldcache-1.0/map.h>
+#include <libdyldcache-1.0/image.h>
+#include <libdyldcache-1.0/cache.h>
+#include <libdyldcache-1.0/pool.h>
+#include <libdyldcache-1.0/segment.h>
+#include <libdyldcache-1.0/scan.h>
+
+typedef struct dyldcache_scan_region_t {
+	uint64_t address;
+	uint64_t offset;
+	uint64_t size;
+} dyldcache_scan_region_t;
+
+typedef struct dyldcache_scan_range_t {
+	uint64_t start;
+	uint64_t end;
+	uint32_t image;
+} dyldcache_scan_range_t;
+
+typedef struct dyldcache_scan_chunk_t {
+	dyldcache_scan_region_t* region;
+	uint64_t start;
+	uint64_t length;
+} dyldcache_scan_chunk_t;
+
+typedef struct dyldcache_scan_list_t {
+	int failed;
+	uint64_t count;
+	uint64_t capacity;
+	dyldcache_hit_t* hits;
+} dyldcache_scan_list_t;
+
+typedef struct dyldcache_scan_ctx_t {
+	dyldcache_t* cache;
+	dyldcache_scan_t* scan;
+	uint32_t region_count;
+	dyldcache_scan_region_t* regions;
+	uint32_t range_count;
+	dyldcache_scan_range_t* ranges;
+	uint32_t chunk_count;
+	dyldcache_scan_chunk_t* chunks;
+	dyldcache_scan_list_t* lists;
+} dyldcache_scan_ctx_t;
+
+// Bytes too common in code and data to make a useful anchor
+static int dyldcache_pattern_score(uint8_t byte) {
+	return (byte == 0x00 || byte == 0xFF) ? 1 : 2;
+}
+
+static int dyldcache_pattern_hex(int c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+static void dyldcache_scan_hit(dyldcache_scan_list_t* list, uint64_t address, uint32_t pattern) {
+	dyldcache_hit_t* hits = NULL;
+	if (list->count == list->capacity) {
+		list->capacity = list->capacity ? list->capacity * 2 : 64;
+		hits = (dyldcache_hit_t*) realloc(list->hits, list->capacity * sizeof(dyldcache_hit_t));
+		if (hits == NULL) {
+			list->capacity = list->count;
+			list->failed = 1;
+			return;
+		}
+		list->hits = hits;
+	}
+	list->hits[list->count].address = address;
+	list->hits[list->count].pattern = pattern;
+	list->hits[list->count].image = -1;
+	list->count++;
+}
+
+static int dyldcache_scan_match(const dyldcache_pattern_t* pattern, const unsigned char* data) {
+	uint32_t i = 0;
+	for (i = 0; i < pattern->length; i++) {
+		if ((data[i] & pattern->mask[i]) != pattern->bytes[i]) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+ * Finds every match of pattern starting in [0, length) of data, where
+ *  avail bytes are readable. Candidates come from the anchor byte(s),
+ *  16 positions at a time where SIMD is available.
+ */
+static void dyldcache_scan_pattern(dyldcache_scan_list_t* list, uint32_t index, const dyldcache_pattern_t* pattern,
+		const unsigned char* data, uint64_t length, uint64_t avail, uint64_t address) {
+	uint64_t q = 0;
+	uint64_t last = 0;
+	uint64_t limit = 0;
+	uint32_t bits = 0;
+	uint8_t first = pattern->bytes[pattern->anchor];
+	uint8_t second = pattern->wide ? pattern->bytes[pattern->anchor + 1] : 0;
+	const unsigned char* found = NULL;
+
+	if (avail < pattern->length) {
+		return;
+	}
+	last = avail - pattern->length + 1;
+	if (last > length) {
+		last = length;
+	}
+	// Anchor positions run from anchor to limit, exclusive
+	limit = last + pattern->anchor;
+	q = pattern->anchor;
+
+#if defined(__SSE2__)
+	{
+		const __m128i one = _mm_set1_epi8((char) first);
+		const __m128i two = _mm_set1_epi8((char) second);
+		__m128i hits;
+		while (q + 17 <= avail && q + 16 <= limit) {
+			hits = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (data + q)), one);
+			if (pattern->wide) {
+				hits = _mm_and_si128(hits, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (data + q + 1)), two));
+			}
+			bits = (uint32_t) _mm_movemask_epi8(hits);
+			while (bits) {
+				found = data + q + __builtin_ctz(bits) - pattern->anchor;
+				if (dyldcache_scan_match(pattern, found)) {
+					dyldcache_scan_hit(list, address + (found - data), index);
+				}
+				bits &= bits - 1;
+			}
+			q += 16;
+		}
+	}
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+	{
+		static const uint8_t weights[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+		const uint8x16_t one = vdupq_n_u8(first);
+		const uint8x16_t two = vdupq_n_u8(second);
+		const uint8x16_t weight = vld1q_u8(weights);
+		uint8x16_t hits;
+		while (q + 17 <= avail && q + 16 <= limit) {
+			hits = vceqq_u8(vld1q_u8(data + q), one);
+			if (pattern->wide) {
+				hits = vandq_u8(hits, vceqq_u8(vld1q_u8(data + q + 1), two));
+			}
+			hits = vandq_u8(hits, weight);
+			bits = vaddv_u8(vget_low_u8(hits)) | ((uint32_t) vaddv_u8(vget_high_u8(hits)) << 8);
+			while (bits) {
+				found = data + q + __builtin_ctz(bits) - pattern->anchor;
+				if (dyldcache_scan_match(pattern, found)) {
+					dyldcache_scan_hit(list, address + (found - data), index);
+				}
+				bits &= bits - 1;
+			}
+			q += 16;
+		}
+	}
+#endif
+
+	while (q < limit) {
+		found = (const unsigned char*) memchr(data + q, first, limit - q);
+		if (found == NULL) {
+			break;
+		}
+		q = found - data;
+		if (!pattern->wide || data[q + 1] == second) {
+			if (dyldcache_scan_match(pattern, data + q - pattern->anchor)) {
+				dyldcache_scan_hit(list, address + q - pattern->anchor, index);
+			}
+		}
+		q++;
+	}
+}
+
+static int dyldcache_scan_compare_hits(const void* a, const void* b) {
+	const dyldcache_hit_t* left = (const dyldcache_hit_t*) a;
+	const dyldcache_hit_t* right = (const dyldcache_hit_t*) b;
+	if (left->address != right->address) {
+		return left->address < right->address ? -1 : 1;
+	}
+	return left->pattern < right->pattern ? -1 : left->pattern > right->pattern;
+}
+
+static int dyldcache_scan_compare_regions(const void* a, const void* b) {
+	const dyldcache_scan_region_t* left = (const dyldcache_scan_region_t*) a;
+	const dyldcache_scan_region_t* right = (const dyldcache_scan_region_t*) b;
+	return left->address < right->address ? -1 : left->address > right->address;
+}
+
+static int dyldcache_scan_compare_ranges(const void* a, const void* b) {
+	const dyldcache_scan_range_t* left = (const dyldcache_scan_range_t*) a;
+	const dyldcache_scan_range_t* right = (const dyldcache_scan_range_t*) b;
+	return left->start < right->start ? -1 : left->start > right->start;
+}
+
+static int32_t dyldcache_scan_owner(dyldcache_scan_ctx_t* ctx, uint64_t address) {
+	uint32_t low = 0;
+	uint32_t high = ctx->range_count;
+	uint32_t middle = 0;
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		if (ctx->ranges[middle].start <= address) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	if (low > 0 && address < ctx->ranges[low - 1].end) {
+		return ctx->ranges[low - 1].image;
+	}
+	return -1;
+}
+
+/*
+ * Calls found for every mapped segment of the image other than the
+ *  __LINKEDIT shared by all images. Returns the segment count.
+ */
+static uint32_t dyldcache_scan_segments(dyldcache_t* cache, dyldimage_t* image,
+		void (*found)(void* userdata, uint32_t image, dyldcache_segment_t* segment), void* userdata) {
+	uint32_t i = 0;
+	uint32_t count = 0;
+	dyldcache_segment_t* segment = NULL;
+	dyldcache_segments_t* segments = dyldcache_segments_load(cache, image);
+
+	for (i = 0; segments && i < segments->count; i++) {
+		segment = &segments->segments[i];
+		if (segment->data == NULL || !strcmp(segment->name, "__LINKEDIT")) {
+			continue;
+		}
+		if (found) {
+			found(userdata, image->index, segment);
+		}
+		count++;
+	}
+	dyldcache_segments_free(segments);
+	return count;
+}
+
+static void dyldcache_scan_add_range(void* userdata, uint32_t image, dyldcache_segment_t* segment) {
+	dyldcache_scan_ctx_t* ctx = (dyldcache_scan_ctx_t*) userdata;
+	ctx->ranges[ctx->range_count].start = segment->address;
+	ctx->ranges[ctx->range_count].end = segment->address + segment->vmsize;
+	ctx->ranges[ctx->range_count].image = image;
+	ctx->range_count++;
+}
+
+static void dyldcache_scan_add_region(void* userdata, uint32_t image, dyldcache_segment_t* segment) {
+	dyldcache_scan_ctx_t* ctx = (dyldcache_scan_ctx_t*) userdata;
+	ctx->regions[ctx->region_count].address = segment->address;
+	ctx->regions[ctx->region_count].offset = segment->offset;
+	ctx->regions[ctx->region_count].size = segment->size;
+	ctx->region_count++;
+}
+
+static void dyldcache_scan_func(uint32_t index, uint32_t worker, void* userdata) {
+	dyldcache_scan_ctx_t* ctx = (dyldcache_scan_ctx_t*) userdata;
+	dyldcache_scan_chunk_t* chunk = &ctx->chunks[index];
+	dyldcache_scan_list_t* list = &ctx->lists[index];
+	dyldcache_scan_t* scan = ctx->scan;
+	uint32_t i = 0;
+	uint64_t avail = 0;
+	unsigned char* data = NULL;
+
+	// Matches may run past the chunk, but not past the region
+	avail = chunk->region->size - chunk->start;
+	if (avail > chunk->length + scan->longest - 1) {
+		avail = chunk->length + scan->longest - 1;
+	}
+	if (dyldcache_fetch(ctx->cache, chunk->region->offset + chunk->start, avail) < 0) {
+		return;
+	}
+	data = &ctx->cache->data[chunk->region->offset + chunk->start];
+	for (i = 0; i < scan->count; i++) {
+		dyldcache_scan_pattern(list, i, scan->patterns[i], data, chunk->length, avail, chunk->region->address + chunk->start);
+	}
+	if (list->count > 1) {
+		qsort(list->hits, list->count, sizeof(dyldcache_hit_t), dyldcache_scan_compare_hits);
+	}
+}
+
+static int dyldcache_scan_run(dyldcache_scan_t* scan, dyldcache_scan_ctx_t* ctx, dyldpool_t* pool) {
+	uint32_t i = 0;
+	uint64_t j = 0;
+	uint64_t start = 0;
+	uint64_t total = 0;
+	dyldpool_t* owned = NULL;
+	dyldcache_t* cache = ctx->cache;
+
+	free(scan->hits);
+	scan->hits = NULL;
+	scan->hit_count = 0;
+
+	// Segment ranges of every image, to name the owner of each hit
+	ctx->ranges = (dyldcache_scan_range_t*) malloc((ctx->range_count + 1) * sizeof(dyldcache_scan_range_t));
+	if (ctx->ranges == NULL) {
+		return -1;
+	}
+	ctx->range_count = 0;
+	for (i = 0; i < cache->count; i++) {
+		dyldcache_scan_segments(cache, cache->images[i], dyldcache_scan_add_range, ctx);
+	}
+	qsort(ctx->ranges, ctx->range_count, sizeof(dyldcache_scan_range_t), dyldcache_scan_compare_ranges);
+	qsort(ctx->regions, ctx->region_count, sizeof(dyldcache_scan_region_t), dyldcache_scan_compare_regions);
+
+	for (i = 0; i < ctx->region_count; i++) {
+		ctx->chunk_count += (ctx->regions[i].size + DYLDSCAN_CHUNK - 1) / DYLDSCAN_CHUNK;
+	}
+	ctx->chunks = (dyldcache_scan_chunk_t*) calloc(ctx->chunk_count + 1, sizeof(dyldcache_scan_chunk_t));
+	ctx->lists = (dyldcache_scan_list_t*) calloc(ctx->chunk_count + 1, sizeof(dyldcache_scan_list_t));
+	if (ctx->chunks == NULL || ctx->lists == NULL) {
+		return -1;
+	}
+	ctx->chunk_count = 0;
+	for (i = 0; i < ctx->region_count; i++) {
+		for (start = 0; start < ctx->regions[i].size; start += DYLDSCAN_CHUNK) {
+			ctx->chunks[ctx->chunk_count].region = &ctx->regions[i];
+			ctx->chunks[ctx->chunk_count].start = start;
+			ctx->chunks[ctx->chunk_count].length = (ctx->regions[i].size - start < DYLDSCAN_CHUNK) ?
+					ctx->regions[i].size - start : DYLDSCAN_CHUNK;
+			ctx->chunk_count++;
+		}
+	}
+
+	if (pool == NULL) {
+		pool = owned = dyldpool_create(0);
+	}
+	dyldcache_hold(ctx->cache);
+	dyldpool_run(pool, ctx->chunk_count, dyldcache_scan_func, ctx);
+	dyldcache_release(ctx->cache);
+	if (owned) {
+		dyldpool_free(owned);
+	}
+
+	// Regions are in address order and each chunk is sorted already
+	for (i = 0; i < ctx->chunk_count; i++) {
+		if (ctx->lists[i].failed) {
+			error("Unable to allocate memory for dyld cache scan hits\n");
+			return -1;
+		}
+		total += ctx->lists[i].count;
+	}
+	scan->hits = (dyldcache_hit_t*) malloc((total + 1) * sizeof(dyldcache_hit_t));
+	if (scan->hits == NULL) {
+		return -1;
+	}
+	for (i = 0; i < ctx->chunk_count; i++) {
+		for (j = 0; j < ctx->lists[i].count; j++) {
+			scan->hits[scan->hit_count] = ctx->lists[i].hits[j];
+			scan->hits[scan->hit_count].image = dyldcache_scan_owner(ctx, scan->hits[scan->hit_count].address);
+			scan->hit_count++;
+		}
+	}
+	return 0;
+}
+
+static void dyldcache_scan_ctx_free(dyldcache_scan_ctx_t* ctx) {
+	uint32_t i = 0;
+	if (ctx->lists) {
+		for (i = 0; i < ctx->chunk_count; i++) {
+			free(ctx->lists[i].hits);
+		}
+	}
+	free(ctx->lists);
+	free(ctx->chunks);
+	free(ctx->regions);
+	free(ctx->ranges);
+}
+
+/*
+ * Dyldcache Pattern Functions
+ */
+dyldcache_pattern_t* dyldcache_pattern_create() {
+	dyldcache_pattern_t* pattern = (dyldcache_pattern_t*) malloc(sizeof(dyldcache_pattern_t));
+	if (pattern) {
+		memset(pattern, '\0', sizeof(dyldcache_pattern_t));
+	}
+	return pattern;
+}
+
+dyldcache_pattern_t* dyldcache_pattern_parse(const char* name, const char* text) {
+	debug("Parsing byte pattern\n");
+	int high = 0;
+	int low = 0;
+	int score = 0;
+	int best = 0;
+	uint32_t i = 0;
+	size_t size = strlen(text) / 2 + 1;
+	dyldcache_pattern_t* pattern = dyldcache_pattern_create();
+
+	if (pattern == NULL) {
+		return NULL;
+	}
+	pattern->bytes = (uint8_t*) malloc(size);
+	pattern->mask = (uint8_t*) malloc(size);
+	pattern->name = strdup(name ? name : text);
+	if (pattern->bytes == NULL || pattern->mask == NULL || pattern->name == NULL) {
+		dyldcache_pattern_free(pattern);
+		return NULL;
+	}
+
+	// Pairs of hex digits or '?', optionally separated by blanks
+	while (*text) {
+		if (isspace((unsigned char) *text)) {
+			text++;
+			continue;
+		}
+		if (text[1] == '\0') {
+			error("Dangling nibble in pattern %s\n", pattern->name);
+			dyldcache_pattern_free(pattern);
+			return NULL;
+		}
+		high = (text[0] == '?') ? -2 : dyldcache_pattern_hex(text[0]);
+		low = (text[1] == '?') ? -2 : dyldcache_pattern_hex(text[1]);
+		if (high == -1 || low == -1) {
+			error("Invalid byte %.2s in pattern %s\n", text, pattern->name);
+			dyldcache_pattern_free(pattern);
+			return NULL;
+		}
+		pattern->mask[pattern->length] = (high >= 0 ? 0xF0 : 0) | (low >= 0 ? 0x0F : 0);
+		pattern->bytes[pattern->length] = ((high >= 0 ? high : 0) << 4) | (low >= 0 ? low : 0);
+		pattern->length++;
+		text += 2;
+	}
+
+	// Anchor on the least common pair of fixed bytes, or a single one
+	best = 0;
+	for (i = 0; i < pattern->length; i++) {
+		if (pattern->mask[i] != 0xFF) {
+			continue;
+		}
+		score = dyldcache_pattern_score(pattern->bytes[i]);
+		if (i + 1 < pattern->length && pattern->mask[i + 1] == 0xFF) {
+			score += 2 + dyldcache_pattern_score(pattern->bytes[i + 1]);
+		}
+		if (score > best) {
+			best = score;
+			pattern->anchor = i;
+			pattern->wide = score > 2;
+		}
+	}
+	if (best == 0) {
+		error("Pattern %s has no fully fixed byte to anchor on\n", pattern->name);
+		dyldcache_pattern_free(pattern);
+		return NULL;
+	}
+	return pattern;
+}
+
+void dyldcache_pattern_free(dyldcache_pattern_t* pattern) {
+	if (pattern) {
+		free(pattern->name);
+		free(pattern->bytes);
+		free(pattern->mask);
+		free(pattern);
+	}
+}
+
+/*
+ * Dyldcache Scan Functions
+ */
+dyldcache_scan_t* dyldcache_scan_create() {
+	debug("Creating dyld cache scanner\n");
+	dyldcache_scan_t* scan = (dyldcache_scan_t*) malloc(sizeof(dyldcache_scan_t));
+	if (scan) {
+		memset(scan, '\0', sizeof(dyldcache_scan_t));
+	}
+	return scan;
+}
+
+int dyldcache_scan_add(dyldcache_scan_t* scan, const char* name, const char* text) {
+	dyldcache_pattern_t* pattern = NULL;
+	dyldcache_pattern_t** patterns = NULL;
+
+	if (scan == NULL || text == NULL) {
+		return -1;
+	}
+	pattern = dyldcache_pattern_parse(name, text);
+	if (pattern == NULL) {
+		return -1;
+	}
+	patterns = (dyldcache_pattern_t**) realloc(scan->patterns, (scan->count + 1) * sizeof(dyldcache_pattern_t*));
+	if (patterns == NULL) {
+		dyldcache_pattern_free(pattern);
+		return -1;
+	}
+	scan->patterns = patterns;
+	scan->patterns[scan->count] = pattern;
+	if (pattern->length > scan->longest) {
+		scan->longest = pattern->length;
+	}
+	return scan->count++;
+}
+
+int dyldcache_scan_mappings(dyldcache_scan_t* scan, dyldcache_t* cache, dyldpool_t* pool, uint32_t prot) {
+	debug("Scanning dyld cache mappings\n");
+	int err = 0;
+	uint32_t i = 0;
+	dyldmap_t* map = NULL;
+	dyldcache_scan_ctx_t ctx;
+
+	if (scan == NULL || cache == NULL || scan->count == 0) {
+		return -1;
+	}
+	memset(&ctx, '\0', sizeof(ctx));
+	ctx.cache = cache;
+	ctx.scan = scan;
+	ctx.regions = (dyldcache_scan_region_t*) calloc(cache->header->mapping_count + 1, sizeof(dyldcache_scan_region_t));
+	if (ctx.regions == NULL) {
+		return -1;
+	}
+	// Only mappings carrying every requested protection bit
+	for (i = 0; i < cache->header->mapping_count; i++) {
+		map = cache->maps[i];
+		if (prot == 0 || (map->info && (map->info->initProt & prot) == prot)) {
+			ctx.regions[ctx.region_count].address = map->address;
+			ctx.regions[ctx.region_count].offset = map->offset;
+			ctx.regions[ctx.region_count].size = map->size;
+			ctx.region_count++;
+		}
+	}
+	for (i = 0; i < cache->count; i++) {
+		ctx.range_count += dyldcache_scan_segments(cache, cache->images[i], NULL, NULL);
+	}
+
+	err = dyldcache_scan_run(scan, &ctx, pool);
+	if (err < 0) {
+		error("Unable to allocate memory for dyld cache scan\n");
+	}
+	dyldcache_scan_ctx_free(&ctx);
+	return err < 0 ? -1 : 0;
+}
+
+int dyldcache_scan_images(dyldcache_scan_t* scan, dyldcache_t* cache, dyldpool_t* pool, dyldimage_t** images, uint32_t count) {
+	debug("Scanning dyld cache images\n");
+	int err = 0;
+	uint32_t i = 0;
+	uint32_t regions = 0;
+	dyldcache_scan_ctx_t ctx;
+
+	if (scan == NULL || cache == NULL || scan->count == 0) {
+		return -1;
+	}
+	memset(&ctx, '\0', sizeof(ctx));
+	ctx.cache = cache;
+	ctx.scan = scan;
+	for (i = 0; i < count; i++) {
+		regions += dyldcache_scan_segments(cache, images[i], NULL, NULL);
+	}
+	ctx.regions = (dyldcache_scan_region_t*) calloc(regions + 1, sizeof(dyldcache_scan_region_t));
+	if (ctx.regions == NULL) {
+		return -1;
+	}
+	for (i = 0; i < count; i++) {
+		dyldcache_scan_segments(cache, images[i], dyldcache_scan_add_region, &ctx);
+	}
+	for (i = 0; i < cache->count; i++) {
+		ctx.range_count += dyldcache_scan_segments(cache, cache->images[i], NULL, NULL);
+	}
+
+	err = dyldcache_scan_run(scan, &ctx, pool);
+	if (err < 0) {
+		error("Unable to allocate memory for dyld cache scan\n");
+	}
+	dyldcache_scan_ctx_free(&ctx);
+	return err < 0 ? -1 : 0;
+}
+
+void dyldcache_scan_debug(dyldcache_scan_t* scan) {
+	uint32_t i = 0;
+	if (scan) {
+		debug("\tScan:\n");
+		for (i = 0; i < scan->count; i++) {
+			debug("\t\t%s: %u bytes, anchor %u\n", scan->patterns[i]->name, scan->patterns[i]->length, scan->patterns[i]->anchor);
+		}
+		debug("\t\thits = %llu\n", (unsigned long long) scan->hit_count);
+		debug("\n");
+	}
+}
+
+void dyldcache_scan_free(dyldcache_scan_t* scan) {
+	debug("Freeing dyld cache scanner\n");
+	uint32_t i = 0;
+	if (scan) {
+		for (i = 0; i < scan->count; i++) {
+			dyldcache_pattern_free(scan->patterns[i]);
+		}
+		free(scan->patterns);
+		free(scan->hits);
+		free(scan);
+	}
+}
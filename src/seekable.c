@@ -0,0 +1,496 @@
+/**
+  * libdyldcache-1.0 - seekable.c
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+#define _DEBUG
+#include <libcrippy-1.0/debug.h>
+#include <libcrippy-1.0/libcrippy.h>
+
+#include <libdyldcache-1.0/seekable.h>
+
+#define ZSTD_FRAME_MAGIC      0xFD2FB528
+#define SEEKABLE_SKIP_MAGIC   0x184D2A5E
+#define SEEKABLE_MAGIC        0x8F92EAB1
+#define SEEKABLE_FOOTER_SIZE  9
+#define SEEKABLE_CHECKSUM     0x80
+
+static uint32_t dyldseekable_le32(const unsigned char* data) {
+	return (uint32_t) data[0] | ((uint32_t) data[1] << 8) |
+			((uint32_t) data[2] << 16) | ((uint32_t) data[3] << 24);
+}
+
+static int dyldseekable_pread(int fd, unsigned char* data, uint64_t size, uint64_t offset) {
+	ssize_t done = 0;
+	while (size > 0) {
+		done = pread(fd, data, size, offset);
+		if (done < 0 && errno == EINTR) {
+			continue;
+		}
+		if (done <= 0) {
+			return -1;
+		}
+		data += done;
+		size -= done;
+		offset += done;
+	}
+	return 0;
+}
+
+#ifdef HAVE_LIBZSTD
+/*
+ * Seek table layout, from the end of the file:
+ *  footer   = frame count (u32), descriptor (u8), seekable magic (u32)
+ *  entries  = compressed size (u32), decompressed size (u32), [checksum (u32)]
+ *  header   = skippable frame magic (u32), frame size (u32)
+ */
+static int dyldseekable_table(dyldseekable_t* seekable, uint64_t length) {
+	uint32_t i = 0;
+	uint32_t entry = 0;
+	uint64_t table = 0;
+	uint64_t offset = 0;
+	uint64_t address = 0;
+	unsigned char footer[SEEKABLE_FOOTER_SIZE];
+	unsigned char* entries = NULL;
+	unsigned char* cursor = NULL;
+
+	if (length < SEEKABLE_FOOTER_SIZE + 8 ||
+			dyldseekable_pread(seekable->fd, footer, SEEKABLE_FOOTER_SIZE, length - SEEKABLE_FOOTER_SIZE) < 0 ||
+			dyldseekable_le32(footer + 5) != SEEKABLE_MAGIC) {
+		return -1;
+	}
+	seekable->count = dyldseekable_le32(footer);
+	entry = (footer[4] & SEEKABLE_CHECKSUM) ? 12 : 8;
+	table = (uint64_t) seekable->count * entry;
+	if (seekable->count == 0 || table + SEEKABLE_FOOTER_SIZE + 8 > length) {
+		return -1;
+	}
+
+	entries = (unsigned char*) malloc(table + 8);
+	if (entries == NULL) {
+		return -1;
+	}
+	if (dyldseekable_pread(seekable->fd, entries, table + 8, length - SEEKABLE_FOOTER_SIZE - table - 8) < 0 ||
+			dyldseekable_le32(entries) != SEEKABLE_SKIP_MAGIC) {
+		free(entries);
+		return -1;
+	}
+
+	seekable->frames = (dyldseekable_frame_t*) calloc(seekable->count, sizeof(dyldseekable_frame_t));
+	if (seekable->frames == NULL) {
+		free(entries);
+		return -1;
+	}
+	cursor = entries + 8;
+	for (i = 0; i < seekable->count; i++) {
+		seekable->frames[i].offset = offset;
+		seekable->frames[i].compressed = dyldseekable_le32(cursor);
+		seekable->frames[i].address = address;
+		seekable->frames[i].size = dyldseekable_le32(cursor + 4);
+		seekable->frames[i].newer = DYLDSEEKABLE_NONE;
+		seekable->frames[i].older = DYLDSEEKABLE_NONE;
+		offset += seekable->frames[i].compressed;
+		address += seekable->frames[i].size;
+		cursor += entry;
+	}
+	free(entries);
+
+	if (offset > length - SEEKABLE_FOOTER_SIZE - table - 8) {
+		error("Seek table runs past the compressed data\n");
+		return -1;
+	}
+	seekable->size = address;
+	return 0;
+}
+
+static uint32_t dyldseekable_find(dyldseekable_t* seekable, uint64_t offset) {
+	uint32_t low = 0;
+	uint32_t high = seekable->count;
+	uint32_t middle = 0;
+	while (high - low > 1) {
+		middle = low + (high - low) / 2;
+		if (seekable->frames[middle].address <= offset) {
+			low = middle;
+		} else {
+			high = middle;
+		}
+	}
+	return low;
+}
+
+static void dyldseekable_unlink(dyldseekable_t* seekable, uint32_t index) {
+	dyldseekable_frame_t* frame = &seekable->frames[index];
+	if (frame->newer != DYLDSEEKABLE_NONE) {
+		seekable->frames[frame->newer].older = frame->older;
+	} else {
+		seekable->newest = frame->older;
+	}
+	if (frame->older != DYLDSEEKABLE_NONE) {
+		seekable->frames[frame->older].newer = frame->newer;
+	} else {
+		seekable->oldest = frame->newer;
+	}
+	frame->newer = DYLDSEEKABLE_NONE;
+	frame->older = DYLDSEEKABLE_NONE;
+}
+
+static void dyldseekable_push(dyldseekable_t* seekable, uint32_t index) {
+	dyldseekable_frame_t* frame = &seekable->frames[index];
+	frame->newer = DYLDSEEKABLE_NONE;
+	frame->older = seekable->newest;
+	if (seekable->newest != DYLDSEEKABLE_NONE) {
+		seekable->frames[seekable->newest].newer = index;
+	} else {
+		seekable->oldest = index;
+	}
+	seekable->newest = index;
+}
+
+/*
+ * Drops a frame's whole pages back to the kernel. Pages it shares with
+ *  a neighbouring frame are left alone.
+ */
+static void dyldseekable_evict(dyldseekable_t* seekable, uint32_t index) {
+	dyldseekable_frame_t* frame = &seekable->frames[index];
+	uint64_t page = (uint64_t) sysconf(_SC_PAGESIZE);
+	uint64_t start = (frame->address + page - 1) & ~(page - 1);
+	uint64_t end = (frame->address + frame->size) & ~(page - 1);
+	dyldseekable_unlink(seekable, index);
+	if (end > start) {
+		madvise(seekable->data + start, end - start, MADV_DONTNEED);
+	}
+	frame->flags &= ~DYLDSEEKABLE_RESIDENT;
+	seekable->resident -= frame->size;
+}
+
+/*
+ * Evicts from the old end of the list until under budget, passing over
+ *  frames that a load still in progress covers.
+ */
+static void dyldseekable_trim(dyldseekable_t* seekable) {
+	uint32_t index = seekable->oldest;
+	uint32_t newer = DYLDSEEKABLE_NONE;
+	while (seekable->holds == 0 && seekable->resident > seekable->budget && index != DYLDSEEKABLE_NONE) {
+		newer = seekable->frames[index].newer;
+		if (seekable->frames[index].loads == 0) {
+			dyldseekable_evict(seekable, index);
+		}
+		index = newer;
+	}
+}
+
+static dyldseekable_context_t* dyldseekable_context_create() {
+	dyldseekable_context_t* context = (dyldseekable_context_t*) malloc(sizeof(dyldseekable_context_t));
+	if (context) {
+		memset(context, '\0', sizeof(dyldseekable_context_t));
+		context->dctx = ZSTD_createDCtx();
+		if (context->dctx == NULL) {
+			free(context);
+			return NULL;
+		}
+	}
+	return context;
+}
+
+static void dyldseekable_context_free(dyldseekable_context_t* context) {
+	if (context) {
+		ZSTD_freeDCtx((ZSTD_DCtx*) context->dctx);
+		free(context->scratch);
+		free(context);
+	}
+}
+
+// Called without the lock held, the frame is marked loading
+static int dyldseekable_decompress(dyldseekable_t* seekable, dyldseekable_context_t* context, dyldseekable_frame_t* frame) {
+	size_t done = 0;
+	unsigned char* scratch = NULL;
+	if (frame->compressed > context->scratch_size) {
+		scratch = (unsigned char*) realloc(context->scratch, frame->compressed);
+		if (scratch == NULL) {
+			error("Unable to allocate memory for compressed frame\n");
+			return -1;
+		}
+		context->scratch = scratch;
+		context->scratch_size = frame->compressed;
+	}
+	if (dyldseekable_pread(seekable->fd, context->scratch, frame->compressed, frame->offset) < 0) {
+		error("Unable to read compressed frame\n");
+		return -1;
+	}
+
+	// Frames decompress directly into their place in the mapping
+	done = ZSTD_decompressDCtx((ZSTD_DCtx*) context->dctx, seekable->data + frame->address, frame->size,
+			context->scratch, frame->compressed);
+	if (ZSTD_isError(done) || done != frame->size) {
+		error("Unable to decompress frame at 0x%llx\n", (unsigned long long) frame->address);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Makes one frame resident, called and returning with the lock held. A
+ *  frame another thread is decompressing is waited for, anything else is
+ *  decompressed with the lock dropped so other frames can load meanwhile.
+ */
+static int dyldseekable_frame_load(dyldseekable_t* seekable, uint32_t index) {
+	int err = 0;
+	uint64_t scratch = 0;
+	dyldseekable_frame_t* frame = &seekable->frames[index];
+	dyldseekable_context_t* context = NULL;
+
+	while (frame->flags & DYLDSEEKABLE_LOADING) {
+		pthread_cond_wait(&seekable->loaded, &seekable->lock);
+	}
+	if (frame->flags & DYLDSEEKABLE_RESIDENT) {
+		return 0;
+	}
+	frame->flags |= DYLDSEEKABLE_LOADING;
+	context = seekable->idle;
+	if (context) {
+		seekable->idle = context->next;
+	}
+	pthread_mutex_unlock(&seekable->lock);
+
+	if (context == NULL) {
+		context = dyldseekable_context_create();
+	}
+	if (context == NULL) {
+		error("Unable to create zstd decompression context\n");
+		err = -1;
+	} else {
+		scratch = context->scratch_size;
+		err = dyldseekable_decompress(seekable, context, frame);
+	}
+
+	pthread_mutex_lock(&seekable->lock);
+	if (context) {
+		seekable->scratch_size += context->scratch_size - scratch;
+		context->next = seekable->idle;
+		seekable->idle = context;
+	}
+	frame->flags &= ~DYLDSEEKABLE_LOADING;
+	if (err == 0) {
+		frame->flags |= DYLDSEEKABLE_RESIDENT;
+		seekable->resident += frame->size;
+		if (!(frame->flags & DYLDSEEKABLE_PINNED)) {
+			dyldseekable_push(seekable, index);
+		}
+	}
+	pthread_cond_broadcast(&seekable->loaded);
+	return err;
+}
+#endif
+
+/*
+ * Dyld Seekable Functions
+ */
+int dyldseekable_probe(const char* path) {
+	int fd = -1;
+	unsigned char magic[4];
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return 0;
+	}
+	if (dyldseekable_pread(fd, magic, sizeof(magic), 0) < 0) {
+		close(fd);
+		return 0;
+	}
+	close(fd);
+	return dyldseekable_le32(magic) == ZSTD_FRAME_MAGIC;
+}
+
+dyldseekable_t* dyldseekable_open(const char* path) {
+	debug("Opening seekable zstd file\n");
+#ifdef HAVE_LIBZSTD
+	struct stat status;
+	dyldseekable_t* seekable = (dyldseekable_t*) malloc(sizeof(dyldseekable_t));
+	if (seekable == NULL) {
+		error("Unable to allocate memory for seekable file\n");
+		return NULL;
+	}
+	memset(seekable, '\0', sizeof(dyldseekable_t));
+	pthread_mutex_init(&seekable->lock, NULL);
+	pthread_cond_init(&seekable->loaded, NULL);
+	seekable->fd = -1;
+	seekable->newest = DYLDSEEKABLE_NONE;
+	seekable->oldest = DYLDSEEKABLE_NONE;
+	seekable->budget = DYLDSEEKABLE_BUDGET;
+	seekable->data = MAP_FAILED;
+
+	seekable->fd = open(path, O_RDONLY);
+	if (seekable->fd < 0 || fstat(seekable->fd, &status) < 0) {
+		error("Unable to open file at path %s\n", path);
+		dyldseekable_free(seekable);
+		return NULL;
+	}
+	if (dyldseekable_table(seekable, status.st_size) < 0) {
+		error("%s is not a seekable zstd file\n", path);
+		dyldseekable_free(seekable);
+		return NULL;
+	}
+
+	// Reserve address space for the whole cache, pages only become
+	//  real memory once a frame is decompressed into them
+	seekable->data = (unsigned char*) mmap(NULL, seekable->size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (seekable->data == MAP_FAILED) {
+		error("Unable to reserve memory for decompressed cache\n");
+		dyldseekable_free(seekable);
+		return NULL;
+	}
+	dyldseekable_debug(seekable);
+	return seekable;
+#else
+	error("libdyldcache was built without zstd support\n");
+	return NULL;
+#endif
+}
+
+int dyldseekable_load(dyldseekable_t* seekable, uint64_t offset, uint64_t size, int pin) {
+#ifdef HAVE_LIBZSTD
+	int err = 0;
+	uint32_t i = 0;
+	uint32_t first = 0;
+	uint32_t last = 0;
+	dyldseekable_frame_t* frame = NULL;
+
+	if (seekable == NULL || offset >= seekable->size) {
+		return -1;
+	}
+	if (size == 0) {
+		size = 1;
+	}
+	if (size > seekable->size - offset) {
+		size = seekable->size - offset;
+	}
+
+	pthread_mutex_lock(&seekable->lock);
+	first = dyldseekable_find(seekable, offset);
+	last = dyldseekable_find(seekable, offset + size - 1);
+	// Claim the whole range before the lock is first dropped, so no
+	//  other load trims a frame this one has already made resident
+	for (i = first; i <= last; i++) {
+		seekable->frames[i].loads++;
+	}
+	for (i = first; i <= last; i++) {
+		frame = &seekable->frames[i];
+		if (dyldseekable_frame_load(seekable, i) < 0) {
+			err = -1;
+			break;
+		}
+		// Only unpinned resident frames are on the list
+		if (!(frame->flags & DYLDSEEKABLE_PINNED)) {
+			dyldseekable_unlink(seekable, i);
+			if (pin) {
+				frame->flags |= DYLDSEEKABLE_PINNED;
+			} else {
+				dyldseekable_push(seekable, i);
+			}
+		}
+	}
+	if (err == 0) {
+		dyldseekable_trim(seekable);
+	}
+	for (i = first; i <= last; i++) {
+		seekable->frames[i].loads--;
+	}
+	pthread_mutex_unlock(&seekable->lock);
+	return err;
+#else
+	return -1;
+#endif
+}
+
+/*
+ * Holds keep every resident frame in place until released, for as long
+ *  as other threads may be reading through pointers into them.
+ */
+void dyldseekable_hold(dyldseekable_t* seekable) {
+	if (seekable) {
+		pthread_mutex_lock(&seekable->lock);
+		seekable->holds++;
+		pthread_mutex_unlock(&seekable->lock);
+	}
+}
+
+void dyldseekable_release(dyldseekable_t* seekable) {
+	if (seekable) {
+		pthread_mutex_lock(&seekable->lock);
+		if (seekable->holds > 0 && --seekable->holds == 0) {
+#ifdef HAVE_LIBZSTD
+			dyldseekable_trim(seekable);
+#endif
+		}
+		pthread_mutex_unlock(&seekable->lock);
+	}
+}
+
+void dyldseekable_debug(dyldseekable_t* seekable) {
+	if (seekable) {
+		debug("\tSeekable:\n");
+		debug("\t\tframes = %u\n", seekable->count);
+		debug("\t\tsize = %llu\n", (unsigned long long) seekable->size);
+		debug("\t\tresident = %llu\n", (unsigned long long) seekable->resident);
+		debug("\t\tbudget = %llu\n", (unsigned long long) seekable->budget);
+		debug("\n");
+	}
+}
+
+void dyldseekable_free(dyldseekable_t* seekable) {
+	debug("Freeing seekable zstd file\n");
+	if (seekable) {
+#ifdef HAVE_LIBZSTD
+		dyldseekable_context_t* context = NULL;
+		while ((context = seekable->idle) != NULL) {
+			seekable->idle = context->next;
+			dyldseekable_context_free(context);
+		}
+#endif
+		if (seekable->data != NULL && seekable->data != MAP_FAILED) {
+			munmap(seekable->data, seekable->size);
+			seekable->data = NULL;
+		}
+		if (seekable->frames) {
+			free(seekable->frames);
+			seekable->frames = NULL;
+		}
+		if (seekable->fd >= 0) {
+			close(seekable->fd);
+		}
+		pthread_cond_destroy(&seekable->loaded);
+		pthread_mutex_destroy(&seekable->lock);
+		free(seekable);
+	}
+}
@@ -0,0 +1,204 @@
+/**
+  * libdyldcache-1.0 - segment.c
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define _DEBUG
+#include <libcrippy-1.0/debug.h>
+#include <libcrippy-1.0/libcrippy.h>
+
+#include <libdyldcache-1.0/map.h>
+#include <libdyldcache-1.0/image.h>
+#include <libdyldcache-1.0/cache.h>
+#include <libdyldcache-1.0/segment.h>
+
+#ifndef LC_SEGMENT
+#define LC_SEGMENT        0x1
+#endif
+#ifndef LC_SEGMENT_64
+#define LC_SEGMENT_64     0x19
+#endif
+
+static void dyldcache_segments_resolve(dyldcache_t* cache, dyldcache_segment_t* segment, uint64_t filesize) {
+	dyldmap_t* map = dyldcache_map_address(cache, segment->address);
+	if (map == NULL || filesize == 0) {
+		return;
+	}
+	segment->map = map;
+	segment->offset = map->offset + (segment->address - map->address);
+	segment->size = map->size - (segment->address - map->address);
+	if (segment->size > filesize) {
+		segment->size = filesize;
+	}
+	segment->data = &cache->data[segment->offset];
+}
+
+/*
+ * Dyldcache Segments Functions
+ */
+dyldcache_segments_t* dyldcache_segments_create() {
+	dyldcache_segments_t* segments = (dyldcache_segments_t*) malloc(sizeof(dyldcache_segments_t));
+	if (segments) {
+		memset(segments, '\0', sizeof(dyldcache_segments_t));
+	}
+	return segments;
+}
+
+dyldcache_segments_t* dyldcache_segments_load(dyldcache_t* cache, dyldimage_t* image) {
+	int wide = 0;
+	uint32_t i = 0;
+	uint32_t cmd = 0;
+	uint32_t size = 0;
+	uint32_t ncmds = 0;
+	uint32_t header = 0;
+	uint64_t offset = 0;
+	uint64_t filesize = 0;
+	unsigned char* macho = NULL;
+	unsigned char* command = NULL;
+	unsigned char* end = NULL;
+	dyldcache_segment_t* segment = NULL;
+	dyldcache_segments_t* segments = NULL;
+	const dyldcache_decoder_t* decoder = NULL;
+
+	if (cache == NULL || image == NULL || image->map == NULL) {
+		return NULL;
+	}
+	decoder = cache->decoder;
+	offset = image->map->offset + (image->address - image->map->address);
+	if (dyldcache_fetch(cache, offset, 32) < 0) {
+		return NULL;
+	}
+	macho = &cache->data[offset];
+	switch (decoder->read32(macho)) {
+	case 0xFEEDFACE:
+		header = 28;
+		break;
+	case 0xFEEDFACF:
+		header = 32;
+		wide = 1;
+		break;
+	default:
+		error("Image %s is not a Mach-O\n", image->path);
+		return NULL;
+	}
+	ncmds = decoder->read32(macho + 16);
+	size = decoder->read32(macho + 20);
+	if (header + (uint64_t) size > cache->size - offset || dyldcache_fetch(cache, offset, header + (uint64_t) size) < 0) {
+		return NULL;
+	}
+
+	segments = dyldcache_segments_create();
+	if (segments == NULL) {
+		error("Unable to allocate memory for dyld cache segments\n");
+		return NULL;
+	}
+	// Every segment command is at least 56 bytes, which bounds the count
+	segments->wide = wide;
+	segments->segments = (dyldcache_segment_t*) calloc(size / 56 + 1, sizeof(dyldcache_segment_t));
+	if (segments->segments == NULL) {
+		error("Unable to allocate memory for dyld cache segments\n");
+		dyldcache_segments_free(segments);
+		return NULL;
+	}
+
+	command = macho + header;
+	end = command + size;
+	for (i = 0; i < ncmds && command + 8 <= end; i++) {
+		cmd = decoder->read32(command);
+		size = decoder->read32(command + 4);
+		if (size < 8 || size > (uint32_t) (end - command)) {
+			break;
+		}
+		if ((cmd == LC_SEGMENT && !wide && size >= 56) || (cmd == LC_SEGMENT_64 && wide && size >= 72)) {
+			segment = &segments->segments[segments->count++];
+			memcpy(segment->name, command + 8, 16);
+			if (wide) {
+				segment->address = decoder->read64(command + 24);
+				segment->vmsize = decoder->read64(command + 32);
+				filesize = decoder->read64(command + 48);
+				segment->maxprot = decoder->read32(command + 56);
+				segment->initprot = decoder->read32(command + 60);
+				segment->nsects = decoder->read32(command + 64);
+				segment->sections = command + 72;
+			} else {
+				segment->address = decoder->read32(command + 24);
+				segment->vmsize = decoder->read32(command + 28);
+				filesize = decoder->read32(command + 36);
+				segment->maxprot = decoder->read32(command + 40);
+				segment->initprot = decoder->read32(command + 44);
+				segment->nsects = decoder->read32(command + 48);
+				segment->sections = command + 56;
+			}
+			// Never let a corrupt count run past the load command
+			if (segment->nsects > (size - (segment->sections - command)) / (wide ? 80 : 68)) {
+				segment->nsects = (size - (segment->sections - command)) / (wide ? 80 : 68);
+			}
+			dyldcache_segments_resolve(cache, segment, filesize);
+		}
+		command += size;
+	}
+	return segments;
+}
+
+dyldcache_segment_t* dyldcache_segments_find(dyldcache_segments_t* segments, const char* name) {
+	uint32_t i = 0;
+	for (i = 0; segments && i < segments->count; i++) {
+		if (!strcmp(segments->segments[i].name, name)) {
+			return &segments->segments[i];
+		}
+	}
+	return NULL;
+}
+
+dyldcache_segment_t* dyldcache_segments_lookup(dyldcache_segments_t* segments, uint64_t address) {
+	uint32_t i = 0;
+	dyldcache_segment_t* segment = NULL;
+	for (i = 0; segments && i < segments->count; i++) {
+		segment = &segments->segments[i];
+		if (address >= segment->address && address - segment->address < segment->vmsize) {
+			return segment;
+		}
+	}
+	return NULL;
+}
+
+void dyldcache_segments_debug(dyldcache_segments_t* segments) {
+	uint32_t i = 0;
+	dyldcache_segment_t* segment = NULL;
+	if (segments) {
+		debug("\tSegments:\n");
+		for (i = 0; i < segments->count; i++) {
+			segment = &segments->segments[i];
+			debug("\t\t%-16s 0x%llx-0x%llx offset 0x%llx size 0x%llx prot %u/%u\n", segment->name,
+					(unsigned long long) segment->address, (unsigned long long) (segment->address + segment->vmsize),
+					(unsigned long long) segment->offset, (unsigned long long) segment->size,
+					segment->initprot, segment->maxprot);
+		}
+		debug("\n");
+	}
+}
+
+void dyldcache_segments_free(dyldcache_segments_t* segments) {
+	if (segments) {
+		free(segments->segments);
+		free(segments);
+	}
+}
@@ -0,0 +1,456 @@
+/**
+  * libdyldcache-1.0 - stubs.c
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define _DEBUG
+#include <libcrippy-1.0/debug.h>
+#include <libcrippy-1.0/libcrippy.h>
+
+#include <libdyldcache-1.0/map.h>
+#include <libdyldcache-1.0/image.h>
+#include <libdyldcache-1.0/cache.h>
+#include <libdyldcache-1.0/pool.h>
+#include <libdyldcache-1.0/segment.h>
+#include <libdyldcache-1.0/stubs.h>
+
+#ifndef S_SYMBOL_STUBS
+#define S_SYMBOL_STUBS    0x8
+#endif
+
+// Shared cache addresses on arm64 fit in 36 bits, the rest is tagging
+#define DYLDSTUB_ADDRESS_MASK  0xFFFFFFFFFULL
+
+typedef struct dyldcache_stubs_list_t {
+	int failed;
+	uint32_t count;
+	uint32_t capacity;
+	dyldcache_stub_t* stubs;
+} dyldcache_stubs_list_t;
+
+typedef struct dyldcache_stubs_ctx_t {
+	dyldcache_t* cache;
+	dyldcache_stubs_list_t* lists;
+	uint32_t pools;
+	int arm64;
+} dyldcache_stubs_ctx_t;
+
+static uint64_t dyldcache_stubs_pointer(dyldcache_stubs_ctx_t* ctx, uint64_t address) {
+	uint64_t value = 0;
+	dyldcache_t* cache = ctx->cache;
+	const unsigned char* data = dyldcache_read(cache, address, cache->decoder->pointer_size);
+	if (data == NULL) {
+		return 0;
+	}
+	value = cache->decoder->pointer(data);
+	if (ctx->arm64) {
+		// Authenticated arm64e pointers hold an offset from the cache base
+		if (value >> 63) {
+			return cache->header->base_address + (value & 0xFFFFFFFFULL);
+		}
+		return value & DYLDSTUB_ADDRESS_MASK;
+	}
+	// Drop the Thumb bit so targets line up with symbol addresses
+	return value & ~1ULL;
+}
+
+static void dyldcache_stubs_add(dyldcache_stubs_list_t* list, uint64_t address, uint64_t target, uint32_t image, uint32_t kind) {
+	dyldcache_stub_t* stubs = NULL;
+	if (target == 0 || target == address) {
+		return;
+	}
+	if (list->count == list->capacity) {
+		list->capacity = list->capacity ? list->capacity * 2 : 1024;
+		stubs = (dyldcache_stub_t*) realloc(list->stubs, list->capacity * sizeof(dyldcache_stub_t));
+		if (stubs == NULL) {
+			list->capacity = list->count;
+			list->failed = 1;
+			return;
+		}
+		list->stubs = stubs;
+	}
+	list->stubs[list->count].address = address;
+	list->stubs[list->count].target = target;
+	list->stubs[list->count].image = image;
+	list->stubs[list->count].kind = kind;
+	list->count++;
+}
+
+static int64_t dyldcache_stubs_sign(uint64_t value, uint32_t bits) {
+	return (int64_t) (value << (64 - bits)) >> (64 - bits);
+}
+
+// Any of BR, BRAAZ, BRABZ, BRAA and BRAB through the given register
+static int dyldcache_stubs_is_br(uint32_t insn, uint32_t reg) {
+	if ((insn & 0xFFFFFC1F) != 0xD61F0000 && (insn & 0xFFFFFC1F) != 0xD61F081F &&
+			(insn & 0xFFFFFC1F) != 0xD61F0C1F && (insn & 0xFFFFF800) != 0xD71F0800) {
+		return 0;
+	}
+	return ((insn >> 5) & 0x1F) == reg;
+}
+
+/*
+ * Decodes one arm64 trampoline at address. Returns the number of bytes it
+ *  spans and sets target, or 0 when the instructions aren't one we know:
+ *    B target
+ *    ADRP xN, page; ADD xN, xN, off; BR xN
+ *    ADRP xN, page; LDR xM, [xN, off]; BR xM
+ *    ADRP xN, page; ADD xN, xN, off; LDR xM, [xN]; BRAA xM, xN
+ */
+static uint32_t dyldcache_stubs_arm64(dyldcache_stubs_ctx_t* ctx, uint64_t address, const unsigned char* code, uint32_t size, uint64_t* target) {
+	uint32_t reg = 0;
+	uint32_t loaded = 0;
+	uint32_t insn[4];
+	uint32_t count = size / 4;
+	uint32_t i = 0;
+	uint64_t page = 0;
+	const dyldcache_decoder_t* decoder = ctx->cache->decoder;
+
+	if (count > 4) {
+		count = 4;
+	}
+	for (i = 0; i < count; i++) {
+		insn[i] = decoder->read32(code + i * 4);
+	}
+	if (count < 1) {
+		return 0;
+	}
+
+	if ((insn[0] & 0xFC000000) == 0x14000000) {
+		*target = address + dyldcache_stubs_sign((uint64_t) (insn[0] & 0x03FFFFFF) << 2, 28);
+		return 4;
+	}
+	if (count < 3 || (insn[0] & 0x9F000000) != 0x90000000) {
+		return 0;
+	}
+	reg = insn[0] & 0x1F;
+	page = (address & ~0xFFFULL) + (dyldcache_stubs_sign((((insn[0] >> 5) & 0x7FFFF) << 2) | ((insn[0] >> 29) & 3), 21) * 4096);
+
+	// ADD xN, xN, #imm{, lsl 12}
+	if ((insn[1] & 0xFF800000) == 0x91000000 && ((insn[1] >> 5) & 0x1F) == reg && (insn[1] & 0x1F) == reg) {
+		page += ((insn[1] >> 10) & 0xFFF) << (((insn[1] >> 22) & 1) ? 12 : 0);
+		if (dyldcache_stubs_is_br(insn[2], reg)) {
+			*target = page;
+			return 12;
+		}
+		if (count == 4 && (insn[2] & 0xFFC00000) == 0xF9400000 && ((insn[2] >> 5) & 0x1F) == reg) {
+			loaded = insn[2] & 0x1F;
+			if (dyldcache_stubs_is_br(insn[3], loaded)) {
+				*target = dyldcache_stubs_pointer(ctx, page + (((insn[2] >> 10) & 0xFFF) << 3));
+				return 16;
+			}
+		}
+		return 0;
+	}
+
+	// LDR xM, [xN, #imm]
+	if ((insn[1] & 0xFFC00000) == 0xF9400000 && ((insn[1] >> 5) & 0x1F) == reg) {
+		loaded = insn[1] & 0x1F;
+		if (dyldcache_stubs_is_br(insn[2], loaded)) {
+			*target = dyldcache_stubs_pointer(ctx, page + (((insn[1] >> 10) & 0xFFF) << 3));
+			return 12;
+		}
+	}
+	return 0;
+}
+
+/*
+ * The ARM mode stubs found in armv6/armv7 caches:
+ *    ldr ip, [pc, #4]; add ip, pc, ip; ldr pc, [ip]; .long ptr - (stub + 12)
+ *    ldr pc, [pc, #-4]; .long target
+ */
+static uint32_t dyldcache_stubs_arm(dyldcache_stubs_ctx_t* ctx, uint64_t address, const unsigned char* code, uint32_t size, uint64_t* target) {
+	const dyldcache_decoder_t* decoder = ctx->cache->decoder;
+	if (size >= 16 && decoder->read32(code) == 0xE59FC004 && decoder->read32(code + 4) == 0xE08FC00C &&
+			decoder->read32(code + 8) == 0xE59CF000) {
+		*target = dyldcache_stubs_pointer(ctx, (uint32_t) (address + 12 + decoder->read32(code + 12)));
+		return 16;
+	}
+	if (size >= 8 && decoder->read32(code) == 0xE51FF004) {
+		*target = decoder->read32(code + 4) & ~1U;
+		return 8;
+	}
+	return 0;
+}
+
+static uint32_t dyldcache_stubs_decode(dyldcache_stubs_ctx_t* ctx, uint64_t address, const unsigned char* code, uint32_t size, uint64_t* target) {
+	*target = 0;
+	if (ctx->arm64) {
+		return dyldcache_stubs_arm64(ctx, address, code, size, target);
+	}
+	return dyldcache_stubs_arm(ctx, address, code, size, target);
+}
+
+static void dyldcache_stubs_section(dyldcache_stubs_ctx_t* ctx, dyldcache_stubs_list_t* list, uint32_t image,
+		uint64_t address, uint64_t size, uint32_t stride, uint32_t kind) {
+	uint32_t used = 0;
+	uint64_t done = 0;
+	uint64_t target = 0;
+	const unsigned char* code = dyldcache_read(ctx->cache, address, size);
+	if (code == NULL) {
+		return;
+	}
+	while (done + 4 <= size) {
+		used = dyldcache_stubs_decode(ctx, address + done, code + done,
+				(size - done > 16) ? 16 : (uint32_t) (size - done), &target);
+		if (used > 0) {
+			dyldcache_stubs_add(list, address + done, target, image, kind);
+		}
+		// Stub sections have a fixed stride, islands are packed
+		if (stride > 0) {
+			done += stride;
+		} else {
+			done += used ? used : 4;
+		}
+	}
+}
+
+static void dyldcache_stubs_image(dyldcache_stubs_ctx_t* ctx, dyldcache_stubs_list_t* list, dyldimage_t* image,
+		uint32_t index, int island) {
+	dyldcache_t* cache = ctx->cache;
+	const dyldcache_decoder_t* decoder = cache->decoder;
+	int wide = 0;
+	uint32_t i = 0;
+	uint32_t j = 0;
+	uint32_t flags = 0;
+	uint32_t stride = 0;
+	uint32_t sectsize = 0;
+	uint64_t address = 0;
+	uint64_t length = 0;
+	unsigned char* section = NULL;
+	dyldcache_segments_t* segments = NULL;
+
+	segments = dyldcache_segments_load(cache, image);
+	if (segments == NULL) {
+		return;
+	}
+	wide = segments->wide;
+	sectsize = wide ? 80 : 68;
+
+	for (i = 0; i < segments->count; i++) {
+		section = segments->segments[i].sections;
+		for (j = 0; j < segments->segments[i].nsects; j++, section += sectsize) {
+			address = wide ? decoder->read64(section + 32) : decoder->read32(section + 32);
+			length = wide ? decoder->read64(section + 40) : decoder->read32(section + 36);
+			flags = decoder->read32(section + (wide ? 64 : 56));
+			stride = decoder->read32(section + (wide ? 72 : 64));
+			if (island && !strncmp((const char*) section, "__text", 16)) {
+				dyldcache_stubs_section(ctx, list, index, address, length, 0, DYLDSTUB_ISLAND);
+			} else if ((flags & 0xFF) == S_SYMBOL_STUBS || !strncmp((const char*) section, "__stubs", 16) ||
+					!strncmp((const char*) section, "__auth_stubs", 16)) {
+				dyldcache_stubs_section(ctx, list, index, address, length, stride,
+						strncmp((const char*) section, "__auth_stubs", 16) ? DYLDSTUB_STUB : DYLDSTUB_AUTH);
+			}
+		}
+	}
+	dyldcache_segments_free(segments);
+}
+
+/*
+ * Indexes past the image count are branch pools, the island dylibs the
+ *  header lists by address. Caches without that table only have islands
+ *  in images named after them.
+ */
+static void dyldcache_stubs_func(uint32_t index, uint32_t worker, void* userdata) {
+	dyldcache_stubs_ctx_t* ctx = (dyldcache_stubs_ctx_t*) userdata;
+	dyldcache_t* cache = ctx->cache;
+	dyldcache_stubs_list_t* list = &ctx->lists[worker];
+	uint64_t offset = 0;
+	dyldimage_t* image = NULL;
+	dyldimage_t pool;
+
+	if (index < cache->count) {
+		image = cache->images[index];
+		dyldcache_stubs_image(ctx, list, image, index,
+				ctx->pools == 0 && image->path && strstr(image->path, "branch_islands") != NULL);
+		return;
+	}
+
+	offset = cache->header->branch_pools_offset + (uint64_t) (index - cache->count) * 8;
+	if (dyldcache_fetch(cache, offset, 8) < 0) {
+		return;
+	}
+	memset(&pool, '\0', sizeof(pool));
+	pool.path = "branch pool";
+	pool.address = cache->decoder->read64(&cache->data[offset]);
+	pool.map = dyldcache_map_address(cache, pool.address);
+	if (pool.map) {
+		dyldcache_stubs_image(ctx, list, &pool, DYLDSTUB_NO_IMAGE, 1);
+	}
+}
+
+static int dyldcache_stubs_compare(const void* a, const void* b) {
+	const dyldcache_stub_t* left = (const dyldcache_stub_t*) a;
+	const dyldcache_stub_t* right = (const dyldcache_stub_t*) b;
+	if (left->address != right->address) {
+		return left->address < right->address ? -1 : 1;
+	}
+	return 0;
+}
+
+/*
+ * Dyldcache Stubs Functions
+ */
+dyldcache_stubs_t* dyldcache_stubs_create() {
+	debug("Creating dyld cache stub table\n");
+	dyldcache_stubs_t* stubs = (dyldcache_stubs_t*) malloc(sizeof(dyldcache_stubs_t));
+	if (stubs) {
+		memset(stubs, '\0', sizeof(dyldcache_stubs_t));
+	}
+	return stubs;
+}
+
+dyldcache_stubs_t* dyldcache_stubs_load(dyldcache_t* cache, dyldpool_t* pool) {
+	debug("Loading dyld cache stub table\n");
+	int failed = 0;
+	uint32_t i = 0;
+	uint32_t total = 0;
+	uint32_t workers = 0;
+	dyldpool_t* owned = NULL;
+	dyldcache_stubs_t* stubs = NULL;
+	dyldcache_stubs_ctx_t ctx;
+
+	if (cache == NULL || cache->images == NULL || cache->arch == NULL) {
+		return NULL;
+	}
+	stubs = dyldcache_stubs_create();
+	if (stubs == NULL) {
+		error("Unable to allocate memory for dyld cache stub table\n");
+		return NULL;
+	}
+	if (cache->arch->cpu_type != kArmType) {
+		debug("No stub decoder for %s caches\n", cache->arch->name);
+		return stubs;
+	}
+
+	if (pool == NULL) {
+		pool = owned = dyldpool_create(0);
+	}
+	workers = pool ? pool->count : 1;
+	memset(&ctx, '\0', sizeof(ctx));
+	ctx.cache = cache;
+	ctx.arm64 = cache->arch->cpu_subtype == kArm64;
+	if (cache->header->branch_pools_count > 0 && cache->header->branch_pools_offset <= cache->size &&
+			cache->header->branch_pools_count <= (cache->size - cache->header->branch_pools_offset) / 8) {
+		ctx.pools = cache->header->branch_pools_count;
+	}
+	ctx.lists = (dyldcache_stubs_list_t*) calloc(workers, sizeof(dyldcache_stubs_list_t));
+	if (ctx.lists == NULL) {
+		error("Unable to allocate memory for dyld cache stub lists\n");
+		if (owned) dyldpool_free(owned);
+		dyldcache_stubs_free(stubs);
+		return NULL;
+	}
+
+	// Each worker collects into its own list, merged and sorted after
+	dyldcache_hold(cache);
+	dyldpool_run(pool, cache->count + ctx.pools, dyldcache_stubs_func, &ctx);
+	dyldcache_release(cache);
+	if (owned) {
+		dyldpool_free(owned);
+	}
+
+	for (i = 0; i < workers; i++) {
+		total += ctx.lists[i].count;
+		failed |= ctx.lists[i].failed;
+	}
+	// A partial table would make lookups silently miss
+	if (failed) {
+		error("Unable to allocate memory for dyld cache stub lists\n");
+	} else {
+		stubs->stubs = (dyldcache_stub_t*) malloc((total + 1) * sizeof(dyldcache_stub_t));
+		if (stubs->stubs == NULL) {
+			error("Unable to allocate memory for dyld cache stubs\n");
+		}
+	}
+	for (i = 0; i < workers; i++) {
+		if (stubs->stubs && ctx.lists[i].count > 0) {
+			memcpy(&stubs->stubs[stubs->count], ctx.lists[i].stubs, ctx.lists[i].count * sizeof(dyldcache_stub_t));
+			stubs->count += ctx.lists[i].count;
+		}
+		free(ctx.lists[i].stubs);
+	}
+	free(ctx.lists);
+	if (stubs->stubs == NULL) {
+		dyldcache_stubs_free(stubs);
+		return NULL;
+	}
+	qsort(stubs->stubs, stubs->count, sizeof(dyldcache_stub_t), dyldcache_stubs_compare);
+
+	debug("Found %u stubs and branch islands\n", stubs->count);
+	return stubs;
+}
+
+dyldcache_stub_t* dyldcache_stubs_lookup(dyldcache_stubs_t* stubs, uint64_t address) {
+	uint32_t low = 0;
+	uint32_t high = 0;
+	uint32_t middle = 0;
+	if (stubs == NULL) {
+		return NULL;
+	}
+	high = stubs->count;
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		if (stubs->stubs[middle].address < address) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	if (low < stubs->count && stubs->stubs[low].address == address) {
+		return &stubs->stubs[low];
+	}
+	return NULL;
+}
+
+uint64_t dyldcache_stubs_resolve(dyldcache_stubs_t* stubs, uint64_t address) {
+	uint32_t hops = 0;
+	dyldcache_stub_t* stub = NULL;
+	// Islands can lead to stubs; stop on loops
+	for (hops = 0; hops < DYLDSTUB_HOPS; hops++) {
+		stub = dyldcache_stubs_lookup(stubs, address);
+		if (stub == NULL) {
+			break;
+		}
+		address = stub->target;
+	}
+	return address;
+}
+
+void dyldcache_stubs_debug(dyldcache_stubs_t* stubs) {
+	uint32_t i = 0;
+	if (stubs) {
+		debug("\tStubs:\n");
+		for (i = 0; i < stubs->count; i++) {
+			debug("\t\t0x%llx -> 0x%llx (%u)\n", (unsigned long long) stubs->stubs[i].address,
+					(unsigned long long) stubs->stubs[i].target, stubs->stubs[i].kind);
+		}
+		debug("\n");
+	}
+}
+
+void dyldcache_stubs_free(dyldcache_stubs_t* stubs) {
+	debug("Freeing dyld cache stub table\n");
+	if (stubs) {
+		free(stubs->stubs);
+		free(stubs);
+	}
+}
@@ -0,0 +1,398 @@
+/**
+  * libdyldcache-1.0 - writer.c
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#define _DEBUG
+#include <libcrippy-1.0/debug.h>
+#include <libcrippy-1.0/libcrippy.h>
+
+#include <libdyldcache-1.0/image.h>
+#include <libdyldcache-1.0/cache.h>
+#include <libdyldcache-1.0/pool.h>
+#include <libdyldcache-1.0/writer.h>
+
+#define DYLDWRITER_FLAGS (O_WRONLY | O_CREAT | O_TRUNC)
+#define DYLDWRITER_MODE  0644
+
+static int dyldwriter_pwrite(int fd, const unsigned char* data, uint64_t size, uint64_t offset) {
+	ssize_t done = 0;
+	while (offset < size) {
+		done = pwrite(fd, data + offset, size - offset, offset);
+		if (done < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -errno;
+		}
+		offset += done;
+	}
+	return 0;
+}
+
+static void dyldwriter_job_sync(dyldwriter_job_t* job) {
+	job->fd = open(job->path, DYLDWRITER_FLAGS, DYLDWRITER_MODE);
+	if (job->fd < 0) {
+		job->err = -errno;
+		return;
+	}
+	job->err = dyldwriter_pwrite(job->fd, job->data, job->size, 0);
+	if (close(job->fd) < 0 && job->err == 0) {
+		job->err = -errno;
+	}
+	job->fd = -1;
+}
+
+static void dyldwriter_job_func(uint32_t index, uint32_t worker, void* userdata) {
+	dyldwriter_t* writer = (dyldwriter_t*) userdata;
+	dyldwriter_job_sync(&writer->jobs[index]);
+}
+
+#ifdef HAVE_LIBURING
+/*
+ * Each batch goes through the ring in up to three rounds: one opening
+ *  every file, one writing every opened descriptor and one closing them.
+ *  Closes are only submitted once a write has completed in full, a short
+ *  write is finished synchronously first.
+ */
+static int dyldwriter_uring_reap(struct io_uring* ring, dyldwriter_t* writer, uint32_t expected) {
+	uint32_t i = 0;
+	int err = 0;
+	uint64_t tag = 0;
+	dyldwriter_job_t* job = NULL;
+	struct io_uring_cqe* cqe = NULL;
+
+	while (i < expected) {
+		err = io_uring_wait_cqe(ring, &cqe);
+		if (err == -EINTR) {
+			continue;
+		}
+		if (err < 0) {
+			return err;
+		}
+		tag = cqe->user_data;
+		job = &writer->jobs[tag >> 2];
+		switch (tag & 3) {
+		case 0:
+			// openat
+			if (cqe->res < 0) {
+				job->err = cqe->res;
+			} else {
+				job->fd = cqe->res;
+			}
+			break;
+		case 1:
+			// write, finish short writes synchronously
+			if (cqe->res < 0) {
+				job->err = cqe->res;
+			} else if ((uint64_t) cqe->res < job->size) {
+				job->err = dyldwriter_pwrite(job->fd, job->data, job->size, cqe->res);
+			}
+			break;
+		case 2:
+			// close
+			if (cqe->res < 0 && job->err == 0) {
+				job->err = cqe->res;
+			}
+			job->fd = -1;
+			break;
+		}
+		io_uring_cqe_seen(ring, cqe);
+		i++;
+	}
+	return 0;
+}
+
+/*
+ * Submits the queued round and waits for all of it. On failure the ring is
+ *  torn down, which cancels whatever is still in flight, so no completion
+ *  of this batch can be mistaken for one of the next.
+ */
+static int dyldwriter_uring_round(dyldwriter_t* writer, uint32_t pending) {
+	int err = 0;
+	struct io_uring* ring = (struct io_uring*) writer->ring;
+	if (pending == 0) {
+		return 0;
+	}
+	err = io_uring_submit(ring);
+	if (err >= 0) {
+		err = dyldwriter_uring_reap(ring, writer, pending);
+	}
+	if (err < 0) {
+		io_uring_queue_exit(ring);
+		free(writer->ring);
+		writer->ring = NULL;
+		writer->backend = kWriterSync;
+		return -1;
+	}
+	return 0;
+}
+
+static int dyldwriter_uring_flush(dyldwriter_t* writer) {
+	uint32_t i = 0;
+	uint32_t pending = 0;
+	dyldwriter_job_t* job = NULL;
+	struct io_uring_sqe* sqe = NULL;
+	struct io_uring* ring = (struct io_uring*) writer->ring;
+
+	for (i = 0; i < writer->count; i++) {
+		sqe = io_uring_get_sqe(ring);
+		io_uring_prep_openat(sqe, AT_FDCWD, writer->jobs[i].path, DYLDWRITER_FLAGS, DYLDWRITER_MODE);
+		sqe->user_data = ((uint64_t) i << 2) | 0;
+	}
+	if (dyldwriter_uring_round(writer, writer->count) < 0) {
+		return -1;
+	}
+
+	pending = 0;
+	for (i = 0; i < writer->count; i++) {
+		job = &writer->jobs[i];
+		if (job->fd < 0) {
+			continue;
+		}
+		sqe = io_uring_get_sqe(ring);
+		io_uring_prep_write(sqe, job->fd, job->data, (unsigned) job->size, 0);
+		sqe->user_data = ((uint64_t) i << 2) | 1;
+		pending++;
+	}
+	if (dyldwriter_uring_round(writer, pending) < 0) {
+		return -1;
+	}
+
+	pending = 0;
+	for (i = 0; i < writer->count; i++) {
+		job = &writer->jobs[i];
+		if (job->fd < 0) {
+			continue;
+		}
+		sqe = io_uring_get_sqe(ring);
+		io_uring_prep_close(sqe, job->fd);
+		sqe->user_data = ((uint64_t) i << 2) | 2;
+		pending++;
+	}
+	if (dyldwriter_uring_round(writer, pending) < 0) {
+		// A close may or may not have run, so never close these again
+		for (i = 0; i < writer->count; i++) {
+			writer->jobs[i].fd = -1;
+		}
+		return -1;
+	}
+	return 0;
+}
+#endif
+
+/*
+ * Dyld Writer Functions
+ */
+dyldwriter_t* dyldwriter_create(dyldwriter_backend_t backend, uint32_t depth) {
+	debug("Creating dyld writer\n");
+	dyldwriter_t* writer = (dyldwriter_t*) malloc(sizeof(dyldwriter_t));
+	if (writer == NULL) {
+		error("Unable to allocate memory for dyld writer\n");
+		return NULL;
+	}
+	memset(writer, '\0', sizeof(dyldwriter_t));
+
+	if (depth == 0) {
+		depth = DYLDWRITER_DEPTH;
+	}
+	writer->depth = depth;
+	writer->jobs = (dyldwriter_job_t*) calloc(depth, sizeof(dyldwriter_job_t));
+	if (writer->jobs == NULL) {
+		error("Unable to allocate memory for dyld writer queue\n");
+		dyldwriter_free(writer);
+		return NULL;
+	}
+
+#ifdef HAVE_LIBURING
+	if (backend == kWriterAuto || backend == kWriterUring) {
+		writer->ring = malloc(sizeof(struct io_uring));
+		if (writer->ring && io_uring_queue_init(depth * 2, (struct io_uring*) writer->ring, 0) == 0) {
+			backend = kWriterUring;
+		} else {
+			debug("io_uring is unavailable, falling back to threads\n");
+			free(writer->ring);
+			writer->ring = NULL;
+			backend = kWriterThreads;
+		}
+	}
+#else
+	if (backend == kWriterAuto || backend == kWriterUring) {
+		if (backend == kWriterUring) {
+			debug("Built without io_uring support, falling back to threads\n");
+		}
+		backend = kWriterThreads;
+	}
+#endif
+
+	if (backend == kWriterThreads) {
+		writer->pool = dyldpool_create(0);
+		if (writer->pool == NULL) {
+			backend = kWriterSync;
+		}
+	}
+	writer->backend = backend;
+	debug("Using %s writer backend\n", dyldwriter_backend_name(backend));
+	return writer;
+}
+
+dyldwriter_backend_t dyldwriter_backend_parse(const char* name) {
+	if (name == NULL || !strcmp(name, "auto")) {
+		return kWriterAuto;
+	} else if (!strcmp(name, "sync")) {
+		return kWriterSync;
+	} else if (!strcmp(name, "threads")) {
+		return kWriterThreads;
+	} else if (!strcmp(name, "uring")) {
+		return kWriterUring;
+	}
+	return kWriterInvalid;
+}
+
+const char* dyldwriter_backend_name(dyldwriter_backend_t backend) {
+	switch (backend) {
+	case kWriterAuto:
+		return "auto";
+	case kWriterSync:
+		return "sync";
+	case kWriterThreads:
+		return "threads";
+	case kWriterUring:
+		return "uring";
+	default:
+		return "unknown";
+	}
+}
+
+int dyldwriter_write(dyldwriter_t* writer, const char* path, const unsigned char* data, uint64_t size) {
+	dyldwriter_job_t* job = NULL;
+	if (writer == NULL || path == NULL || data == NULL) {
+		return -1;
+	}
+	if (writer->count == writer->depth) {
+		dyldwriter_flush(writer);
+	}
+
+	job = &writer->jobs[writer->count];
+	job->path = strdup(path);
+	if (job->path == NULL) {
+		error("Unable to allocate memory for dyld writer path\n");
+		return -1;
+	}
+	job->data = data;
+	job->size = size;
+	job->fd = -1;
+	job->err = 0;
+	writer->count++;
+	return 0;
+}
+
+int dyldwriter_save(dyldwriter_t* writer, dyldcache_t* cache, dyldimage_t* image, const char* path) {
+	debug("Queueing dyldimage\n");
+	uint64_t size = 0;
+	unsigned char* data = dyldcache_image_extent(cache, image, &size);
+	if (data == NULL) {
+		return -1;
+	}
+	return dyldwriter_write(writer, path, data, size);
+}
+
+int dyldwriter_flush(dyldwriter_t* writer) {
+	debug("Flushing dyld writer\n");
+	uint32_t i = 0;
+	uint32_t failed = 0;
+	dyldwriter_job_t* job = NULL;
+	if (writer == NULL) {
+		return -1;
+	}
+
+	switch (writer->backend) {
+#ifdef HAVE_LIBURING
+	case kWriterUring:
+		if (dyldwriter_uring_flush(writer) < 0) {
+			error("io_uring failed, finishing synchronously\n");
+			for (i = 0; i < writer->count; i++) {
+				job = &writer->jobs[i];
+				if (job->fd >= 0) {
+					close(job->fd);
+				}
+				dyldwriter_job_sync(job);
+			}
+		}
+		break;
+#endif
+	case kWriterThreads:
+		dyldpool_run(writer->pool, writer->count, dyldwriter_job_func, writer);
+		break;
+	default:
+		for (i = 0; i < writer->count; i++) {
+			dyldwriter_job_sync(&writer->jobs[i]);
+		}
+		break;
+	}
+
+	for (i = 0; i < writer->count; i++) {
+		job = &writer->jobs[i];
+		if (job->err != 0) {
+			error("Unable to write %s: %s\n", job->path, strerror(-job->err));
+			failed++;
+		}
+		free(job->path);
+		job->path = NULL;
+	}
+	writer->count = 0;
+	writer->failed += failed;
+	return failed == 0 ? 0 : -1;
+}
+
+void dyldwriter_free(dyldwriter_t* writer) {
+	debug("Freeing dyld writer\n");
+	if (writer) {
+		if (writer->jobs) {
+			dyldwriter_flush(writer);
+			free(writer->jobs);
+			writer->jobs = NULL;
+		}
+#ifdef HAVE_LIBURING
+		if (writer->ring) {
+			io_uring_queue_exit((struct io_uring*) writer->ring);
+			free(writer->ring);
+			writer->ring = NULL;
+		}
+#endif
+		if (writer->pool) {
+			dyldpool_free(writer->pool);
+			writer->pool = NULL;
+		}
+		free(writer);
+	}
+}
@@ -0,0 +1,614 @@
+/**
+  * libdyldcache-1.0 - xrefs.c
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define _DEBUG
+#include <libcrippy-1.0/debug.h>
+#include <libcrippy-1.0/libcrippy.h>
+
+#include <libdyldcache-1.0/map.h>
+#include <libdyldcache-1.0/cache.h>
+#include <libdyldcache-1.0/pool.h>
+#include <libdyldcache-1.0/xrefs.h>
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#if defined(__SSE2__) || (defined(__aarch64__) && defined(__ARM_NEON))
+#define DYLDXREFS_VECTOR
+#endif
+#endif
+
+/*
+ * Instructions are 4 byte aligned, so the kind is kept in the low bits of
+ *  the referencing address while sorting.
+ */
+typedef struct dyldcache_xref_entry_t {
+	uint64_t target;
+	uint64_t from;
+} dyldcache_xref_entry_t;
+
+typedef struct dyldcache_xrefs_list_t {
+	int failed;
+	uint64_t count;
+	uint64_t capacity;
+	dyldcache_xref_entry_t* entries;
+} dyldcache_xrefs_list_t;
+
+typedef struct dyldcache_xrefs_chunk_t {
+	dyldmap_t* map;
+	uint64_t start;
+	uint64_t length;
+} dyldcache_xrefs_chunk_t;
+
+typedef struct dyldcache_xrefs_ctx_t {
+	dyldcache_t* cache;
+	uint32_t kinds;
+	uint32_t count;
+	dyldcache_xrefs_chunk_t* chunks;
+	dyldcache_xrefs_list_t* lists;
+} dyldcache_xrefs_ctx_t;
+
+typedef struct dyldcache_xrefs_file_t {
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+	uint64_t base_address;
+	uint8_t uuid[16];
+	uint64_t count;
+	uint64_t ref_count;
+} dyldcache_xrefs_file_t;
+
+static int64_t dyldcache_xrefs_sign(uint64_t value, uint32_t bits) {
+	return (int64_t) (value << (64 - bits)) >> (64 - bits);
+}
+
+static uint32_t dyldcache_xrefs_bit(uint32_t kind) {
+	switch (kind) {
+	case DYLDXREF_CALL:
+		return 0;
+	case DYLDXREF_JUMP:
+		return 1;
+	case DYLDXREF_ADDR:
+		return 2;
+	default:
+		return 3;
+	}
+}
+
+static void dyldcache_xrefs_add(dyldcache_xrefs_list_t* list, uint64_t target, uint64_t from, uint32_t kind) {
+	dyldcache_xref_entry_t* entries = NULL;
+	if (list->count == list->capacity) {
+		list->capacity = list->capacity ? list->capacity * 2 : 4096;
+		entries = (dyldcache_xref_entry_t*) realloc(list->entries, list->capacity * sizeof(dyldcache_xref_entry_t));
+		if (entries == NULL) {
+			list->capacity = list->count;
+			list->failed = 1;
+			return;
+		}
+		list->entries = entries;
+	}
+	list->entries[list->count].target = target;
+	list->entries[list->count].from = from | dyldcache_xrefs_bit(kind);
+	list->count++;
+}
+
+/*
+ * Marks which of the 16 instructions at code are branches (B/BL) or ADRP,
+ *  the only ones worth decoding.
+ */
+static uint32_t dyldcache_xrefs_classify(const dyldcache_decoder_t* decoder, const unsigned char* code) {
+	uint32_t mask = 0;
+#if defined(DYLDXREFS_VECTOR) && defined(__SSE2__)
+	uint32_t i = 0;
+	__m128i insn;
+	__m128i hits;
+	const __m128i branch_mask = _mm_set1_epi32(0x7C000000);
+	const __m128i branch = _mm_set1_epi32(0x14000000);
+	const __m128i adrp_mask = _mm_set1_epi32((int) 0x9F000000);
+	const __m128i adrp = _mm_set1_epi32((int) 0x90000000);
+	for (i = 0; i < 4; i++) {
+		insn = _mm_loadu_si128((const __m128i*) (code + i * 16));
+		hits = _mm_or_si128(_mm_cmpeq_epi32(_mm_and_si128(insn, branch_mask), branch),
+				_mm_cmpeq_epi32(_mm_and_si128(insn, adrp_mask), adrp));
+		mask |= (uint32_t) _mm_movemask_ps(_mm_castsi128_ps(hits)) << (i * 4);
+	}
+#elif defined(DYLDXREFS_VECTOR)
+	uint32_t i = 0;
+	uint32x4_t insn;
+	uint32x4_t hits;
+	static const uint32_t lanes[4] = { 1, 2, 4, 8 };
+	const uint32x4_t bits = vld1q_u32(lanes);
+	for (i = 0; i < 4; i++) {
+		insn = vld1q_u32((const uint32_t*) (code + i * 16));
+		hits = vorrq_u32(vceqq_u32(vandq_u32(insn, vdupq_n_u32(0x7C000000)), vdupq_n_u32(0x14000000)),
+				vceqq_u32(vandq_u32(insn, vdupq_n_u32(0x9F000000)), vdupq_n_u32(0x90000000)));
+		mask |= vaddvq_u32(vandq_u32(hits, bits)) << (i * 4);
+	}
+#else
+	uint32_t i = 0;
+	uint32_t insn = 0;
+	for (i = 0; i < 16; i++) {
+		insn = decoder->read32(code + i * 4);
+		if ((insn & 0x7C000000) == 0x14000000 || (insn & 0x9F000000) == 0x90000000) {
+			mask |= 1U << i;
+		}
+	}
+#endif
+	return mask;
+}
+
+static void dyldcache_xrefs_decode(dyldcache_xrefs_ctx_t* ctx, dyldcache_xrefs_list_t* list,
+		uint64_t pc, uint32_t insn, const unsigned char* next) {
+	uint32_t reg = 0;
+	uint32_t follow = 0;
+	uint64_t page = 0;
+	uint64_t target = 0;
+
+	if ((insn & 0x7C000000) == 0x14000000) {
+		target = pc + dyldcache_xrefs_sign((uint64_t) (insn & 0x03FFFFFF) << 2, 28);
+		if (insn & 0x80000000) {
+			if (ctx->kinds & DYLDXREF_CALL) dyldcache_xrefs_add(list, target, pc, DYLDXREF_CALL);
+		} else {
+			if (ctx->kinds & DYLDXREF_JUMP) dyldcache_xrefs_add(list, target, pc, DYLDXREF_JUMP);
+		}
+		return;
+	}
+	if (next == NULL || (insn & 0x9F000000) != 0x90000000) {
+		return;
+	}
+
+	reg = insn & 0x1F;
+	page = (pc & ~0xFFFULL) + (dyldcache_xrefs_sign((((insn >> 5) & 0x7FFFF) << 2) | ((insn >> 29) & 3), 21) * 4096);
+	follow = ctx->cache->decoder->read32(next);
+	if (((follow >> 5) & 0x1F) != reg) {
+		return;
+	}
+	// ADD xD, xN, #imm{, lsl 12}
+	if ((follow & 0xFF800000) == 0x91000000 && (ctx->kinds & DYLDXREF_ADDR)) {
+		target = page + ((uint64_t) ((follow >> 10) & 0xFFF) << (((follow >> 22) & 1) ? 12 : 0));
+		dyldcache_xrefs_add(list, target, pc, DYLDXREF_ADDR);
+	// LDR xT/wT, [xN, #imm]
+	} else if (((follow & 0xFFC00000) == 0xF9400000 || (follow & 0xFFC00000) == 0xB9400000) && (ctx->kinds & DYLDXREF_LOAD)) {
+		target = page + ((uint64_t) ((follow >> 10) & 0xFFF) << ((follow >> 30) & 3));
+		dyldcache_xrefs_add(list, target, pc, DYLDXREF_LOAD);
+	}
+}
+
+static void dyldcache_xrefs_func(uint32_t index, uint32_t worker, void* userdata) {
+	dyldcache_xrefs_ctx_t* ctx = (dyldcache_xrefs_ctx_t*) userdata;
+	dyldcache_xrefs_chunk_t* chunk = &ctx->chunks[index];
+	dyldcache_xrefs_list_t* list = &ctx->lists[index];
+	const dyldcache_decoder_t* decoder = ctx->cache->decoder;
+	uint32_t bit = 0;
+	uint32_t mask = 0;
+	uint64_t i = 0;
+	uint64_t pc = 0;
+	uint64_t fetch = 0;
+	uint64_t blocks = 0;
+	unsigned char* code = NULL;
+	unsigned char* next = NULL;
+
+	// One instruction of look ahead for ADRP pairs crossing the chunk
+	fetch = chunk->length;
+	if (chunk->start + fetch + 4 <= chunk->map->size) {
+		fetch += 4;
+	}
+	if (dyldcache_fetch(ctx->cache, chunk->map->offset + chunk->start, fetch) < 0) {
+		return;
+	}
+	code = &ctx->cache->data[chunk->map->offset + chunk->start];
+	pc = chunk->map->address + chunk->start;
+
+	blocks = chunk->length / 64;
+	for (i = 0; i < blocks; i++) {
+		mask = dyldcache_xrefs_classify(decoder, code + i * 64);
+		while (mask) {
+			bit = __builtin_ctz(mask);
+			mask &= mask - 1;
+			next = (i * 64 + bit * 4 + 8 <= fetch) ? code + i * 64 + bit * 4 + 4 : NULL;
+			dyldcache_xrefs_decode(ctx, list, pc + i * 64 + bit * 4,
+					decoder->read32(code + i * 64 + bit * 4), next);
+		}
+	}
+	for (i = blocks * 64; i + 4 <= chunk->length; i += 4) {
+		next = (i + 8 <= fetch) ? code + i + 4 : NULL;
+		dyldcache_xrefs_decode(ctx, list, pc + i, decoder->read32(code + i), next);
+	}
+}
+
+// Stable LSD radix sort on target, keeping each target's refs in address order
+static int dyldcache_xrefs_sort(dyldcache_xref_entry_t* entries, uint64_t count) {
+	uint32_t shift = 0;
+	uint64_t i = 0;
+	uint64_t low = ~0ULL;
+	uint64_t high = 0;
+	uint64_t total = 0;
+	uint64_t buckets[256];
+	dyldcache_xref_entry_t* scratch = NULL;
+	dyldcache_xref_entry_t* swap = NULL;
+	dyldcache_xref_entry_t* source = entries;
+
+	if (count < 2) {
+		return 0;
+	}
+	scratch = (dyldcache_xref_entry_t*) malloc(count * sizeof(dyldcache_xref_entry_t));
+	if (scratch == NULL) {
+		return -1;
+	}
+	for (i = 0; i < count; i++) {
+		if (entries[i].target < low) low = entries[i].target;
+		if (entries[i].target > high) high = entries[i].target;
+	}
+	// Only the bytes that differ need a pass
+	for (shift = 0; shift < 64 && ((low ^ high) >> shift) != 0; shift += 8) {
+		memset(buckets, '\0', sizeof(buckets));
+		for (i = 0; i < count; i++) {
+			buckets[(source[i].target >> shift) & 0xFF]++;
+		}
+		total = 0;
+		for (i = 0; i < 256; i++) {
+			total += buckets[i];
+			buckets[i] = total - buckets[i];
+		}
+		for (i = 0; i < count; i++) {
+			scratch[buckets[(source[i].target >> shift) & 0xFF]++] = source[i];
+		}
+		swap = source;
+		source = scratch;
+		scratch = swap;
+	}
+	if (source != entries) {
+		memcpy(entries, source, count * sizeof(dyldcache_xref_entry_t));
+		free(source);
+	} else {
+		free(scratch);
+	}
+	return 0;
+}
+
+static int dyldcache_xrefs_alloc(dyldcache_xrefs_t* xrefs) {
+	xrefs->targets = (uint64_t*) malloc((xrefs->count + 1) * sizeof(uint64_t));
+	xrefs->offsets = (uint32_t*) malloc((xrefs->count + 1) * sizeof(uint32_t));
+	xrefs->refs = (uint32_t*) malloc((xrefs->ref_count + 1) * sizeof(uint32_t));
+	xrefs->kinds = (uint8_t*) malloc(xrefs->ref_count + 1);
+	if (xrefs->targets == NULL || xrefs->offsets == NULL || xrefs->refs == NULL || xrefs->kinds == NULL) {
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Dyldcache Xrefs Functions
+ */
+dyldcache_xrefs_t* dyldcache_xrefs_create() {
+	debug("Creating dyld cache xref index\n");
+	dyldcache_xrefs_t* xrefs = (dyldcache_xrefs_t*) malloc(sizeof(dyldcache_xrefs_t));
+	if (xrefs) {
+		memset(xrefs, '\0', sizeof(dyldcache_xrefs_t));
+	}
+	return xrefs;
+}
+
+dyldcache_xrefs_t* dyldcache_xrefs_load(dyldcache_t* cache, dyldpool_t* pool, uint32_t kinds) {
+	debug("Scanning dyld cache for cross references\n");
+	int failed = 0;
+	uint32_t i = 0;
+	uint64_t j = 0;
+	uint64_t start = 0;
+	uint64_t total = 0;
+	dyldmap_t* map = NULL;
+	dyldpool_t* owned = NULL;
+	dyldcache_xrefs_t* xrefs = NULL;
+	dyldcache_xref_entry_t* entries = NULL;
+	dyldcache_xrefs_ctx_t ctx;
+
+	if (cache == NULL || cache->maps == NULL || cache->arch == NULL) {
+		return NULL;
+	}
+	xrefs = dyldcache_xrefs_create();
+	if (xrefs == NULL) {
+		error("Unable to allocate memory for dyld cache xref index\n");
+		return NULL;
+	}
+	xrefs->base_address = cache->header->base_address;
+	memcpy(xrefs->uuid, cache->header->uuid, sizeof(xrefs->uuid));
+	if (cache->arch->cpu_subtype != kArm64) {
+		debug("No xref decoder for %s caches\n", cache->arch->name);
+		if (dyldcache_xrefs_alloc(xrefs) < 0) {
+			dyldcache_xrefs_free(xrefs);
+			return NULL;
+		}
+		xrefs->offsets[0] = 0;
+		return xrefs;
+	}
+
+	// Split every executable mapping into fixed size chunks
+	memset(&ctx, '\0', sizeof(ctx));
+	ctx.cache = cache;
+	ctx.kinds = kinds ? kinds : DYLDXREF_ALL;
+	for (i = 0; i < cache->header->mapping_count; i++) {
+		map = cache->maps[i];
+		if (map->info && (map->info->initProt & DYLDMAP_EXEC)) {
+			if (map->address < xrefs->base_address || map->address + map->size - xrefs->base_address > DYLDXREFS_REACH) {
+				error("Executable mapping at 0x%llx is out of reach of the xref index\n", (unsigned long long) map->address);
+				dyldcache_xrefs_free(xrefs);
+				return NULL;
+			}
+			ctx.count += (map->size + DYLDXREFS_CHUNK - 1) / DYLDXREFS_CHUNK;
+		}
+	}
+	ctx.chunks = (dyldcache_xrefs_chunk_t*) calloc(ctx.count + 1, sizeof(dyldcache_xrefs_chunk_t));
+	ctx.lists = (dyldcache_xrefs_list_t*) calloc(ctx.count + 1, sizeof(dyldcache_xrefs_list_t));
+	if (ctx.chunks == NULL || ctx.lists == NULL) {
+		error("Unable to allocate memory for dyld cache xref chunks\n");
+		free(ctx.chunks);
+		free(ctx.lists);
+		dyldcache_xrefs_free(xrefs);
+		return NULL;
+	}
+	ctx.count = 0;
+	for (i = 0; i < cache->header->mapping_count; i++) {
+		map = cache->maps[i];
+		if (map->info == NULL || !(map->info->initProt & DYLDMAP_EXEC)) {
+			continue;
+		}
+		for (start = 0; start < map->size; start += DYLDXREFS_CHUNK) {
+			ctx.chunks[ctx.count].map = map;
+			ctx.chunks[ctx.count].start = start;
+			ctx.chunks[ctx.count].length = (map->size - start < DYLDXREFS_CHUNK) ? map->size - start : DYLDXREFS_CHUNK;
+			ctx.count++;
+		}
+	}
+
+	if (pool == NULL) {
+		pool = owned = dyldpool_create(0);
+	}
+	dyldcache_hold(cache);
+	dyldpool_run(pool, ctx.count, dyldcache_xrefs_func, &ctx);
+	dyldcache_release(cache);
+	if (owned) {
+		dyldpool_free(owned);
+	}
+
+	// Chunks are in address order, so concatenating keeps refs sorted
+	for (i = 0; i < ctx.count; i++) {
+		total += ctx.lists[i].count;
+		failed |= ctx.lists[i].failed;
+	}
+	// A chunk that lost references would leave holes in the index
+	entries = failed ? NULL : (dyldcache_xref_entry_t*) malloc((total + 1) * sizeof(dyldcache_xref_entry_t));
+	if (entries != NULL) {
+		total = 0;
+		for (i = 0; i < ctx.count; i++) {
+			if (ctx.lists[i].count > 0) memcpy(&entries[total], ctx.lists[i].entries, ctx.lists[i].count * sizeof(dyldcache_xref_entry_t));
+			total += ctx.lists[i].count;
+		}
+	}
+	for (i = 0; i < ctx.count; i++) {
+		free(ctx.lists[i].entries);
+	}
+	free(ctx.lists);
+	free(ctx.chunks);
+	if (entries == NULL || dyldcache_xrefs_sort(entries, total) < 0) {
+		error("Unable to allocate memory for dyld cache xrefs\n");
+		free(entries);
+		dyldcache_xrefs_free(xrefs);
+		return NULL;
+	}
+
+	if (total > 0xFFFFFFFFULL) {
+		error("Too many cross references for the xref index\n");
+		free(entries);
+		dyldcache_xrefs_free(xrefs);
+		return NULL;
+	}
+	xrefs->ref_count = total;
+	for (j = 0; j < total; j++) {
+		if (j == 0 || entries[j].target != entries[j - 1].target) {
+			xrefs->count++;
+		}
+	}
+	if (dyldcache_xrefs_alloc(xrefs) < 0) {
+		error("Unable to allocate memory for dyld cache xref index\n");
+		free(entries);
+		dyldcache_xrefs_free(xrefs);
+		return NULL;
+	}
+	xrefs->count = 0;
+	for (j = 0; j < total; j++) {
+		if (j == 0 || entries[j].target != entries[j - 1].target) {
+			xrefs->targets[xrefs->count] = entries[j].target;
+			xrefs->offsets[xrefs->count] = j;
+			xrefs->count++;
+		}
+		xrefs->refs[j] = (uint32_t) ((entries[j].from - xrefs->base_address) >> 2);
+		xrefs->kinds[j] = 1 << (entries[j].from & 3);
+	}
+	xrefs->offsets[xrefs->count] = total;
+	free(entries);
+
+	debug("Found %llu references to %llu targets\n", (unsigned long long) xrefs->ref_count, (unsigned long long) xrefs->count);
+	return xrefs;
+}
+
+uint32_t* dyldcache_xrefs_get(dyldcache_xrefs_t* xrefs, uint64_t target, uint8_t** kinds, uint64_t* count) {
+	uint64_t low = 0;
+	uint64_t high = 0;
+	uint64_t middle = 0;
+
+	*count = 0;
+	if (kinds) *kinds = NULL;
+	if (xrefs == NULL) {
+		return NULL;
+	}
+	high = xrefs->count;
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		if (xrefs->targets[middle] < target) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	if (low == xrefs->count || xrefs->targets[low] != target) {
+		return NULL;
+	}
+	*count = xrefs->offsets[low + 1] - xrefs->offsets[low];
+	if (kinds) *kinds = &xrefs->kinds[xrefs->offsets[low]];
+	return &xrefs->refs[xrefs->offsets[low]];
+}
+
+uint64_t dyldcache_xrefs_address(dyldcache_xrefs_t* xrefs, uint32_t ref) {
+	return xrefs->base_address + ((uint64_t) ref << 2);
+}
+
+int dyldcache_xrefs_save(dyldcache_xrefs_t* xrefs, const char* path) {
+	debug("Saving dyld cache xref index\n");
+	int err = 0;
+	FILE* file = NULL;
+	dyldcache_xrefs_file_t header;
+
+	if (xrefs == NULL || path == NULL) {
+		return -1;
+	}
+	file = fopen(path, "wb");
+	if (file == NULL) {
+		error("Unable to open %s for writing\n", path);
+		return -1;
+	}
+	memset(&header, '\0', sizeof(header));
+	memcpy(header.magic, DYLDXREFS_MAGIC, sizeof(header.magic));
+	header.version = DYLDXREFS_VERSION;
+	header.base_address = xrefs->base_address;
+	memcpy(header.uuid, xrefs->uuid, sizeof(header.uuid));
+	header.count = xrefs->count;
+	header.ref_count = xrefs->ref_count;
+	if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+			fwrite(xrefs->targets, sizeof(uint64_t), xrefs->count, file) != xrefs->count ||
+			fwrite(xrefs->offsets, sizeof(uint32_t), xrefs->count + 1, file) != xrefs->count + 1 ||
+			fwrite(xrefs->refs, sizeof(uint32_t), xrefs->ref_count, file) != xrefs->ref_count ||
+			fwrite(xrefs->kinds, 1, xrefs->ref_count, file) != xrefs->ref_count) {
+		error("Unable to write xref index to %s\n", path);
+		err = -1;
+	}
+	if (fclose(file) != 0) {
+		err = -1;
+	}
+	return err;
+}
+
+dyldcache_xrefs_t* dyldcache_xrefs_open(dyldcache_t* cache, const char* path) {
+	debug("Opening dyld cache xref index\n");
+	uint64_t i = 0;
+	uint64_t size = 0;
+	FILE* file = NULL;
+	dyldcache_xrefs_t* xrefs = NULL;
+	dyldcache_xrefs_file_t header;
+	struct stat status;
+
+	file = fopen(path, "rb");
+	if (file == NULL) {
+		return NULL;
+	}
+	if (fstat(fileno(file), &status) != 0 || fread(&header, sizeof(header), 1, file) != 1 ||
+			memcmp(header.magic, DYLDXREFS_MAGIC, sizeof(header.magic)) != 0 ||
+			header.version != DYLDXREFS_VERSION) {
+		error("%s is not a dyld cache xref index\n", path);
+		fclose(file);
+		return NULL;
+	}
+	// An index built for another cache would answer with garbage
+	if (cache && cache->header && (header.base_address != cache->header->base_address ||
+			memcmp(header.uuid, cache->header->uuid, sizeof(header.uuid)) != 0)) {
+		error("Xref index %s was built for a different cache\n", path);
+		fclose(file);
+		return NULL;
+	}
+	// Check the counts against the file before trusting them with malloc
+	size = (uint64_t) status.st_size - sizeof(header);
+	if (header.count > size / 12 || header.ref_count > size / 5 || header.ref_count > 0xFFFFFFFFULL ||
+			header.count * 12 + 4 + header.ref_count * 5 != size) {
+		error("Xref index %s is truncated or corrupt\n", path);
+		fclose(file);
+		return NULL;
+	}
+
+	xrefs = dyldcache_xrefs_create();
+	if (xrefs == NULL) {
+		fclose(file);
+		return NULL;
+	}
+	xrefs->base_address = header.base_address;
+	memcpy(xrefs->uuid, header.uuid, sizeof(xrefs->uuid));
+	xrefs->count = header.count;
+	xrefs->ref_count = header.ref_count;
+	if (dyldcache_xrefs_alloc(xrefs) < 0 ||
+			fread(xrefs->targets, sizeof(uint64_t), xrefs->count, file) != xrefs->count ||
+			fread(xrefs->offsets, sizeof(uint32_t), xrefs->count + 1, file) != xrefs->count + 1 ||
+			fread(xrefs->refs, sizeof(uint32_t), xrefs->ref_count, file) != xrefs->ref_count ||
+			fread(xrefs->kinds, 1, xrefs->ref_count, file) != xrefs->ref_count) {
+		error("Unable to read xref index from %s\n", path);
+		dyldcache_xrefs_free(xrefs);
+		fclose(file);
+		return NULL;
+	}
+	fclose(file);
+
+	// dyldcache_xrefs_get() indexes refs by these without further checks
+	for (i = 0; i < xrefs->count; i++) {
+		if (xrefs->offsets[i] > xrefs->offsets[i + 1]) {
+			break;
+		}
+	}
+	if (i < xrefs->count || xrefs->offsets[0] != 0 || xrefs->offsets[xrefs->count] != xrefs->ref_count) {
+		error("Xref index %s is truncated or corrupt\n", path);
+		dyldcache_xrefs_free(xrefs);
+		return NULL;
+	}
+	return xrefs;
+}
+
+void dyldcache_xrefs_debug(dyldcache_xrefs_t* xrefs) {
+	if (xrefs) {
+		debug("\tXrefs:\n");
+		debug("\t\ttargets = %llu\n", (unsigned long long) xrefs->count);
+		debug("\t\treferences = %llu\n", (unsigned long long) xrefs->ref_count);
+		debug("\n");
+	}
+}
+
+void dyldcache_xrefs_free(dyldcache_xrefs_t* xrefs) {
+	debug("Freeing dyld cache xref index\n");
+	if (xrefs) {
+		free(xrefs->targets);
+		free(xrefs->offsets);
+		free(xrefs->refs);
+		free(xrefs->kinds);
+		free(xrefs);
+	}
+}
@@ -18,25 +18,126 @@
  **/
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <libdyldcache-1.0/libdyldcache.h>
 
+static int verify(dyldcache_t* cache) {
+	int err = 0;
+	uint32_t i = 0;
+	dyldcodesign_t* codesign = NULL;
+
+	codesign = dyldcodesign_load(cache);
+	if(codesign == NULL) {
+		printf("No usable code signature\n");
+		return -1;
+	}
+	err = dyldcodesign_verify(codesign, cache, NULL);
+	if(err < 0) {
+		printf("Unable to verify code signature\n");
+	} else {
+		for(i = 0; i < codesign->mismatch_count; i++) {
+			printf("page %u at 0x%llx does not match its %s hash\n", codesign->mismatches[i],
+					(unsigned long long) codesign->mismatches[i] * codesign->page_size,
+					dyldcodesign_hash_name(codesign->hash_type));
+		}
+		printf("%u of %u pages verified\n", codesign->count - codesign->mismatch_count, codesign->count);
+		err = codesign->mismatch_count ? -1 : 0;
+	}
+	dyldcodesign_free(codesign);
+	return err;
+}
+
+static int dump(dyldcache_t* cache, dylddump_format_t format, uint32_t sections, const char* output) {
+	int fd = 1;
+	int err = 0;
+	dylddump_t* dump = NULL;
+
+	if(output) {
+		fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if(fd < 0) {
+			printf("Unable to open %s\n", output);
+			return -1;
+		}
+	}
+	dump = dylddump_create(fd, format);
+	if(dump == NULL) {
+		err = -1;
+	} else {
+		err = dylddump_cache(dump, cache, sections);
+		dylddump_free(dump);
+	}
+	if(output) {
+		close(fd);
+	}
+	return err;
+}
+
+static void usage() {
+	printf("usage: ./dbgcache [-v] [-j | -b] [-s] [-o file] <dyldcache>\n");
+	printf("  -v  verify the page hashes of the code signature\n");
+	printf("  -j  dump the header, mappings and images as JSON Lines\n");
+	printf("  -b  dump them in the binary record format instead\n");
+	printf("  -s  include the symbols of every image in the dump\n");
+	printf("  -o  write the dump to a file rather than stdout\n");
+}
+
 int main(int argc, char* argv[]) {
+	int err = 0;
+	int opt = 0;
+	int check = 0;
+	int dumping = 0;
+	uint32_t sections = DYLDDUMP_TABLES;
+	char* output = NULL;
 	char* dyldcache = NULL;
 	dyldcache_t* cache = NULL;
+	dylddump_format_t format = kDumpJson;
 
-	if(argc != 2) {
-		printf("usage: ./dbgcache <dyldcache>\n");
+	while((opt = getopt(argc, argv, "vjbso:")) != -1) {
+		switch(opt) {
+		case 'v':
+			check = 1;
+			break;
+		case 'j':
+			dumping = 1;
+			format = kDumpJson;
+			break;
+		case 'b':
+			dumping = 1;
+			format = kDumpBinary;
+			break;
+		case 's':
+			sections |= DYLDDUMP_SYMBOLS;
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		default:
+			usage();
+			return -1;
+		}
+	}
+	if(optind + 1 != argc) {
+		usage();
 		return -1;
 	}
-	dyldcache = strdup(argv[1]);
+	dyldcache = strdup(argv[optind]);
 
 	cache = dyldcache_open(dyldcache);
 	if(cache) {
 		//dyldcache_debug(cache);
+		if(check) {
+			err = verify(cache);
+		}
+		if(dumping && dump(cache, format, sections, output) < 0) {
+			err = -1;
+		}
 		dyldcache_free(cache);
 	}
 
 	free(dyldcache);
-	return 0;
+	return err;
 }
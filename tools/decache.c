@@ -18,36 +18,186 @@
  **/
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <libdyldcache-1.0/cache.h>
 #include <libdyldcache-1.0/image.h>
+#include <libdyldcache-1.0/writer.h>
+#include <libdyldcache-1.0/extract.h>
+#include <libdyldcache-1.0/compress.h>
+#include <libdyldcache-1.0/client.h>
+
+static void usage(const char* name) {
+	printf("usage: %s [-w backend] [-c | -z | -a archive] <dyldcache>\n", name);
+	printf("       %s [-w backend] [-c | -z | -a archive] <dyldcache> <dylib>\n", name);
+	printf("\n");
+	printf("  -c           rebuild each dylib with its own compacted LINKEDIT\n");
+	printf("  -w backend   output backend: auto, sync, threads or uring (default: sync)\n");
+	printf("  -z           write each dylib as <name>.zst\n");
+	printf("  -a archive   write all dylibs into a single zstd compressed tarball\n");
+	printf("\n");
+	printf("Set %s to extract single dylibs through dyldcached\n", DYLDCACHED_SOCKET_ENV);
+}
+
+static int extract_remote(const char* cache, const char* dylib) {
+	int err = -1;
+	uint64_t size = 0;
+	unsigned char* data = NULL;
+	dyldclient_t* client = dyldclient_connect(NULL);
+	if(client == NULL) {
+		return -1;
+	}
+
+	if(dyldclient_open(client, cache) == 0 &&
+			dyldclient_extract(client, dylib, &data, &size) == 0 && size > 0) {
+		printf("Writing dylib to %s\n", dylib);
+		err = file_write(dylib, data, size);
+	}
+
+	free(data);
+	dyldclient_free(client);
+	return err;
+}
+
+/*
+ * Writes an image's Mach-O as it sits in the cache.
+ */
+static int save_image(dyldcache_t* cache, dyldimage_t* image, const char* path) {
+	dyldimage_t output;
+	memset(&output, '\0', sizeof(output));
+	output.data = dyldcache_image_extent(cache, image, &output.size);
+	if(output.data == NULL) {
+		printf("Unable to read %s from dyldcache\n", image->path);
+		return -1;
+	}
+	return dyldimage_save(&output, path);
+}
+
+static int save_compacted(dyldcache_t* cache, dyldimage_t** images, uint32_t count, const char* path) {
+	int err = 0;
+	dyldimage_t output;
+	dyldextract_t* extract = dyldextract_create(cache, count > 1 ? 0 : 1);
+	if(extract == NULL) {
+		printf("Unable to create extractor\n");
+		return -1;
+	}
+
+	// Every worker rebuilds into a buffer of its own, reused image to image
+	if(path != NULL) {
+		err = dyldextract_image(extract, images[0], 0, &output);
+		if(err == 0) {
+			err = dyldimage_save(&output, path);
+		}
+	} else {
+		err = dyldextract_save(extract, images, count, ".");
+	}
+	if(err < 0) {
+		printf("Unable to write compacted dylibs\n");
+	}
+
+	dyldextract_free(extract);
+	return err;
+}
+
+static int save_compressed(dyldcache_t* cache, dyldimage_t** images, uint32_t count, const char* archive) {
+	int err = 0;
+	dyldcompress_t* compress = dyldcompress_create(0, 0);
+	if(compress == NULL) {
+		printf("Unable to create compressor\n");
+		return -1;
+	}
+
+	// Images are compressed in parallel, straight out of the cache
+	if(archive != NULL) {
+		err = dyldcompress_archive(compress, cache, images, count, archive);
+	} else {
+		err = dyldcompress_save(compress, cache, images, count, ".");
+	}
+	if(err < 0) {
+		printf("Unable to write compressed dylibs\n");
+	}
+
+	dyldcompress_free(compress);
+	return err;
+}
 
 int main(int argc, char* argv[]) {
+	int opt = 0;
 	int err = 0;
 	char* cache = NULL; // The path the dyldcache
 	char* dylib = NULL; // The name of the dylib to extract
+	char* archive = NULL; // The path of the compressed archive to write
+	int zstd = 0; // Whether to compress each dylib on its own
+	int compact = 0; // Whether to rebuild each dylib's LINKEDIT
 	dyldcache_t* dyldcache = NULL; // Handle to dyld cache
 	dyldimage_t* dyldimage = NULL; // Handle to dyld image
+	dyldwriter_t* writer = NULL; // Handle to the output backend
+	dyldwriter_backend_t backend = kWriterSync;
 
-	if(argc == 2) {
-		// We need to free this when we're done with it
-		cache = strdup(argv[1]);
+	while ((opt = getopt(argc, argv, "w:cza:")) != -1) {
+		switch (opt) {
+		case 'w':
+			backend = dyldwriter_backend_parse(optarg);
+			if (backend == kWriterInvalid) {
+				printf("Unknown output backend %s\n", optarg);
+				return -1;
+			}
+			break;
+		case 'c':
+			compact = 1;
+			break;
+		case 'z':
+			zstd = 1;
+			break;
+		case 'a':
+			archive = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+	argc -= optind;
+	argv += optind;
 
-	} else if(argc == 3) {
+	if(argc == 1) {
 		// We need to free this when we're done with it
-		dylib = strdup(argv[2]);
+		cache = strdup(argv[0]);
+
+	} else if(argc == 2) {
+		// We need to free these when we're done with them
+		cache = strdup(argv[0]);
+		dylib = strdup(argv[1]);
 
 	} else {
-		printf("usage: ./decache <dyldcache>\n");
-		printf("       ./decache <dyldcache> <dylib>\n");
+		usage("decache");
 		return -1;
 	}
 
+	if(compact && (zstd || archive != NULL)) {
+		printf("Compacted dylibs can't be compressed\n");
+		free(dylib);
+		free(cache);
+		return -1;
+	}
+
+	// A running dyldcached already has the cache open
+	//  so ask it for single dylibs first
+	if(dylib != NULL && !compact && !zstd && archive == NULL && getenv(DYLDCACHED_SOCKET_ENV) != NULL) {
+		if(extract_remote(cache, dylib) == 0) {
+			free(dylib);
+			free(cache);
+			return 0;
+		}
+	}
+
 	// Make sure cache was specified on the command line
 	if(cache != NULL) {
 		// Cache was specified on the command line
 		//  so let's try openning it
-		dyldcache_t* dyldcache = dyldcache_open(cache);
+		dyldcache = dyldcache_open(cache);
 		if(dyldcache != NULL) {
 			// Cache was successfully opened
 			//  did they specify which dylib they wanted also?
@@ -58,7 +208,13 @@ int main(int argc, char* argv[]) {
 				if(dyldimage != NULL) {
 					// We've successfully found the dylib
 					//  Let's write it to disk
-					dyldimage_save(dyldimage, dylib);
+					if(compact) {
+						err = save_compacted(dyldcache, &dyldimage, 1, dylib);
+					} else if(zstd || archive != NULL) {
+						err = save_compressed(dyldcache, &dyldimage, 1, archive);
+					} else {
+						err = save_image(dyldcache, dyldimage, dylib);
+					}
 					// dyldimage is freed when dyldcache is
 					//  this might not be very safe if used incorrectly...
 
@@ -75,11 +231,48 @@ int main(int argc, char* argv[]) {
 			} else {
 				// No dylib was specified on the command line
 				//  so extract all dylibs
-				for(dyldimage = dyldcache_first_image(dyldcache);
-					dyldimage != NULL;
-					dyldimage = dyldcache_next_image(dyldcache, dyldimage)) {
-						// Save each image
-						dyldimage_save(dyldimage, dyldimage_get_name(dyldimage));
+				if(compact) {
+					err = save_compacted(dyldcache, dyldcache->images, dyldcache->count, NULL);
+
+				} else if(zstd || archive != NULL) {
+					err = save_compressed(dyldcache, dyldcache->images, dyldcache->count, archive);
+
+				} else if(backend == kWriterSync) {
+					for(dyldimage = dyldcache_first_image(dyldcache);
+						dyldimage != NULL;
+						dyldimage = dyldcache_next_image(dyldcache, dyldimage)) {
+							// Save each image
+							if(save_image(dyldcache, dyldimage, dyldimage_get_name(dyldimage)) < 0) {
+								err = -1;
+							}
+					}
+
+				} else {
+					// Queue every image and let the writer batch
+					//  the open/write/close calls for us
+					writer = dyldwriter_create(backend, 0);
+					if(writer != NULL) {
+						// Queued images must stay fetched until flushed
+						dyldcache_hold(dyldcache);
+						for(dyldimage = dyldcache_first_image(dyldcache);
+							dyldimage != NULL;
+							dyldimage = dyldcache_next_image(dyldcache, dyldimage)) {
+								dyldwriter_save(writer, dyldcache, dyldimage, dyldimage_get_name(dyldimage));
+						}
+						// Image data lives in the cache, so the writer
+						//  must be done before the cache is freed
+						dyldwriter_flush(writer);
+						dyldcache_release(dyldcache);
+						if(writer->failed > 0) {
+							printf("Unable to write %u dylibs\n", writer->failed);
+							err = -1;
+						}
+						dyldwriter_free(writer);
+
+					} else {
+						printf("Unable to create output writer\n");
+						err = -1;
+					}
 				}
 			}
 
@@ -0,0 +1,1024 @@
+/**
+  * libdyldcache-1.0 - dyldcached.c
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <libmacho-1.0/macho.h>
+#include <libcrippy-1.0/debug.h>
+#include <libcrippy-1.0/libcrippy.h>
+#include <libdyldcache-1.0/cache.h>
+#include <libdyldcache-1.0/deps.h>
+#include <libdyldcache-1.0/pool.h>
+#include <libdyldcache-1.0/client.h>
+
+#define MAX_CACHES   255
+#define MAX_PAYLOAD  (64 * 1024)
+#define MAX_CLIENTS  1024
+
+// Seconds between checks for replaced caches
+#define REFRESH_INTERVAL  10
+
+// Seconds a client may take to send the rest of a started request
+#define REQUEST_TIMEOUT   5
+
+typedef struct symbol_t {
+	char* name;
+	uint64_t address;
+	uint32_t image;
+} symbol_t;
+
+/*
+ * The symbols of one image, keyed by the hash of its Mach-O header and
+ *  load commands. Snapshots of a replaced cache share the lists of images
+ *  whose key didn't change, so each list is reference counted. complete
+ *  is set once the image has been parsed, by whichever snapshot did it;
+ *  failed when symbols were lost to an allocation failure on the way.
+ */
+typedef struct symbols_t {
+	symbol_t* symbols;
+	uint32_t count;
+	uint32_t capacity;
+	uint64_t hash;
+	int complete;
+	int failed;
+	volatile uint32_t refs;
+} symbols_t;
+
+/*
+ * Everything kept resident for one cache. Symbols are sorted by address
+ *  for address queries and hashed by name for symbol queries; their
+ *  names belong to the per image lists. fd is the file the cache was
+ *  mapped from and status its state then, so a file rewritten in place
+ *  is noticed before its bytes are served.
+ */
+typedef struct served_t {
+	char* path;
+	dyldcache_t* cache;
+	dyldcache_deps_t* deps;
+	symbol_t* symbols;
+	uint32_t count;
+	uint32_t* names;
+	uint32_t names_mask;
+	uint32_t* images;
+	uint32_t images_mask;
+	symbols_t** lists;
+	int fd;
+	struct stat status;
+	volatile uint32_t refs;
+} served_t;
+
+/*
+ * A served cache file. Queries take a reference to current, which the
+ *  refresh thread replaces with a rebuilt snapshot when the file changes;
+ *  the old one goes away with its last query. seen is what the path last
+ *  resolved to, which only the refresh thread looks at.
+ */
+typedef struct slot_t {
+	char* path;
+	served_t* current;
+	struct stat seen;
+	pthread_mutex_t lock;
+} slot_t;
+
+typedef struct buffer_t {
+	unsigned char* data;
+	uint32_t size;
+	uint32_t capacity;
+} buffer_t;
+
+typedef struct queue_t {
+	int fds[MAX_CLIENTS];
+	uint32_t head;
+	uint32_t count;
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+} queue_t;
+
+static slot_t slots[MAX_CACHES];
+static uint32_t slot_count = 0;
+static queue_t queue;
+static volatile sig_atomic_t running = 1;
+static int listener = -1;
+static int wakeup[2] = { -1, -1 };
+static volatile uint32_t connected = 0;
+
+static uint32_t hash(const char* name, size_t length) {
+	size_t i = 0;
+	uint32_t value = 2166136261u;
+	for (i = 0; i < length; i++) {
+		value ^= (uint8_t) name[i];
+		value *= 16777619u;
+	}
+	return value;
+}
+
+static uint64_t hash64(uint64_t value, const unsigned char* data, size_t length) {
+	size_t i = 0;
+	for (i = 0; i < length; i++) {
+		value ^= data[i];
+		value *= 1099511628211ULL;
+	}
+	return value;
+}
+
+static uint32_t table_size(uint32_t count) {
+	uint32_t size = 16;
+	while (size < count * 2) {
+		size <<= 1;
+	}
+	return size;
+}
+
+/*
+ * Index building
+ */
+static void collect_symbol(const char* name, uint32_t address, void* userdata) {
+	char* copy = NULL;
+	uint32_t capacity = 0;
+	symbols_t* list = (symbols_t*) userdata;
+	symbol_t* grown = NULL;
+	if (list->failed) {
+		return;
+	}
+	if (list->count == list->capacity) {
+		capacity = list->capacity ? list->capacity * 2 : 64;
+		grown = (symbol_t*) realloc(list->symbols, capacity * sizeof(symbol_t));
+		if (grown == NULL) {
+			list->failed = 1;
+			return;
+		}
+		list->symbols = grown;
+		list->capacity = capacity;
+	}
+	copy = strdup(name);
+	if (copy == NULL) {
+		list->failed = 1;
+		return;
+	}
+	list->symbols[list->count].name = copy;
+	list->symbols[list->count].address = address;
+	list->count++;
+}
+
+static void collect_image(uint32_t index, uint32_t worker, void* userdata) {
+	uint64_t size = 0;
+	unsigned char* data = NULL;
+	macho_t* macho = NULL;
+	served_t* entry = (served_t*) userdata;
+	dyldimage_t* image = entry->cache->images[index];
+	symbols_t* list = entry->lists[index];
+
+	// Lists taken over from the previous snapshot are already complete
+	if (list == NULL || list->complete) {
+		return;
+	}
+	data = dyldcache_image_data(entry->cache, image, &size);
+	macho = data ? macho_load(data, size > UINT32_MAX ? UINT32_MAX : (uint32_t) size) : NULL;
+	if (macho) {
+		macho_list_symbols(macho, collect_symbol, list);
+		macho_free(macho);
+	}
+	list->complete = 1;
+}
+
+/*
+ * The install path, Mach-O header and load commands of an image. They
+ *  carry its LC_UUID and segment addresses, so an equal hash in a new
+ *  cache means the symbols read from it would be the same.
+ */
+static uint64_t image_hash(dyldcache_t* cache, dyldimage_t* image) {
+	uint32_t header = 0;
+	uint64_t value = 14695981039346656037ULL;
+	const unsigned char* macho = dyldcache_read(cache, image->address, 32);
+
+	value = hash64(value, (const unsigned char*) image->path, strlen(image->path) + 1);
+	if (macho == NULL) {
+		return value;
+	}
+	switch (cache->decoder->read32(macho)) {
+	case 0xFEEDFACE:
+		header = 28;
+		break;
+	case 0xFEEDFACF:
+		header = 32;
+		break;
+	default:
+		return value;
+	}
+	header += cache->decoder->read32(macho + 20);
+	macho = dyldcache_read(cache, image->address, header);
+	return macho ? hash64(value, macho, header) : value;
+}
+
+static void symbols_release(symbols_t* list) {
+	uint32_t i = 0;
+	if (list && __sync_sub_and_fetch(&list->refs, 1) == 0) {
+		for (i = 0; i < list->count; i++) {
+			free(list->symbols[i].name);
+		}
+		free(list->symbols);
+		free(list);
+	}
+}
+
+static int compare_address(const void* a, const void* b) {
+	const symbol_t* left = (const symbol_t*) a;
+	const symbol_t* right = (const symbol_t*) b;
+	if (left->address != right->address) {
+		return left->address < right->address ? -1 : 1;
+	}
+	return left->image < right->image ? -1 : left->image > right->image;
+}
+
+static void served_free(served_t* entry) {
+	uint32_t i = 0;
+	if (entry) {
+		for (i = 0; entry->lists && i < entry->cache->count; i++) {
+			symbols_release(entry->lists[i]);
+		}
+		free(entry->lists);
+		free(entry->symbols);
+		free(entry->names);
+		free(entry->images);
+		if (entry->deps) {
+			dyldcache_deps_free(entry->deps);
+		}
+		if (entry->cache) {
+			dyldcache_free(entry->cache);
+		}
+		if (entry->fd >= 0) {
+			close(entry->fd);
+		}
+		free(entry->path);
+		free(entry);
+	}
+}
+
+static served_t* served_acquire(slot_t* slot) {
+	served_t* entry = NULL;
+	pthread_mutex_lock(&slot->lock);
+	entry = slot->current;
+	__sync_fetch_and_add(&entry->refs, 1);
+	pthread_mutex_unlock(&slot->lock);
+	return entry;
+}
+
+static void served_release(served_t* entry) {
+	if (entry && __sync_sub_and_fetch(&entry->refs, 1) == 0) {
+		served_free(entry);
+	}
+}
+
+static served_t* served_open(const char* path) {
+	char resolved[PATH_MAX];
+	served_t* entry = NULL;
+
+	if (realpath(path, resolved) == NULL) {
+		error("Unable to resolve %s\n", path);
+		return NULL;
+	}
+	entry = (served_t*) calloc(1, sizeof(served_t));
+	if (entry == NULL) {
+		return NULL;
+	}
+	entry->fd = -1;
+	entry->refs = 1;
+	entry->path = strdup(resolved);
+	entry->fd = open(resolved, O_RDONLY);
+	if (entry->fd < 0 || fstat(entry->fd, &entry->status) < 0) {
+		error("Unable to stat %s\n", path);
+		served_free(entry);
+		return NULL;
+	}
+	entry->cache = dyldcache_open(resolved);
+	if (entry->cache == NULL) {
+		error("Unable to open dyldcache %s\n", path);
+		served_free(entry);
+		return NULL;
+	}
+	// The path may have been replaced between the two opens
+	if (entry->cache->inode != (uint64_t) entry->status.st_ino ||
+			entry->cache->mtime != (uint64_t) entry->status.st_mtime) {
+		error("%s changed while it was being opened\n", path);
+		served_free(entry);
+		return NULL;
+	}
+	return entry;
+}
+
+/*
+ * Builds the tables of entry. Images whose hash matches one in previous
+ *  take over its symbol list, only the others are parsed. The dependency
+ *  graph, the address order and the name table are still rebuilt whole.
+ *  Returns -1 if anything couldn't be built whole.
+ */
+static int served_index(served_t* entry, served_t* previous, dyldpool_t* pool) {
+	uint32_t i = 0;
+	uint32_t j = 0;
+	uint32_t slot = 0;
+	uint32_t mask = 0;
+	uint32_t total = 0;
+	uint32_t reused = 0;
+	uint32_t* known = NULL;
+	uint64_t value = 0;
+	symbols_t* list = NULL;
+	dyldimage_t* image = NULL;
+
+	entry->deps = dyldcache_deps_load(entry->cache, pool);
+	entry->lists = (symbols_t**) calloc(entry->cache->count, sizeof(symbols_t*));
+	if (entry->lists == NULL) {
+		error("Unable to allocate memory for %s symbols\n", entry->path);
+		return -1;
+	}
+
+	if (previous && previous->lists) {
+		mask = table_size(previous->cache->count) - 1;
+		known = (uint32_t*) calloc(mask + 1, sizeof(uint32_t));
+		for (i = 0; known && i < previous->cache->count; i++) {
+			if (previous->lists[i] == NULL) {
+				continue;
+			}
+			slot = (uint32_t) previous->lists[i]->hash & mask;
+			while (known[slot] != 0) {
+				slot = (slot + 1) & mask;
+			}
+			known[slot] = i + 1;
+		}
+	}
+	for (i = 0; i < entry->cache->count; i++) {
+		value = image_hash(entry->cache, entry->cache->images[i]);
+		list = NULL;
+		if (known) {
+			slot = (uint32_t) value & mask;
+			while (known[slot] != 0 && previous->lists[known[slot] - 1]->hash != value) {
+				slot = (slot + 1) & mask;
+			}
+			if (known[slot] != 0) {
+				list = previous->lists[known[slot] - 1];
+				__sync_fetch_and_add(&list->refs, 1);
+				reused++;
+			}
+		}
+		if (list == NULL) {
+			list = (symbols_t*) calloc(1, sizeof(symbols_t));
+			if (list == NULL) {
+				free(known);
+				error("Unable to allocate memory for %s symbols\n", entry->path);
+				return -1;
+			}
+			list->hash = value;
+			list->refs = 1;
+			list->complete = 0;
+		}
+		entry->lists[i] = list;
+	}
+	free(known);
+
+	// Parse every changed image once, in parallel, then merge
+	dyldcache_hold(entry->cache);
+	dyldpool_run(pool, entry->cache->count, collect_image, entry);
+	dyldcache_release(entry->cache);
+	for (i = 0; i < entry->cache->count; i++) {
+		if (entry->lists[i]->failed) {
+			error("Unable to allocate memory for %s symbols\n", entry->cache->images[i]->path);
+			return -1;
+		}
+		total += entry->lists[i]->count;
+	}
+	entry->symbols = (symbol_t*) malloc((total + 1) * sizeof(symbol_t));
+	if (entry->symbols == NULL) {
+		error("Unable to allocate memory for %s symbols\n", entry->path);
+		return -1;
+	}
+	for (i = 0; i < entry->cache->count; i++) {
+		list = entry->lists[i];
+		for (j = 0; j < list->count; j++) {
+			entry->symbols[entry->count] = list->symbols[j];
+			entry->symbols[entry->count].image = i;
+			entry->count++;
+		}
+	}
+	qsort(entry->symbols, entry->count, sizeof(symbol_t), compare_address);
+
+	entry->names_mask = table_size(entry->count) - 1;
+	entry->names = (uint32_t*) calloc(entry->names_mask + 1, sizeof(uint32_t));
+	entry->images_mask = table_size(entry->cache->count) - 1;
+	entry->images = (uint32_t*) calloc(entry->images_mask + 1, sizeof(uint32_t));
+	if (entry->names == NULL || entry->images == NULL) {
+		error("Unable to allocate memory for %s tables\n", entry->path);
+		return -1;
+	}
+	for (i = 0; i < entry->count; i++) {
+		slot = hash(entry->symbols[i].name, strlen(entry->symbols[i].name)) & entry->names_mask;
+		while (entry->names[slot] != 0) {
+			slot = (slot + 1) & entry->names_mask;
+		}
+		entry->names[slot] = i + 1;
+	}
+
+	for (j = 0; j < entry->cache->count; j++) {
+		image = entry->cache->images[j];
+		slot = hash(image->name, strlen(image->name)) & entry->images_mask;
+		while (entry->images[slot] != 0) {
+			slot = (slot + 1) & entry->images_mask;
+		}
+		entry->images[slot] = j + 1;
+	}
+
+	info("Serving %s: %u images (%u unchanged), %u symbols\n", entry->path,
+			entry->cache->count, reused, entry->count);
+	return 0;
+}
+
+static served_t* serve_cache(const char* path, dyldpool_t* pool) {
+	served_t* entry = served_open(path);
+	if (entry != NULL && served_index(entry, NULL, pool) < 0) {
+		served_release(entry);
+		return NULL;
+	}
+	return entry;
+}
+
+/*
+ * Cache refresh
+ */
+static int served_changed(struct stat* seen, struct stat* status) {
+	return status->st_dev != seen->st_dev || status->st_ino != seen->st_ino ||
+			status->st_size != seen->st_size || status->st_mtime != seen->st_mtime;
+}
+
+/*
+ * Caches are mapped private, which doesn't protect them from writes to
+ *  the file: a cache rewritten in place shows the new bytes, or faults
+ *  past a new end. Replacing caches by rename keeps old snapshots whole;
+ *  this catches the rest before the mapping is read from.
+ */
+static int served_intact(served_t* entry) {
+	struct stat status;
+	if (fstat(entry->fd, &status) < 0) {
+		return 0;
+	}
+	return !served_changed(&entry->status, &status);
+}
+
+/*
+ * Replaced files are told apart by inode, size and mtime, then by the
+ *  header UUID, so a copy of the same cache only costs an open. A file
+ *  rewritten in place always gets a new snapshot, as the current one
+ *  maps the same changing inode.
+ */
+static void refresh_slot(slot_t* slot, dyldpool_t* pool) {
+	static const uint8_t zero[16] = { 0 };
+	struct stat status;
+	served_t* fresh = NULL;
+	served_t* current = slot->current;
+
+	if (stat(slot->path, &status) < 0 || !served_changed(&slot->seen, &status)) {
+		return;
+	}
+	fresh = served_open(slot->path);
+	if (fresh == NULL) {
+		return;
+	}
+	slot->seen = fresh->status;
+	if (served_intact(current) && memcmp(fresh->cache->header->uuid, zero, sizeof(zero)) &&
+			!memcmp(fresh->cache->header->uuid, current->cache->header->uuid, sizeof(zero))) {
+		served_release(fresh);
+		return;
+	}
+	if (!served_intact(current)) {
+		info("%s was rewritten in place, replace caches by rename instead\n", slot->path);
+	}
+
+	info("Reindexing %s\n", slot->path);
+	if (served_index(fresh, current, pool) < 0) {
+		// Keep serving the old snapshot and try again next time
+		memset(&slot->seen, '\0', sizeof(slot->seen));
+		served_release(fresh);
+		return;
+	}
+	pthread_mutex_lock(&slot->lock);
+	slot->current = fresh;
+	pthread_mutex_unlock(&slot->lock);
+	served_release(current);
+}
+
+static void* refresh_main(void* arg) {
+	uint32_t i = 0;
+	uint32_t* interval = (uint32_t*) arg;
+	dyldpool_t* pool = dyldpool_create(0);
+	while (running) {
+		sleep(*interval);
+		for (i = 0; running && i < slot_count; i++) {
+			refresh_slot(&slots[i], pool);
+		}
+	}
+	dyldpool_free(pool);
+	return NULL;
+}
+
+/*
+ * Response building
+ */
+static int buffer_reserve(buffer_t* buffer, uint32_t size) {
+	unsigned char* grown = NULL;
+	uint32_t capacity = buffer->capacity ? buffer->capacity : 4096;
+	if (buffer->size + size <= buffer->capacity) {
+		return 0;
+	}
+	while (capacity < buffer->size + size) {
+		capacity *= 2;
+	}
+	grown = (unsigned char*) realloc(buffer->data, capacity);
+	if (grown == NULL) {
+		return -1;
+	}
+	buffer->data = grown;
+	buffer->capacity = capacity;
+	return 0;
+}
+
+static int buffer_record(buffer_t* buffer, uint64_t address, uint32_t image, const char* image_name, const char* symbol) {
+	dyldcached_record_t record;
+	record.address = address;
+	record.image = image;
+	record.image_length = image_name ? strlen(image_name) : 0;
+	record.symbol_length = symbol ? strlen(symbol) : 0;
+	if (buffer_reserve(buffer, sizeof(record) + record.image_length + record.symbol_length) < 0) {
+		return -1;
+	}
+	memcpy(buffer->data + buffer->size, &record, sizeof(record));
+	buffer->size += sizeof(record);
+	if (record.image_length > 0) {
+		memcpy(buffer->data + buffer->size, image_name, record.image_length);
+		buffer->size += record.image_length;
+	}
+	if (record.symbol_length > 0) {
+		memcpy(buffer->data + buffer->size, symbol, record.symbol_length);
+		buffer->size += record.symbol_length;
+	}
+	return 0;
+}
+
+static int write_all(int fd, const void* data, size_t size) {
+	ssize_t done = 0;
+	const unsigned char* cursor = (const unsigned char*) data;
+	while (size > 0) {
+		done = send(fd, cursor, size, MSG_NOSIGNAL);
+		if (done < 0 && errno == EINTR) {
+			continue;
+		}
+		if (done <= 0) {
+			return -1;
+		}
+		cursor += done;
+		size -= done;
+	}
+	return 0;
+}
+
+static int read_all(int fd, void* data, size_t size) {
+	ssize_t done = 0;
+	unsigned char* cursor = (unsigned char*) data;
+	while (size > 0) {
+		done = recv(fd, cursor, size, 0);
+		if (done < 0 && errno == EINTR) {
+			continue;
+		}
+		if (done <= 0) {
+			return -1;
+		}
+		cursor += done;
+		size -= done;
+	}
+	return 0;
+}
+
+static int respond(int fd, int status, uint32_t count, const void* payload, uint32_t length) {
+	dyldcached_response_t response;
+	response.magic = DYLDCACHED_MAGIC;
+	response.status = status;
+	response.count = count;
+	response.length = length;
+	if (write_all(fd, &response, sizeof(response)) < 0) {
+		return -1;
+	}
+	return length ? write_all(fd, payload, length) : 0;
+}
+
+/*
+ * Queries
+ */
+static int find_image(served_t* entry, const char* name) {
+	uint32_t slot = hash(name, strlen(name)) & entry->images_mask;
+	uint32_t found = 0;
+	while ((found = entry->images[slot]) != 0) {
+		if (!strcmp(entry->cache->images[found - 1]->name, name)) {
+			return found - 1;
+		}
+		slot = (slot + 1) & entry->images_mask;
+	}
+	return -1;
+}
+
+static uint32_t find_symbol(served_t* entry, const char* name, int image, buffer_t* buffer) {
+	uint32_t slot = hash(name, strlen(name)) & entry->names_mask;
+	uint32_t found = 0;
+	uint32_t count = 0;
+	symbol_t* symbol = NULL;
+	while ((found = entry->names[slot]) != 0) {
+		symbol = &entry->symbols[found - 1];
+		if ((image < 0 || symbol->image == (uint32_t) image) && !strcmp(symbol->name, name)) {
+			buffer_record(buffer, symbol->address, symbol->image,
+					entry->cache->images[symbol->image]->name, symbol->name);
+			count++;
+		}
+		slot = (slot + 1) & entry->names_mask;
+	}
+	return count;
+}
+
+static uint32_t query_image_symbol(served_t* entry, const char* dylib, const char* symbol, buffer_t* buffer) {
+	int image = find_image(entry, dylib);
+	uint32_t i = 0;
+	uint32_t count = 0;
+	uint32_t found = 0;
+	uint32_t* reexports = NULL;
+	if (image < 0) {
+		return 0;
+	}
+	found = find_symbol(entry, symbol, image, buffer);
+	if (found == 0 && entry->deps) {
+		// Follow re-exports, as dyldrop does
+		reexports = dyldcache_deps_closure(entry->deps, image, DYLDDEP_REEXPORT, &count);
+		for (i = 0; i < count && found == 0; i++) {
+			found = find_symbol(entry, symbol, reexports[i], buffer);
+		}
+		free(reexports);
+	}
+	return found;
+}
+
+static uint32_t query_address(served_t* entry, uint64_t address, buffer_t* buffer) {
+	uint32_t low = 0;
+	uint32_t high = entry->count;
+	uint32_t middle = 0;
+	symbol_t* symbol = NULL;
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		if (entry->symbols[middle].address <= address) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	if (low == 0) {
+		return 0;
+	}
+	symbol = &entry->symbols[low - 1];
+	buffer_record(buffer, symbol->address, symbol->image, entry->cache->images[symbol->image]->name, symbol->name);
+	return 1;
+}
+
+static int serve_query(int fd, served_t* entry, dyldcached_request_t* request, char* payload, buffer_t* buffer) {
+	int image = 0;
+	uint32_t i = 0;
+	uint32_t count = 0;
+	uint64_t size = 0;
+	uint64_t address = 0;
+	unsigned char* data = NULL;
+	dyldimage_t* dylib = NULL;
+
+	switch (request->op) {
+	case DYLDCACHED_OP_SYMBOL:
+		count = find_symbol(entry, payload, -1, buffer);
+		break;
+	case DYLDCACHED_OP_IMAGE_SYMBOL:
+		if (strlen(payload) + 1 >= request->length) {
+			return respond(fd, -1, 0, NULL, 0);
+		}
+		count = query_image_symbol(entry, payload, payload + strlen(payload) + 1, buffer);
+		break;
+	case DYLDCACHED_OP_ADDRESS:
+		if (request->length != sizeof(address)) {
+			return respond(fd, -1, 0, NULL, 0);
+		}
+		memcpy(&address, payload, sizeof(address));
+		count = query_address(entry, address, buffer);
+		break;
+	case DYLDCACHED_OP_IMAGES:
+		for (i = 0; i < entry->cache->count; i++) {
+			dylib = entry->cache->images[i];
+			buffer_record(buffer, dylib->address, i, dylib->path, NULL);
+		}
+		count = entry->cache->count;
+		break;
+	case DYLDCACHED_OP_EXTRACT:
+		image = find_image(entry, payload);
+		if (image < 0) {
+			return respond(fd, -1, 0, NULL, 0);
+		}
+		data = dyldcache_image_extent(entry->cache, entry->cache->images[image], &size);
+		if (data == NULL || size > UINT32_MAX) {
+			return respond(fd, -1, 0, NULL, 0);
+		}
+		return respond(fd, 0, 1, data, (uint32_t) size);
+	default:
+		return respond(fd, -1, 0, NULL, 0);
+	}
+	return respond(fd, count > 0 ? 0 : -1, count, buffer->data, buffer->size);
+}
+
+static int serve_request(int fd, dyldcached_request_t* request, char* payload, buffer_t* buffer) {
+	int err = 0;
+	uint32_t i = 0;
+	served_t* entry = NULL;
+
+	buffer->size = 0;
+	if (request->op == DYLDCACHED_OP_OPEN) {
+		for (i = 0; i < slot_count; i++) {
+			if (!strcmp(slots[i].path, payload)) {
+				return respond(fd, 0, 1, &i, sizeof(i));
+			}
+		}
+		return respond(fd, -1, 0, NULL, 0);
+	}
+
+	if (request->cache >= slot_count) {
+		return respond(fd, -1, 0, NULL, 0);
+	}
+	// The snapshot stays alive until the response is out, even if a
+	//  refresh replaces it meanwhile
+	entry = served_acquire(&slots[request->cache]);
+	// Every query reads the mapping, if only for image names; refuse it
+	//  while the file is changed under it and no new snapshot is ready
+	if (!served_intact(entry)) {
+		served_release(entry);
+		return respond(fd, -1, 0, NULL, 0);
+	}
+	dyldcache_hold(entry->cache);
+	err = serve_query(fd, entry, request, payload, buffer);
+	dyldcache_release(entry->cache);
+	served_release(entry);
+	return err;
+}
+
+/*
+ * Reads and answers one request. Returns -1 once the connection should
+ *  be closed.
+ */
+static int serve_client(int fd, char* payload, buffer_t* buffer) {
+	dyldcached_request_t request;
+	if (read_all(fd, &request, sizeof(request)) < 0) {
+		return -1;
+	}
+	if (request.magic != DYLDCACHED_MAGIC || request.length > MAX_PAYLOAD) {
+		return -1;
+	}
+	if (request.length > 0 && read_all(fd, payload, request.length) < 0) {
+		return -1;
+	}
+	payload[request.length] = '\0';
+	return serve_request(fd, &request, payload, buffer);
+}
+
+/*
+ * Client thread pool. Workers take one request at a time, so idle
+ *  connections cost a slot in the poll set rather than a thread. A
+ *  connection is handed back to the poller once its request is answered.
+ */
+static void* worker_main(void* arg) {
+	int fd = -1;
+	char* payload = NULL;
+	buffer_t buffer;
+
+	memset(&buffer, '\0', sizeof(buffer));
+	payload = (char*) malloc(MAX_PAYLOAD + 1);
+	if (payload == NULL) {
+		error("Unable to allocate memory for request payload\n");
+		return NULL;
+	}
+	while (1) {
+		pthread_mutex_lock(&queue.lock);
+		while (running && queue.count == 0) {
+			pthread_cond_wait(&queue.ready, &queue.lock);
+		}
+		if (!running && queue.count == 0) {
+			pthread_mutex_unlock(&queue.lock);
+			break;
+		}
+		fd = queue.fds[queue.head];
+		queue.head = (queue.head + 1) % MAX_CLIENTS;
+		queue.count--;
+		pthread_mutex_unlock(&queue.lock);
+
+		if (serve_client(fd, payload, &buffer) < 0 || write(wakeup[1], &fd, sizeof(fd)) != sizeof(fd)) {
+			close(fd);
+			__sync_fetch_and_sub(&connected, 1);
+		}
+	}
+	free(buffer.data);
+	free(payload);
+	return NULL;
+}
+
+static void enqueue(int fd) {
+	pthread_mutex_lock(&queue.lock);
+	queue.fds[(queue.head + queue.count) % MAX_CLIENTS] = fd;
+	queue.count++;
+	pthread_cond_signal(&queue.ready);
+	pthread_mutex_unlock(&queue.lock);
+}
+
+static void stop(int signal) {
+	running = 0;
+	if (listener >= 0) {
+		shutdown(listener, SHUT_RDWR);
+	}
+}
+
+int main(int argc, char* argv[]) {
+	int i = 0;
+	int fd = -1;
+	int opt = 0;
+	uint32_t threads = 0;
+	uint32_t interval = REFRESH_INTERVAL;
+	const char* path = NULL;
+	served_t* entry = NULL;
+	nfds_t count = 2;
+	pthread_t refresher;
+	pthread_t* workers = NULL;
+	dyldpool_t* pool = NULL;
+	struct sockaddr_un address;
+	struct timeval timeout = { REQUEST_TIMEOUT, 0 };
+	static struct pollfd polls[MAX_CLIENTS + 2];
+
+	while ((opt = getopt(argc, argv, "r:s:t:")) != -1) {
+		switch (opt) {
+		case 'r':
+			interval = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			path = optarg;
+			break;
+		case 't':
+			threads = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			info("Usage: %s [-r seconds] [-s socket] [-t threads] <dyldcache> [<dyldcache> ...]\n", argv[0]);
+			return -1;
+		}
+	}
+	if (optind >= argc) {
+		info("Usage: %s [-r seconds] [-s socket] [-t threads] <dyldcache> [<dyldcache> ...]\n", argv[0]);
+		return -1;
+	}
+	if (path == NULL) {
+		path = getenv(DYLDCACHED_SOCKET_ENV);
+	}
+	if (path == NULL) {
+		path = DYLDCACHED_SOCKET;
+	}
+	if (strlen(path) >= sizeof(address.sun_path)) {
+		error("Socket path is too long\n");
+		return -1;
+	}
+	if (threads == 0) {
+		threads = dyldpool_cpu_count();
+	}
+
+	pool = dyldpool_create(threads);
+	for (i = optind; i < argc && slot_count < MAX_CACHES; i++) {
+		entry = serve_cache(argv[i], pool);
+		if (entry != NULL) {
+			slots[slot_count].path = strdup(entry->path);
+			slots[slot_count].current = entry;
+			slots[slot_count].seen = entry->status;
+			pthread_mutex_init(&slots[slot_count].lock, NULL);
+			slot_count++;
+		}
+	}
+	dyldpool_free(pool);
+	if (slot_count == 0) {
+		error("No caches to serve\n");
+		return -1;
+	}
+
+	memset(&address, '\0', sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+	unlink(path);
+	listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0 || bind(listener, (struct sockaddr*) &address, sizeof(address)) < 0 ||
+			listen(listener, 128) < 0) {
+		error("Unable to listen on %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+
+	if (pipe(wakeup) < 0 || fcntl(wakeup[0], F_SETFL, O_NONBLOCK) < 0 ||
+			fcntl(listener, F_SETFL, O_NONBLOCK) < 0) {
+		error("Unable to set up client polling: %s\n", strerror(errno));
+		return -1;
+	}
+	pthread_mutex_init(&queue.lock, NULL);
+	pthread_cond_init(&queue.ready, NULL);
+	workers = (pthread_t*) calloc(threads, sizeof(pthread_t));
+	for (i = 0; workers && i < threads; i++) {
+		pthread_create(&workers[i], NULL, worker_main, NULL);
+	}
+	// Replaced caches are reindexed in the background while queries
+	//  keep being answered from the snapshot they replace
+	if (interval > 0) {
+		pthread_create(&refresher, NULL, refresh_main, &interval);
+	}
+
+	info("Listening on %s\n", path);
+	polls[0].fd = listener;
+	polls[0].events = POLLIN;
+	polls[1].fd = wakeup[0];
+	polls[1].events = POLLIN;
+	while (running) {
+		if (poll(polls, count, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+
+		// Connections with a request waiting leave the poll set
+		//  until a worker has answered it
+		for (i = count - 1; i >= 2; i--) {
+			if (polls[i].revents) {
+				enqueue(polls[i].fd);
+				polls[i] = polls[--count];
+			}
+		}
+		if (polls[1].revents & POLLIN) {
+			while (read(wakeup[0], &fd, sizeof(fd)) == sizeof(fd)) {
+				polls[count].fd = fd;
+				polls[count].events = POLLIN;
+				count++;
+			}
+		}
+		if (polls[0].revents) {
+			fd = accept(listener, NULL, NULL);
+			if (fd < 0) {
+				if (errno == EINTR || errno == EAGAIN || errno == ECONNABORTED) {
+					continue;
+				}
+				break;
+			}
+			if (connected == MAX_CLIENTS) {
+				close(fd);
+				continue;
+			}
+			// A client stalling halfway through a request only holds
+			//  its worker this long
+			setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+			__sync_fetch_and_add(&connected, 1);
+			polls[count].fd = fd;
+			polls[count].events = POLLIN;
+			count++;
+		}
+	}
+
+	// Workers may be in the middle of a request, so leave them and the
+	//  caches they reference to process exit
+	close(listener);
+	unlink(path);
+	info("Shutting down\n");
+	return 0;
+}
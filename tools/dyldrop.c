@@ -20,12 +20,25 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
 
 #include <libmacho-1.0/macho.h>
 #include <libcrippy-1.0/debug.h>
 #include <libcrippy-1.0/directory.h>
 #include <libcrippy-1.0/libcrippy.h>
 #include <libdyldcache-1.0/cache.h>
+#include <libdyldcache-1.0/bloom.h>
+#include <libdyldcache-1.0/deps.h>
+#include <libdyldcache-1.0/pool.h>
+#include <libdyldcache-1.0/client.h>
+#include <libdyldcache-1.0/xrefs.h>
+
+#define DYLDROP_BLOOM_ENV  "DYLDROP_BLOOM_DIR"
 
 enum {
 	MODE_NONE,
@@ -41,13 +54,38 @@ static void print_sym(const char* name, uint32_t addr, void* userdata)
 	printf("#define %s (void*)0x%08x\n", name, addr);
 }
 
-static void print_sym_struct_elem(const char* name, uint32_t address, void* userdata)
+
+static int query_daemon(const char* path, const char* dylib, const char* symbol)
 {
-	if (userdata) {
-		fprintf(userdata, "\t{ \"%s\", 0x%08x },\n", name, address);
+	uint32_t i = 0;
+	uint32_t count = 0;
+	dyldclient_t* client = NULL;
+	dyldclient_record_t* records = NULL;
+
+	client = dyldclient_connect(NULL);
+	if (client == NULL) {
+		return -1;
+	}
+	if (dyldclient_open(client, path) < 0) {
+		// Not one of the daemon's caches
+		dyldclient_free(client);
+		return -1;
+	}
+
+	if (dylib) {
+		dyldclient_image_symbol(client, dylib, symbol, &records, &count);
 	} else {
-		printf("\t{ \"%s\", 0x%08x },\n", name, address);
+		dyldclient_symbol(client, symbol, &records, &count);
+	}
+	for (i = 0; i < count; i++) {
+		if (!dylib || strcmp(dylib, records[i].image_name)) {
+			printf("// %s:\n", records[i].image_name);
+		}
+		print_sym(symbol, (uint32_t) records[i].address, NULL);
 	}
+	dyldclient_records_free(records, count);
+	dyldclient_free(client);
+	return 0;
 }
 
 static char* c_safe_name(const char* name)
@@ -69,18 +107,922 @@ static char* c_safe_name(const char* name)
 	return outname;
 }
 
+/*
+ * Parses an image's Mach-O in place, clamped to what libmacho takes the
+ *  same way the bloom filters are built.
+ */
+static macho_t* load_image(dyldcache_t* cache, dyldimage_t* image)
+{
+	uint64_t size = 0;
+	unsigned char* data = dyldcache_image_data(cache, image, &size);
+	if (data == NULL) {
+		return NULL;
+	}
+	return macho_load(data, size > 0xFFFFFFFFULL ? 0xFFFFFFFFU : (uint32_t)size);
+}
+
+/*
+ * Symbol search only parses the images whose bloom filter matches.
+ *  Filters saved next to the cache are used when they match it; others
+ *  are built on each run, and only saved when DYLDROP_BLOOM_DIR names a
+ *  directory to keep them in.
+ */
+static dyldcache_bloom_t* open_bloom(dyldcache_t* cache, const char* path)
+{
+	const char* name = NULL;
+	const char* directory = NULL;
+	char* bloompath = NULL;
+	dyldcache_bloom_t* bloom = NULL;
+
+	directory = getenv(DYLDROP_BLOOM_ENV);
+	if (directory && *directory) {
+		name = strrchr(path, '/');
+		name = name ? name + 1 : path;
+		bloompath = (char*)malloc(strlen(directory) + strlen(name) + strlen(DYLDBLOOM_SUFFIX) + 2);
+		if (bloompath) {
+			sprintf(bloompath, "%s/%s%s", directory, name, DYLDBLOOM_SUFFIX);
+		}
+	} else {
+		bloompath = (char*)malloc(strlen(path) + strlen(DYLDBLOOM_SUFFIX) + 1);
+		if (bloompath) {
+			sprintf(bloompath, "%s%s", path, DYLDBLOOM_SUFFIX);
+		}
+	}
+	if (bloompath == NULL) {
+		return NULL;
+	}
+	if (access(bloompath, F_OK) == 0) {
+		bloom = dyldcache_bloom_open(cache, bloompath);
+	}
+	if (bloom == NULL) {
+		bloom = dyldcache_bloom_load(cache, NULL);
+		if (bloom && directory && *directory) {
+			dyldcache_bloom_save(bloom, bloompath);
+		}
+	}
+	free(bloompath);
+	return bloom;
+}
+
+/*
+ * Output buffers
+ *
+ * Workers format into these rather than stdout, which is written in
+ *  image order once the work is done.
+ */
+typedef struct output_t {
+	char* data;
+	size_t size;
+	size_t capacity;
+} output_t;
+
+static char* output_reserve(output_t* buffer, size_t size)
+{
+	char* data = NULL;
+	size_t capacity = buffer->capacity ? buffer->capacity : 64 * 1024;
+	if (buffer->size + size > buffer->capacity) {
+		while (buffer->size + size > capacity) {
+			capacity *= 2;
+		}
+		data = (char*)realloc(buffer->data, capacity);
+		if (data == NULL) {
+			return NULL;
+		}
+		buffer->data = data;
+		buffer->capacity = capacity;
+	}
+	return buffer->data + buffer->size;
+}
+
+static void output_append(output_t* buffer, const char* text, size_t length)
+{
+	char* cursor = output_reserve(buffer, length);
+	if (cursor) {
+		memcpy(cursor, text, length);
+		buffer->size += length;
+	}
+}
+
+static void output_append_safe(output_t* buffer, const char* name)
+{
+	size_t i = 0;
+	size_t length = strlen(name);
+	char* cursor = output_reserve(buffer, length);
+	if (cursor == NULL) {
+		return;
+	}
+	for (i = 0; i < length; i++) {
+		switch (name[i]) {
+		case ' ':
+		case '.':
+		case '-':
+			cursor[i] = '_';
+			break;
+		default:
+			cursor[i] = name[i];
+			break;
+		}
+	}
+	buffer->size += length;
+}
+
+static void output_printf(output_t* buffer, const char* format, ...)
+{
+	int length = 0;
+	char* cursor = NULL;
+	va_list args;
+
+	va_start(args, format);
+	length = vsnprintf(NULL, 0, format, args);
+	va_end(args);
+	if (length < 0) {
+		return;
+	}
+	cursor = output_reserve(buffer, length + 1);
+	if (cursor == NULL) {
+		return;
+	}
+	va_start(args, format);
+	vsnprintf(cursor, length + 1, format, args);
+	va_end(args);
+	buffer->size += length;
+}
+
+static void output_sym(const char* name, uint32_t addr, void* userdata)
+{
+	output_printf((output_t*)userdata, "#define %s (void*)0x%08x\n", name, addr);
+}
+
+/*
+ * Header mode
+ *
+ * Every image's header is formatted into its worker's buffer, which is
+ *  kept between images, and written out with a single write().
+ */
+typedef struct header_ctx_t {
+	dyldcache_t* cache;
+	const char* outpath;
+	output_t* buffers;
+	volatile uint32_t failed;
+} header_ctx_t;
+
+static void header_sym(const char* name, uint32_t address, void* userdata)
+{
+	static const char hex[] = "0123456789abcdef";
+	output_t* buffer = (output_t*)userdata;
+	size_t length = strlen(name);
+	char* cursor = output_reserve(buffer, length + 24);
+	int i = 0;
+	if (cursor == NULL) {
+		return;
+	}
+	// "\t{ \"<name>\", 0x%08x },\n"
+	memcpy(cursor, "\t{ \"", 4);
+	memcpy(cursor + 4, name, length);
+	cursor += 4 + length;
+	memcpy(cursor, "\", 0x", 5);
+	cursor += 5;
+	for (i = 7; i >= 0; i--) {
+		cursor[7 - i] = hex[(address >> (i * 4)) & 0xF];
+	}
+	memcpy(cursor + 8, " },\n", 4);
+	buffer->size += length + 21;
+}
+
+static int header_write(const char* path, const char* data, size_t size)
+{
+	ssize_t done = 0;
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		return -1;
+	}
+	while (size > 0) {
+		done = write(fd, data, size);
+		if (done < 0 && errno == EINTR) {
+			continue;
+		}
+		if (done <= 0) {
+			close(fd);
+			return -1;
+		}
+		data += done;
+		size -= done;
+	}
+	return close(fd);
+}
+
+static void header_func(uint32_t index, uint32_t worker, void* userdata)
+{
+	header_ctx_t* ctx = (header_ctx_t*)userdata;
+	output_t* buffer = &ctx->buffers[worker];
+	dyldimage_t* image = ctx->cache->images[index];
+	macho_t* macho = NULL;
+	char* cf = NULL;
+	size_t length = 0;
+
+	macho = load_image(ctx->cache, image);
+	if (macho == NULL) {
+		debug("Unable to parse Mach-O file in cache\n");
+		return;
+	}
+
+	buffer->size = 0;
+	length = strlen(image->name);
+	output_append(buffer, "// ", strlen("// "));
+	output_append(buffer, image->name, length);
+	output_append(buffer, "\nstatic struct symaddr ", strlen("\nstatic struct symaddr "));
+	output_append_safe(buffer, image->name);
+	output_append(buffer, "_syms[] {\n", strlen("_syms[] {\n"));
+	macho_list_symbols(macho, header_sym, buffer);
+	output_append(buffer, "\t{ NULL, 0 }\n};\n", strlen("\t{ NULL, 0 }\n};\n"));
+	macho_free(macho);
+
+	// The path is built past the header text, in the same buffer
+	cf = output_reserve(buffer, strlen(ctx->outpath) + 1 + length + 2 + 1);
+	if (cf == NULL) {
+		__sync_fetch_and_add(&ctx->failed, 1);
+		return;
+	}
+	strcpy(cf, ctx->outpath);
+	strcat(cf, "/");
+	strcat(cf, image->name);
+	strcat(cf, ".h");
+	if (header_write(cf, buffer->data, buffer->size) < 0) {
+		error("Unable to write %s\n", cf);
+		__sync_fetch_and_add(&ctx->failed, 1);
+	}
+}
+
+static int header_mode(dyldcache_t* cache, const char* outpath)
+{
+	uint32_t i = 0;
+	dyldpool_t* pool = NULL;
+	header_ctx_t ctx;
+
+	memset(&ctx, '\0', sizeof(ctx));
+	ctx.cache = cache;
+	ctx.outpath = outpath;
+	pool = dyldpool_create(0);
+	if (pool == NULL) {
+		return -1;
+	}
+	ctx.buffers = (output_t*)calloc(pool->count, sizeof(output_t));
+	if (ctx.buffers == NULL) {
+		dyldpool_free(pool);
+		return -1;
+	}
+	dyldcache_hold(cache);
+	dyldpool_run(pool, cache->header->images_count, header_func, &ctx);
+	dyldcache_release(cache);
+	for (i = 0; i < pool->count; i++) {
+		free(ctx.buffers[i].data);
+	}
+	free(ctx.buffers);
+	dyldpool_free(pool);
+	return ctx.failed ? -1 : 0;
+}
+
+/*
+ * Image core
+ *
+ * Runs a mode's callback on the parsed Mach-O of every selected image
+ *  across a pool. Workers claim one image at a time, biggest first, so
+ *  the few huge frameworks can't leave a single worker finishing alone.
+ *  Each image formats into its own output, written to stdout in image
+ *  order as soon as all the images before it are done, so the result is
+ *  the same as a serial run.
+ */
+typedef void (*image_func_t)(dyldimage_t* image, macho_t* macho, output_t* output, void* userdata);
+
+typedef struct image_weight_t {
+	uint64_t weight;
+	uint32_t position;
+} image_weight_t;
+
+typedef struct image_core_t {
+	dyldcache_t* cache;
+	const uint32_t* images;
+	image_weight_t* order;
+	output_t* outputs;
+	uint8_t* done;
+	uint32_t count;
+	uint32_t flushed;
+	pthread_mutex_t lock;
+	image_func_t func;
+	void* userdata;
+} image_core_t;
+
+static int compare_address(const void* a, const void* b)
+{
+	uint64_t left = *(const uint64_t*)a;
+	uint64_t right = *(const uint64_t*)b;
+	return left < right ? -1 : left > right;
+}
+
+static int compare_weight(const void* a, const void* b)
+{
+	const image_weight_t* left = (const image_weight_t*)a;
+	const image_weight_t* right = (const image_weight_t*)b;
+	if (left->weight != right->weight) {
+		return left->weight > right->weight ? -1 : 1;
+	}
+	return left->position < right->position ? -1 : left->position > right->position;
+}
+
+/*
+ * An image's size is taken as the distance to the next image above it
+ *  in its mapping, which needs no parsing.
+ */
+static int image_core_order(image_core_t* core)
+{
+	uint32_t i = 0;
+	uint32_t low = 0;
+	uint32_t high = 0;
+	uint32_t middle = 0;
+	uint64_t end = 0;
+	uint64_t* addresses = NULL;
+	dyldimage_t* image = NULL;
+	dyldcache_t* cache = core->cache;
+
+	addresses = (uint64_t*)malloc((cache->count + 1) * sizeof(uint64_t));
+	if (addresses == NULL) {
+		return -1;
+	}
+	for (i = 0; i < cache->count; i++) {
+		addresses[i] = cache->images[i]->address;
+	}
+	qsort(addresses, cache->count, sizeof(uint64_t), compare_address);
+
+	for (i = 0; i < core->count; i++) {
+		image = cache->images[core->images[i]];
+		low = 0;
+		high = cache->count;
+		while (low < high) {
+			middle = low + (high - low) / 2;
+			if (addresses[middle] <= image->address) {
+				low = middle + 1;
+			} else {
+				high = middle;
+			}
+		}
+		end = image->map ? image->map->address + image->map->size : image->address;
+		if (low < cache->count && addresses[low] < end) {
+			end = addresses[low];
+		}
+		core->order[i].weight = end > image->address ? end - image->address : 0;
+		core->order[i].position = i;
+	}
+	free(addresses);
+	qsort(core->order, core->count, sizeof(image_weight_t), compare_weight);
+	return 0;
+}
+
+static void image_core_func(uint32_t index, uint32_t worker, void* userdata)
+{
+	image_core_t* core = (image_core_t*)userdata;
+	uint32_t position = core->order[index].position;
+	output_t* output = NULL;
+	dyldimage_t* image = core->cache->images[core->images[position]];
+	macho_t* macho = load_image(core->cache, image);
+
+	if (macho == NULL) {
+		debug("Unable to parse Mach-O file in cache\n");
+	} else {
+		core->func(image, macho, &core->outputs[position], core->userdata);
+		macho_free(macho);
+	}
+
+	// Whoever completes the next image in order writes out everything ready
+	pthread_mutex_lock(&core->lock);
+	core->done[position] = 1;
+	while (core->flushed < core->count && core->done[core->flushed]) {
+		output = &core->outputs[core->flushed];
+		if (output->size > 0) {
+			fwrite(output->data, 1, output->size, stdout);
+		}
+		free(output->data);
+		output->data = NULL;
+		core->flushed++;
+	}
+	fflush(stdout);
+	pthread_mutex_unlock(&core->lock);
+}
+
+static int image_core_run(dyldcache_t* cache, const uint32_t* images, uint32_t count, image_func_t func, void* userdata)
+{
+	uint32_t i = 0;
+	dyldpool_t* pool = NULL;
+	image_core_t core;
+
+	if (count == 0) {
+		return 0;
+	}
+	memset(&core, '\0', sizeof(core));
+	core.cache = cache;
+	core.images = images;
+	core.count = count;
+	core.func = func;
+	core.userdata = userdata;
+	core.order = (image_weight_t*)malloc(count * sizeof(image_weight_t));
+	core.outputs = (output_t*)calloc(count, sizeof(output_t));
+	core.done = (uint8_t*)calloc(count, sizeof(uint8_t));
+	if (core.order == NULL || core.outputs == NULL || core.done == NULL || image_core_order(&core) < 0) {
+		error("Unable to allocate memory for image core\n");
+		free(core.order);
+		free(core.outputs);
+		free(core.done);
+		return -1;
+	}
+	pthread_mutex_init(&core.lock, NULL);
+
+	if (count > 1) {
+		pool = dyldpool_create(0);
+	}
+	dyldcache_hold(cache);
+	dyldpool_run(pool, count, image_core_func, &core);
+	dyldcache_release(cache);
+	if (pool) {
+		dyldpool_free(pool);
+	}
+
+	for (i = 0; i < count; i++) {
+		free(core.outputs[i].data);
+	}
+	pthread_mutex_destroy(&core.lock);
+	free(core.order);
+	free(core.outputs);
+	free(core.done);
+	return 0;
+}
+
+/*
+ * Batch mode
+ *
+ * Reads "sym <name>", "img <dylib> <symbol>", "addr <hex>" and "xref <hex>"
+ *  lines from stdin. Whatever has arrived is answered as one batch, so every image
+ *  is parsed at most once per batch however many queries touch it.
+ */
+enum {
+	QUERY_SYM,
+	QUERY_IMG,
+	QUERY_ADDR,
+	QUERY_XREF
+};
+
+typedef struct query_t {
+	int kind;
+	int image;
+	int next;
+	int resolved;
+	char* name;
+	char* dylib;
+	uint64_t address;
+	uint32_t best;
+	const char* best_name;
+	char* nearest;
+} query_t;
+
+typedef struct batch_t {
+	dyldcache_t* cache;
+	dyldcache_deps_t* deps;
+	dyldcache_xrefs_t* xrefs;
+	query_t* queries;
+	uint32_t count;
+	uint32_t capacity;
+	int* first;
+	int has_sym;
+} batch_t;
+
+static int batch_find_image(batch_t* batch, const char* name)
+{
+	uint32_t i = 0;
+	for (i = 0; i < batch->cache->count; i++) {
+		if (!strcmp(batch->cache->images[i]->name, name)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static int batch_image_for_address(batch_t* batch, uint64_t address)
+{
+	dyldimage_t* image = dyldcache_image_containing(batch->cache, address);
+	return image ? (int) image->index : -1;
+}
+
+static void batch_nearest(const char* name, uint32_t address, void* userdata)
+{
+	query_t* query = (query_t*) userdata;
+	if (address <= query->address && (query->best_name == NULL || address > query->best)) {
+		query->best = address;
+		query->best_name = name;
+		// Names may not outlive the callback
+		free(query->nearest);
+		query->nearest = strdup(name);
+	}
+}
+
+static void batch_add(batch_t* batch, char* line)
+{
+	char* kind = strtok(line, " \t\r\n");
+	char* first = strtok(NULL, " \t\r\n");
+	char* second = strtok(NULL, " \t\r\n");
+	query_t* query = NULL;
+
+	if (kind == NULL || first == NULL) {
+		return;
+	}
+	if (batch->count == batch->capacity) {
+		batch->capacity = batch->capacity ? batch->capacity * 2 : 256;
+		batch->queries = (query_t*) realloc(batch->queries, batch->capacity * sizeof(query_t));
+	}
+	query = &batch->queries[batch->count];
+	memset(query, '\0', sizeof(query_t));
+	query->image = -1;
+	query->next = -1;
+
+	if (!strcmp(kind, "sym")) {
+		query->kind = QUERY_SYM;
+		query->name = strdup(first);
+		batch->has_sym = 1;
+	} else if (!strcmp(kind, "img") && second != NULL) {
+		query->kind = QUERY_IMG;
+		query->dylib = strdup(first);
+		query->name = strdup(second);
+		query->image = batch_find_image(batch, first);
+	} else if (!strcmp(kind, "addr")) {
+		query->kind = QUERY_ADDR;
+		query->name = strdup(first);
+		query->address = strtoull(first, NULL, 16);
+		query->image = batch_image_for_address(batch, query->address);
+	} else if (!strcmp(kind, "xref")) {
+		// Answered from the xref index, not by parsing images
+		query->kind = QUERY_XREF;
+		query->name = strdup(first);
+		query->address = strtoull(first, NULL, 16);
+	} else {
+		printf("%s\t%s\t?\n", kind, first);
+		return;
+	}
+	batch->count++;
+}
+
+/*
+ * Answers the queries bucketed on image, and with all every symbol
+ *  query. Symbol queries may be resolved by several images at once,
+ *  bucketed ones are only ever touched by their own image.
+ */
+static void batch_resolve(batch_t* batch, dyldimage_t* image, macho_t* macho, int all, output_t* output)
+{
+	int q = 0;
+	uint32_t j = 0;
+	uint32_t address = 0;
+	query_t* query = NULL;
+
+	if (all) {
+		for (j = 0; j < batch->count; j++) {
+			query = &batch->queries[j];
+			if (query->kind != QUERY_SYM) {
+				continue;
+			}
+			address = macho_lookup(macho, query->name);
+			if (address != 0) {
+				output_printf(output, "sym\t%s\t%s\t0x%08x\n", query->name, image->name, address);
+				__sync_fetch_and_or(&query->resolved, 1);
+			}
+		}
+	}
+
+	for (q = batch->first[image->index]; q >= 0; q = batch->queries[q].next) {
+		query = &batch->queries[q];
+		if (query->resolved) {
+			continue;
+		}
+		if (query->kind == QUERY_IMG) {
+			address = macho_lookup(macho, query->name);
+			if (address != 0) {
+				output_printf(output, "img\t%s\t%s\t0x%08x\t%s\n", query->dylib, query->name, address, image->name);
+				query->resolved = 1;
+			}
+		} else if (query->kind == QUERY_ADDR) {
+			macho_list_symbols(macho, batch_nearest, query);
+			if (query->nearest != NULL) {
+				output_printf(output, "addr\t%s\t%s\t%s+0x%llx\n", query->name, image->name, query->nearest,
+						(unsigned long long) (query->address - query->best));
+				query->resolved = 1;
+			}
+		}
+	}
+}
+
+static void batch_image_func(dyldimage_t* image, macho_t* macho, output_t* output, void* userdata)
+{
+	batch_t* batch = (batch_t*)userdata;
+	batch_resolve(batch, image, macho, batch->has_sym, output);
+}
+
+static void batch_resolve_image(batch_t* batch, uint32_t index)
+{
+	output_t output;
+	dyldimage_t* image = batch->cache->images[index];
+	macho_t* macho = load_image(batch->cache, image);
+	if (macho == NULL) {
+		return;
+	}
+	memset(&output, '\0', sizeof(output));
+	batch_resolve(batch, image, macho, 0, &output);
+	fwrite(output.data, 1, output.size, stdout);
+	free(output.data);
+	macho_free(macho);
+}
+
+static void batch_xrefs(batch_t* batch, query_t* query)
+{
+	int image = 0;
+	uint64_t i = 0;
+	uint64_t count = 0;
+	uint64_t from = 0;
+	uint32_t* refs = NULL;
+	uint8_t* kinds = NULL;
+	const char* kind = NULL;
+
+	if (batch->xrefs == NULL) {
+		batch->xrefs = dyldcache_xrefs_load(batch->cache, NULL, DYLDXREF_ALL);
+	}
+	refs = dyldcache_xrefs_get(batch->xrefs, query->address, &kinds, &count);
+	for (i = 0; i < count; i++) {
+		switch (kinds[i]) {
+		case DYLDXREF_CALL: kind = "call"; break;
+		case DYLDXREF_JUMP: kind = "jump"; break;
+		case DYLDXREF_ADDR: kind = "addr"; break;
+		default: kind = "load"; break;
+		}
+		from = dyldcache_xrefs_address(batch->xrefs, refs[i]);
+		image = batch_image_for_address(batch, from);
+		printf("xref\t%s\t0x%llx\t%s\t%s\n", query->name, (unsigned long long) from, kind,
+				image >= 0 ? batch->cache->images[image]->name : "?");
+	}
+	query->resolved = count > 0;
+}
+
+static void batch_run(batch_t* batch)
+{
+	uint32_t i = 0;
+	uint32_t j = 0;
+	uint32_t count = 0;
+	uint32_t* reexports = NULL;
+	uint32_t* images = NULL;
+	query_t* query = NULL;
+
+	// Bucket the image bound queries by image
+	for (i = 0; i < batch->cache->count; i++) {
+		batch->first[i] = -1;
+	}
+	for (i = batch->count; i-- > 0;) {
+		query = &batch->queries[i];
+		if (query->image >= 0) {
+			query->next = batch->first[query->image];
+			batch->first[query->image] = i;
+		}
+	}
+
+	images = (uint32_t*) malloc((batch->cache->count + 1) * sizeof(uint32_t));
+	if (images) {
+		for (i = 0; i < batch->cache->count; i++) {
+			if (batch->has_sym || batch->first[i] >= 0) {
+				images[count++] = i;
+			}
+		}
+		image_core_run(batch->cache, images, count, batch_image_func, batch);
+		free(images);
+		count = 0;
+	}
+
+	for (j = 0; j < batch->count; j++) {
+		if (batch->queries[j].kind == QUERY_XREF) {
+			batch_xrefs(batch, &batch->queries[j]);
+		}
+	}
+	fflush(stdout);
+
+	// Unresolved image queries may sit behind umbrella re-exports
+	for (j = 0; j < batch->count; j++) {
+		query = &batch->queries[j];
+		if (query->kind != QUERY_IMG || query->resolved || query->image < 0) {
+			continue;
+		}
+		if (batch->deps == NULL) {
+			batch->deps = dyldcache_deps_load(batch->cache, NULL);
+		}
+		reexports = dyldcache_deps_closure(batch->deps, query->image, DYLDDEP_REEXPORT, &count);
+		for (i = 0; i < count && !query->resolved; i++) {
+			batch->first[reexports[i]] = j;
+			query->next = -1;
+			batch_resolve_image(batch, reexports[i]);
+			batch->first[reexports[i]] = -1;
+		}
+		free(reexports);
+	}
+
+	for (j = 0; j < batch->count; j++) {
+		query = &batch->queries[j];
+		if (!query->resolved) {
+			if (query->kind == QUERY_SYM) {
+				printf("sym\t%s\t?\n", query->name);
+			} else if (query->kind == QUERY_IMG) {
+				printf("img\t%s\t%s\t?\n", query->dylib, query->name);
+			} else if (query->kind == QUERY_XREF) {
+				printf("xref\t%s\t?\n", query->name);
+			} else {
+				printf("addr\t%s\t?\n", query->name);
+			}
+		}
+		free(query->name);
+		free(query->dylib);
+		free(query->nearest);
+	}
+	fflush(stdout);
+	batch->count = 0;
+	batch->has_sym = 0;
+}
+
+static int batch_mode(const char* path)
+{
+	int more = 0;
+	size_t used = 0;
+	size_t start = 0;
+	size_t capacity = 64 * 1024;
+	ssize_t done = 0;
+	char* buffer = NULL;
+	char* newline = NULL;
+	batch_t batch;
+	struct pollfd input;
+
+	memset(&batch, '\0', sizeof(batch));
+	batch.cache = dyldcache_open(path);
+	if (batch.cache == NULL) {
+		error("Unable to open dyldcache %s\n", path);
+		return -1;
+	}
+	batch.first = (int*) malloc(batch.cache->count * sizeof(int));
+	buffer = (char*) malloc(capacity + 1);
+	if (batch.first == NULL || buffer == NULL) {
+		error("Unable to allocate memory for batch queries\n");
+		dyldcache_free(batch.cache);
+		return -1;
+	}
+	used = 0;
+	input.fd = STDIN_FILENO;
+	input.events = POLLIN;
+	while (1) {
+		done = read(STDIN_FILENO, buffer + used, capacity - used);
+		if (done < 0 && errno == EINTR) {
+			continue;
+		}
+		if (done > 0) {
+			used += done;
+			buffer[used] = '\0';
+			start = 0;
+			while ((newline = strchr(buffer + start, '\n')) != NULL) {
+				*newline = '\0';
+				batch_add(&batch, buffer + start);
+				start = newline - buffer + 1;
+			}
+			memmove(buffer, buffer + start, used - start);
+			used -= start;
+			if (used == capacity) {
+				// Overlong line, drop it
+				used = 0;
+			}
+		}
+
+		// Answer once the writer has nothing more queued for us
+		more = done > 0 && poll(&input, 1, 0) > 0;
+		if (!more && batch.count > 0) {
+			batch_run(&batch);
+		}
+		if (done <= 0) {
+			break;
+		}
+	}
+	if (used > 0) {
+		buffer[used] = '\0';
+		batch_add(&batch, buffer);
+		batch_run(&batch);
+	}
+
+	free(buffer);
+	free(batch.queries);
+	free(batch.first);
+	if (batch.deps) {
+		dyldcache_deps_free(batch.deps);
+	}
+	if (batch.xrefs) {
+		dyldcache_xrefs_free(batch.xrefs);
+	}
+	dyldcache_free(batch.cache);
+	return 0;
+}
+
+/*
+ * Single lookup, listing and symbol database modes, run on the image core
+ */
+typedef struct drop_ctx_t {
+	int mode;
+	const char* dylib;
+	const char* symbol;
+	char** symbols;
+	int symbol_count;
+	volatile uint32_t parsed;
+	volatile uint32_t hits;
+} drop_ctx_t;
+
+static void drop_symdb(dyldimage_t* image, macho_t* macho, output_t* output, drop_ctx_t* ctx)
+{
+	int j = 0;
+	int symno = 0;
+	uint32_t address = 0;
+	char* cn = NULL;
+	char* csn = NULL;
+	char** symnames = (char**)malloc(sizeof(char*) * ctx->symbol_count);
+	uint32_t* symaddrs = (uint32_t*)malloc(sizeof(uint32_t) * ctx->symbol_count);
+	if (symnames == NULL || symaddrs == NULL) {
+		free(symnames);
+		free(symaddrs);
+		return;
+	}
+	for (j = 0; j < ctx->symbol_count; j++) {
+		address = macho_lookup(macho, ctx->symbols[j]);
+		if (address != 0) {
+			symnames[symno] = ctx->symbols[j];
+			symaddrs[symno] = address;
+			symno++;
+		}
+	}
+	if (symno > 0) {
+		cn = c_safe_name(image->name);
+		output_printf(output, "// %s\n", image->name);
+		output_printf(output, "struct %s_syms {\n", cn);
+		for (j = 0; j < symno; j++) {
+			csn = c_safe_name(symnames[j]);
+			output_printf(output, "\tvoid* %s;\n", csn);
+			free(csn);
+		}
+		output_printf(output, "};\n");
+		output_printf(output, "struct %s_syms %s = {\n", cn, cn);
+		for (j = 0; j < symno; j++) {
+			output_printf(output, "\t(void*)0x%x", symaddrs[j]);
+			output_printf(output, j == symno - 1 ? "\n" : ",\n");
+		}
+		output_printf(output, "};\n");
+		output_printf(output, "\n");
+		free(cn);
+	}
+	free(symnames);
+	free(symaddrs);
+}
+
+static void drop_func(dyldimage_t* image, macho_t* macho, output_t* output, void* userdata)
+{
+	drop_ctx_t* ctx = (drop_ctx_t*)userdata;
+	uint32_t address = 0;
+
+	__sync_fetch_and_add(&ctx->parsed, 1);
+	if (ctx->symbol) {
+		address = macho_lookup(macho, ctx->symbol);
+		if (address != 0) {
+			if (!ctx->dylib) {
+				output_printf(output, "// %s:\n", image->name);
+			}
+			output_sym(ctx->symbol, address, output);
+			__sync_fetch_and_add(&ctx->hits, 1);
+		}
+	} else if (ctx->mode == MODE_SYMDB) {
+		drop_symdb(image, macho, output, ctx);
+	} else {
+		output_printf(output, "// %s:\n", image->name);
+		macho_list_symbols(macho, output_sym, output);
+	}
+}
+
 int main(int argc, char* argv[]) {
 	int i = 0;
 	int ret = 0;
 	int lastidx = 0;
+	int found = -1;
 	char* path = NULL;
 	char* dylib = NULL;
 	char* symbol = NULL;
 	char* outpath = NULL;
+	uint32_t selected = 0;
 	uint32_t address = 0xFFFFFFFF;
+	uint32_t* images = NULL;
 	macho_t* macho = NULL;
 	dyldimage_t* image = NULL;
 	dyldcache_t* cache = NULL;
+	dyldcache_deps_t* deps = NULL;
+	dyldcache_bloom_t* bloom = NULL;
+	drop_ctx_t ctx;
 
 	if ((argc < 4) && (argc != 3)) {
 		char *name = strrchr(argv[0], '/');
@@ -90,11 +1032,20 @@ int main(int argc, char* argv[]) {
 		     "       %s <dyldcache> -s <symbol>\n"
 		     "       %s <dyldcache> -h PATH\n"
 		     "       %s <dyldcache> -S <symbol1> [<symbol2> ...]\n"
+		     "       %s <dyldcache> -b < queries\n"
 		     "       %s <mach-o> -l\n"
-		     "       %s <mach-o> <symbol>\n", name, name, name, name, name, name, name);
+		     "       %s <mach-o> <symbol>\n"
+		     "\n"
+		     "Set %s to answer symbol queries through dyldcached,\n"
+		     "and %s to a directory to keep -s bloom filters in\n",
+		     name, name, name, name, name, name, name, name, DYLDCACHED_SOCKET_ENV, DYLDROP_BLOOM_ENV);
 		return 0;
 	}
 
+	if (argc == 3 && !strcmp(argv[2], "-b")) {
+		return batch_mode(argv[1]);
+	}
+
 	if (argc >= 4) {
 	int mode = MODE_NONE;
 	path = strdup(argv[1]);
@@ -121,6 +1072,14 @@ int main(int argc, char* argv[]) {
 		mode = MODE_DYLIB_SYM;
 	}
 
+	if ((mode == MODE_DYLIB_SYM || mode == MODE_SYM_SEARCH) && getenv(DYLDCACHED_SOCKET_ENV)) {
+		// Let a running dyldcached answer instead of opening the cache
+		if (query_daemon(path, dylib, symbol) == 0) {
+			address = 0;
+			goto finish;
+		}
+	}
+
 	debug("Creating dyldcache from %s\n", path);
 	cache = dyldcache_open(path);
 	if (cache == NULL) {
@@ -130,93 +1089,70 @@ int main(int argc, char* argv[]) {
 
 	if (outpath) {
 		mkdir_with_parents(outpath, 0755);
+		ret = header_mode(cache, outpath);
+		address = 0;
+		goto finish;
+	}
+
+	if (mode == MODE_SYM_SEARCH) {
+		bloom = open_bloom(cache, path);
 	}
 
+	images = (uint32_t*)malloc((cache->count + 1) * sizeof(uint32_t));
+	if (images == NULL) {
+		error("Unable to allocate memory for image list\n");
+		goto panic;
+	}
 	for (i = 0; i < cache->header->images_count; i++) {
 		image = cache->images[i];
-		//debug("Found %s\n", image->name);
+		if (bloom && !dyldcache_bloom_test(bloom, i, symbol)) {
+			continue;
+		}
 		if ((dylib == NULL) || (strcmp(dylib, image->name) == 0)) {
-			macho = macho_load(image->data, image->size);
-			if (macho == NULL) {
-				debug("Unable to parse Mach-O file in cache\n");
-				continue;
-			}
-			//macho_debug(macho);
+			found = i;
+			images[selected++] = i;
+		}
+	}
+
+	memset(&ctx, '\0', sizeof(ctx));
+	ctx.mode = mode;
+	ctx.dylib = dylib;
+	ctx.symbol = symbol;
+	ctx.symbols = &argv[3];
+	ctx.symbol_count = argc - 3;
+	image_core_run(cache, images, selected, drop_func, &ctx);
+	// Every filter rejecting the symbol is a search that found nothing
+	if (ctx.parsed > 0 || (bloom && selected == 0)) {
+		address = 0;
+	}
+	free(images);
+	images = NULL;
 
-			if (symbol) {
+	if (mode == MODE_DYLIB_SYM && found >= 0 && address == 0 && ctx.hits == 0) {
+		// Umbrella frameworks (UIKit and friends) re-export most of their
+		//  symbols from sub-libraries, so walk the re-export graph
+		deps = dyldcache_deps_load(cache, NULL);
+		if (deps) {
+			uint32_t j = 0;
+			uint32_t count = 0;
+			uint32_t* reexports = dyldcache_deps_closure(deps, found, DYLDDEP_REEXPORT, &count);
+			for (j = 0; j < count && address == 0; j++) {
+				image = cache->images[reexports[j]];
+				macho = load_image(cache, image);
+				if (macho == NULL) {
+					continue;
+				}
 				address = macho_lookup(macho, symbol);
 				if (address != 0) {
-					if (!dylib) {
-						printf("// %s:\n", image->name);
-					}
-					print_sym(symbol, address, NULL);
-				}
-			} else if (!symbol && (mode == MODE_SYMDB)) {
-				int j;
-				int symno = 0;
-				char** symnames = (char**)malloc(sizeof(char*) * argc-3);
-				uint32_t* symaddrs = (uint32_t*)malloc(sizeof(uint32_t) * argc-3);
-				for (j = 3; j < argc; j++) {
-					address = macho_lookup(macho, argv[j]);
-					if (address != 0) {
-						symnames[symno] = argv[j];
-						symaddrs[symno] = address;
-						symno++;
-					}
-				}
-				if (symno > 0) {
-					char *cn = c_safe_name(image->name);
-					printf("// %s\n", image->name);
-					printf("struct %s_syms {\n", cn);
-					for (j = 0; j < symno; j++) {
-						char* csn = c_safe_name(symnames[j]);
-						printf("\tvoid* %s;\n", csn);
-						free(csn);
-					}
-					printf("};\n");
-					printf("struct %s_syms %s = {\n", cn, cn);
-					for (j = 0; j < symno; j++) {
-						printf("\t(void*)0x%x", symaddrs[j]);
-						if (j == symno-1) {
-							printf("\n");
-						} else {
-							printf(",\n");
-						}
-					}
-					printf("};\n");
-					printf("\n");	
-					free(cn);
-				}
-				free(symnames);
-				free(symaddrs);
-			} else {
-				if (dylib) {
 					printf("// %s:\n", image->name);
-					macho_list_symbols(macho, print_sym, NULL);
-				} else {
-					char *cn = c_safe_name(image->name);
-					char *cf = (char*)malloc(strlen(outpath)+1+strlen(image->name)+2+1);
-					strcpy(cf, outpath);
-					strcat(cf, "/");
-					strcat(cf, image->name);
-					strcat(cf, ".h");
-
-					FILE* f = fopen(cf, "wb");
-					if (f) {
-						fprintf(f, "// %s\n", image->name);
-						fprintf(f, "static struct symaddr %s_syms[] {\n", cn);
-						macho_list_symbols(macho, print_sym_struct_elem, f);
-						fprintf(f, "\t{ NULL, 0 }\n");
-						fprintf(f, "};\n");
-						fclose(f);
-					}
-					free(cf);
-					free(cn);
+					print_sym(symbol, address, NULL);
 				}
+				macho_free(macho);
+				macho = NULL;
 			}
-
-			macho_free(macho);
-			macho = NULL;
+			free(reexports);
+			dyldcache_deps_free(deps);
+			deps = NULL;
 		}
 	}
 
@@ -253,6 +1189,8 @@ int main(int argc, char* argv[]) {
 	error("ERROR: %d\n", ret == 0 ? -1 : ret);
 
 	finish: debug("Cleaning up\n");
+	if (bloom)
+		dyldcache_bloom_free(bloom);
 	if (cache)
 		dyldcache_free(cache);
 	if (macho)
@@ -265,5 +1203,7 @@ int main(int argc, char* argv[]) {
 		free(dylib);
 	if (outpath)
 		free(outpath);
+	if (images)
+		free(images);
 	return ret;
 }
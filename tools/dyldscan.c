@@ -0,0 +1,185 @@
+/**
+  * libdyldcache-1.0 - dyldscan.c
+  * Copyright (C) 2013 Crippy-Dev Team
+  * Copyright (C) 2010-2013 Joshua Hill
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+
+#include <libcrippy-1.0/debug.h>
+#include <libcrippy-1.0/libcrippy.h>
+
+#include <libdyldcache-1.0/libdyldcache.h>
+
+static void usage(const char* name) {
+	info("Usage: %s [-t threads] [-a] [-i dylib]... [-f patterns] <dyldcache> [pattern...]\n", name);
+	info("  -t  number of scanning threads\n");
+	info("  -a  scan every mapping, not only executable ones\n");
+	info("  -i  only scan the segments of this dylib, may be repeated\n");
+	info("  -f  read patterns from a file, one \"name: E0 03 ?? AA\" per line\n");
+	info("  patterns are given as \"name=E0 03 ?? AA\" or just \"E0 03 ?? AA\"\n");
+}
+
+/*
+ * Adds "name=bytes" (or "name: bytes" from a file) or bare bytes
+ */
+static int add_pattern(dyldcache_scan_t* scan, char* text, char separator) {
+	char* name = NULL;
+	char* split = strchr(text, separator);
+	if (split) {
+		*split = '\0';
+		name = text;
+		text = split + 1;
+		while (split > name && isspace((unsigned char) split[-1])) {
+			*--split = '\0';
+		}
+	}
+	return dyldcache_scan_add(scan, name, text);
+}
+
+static int add_file(dyldcache_scan_t* scan, const char* path) {
+	char* cursor = NULL;
+	char line[4096];
+	FILE* fd = fopen(path, "r");
+	if (fd == NULL) {
+		error("Unable to open pattern file %s\n", path);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), fd)) {
+		line[strcspn(line, "#\r\n")] = '\0';
+		for (cursor = line; isspace((unsigned char) *cursor); cursor++);
+		if (*cursor && add_pattern(scan, cursor, ':') < 0) {
+			fclose(fd);
+			return -1;
+		}
+	}
+	fclose(fd);
+	return 0;
+}
+
+int main(int argc, char* argv[]) {
+	int i = 0;
+	int err = 0;
+	int opt = 0;
+	int all = 0;
+	uint64_t j = 0;
+	uint32_t threads = 0;
+	uint32_t dylib_count = 0;
+	char** dylibs = NULL;
+	const char* file = NULL;
+	dyldimage_t* image = NULL;
+	dyldimage_t** images = NULL;
+	dyldpool_t* pool = NULL;
+	dyldcache_t* cache = NULL;
+	dyldcache_scan_t* scan = NULL;
+	dyldcache_hit_t* hit = NULL;
+
+	dylibs = (char**) calloc(argc + 1, sizeof(char*));
+	if (dylibs == NULL) {
+		return -1;
+	}
+	while ((opt = getopt(argc, argv, "t:ai:f:")) != -1) {
+		switch (opt) {
+		case 't':
+			threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'a':
+			all = 1;
+			break;
+		case 'i':
+			dylibs[dylib_count++] = optarg;
+			break;
+		case 'f':
+			file = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			free(dylibs);
+			return -1;
+		}
+	}
+	if (optind >= argc) {
+		usage(argv[0]);
+		free(dylibs);
+		return -1;
+	}
+
+	scan = dyldcache_scan_create();
+	if (scan == NULL || (file && add_file(scan, file) < 0)) {
+		dyldcache_scan_free(scan);
+		free(dylibs);
+		return -1;
+	}
+	for (i = optind + 1; i < argc; i++) {
+		if (add_pattern(scan, argv[i], '=') < 0) {
+			dyldcache_scan_free(scan);
+			free(dylibs);
+			return -1;
+		}
+	}
+	if (scan->count == 0) {
+		error("No patterns to scan for\n");
+		dyldcache_scan_free(scan);
+		free(dylibs);
+		return -1;
+	}
+
+	cache = dyldcache_open(argv[optind]);
+	if (cache == NULL) {
+		error("Unable to open dyldcache %s\n", argv[optind]);
+		dyldcache_scan_free(scan);
+		free(dylibs);
+		return -1;
+	}
+
+	pool = dyldpool_create(threads);
+	if (dylib_count > 0) {
+		images = (dyldimage_t**) calloc(dylib_count, sizeof(dyldimage_t*));
+		for (i = 0; images && i < (int) dylib_count; i++) {
+			images[i] = image = dyldcache_get_image(cache, dylibs[i]);
+			if (image == NULL) {
+				error("Unable to find %s in dyldcache\n", dylibs[i]);
+				err = -1;
+				break;
+			}
+		}
+		if (images && err == 0) {
+			err = dyldcache_scan_images(scan, cache, pool, images, dylib_count);
+		}
+		free(images);
+	} else {
+		err = dyldcache_scan_mappings(scan, cache, pool, all ? 0 : DYLDMAP_EXEC);
+	}
+
+	if (err == 0) {
+		for (j = 0; j < scan->hit_count; j++) {
+			hit = &scan->hits[j];
+			printf("0x%llx\t%s\t%s\n", (unsigned long long) hit->address,
+					hit->image >= 0 ? cache->images[hit->image]->path : "-",
+					scan->patterns[hit->pattern]->name);
+		}
+	}
+
+	dyldpool_free(pool);
+	dyldcache_scan_free(scan);
+	dyldcache_free(cache);
+	free(dylibs);
+	return err;
+}